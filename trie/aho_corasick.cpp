@@ -0,0 +1,145 @@
+/** @file aho_corasick.cpp
+  * @brief 基于双数组的AC自动机
+  *
+  * Aho-Corasick: https://en.wikipedia.org/wiki/Aho%E2%80%93Corasick_algorithm
+  *
+  * @author teng.qing
+  * @date 2021/7/5
+  */
+
+#include "aho_corasick.h"
+#include "trie_arena.h"
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+void AhoCorasick::clear() {
+    dat_ = nullptr;
+    nodes_.clear();
+    nodes_.shrink_to_fit();
+    node_data_ = nullptr;
+    max_depth_ = 0;
+}
+
+void AhoCorasick::attach(const DoubleArray &dat, const Node *nodes, int max_depth) {
+    clear();
+    dat_ = &dat;
+    node_data_ = nodes;
+    max_depth_ = max_depth;
+}
+
+void AhoCorasick::build(const TrieArena &trie, const DoubleArray &dat) {
+    clear();
+    dat_ = &dat;
+    nodes_.assign(dat.size(), Node{DoubleArray::kRoot, -1, 0});
+
+    // 广度优先，保证处理子节点时父节点和fail指向的节点都已经处理完
+    std::queue<std::pair<uint32_t, int>> nodes;
+    nodes.emplace(TrieArena::kRoot, DoubleArray::kRoot);
+
+    while (!nodes.empty()) {
+        const TrieArena::Node &node = trie.node(nodes.front().first);
+        int state = nodes.front().second;
+        nodes.pop();
+
+        for (uint32_t i = node.firstChild; i < node.firstChild + node.childCount; ++i) {
+            uint16_t code = dat.code(trie.node(i).code);
+            if (code == Alphabet::kOther) {
+                continue;
+            }
+            int child = dat.transition(state, code);
+
+            int fail = DoubleArray::kRoot;
+            if (state != DoubleArray::kRoot) {
+                int f = nodes_[state].fail;
+                while (f != DoubleArray::kRoot && dat.transition(f, code) < 0) {
+                    f = nodes_[f].fail;
+                }
+                int t = dat.transition(f, code);
+                fail = t >= 0 ? t : DoubleArray::kRoot;
+            }
+
+            Node &n = nodes_[child];
+            n.fail = fail;
+            n.depth = nodes_[state].depth + 1;
+            n.output = dat.isTerminal(child) ? child : nodes_[fail].output;
+            max_depth_ = std::max(max_depth_, static_cast<int>(n.depth));
+
+            nodes.emplace(i, child);
+        }
+    }
+    node_data_ = nodes_.data();
+}
+
+const size_t AhoCorasick::Scanner::kInlineCapacity;
+
+AhoCorasick::Scanner::Scanner(const AhoCorasick &ac, bool per_start) : ac_(ac), per_start_(per_start) {
+    // 待定结果最多跨越maxDepth个字符，再加上计算起点时需要的前一个字符
+    size_t capacity = 1;
+    while (capacity < static_cast<size_t>(ac.maxDepth()) + 2) {
+        capacity <<= 1;
+    }
+    if (capacity <= kInlineCapacity) {
+        ring_ = inline_;
+    } else {
+        heap_.resize(capacity);
+        ring_ = heap_.data();
+    }
+    mask_ = capacity - 1;
+}
+
+void AhoCorasick::Scanner::reset() {
+    state_ = DoubleArray::kRoot;
+    total_ = 0;
+    cursor_ = 0;
+    start_ = 0;
+    window_ = 0;
+    resume_index_ = 0;
+    resume_offset_ = 0;
+    pending_start_ = -1;
+    pending_end_ = -1;
+    pending_word_ = -1;
+}
+
+void AhoCorasick::Scanner::commit() {
+    int64_t start_index = resume_index_;
+    size_t start_offset = resume_offset_;
+    if (pending_start_ > window_) {
+        start_index = at(pending_start_ - 1).index + 1;
+        start_offset = at(pending_start_ - 1).end;
+    }
+    const Entry &end = at(pending_end_);
+    auto len = static_cast<int>(end.index - start_index + 1);
+    last_ = MatchSpan{start_offset, end.end - start_offset, start_index, len, pending_word_};
+
+    // 从敏感词之后重新开始，已经读过的字符还在环形缓冲区里，由run()重新处理
+    resume_index_ = end.index + 1;
+    resume_offset_ = end.end;
+    window_ = pending_end_ + 1;
+    cursor_ = window_;
+    state_ = DoubleArray::kRoot;
+    pending_start_ = -1;
+    pending_end_ = -1;
+    pending_word_ = -1;
+}
+
+void AhoCorasick::Scanner::failStart() {
+    // 和scanSpans一样，首字符之后的内容重新开始计算前面的停顿词
+    const Entry &entry = at(start_);
+    resume_index_ = entry.index + 1;
+    resume_offset_ = entry.end;
+    cursor_ = ++start_;
+    state_ = DoubleArray::kRoot;
+}
+
+void AhoCorasick::Scanner::grow() {
+    std::vector<Entry> ring((mask_ + 1) * 2);
+    size_t mask = ring.size() - 1;
+    for (int64_t seq = start_; seq < total_; ++seq) {
+        ring[static_cast<size_t>(seq) & mask] = at(seq);
+    }
+    heap_.swap(ring);
+    ring_ = heap_.data();
+    mask_ = mask;
+}
@@ -0,0 +1,344 @@
+/** @file aho_corasick.h
+  * @brief 基于双数组的AC自动机，一次遍历文本找出所有敏感词
+  * @author teng.qing
+  * @date 2021/7/5
+  */
+
+#ifndef INC_01_TRIE_TREE_AHO_CORASICK_H_
+#define INC_01_TRIE_TREE_AHO_CORASICK_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "double_array.h"
+
+class TrieArena;
+
+/** @struct MatchSpan
+  * @brief 敏感词命中位置
+  *
+  * offset/length的单位是输入的编码单元（宽字符串为wchar_t，utf8为字节），startIndex/len的单位是字符。
+  * 流式匹配（MatchStream）时为整个流中的位置，可能超过int的范围，所以startIndex是64位。
+  */
+struct MatchSpan {
+    size_t offset;
+    size_t length;
+    int64_t startIndex;
+    int len;
+    int wordId; // 命中的敏感词编号，见DoubleArray::wordId
+};
+
+/** @class AhoCorasick
+  * @brief 在双数组的状态上增加失败指针（fail）、输出指针（output）和深度（depth）
+  *
+  * getSensitiveLength需要从每个位置重新开始匹配，复杂度为 O(文本长度 * 最长敏感词长度)，
+  * AC自动机匹配失败时沿fail跳转，不需要回退文本，复杂度为 O(文本长度)。
+  */
+class AhoCorasick {
+public:
+    class Scanner;
+
+    struct Node {
+        int32_t fail;
+        int32_t output;
+        int32_t depth;
+    };
+
+    AhoCorasick() = default;
+
+    AhoCorasick(const AhoCorasick &that) = delete;
+
+    AhoCorasick &operator=(const AhoCorasick &that) = delete;
+
+    /** @fn build
+      * @brief 从敏感词树和已经编译好的双数组构建失败指针
+      * @param [in]trie: 敏感词树
+      * @param [in]dat: 由trie编译出的双数组
+      * @return void
+      */
+    void build(const TrieArena &trie, const DoubleArray &dat);
+
+    /** @fn attach
+      * @brief 直接使用外部内存中的节点数组，不拷贝，会清空之前的内容
+      * @param [in]dat: 对应的双数组
+      * @param [in]nodes: 节点数组，和dat等长
+      * @param [in]max_depth: 最长敏感词的长度
+      * @return void
+      */
+    void attach(const DoubleArray &dat, const Node *nodes, int max_depth);
+
+    /** @fn clear
+      * @brief 清空
+      * @return void
+      */
+    void clear();
+
+    /** @fn next
+      * @brief 带失败跳转的状态转移，找不到时最终回到根节点
+      * @param [in]state: 当前状态
+      * @param [in]code: 字符编号，见DoubleArray::code
+      * @return 新状态
+      */
+    int next(int state, uint16_t code) const {
+        for (;;) {
+            int t = dat_->transition(state, code);
+            if (t >= 0) {
+                return t;
+            }
+            if (state == DoubleArray::kRoot) {
+                return DoubleArray::kRoot;
+            }
+            state = node_data_[state].fail;
+        }
+    }
+
+    // 状态对应的路径长度
+    int depth(int state) const { return node_data_[state].depth; }
+
+    // 以该状态结尾的最长敏感词（自身或fail链上最近的结尾状态），没有返回-1
+    int output(int state) const { return node_data_[state].output; }
+
+    // 最长敏感词的长度
+    int maxDepth() const { return max_depth_; }
+
+    const DoubleArray &dat() const { return *dat_; }
+
+    const Node *nodes() const { return node_data_; }
+
+    // 节点数组占用的内存，单位字节
+    size_t memoryUsage() const { return dat_ != nullptr ? dat_->size() * sizeof(Node) : 0; }
+
+private:
+    const DoubleArray *dat_ = nullptr;
+    std::vector<Node> nodes_;          // build时使用，attach后为空
+    const Node *node_data_ = nullptr;  // 指向nodes_或者外部内存
+    int max_depth_ = 0;
+};
+
+/** @class AhoCorasick::Scanner
+  * @brief 逐字符推进的扫描器，结果和Trie::getSensitive逐位置匹配完全一致：
+  *
+  * 1. 起点越靠左越优先，同一起点取最短的敏感词，命中后从敏感词之后继续
+  * 2. 当前状态没有该字符的转移，且该字符是停顿词时跳过，计入敏感词长度
+  * 3. 敏感词前面紧挨着的停顿词也计入敏感词（和getSensitiveLength从停顿词位置开始匹配的效果一样）
+  *
+  * AC自动机是按结尾位置发现敏感词的，一个敏感词找到时，可能还有更靠左的起点没有匹配完，
+  * 所以先记为待定，等到当前状态的深度表明不可能再有更靠左的起点时才输出。
+  * 输出后，已经读过的、位于敏感词之后的字符从环形缓冲区重放，缓冲区长度只和最长敏感词有关，
+  * 最长敏感词不超过kInlineCapacity - 2个字符时不会申请堆内存。
+  *
+  * 停顿词同时出现在敏感词里时（如敏感词"@"和停顿词"@"），是否跳过这个字符要看每个起点各自匹配到的状态，
+  * 不能只看当前（最长）状态。这时用per_start构造：不走fail指针，按getSensitiveLength的方式从每个起点匹配，
+  * 读入的字符留在缓冲区中，起点失败后从下一个起点重新匹配。缓冲区长度为最长敏感词加上其中跳过的停顿词，
+  * 超过kInlineCapacity时在堆上扩容。
+  */
+class AhoCorasick::Scanner {
+public:
+    /** @fn Scanner
+      * @param [in]ac: AC自动机
+      * @param [in]per_start: 是否逐起点匹配，停顿词同时出现在敏感词里时使用，见FrozenTrie::stopWordsInWords
+      */
+    explicit Scanner(const AhoCorasick &ac, bool per_start = false);
+
+    Scanner(const Scanner &that) = delete;
+
+    Scanner &operator=(const Scanner &that) = delete;
+
+    /** @fn push
+      * @brief 推进一个字符
+      * @param [in]code: 字符编号，见DoubleArray::code
+      * @param [in]stop: 是否是停顿词
+      * @param [in]index: 字符序号
+      * @param [in]offset: 字符在原文中的偏移
+      * @param [in]end: 字符结束的偏移
+      * @param [in]emit: 命中回调 emit(const MatchSpan &)
+      * @return void
+      */
+    template<typename Emit>
+    void push(uint16_t code, bool stop, int64_t index, size_t offset, size_t end, Emit &&emit) {
+        if (per_start_) {
+            // 不在任何敏感词中的停顿词不会是起点，每个起点匹配时也都会跳过，不需要保存
+            if (stop && code == Alphabet::kOther) {
+                return;
+            }
+            if (total_ - start_ > static_cast<int64_t>(mask_)) {
+                grow();
+            }
+            at(total_++) = Entry{code, stop, index, offset, end};
+            runPerStart(emit);
+            return;
+        }
+        if (stop && ac_.dat().transition(state_, code) < 0) {
+            return;
+        }
+        at(total_++) = Entry{code, stop, index, offset, end};
+        run(emit);
+    }
+
+    /** @fn finish
+      * @brief 文本结束，输出剩余的待定结果
+      * @param [in]emit: 命中回调
+      * @return void
+      */
+    template<typename Emit>
+    void finish(Emit &&emit) {
+        if (per_start_) {
+            // 文本结束时还在匹配中的起点都失败了，从下一个起点重新匹配
+            while (start_ < total_) {
+                failStart();
+                runPerStart(emit);
+            }
+            return;
+        }
+        while (pending_start_ >= 0) {
+            commit();
+            emit(last_);
+            run(emit);
+        }
+    }
+
+    /** @fn idle
+      * @brief 是否处于根状态且没有待定结果，此时跳过一些字符不会影响之后的结果
+      * @return bool
+      */
+    bool idle() const { return state_ == DoubleArray::kRoot && pending_start_ < 0; }
+
+    /** @fn barrier
+      * @brief 在idle状态下跳过了一些字符（不是停顿词），之后的敏感词不能从这些字符之前开始
+      * @param [in]index: 跳过的字符之后的字符序号
+      * @param [in]offset: 跳过的字符之后的偏移
+      * @return void
+      */
+    void barrier(int64_t index, size_t offset) {
+        resume_index_ = index;
+        resume_offset_ = offset;
+        window_ = total_;
+    }
+
+    /** @fn reset
+      * @brief 回到初始状态，可以开始扫描新的文本
+      * @return void
+      */
+    void reset();
+
+    /** @fn state
+      * @brief 当前自动机状态
+      * @return 状态
+      */
+    int state() const { return state_; }
+
+    // 环形缓冲区在堆上占用的内存，单位字节
+    size_t memoryUsage() const { return heap_.capacity() * sizeof(Entry); }
+
+private:
+    static const size_t kInlineCapacity = 64;
+
+    struct Entry {
+        uint16_t code;
+        bool stop;
+        int64_t index;
+        size_t offset;
+        size_t end;
+    };
+
+    Entry &at(int64_t seq) { return ring_[static_cast<size_t>(seq) & mask_]; }
+
+    // 处理所有已读入但还没有处理的字符
+    template<typename Emit>
+    void run(Emit &emit) {
+        while (cursor_ < total_) {
+            if (step(cursor_++)) {
+                emit(last_);
+            }
+        }
+    }
+
+    // 处理一个字符，有结果输出时返回true，结果在last_里
+    bool step(int64_t k) {
+        state_ = ac_.next(state_, at(k).code);
+
+        int out = ac_.output(state_);
+        if (out >= 0) {
+            int64_t start = k - ac_.depth(out) + 1;
+            if (pending_start_ < 0 || start < pending_start_) {
+                pending_start_ = start;
+                pending_end_ = k;
+                pending_word_ = ac_.dat().wordId(out);
+            }
+        }
+        // 当前仍在匹配中的最靠左的起点都不早于待定结果，说明它就是最终结果
+        if (pending_start_ >= 0 && k - ac_.depth(state_) + 1 >= pending_start_) {
+            commit();
+            return true;
+        }
+        return false;
+    }
+
+    // 输出待定结果到last_，并回退到敏感词之后重新开始
+    void commit();
+
+    // 逐起点匹配：从start_开始按getSensitiveLength的方式处理已读入的字符，命中后从敏感词之后继续
+    template<typename Emit>
+    void runPerStart(Emit &emit) {
+        const DoubleArray &dat = ac_.dat();
+        while (cursor_ < total_) {
+            const Entry &entry = at(cursor_);
+            int next = dat.transition(state_, entry.code);
+            if (next < 0) {
+                if (cursor_ == start_) {
+                    // 不是首字符：停顿词计入后面的敏感词，其他字符之前的内容不会再属于敏感词
+                    if (!entry.stop) {
+                        resume_index_ = entry.index + 1;
+                        resume_offset_ = entry.end;
+                    }
+                    start_ = ++cursor_;
+                } else if (entry.stop) {
+                    ++cursor_;
+                } else {
+                    failStart();
+                }
+                continue;
+            }
+            if (dat.isTerminal(next)) {
+                last_ = MatchSpan{resume_offset_, entry.end - resume_offset_, resume_index_,
+                                  static_cast<int>(entry.index - resume_index_ + 1), dat.wordId(next)};
+                resume_index_ = entry.index + 1;
+                resume_offset_ = entry.end;
+                start_ = ++cursor_;
+                state_ = DoubleArray::kRoot;
+                emit(last_);
+                continue;
+            }
+            state_ = next;
+            ++cursor_;
+        }
+    }
+
+    // 逐起点匹配：当前起点没有命中，从下一个字符重新开始
+    void failStart();
+
+    // 逐起点匹配：缓冲区满时容量翻倍
+    void grow();
+
+private:
+    const AhoCorasick &ac_;
+    bool per_start_;
+    Entry inline_[kInlineCapacity];
+    std::vector<Entry> heap_;
+    Entry *ring_;
+    size_t mask_;
+
+    int state_ = DoubleArray::kRoot;
+    int64_t total_ = 0;        // 读入的字符数（不含跳过的停顿词）
+    int64_t cursor_ = 0;       // 下一个要处理的字符
+    int64_t start_ = 0;        // 逐起点匹配时当前的起点，之前的字符已经不需要保存
+    int64_t window_ = 0;       // 上一个敏感词之后的第一个字符
+    int64_t resume_index_ = 0; // 上一个敏感词结尾之后的位置
+    size_t resume_offset_ = 0;
+    int64_t pending_start_ = -1;
+    int64_t pending_end_ = -1;
+    int pending_word_ = -1;
+    MatchSpan last_{};
+};
+
+#endif //INC_01_TRIE_TREE_AHO_CORASICK_H_
@@ -0,0 +1,85 @@
+/** @file alphabet.cpp
+  * @brief 字符表
+  * @author teng.qing
+  * @date 2021/7/26
+  */
+
+#include "alphabet.h"
+#include "trie_arena.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+const uint16_t Alphabet::kOther;
+const size_t Alphabet::kMaxSymbols;
+const size_t Alphabet::kBmpSize;
+
+bool Alphabet::build(const TrieArena &trie, const std::vector<uint64_t> *weights) {
+    // 统计每个字符作为边出现的次数，即除根节点外每个节点的字符；有访问统计时同时累加访问次数
+    typedef std::pair<uint64_t, size_t> Count; // 访问次数，出现次数
+    std::vector<Count> bmp_counts(kBmpSize, Count(0, 0));
+    std::unordered_map<uint32_t, Count> astral_counts;
+    for (uint32_t i = TrieArena::kRoot + 1; i < trie.size(); ++i) {
+        uint32_t c = trie.node(i).code;
+        Count &count = c < kBmpSize ? bmp_counts[c] : astral_counts[c];
+        count.first += weights != nullptr ? (*weights)[i] : 0;
+        count.second++;
+    }
+
+    // 访问次数多、出现次数多的字符编号小，根节点和浅层节点的子节点更集中，双数组更紧凑
+    std::vector<std::pair<uint32_t, Count>> symbols(astral_counts.begin(), astral_counts.end());
+    for (uint32_t c = 0; c < kBmpSize; ++c) {
+        if (bmp_counts[c].second > 0) {
+            symbols.emplace_back(c, bmp_counts[c]);
+        }
+    }
+    std::sort(symbols.begin(), symbols.end(), [](const std::pair<uint32_t, Count> &a,
+                                                 const std::pair<uint32_t, Count> &b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    bool ok = symbols.size() <= kMaxSymbols;
+    if (!ok) {
+        symbols.resize(kMaxSymbols);
+    }
+
+    bmp_.assign(kBmpSize, kOther);
+    astral_.clear();
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        auto id = static_cast<uint16_t>(i + 1);
+        if (symbols[i].first < kBmpSize) {
+            bmp_[symbols[i].first] = id;
+        } else {
+            astral_.push_back(Astral{symbols[i].first, id});
+        }
+    }
+    std::sort(astral_.begin(), astral_.end(), [](const Astral &a, const Astral &b) { return a.code < b.code; });
+    astral_.shrink_to_fit();
+
+    bmp_data_ = bmp_.data();
+    astral_data_ = astral_.data();
+    astral_count_ = astral_.size();
+    size_ = symbols.size() + 1;
+    return ok;
+}
+
+void Alphabet::attach(const uint16_t *bmp, const Astral *astral, size_t astral_count, size_t size) {
+    bmp_.clear();
+    bmp_.shrink_to_fit();
+    astral_.clear();
+    astral_.shrink_to_fit();
+    bmp_data_ = bmp;
+    astral_data_ = astral;
+    astral_count_ = astral_count;
+    size_ = size;
+}
+
+uint16_t Alphabet::astralId(uint32_t c) const {
+    const Astral *end = astral_data_ + astral_count_;
+    const Astral *it = std::lower_bound(astral_data_, end, c,
+                                        [](const Astral &a, uint32_t code) { return a.code < code; });
+    if (it != end && it->code == c) {
+        return static_cast<uint16_t>(it->id);
+    }
+    return kOther;
+}
@@ -0,0 +1,106 @@
+/** @file alphabet.h
+  * @brief 字符表：把敏感词中出现过的unicode映射为连续的小编号，双数组按编号转移
+  * @author teng.qing
+  * @date 2021/7/26
+  */
+
+#ifndef INC_01_TRIE_TREE_ALPHABET_H_
+#define INC_01_TRIE_TREE_ALPHABET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TrieArena;
+
+/** @class Alphabet
+  * @brief 字符表
+  *
+  * 敏感词里只出现了几千个不同的字符，但unicode的范围是0~0x10FFFF，直接用unicode做转移时，
+  * 双数组的子节点会分散在很大的范围里，数组又大又稀疏；截断为16位又会让emoji等BMP之外的字符和普通字符冲突。
+  * 字符表只给敏感词中出现过的字符分配编号（1 ~ size()-1，出现次数越多编号越小），
+  * 其他所有字符都是kOther，kOther在双数组中没有任何转移。
+  *
+  * BMP内的字符直接查表，BMP之外的字符在有序数组中二分查找。
+  */
+class Alphabet {
+public:
+    // 不在字符表中的字符
+    static const uint16_t kOther = 0;
+
+    // 最多可以编号的字符数（不含kOther）
+    static const size_t kMaxSymbols = 65535;
+
+    // BMP之外的字符和编号
+    struct Astral {
+        uint32_t code;
+        uint32_t id;
+    };
+
+    Alphabet() = default;
+
+    Alphabet(const Alphabet &that) = delete;
+
+    Alphabet &operator=(const Alphabet &that) = delete;
+
+    /** @fn build
+      * @brief 统计树中所有的字符并编号，会清空之前的内容
+      * @param [in]trie: 敏感词树
+      * @param [in]weights: 可选，每个节点的访问次数（见LayoutProfile），给出时先按字符被访问的次数编号，
+      * 热的字符编号小，热的子节点在子节点块的开头
+      * @return 超过kMaxSymbols个不同字符时返回false，多出的字符（排在最后的）视为kOther
+      */
+    bool build(const TrieArena &trie, const std::vector<uint64_t> *weights = nullptr);
+
+    /** @fn attach
+      * @brief 直接使用外部内存中的表，不拷贝，会清空之前的内容
+      * @param [in]bmp: BMP字符的编号表，65536项
+      * @param [in]astral: BMP之外的字符，按code排序
+      * @param [in]astral_count: astral的长度
+      * @param [in]size: 编号数（含kOther）
+      * @return void
+      */
+    void attach(const uint16_t *bmp, const Astral *astral, size_t astral_count, size_t size);
+
+    /** @fn id
+      * @brief 字符的编号
+      * @param [in]c: 经过charConvert的unicode
+      * @return 编号，不在字符表中返回kOther
+      */
+    uint16_t id(uint32_t c) const {
+        if (c < kBmpSize) {
+            return bmp_data_[c];
+        }
+        return astralId(c);
+    }
+
+    // 编号数（含kOther）
+    size_t size() const { return size_; }
+
+    const uint16_t *bmp() const { return bmp_data_; }
+
+    const Astral *astral() const { return astral_data_; }
+
+    size_t astralCount() const { return astral_count_; }
+
+    // 占用的内存，单位字节
+    size_t memoryUsage() const { return kBmpSize * sizeof(uint16_t) + astral_count_ * sizeof(Astral); }
+
+    static const size_t kBmpSize = 65536;
+
+private:
+    uint16_t astralId(uint32_t c) const;
+
+private:
+    // build时使用，attach后为空
+    std::vector<uint16_t> bmp_;
+    std::vector<Astral> astral_;
+
+    // 查询时使用，指向bmp_/astral_或者外部内存
+    const uint16_t *bmp_data_ = nullptr;
+    const Astral *astral_data_ = nullptr;
+    size_t astral_count_ = 0;
+    size_t size_ = 0;
+};
+
+#endif //INC_01_TRIE_TREE_ALPHABET_H_
@@ -0,0 +1,140 @@
+/** @file corpus_gen.cpp
+  * @brief 基准测试用的合成词库和语料
+  * @author teng.qing
+  * @date 2021/7/24
+  */
+
+#include "corpus_gen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <unordered_set>
+
+wchar_t CorpusGenerator::commonCjk() {
+    if (common_.empty()) {
+        std::unordered_set<wchar_t> used;
+        while (used.size() < 3500) {
+            used.insert(cjk());
+        }
+        common_.assign(used.begin(), used.end());
+    }
+    return common_[uniform(common_.size())];
+}
+
+std::wstring CorpusGenerator::asciiWord(size_t min_len, size_t max_len) {
+    std::wstring word;
+    size_t len = min_len + uniform(max_len - min_len + 1);
+    for (size_t i = 0; i < len; ++i) {
+        word.push_back(static_cast<wchar_t>(L'a' + uniform(26)));
+    }
+    return word;
+}
+
+std::vector<std::wstring> CorpusGenerator::words(size_t count) {
+    std::unordered_set<std::wstring> used;
+    std::vector<std::wstring> result;
+    result.reserve(count);
+    while (result.size() < count) {
+        std::wstring word;
+        if (chance(0.7)) {
+            size_t len = 2 + uniform(4);
+            for (size_t i = 0; i < len; ++i) {
+                word.push_back(commonCjk());
+            }
+        } else {
+            word = asciiWord(3, 8);
+        }
+        if (used.insert(word).second) {
+            result.push_back(std::move(word));
+        }
+    }
+    return result;
+}
+
+std::vector<std::wstring> CorpusGenerator::messages(const std::vector<std::wstring> &dict,
+                                                    const std::vector<wchar_t> &stop_words,
+                                                    const CorpusOptions &options) {
+    std::vector<std::wstring> result;
+    result.reserve(options.messages);
+    std::vector<double> word_cdf;
+    if (options.wordZipf > 0) {
+        word_cdf = zipfCdf(dict.size(), options.wordZipf);
+    }
+    for (size_t m = 0; m < options.messages; ++m) {
+        size_t len = options.minLen + uniform(options.maxLen - options.minLen + 1);
+        std::wstring msg;
+        while (msg.size() < len) {
+            if (!dict.empty() && chance(options.hitDensity)) {
+                // 敏感词，字符之间可能夹杂停顿词，字母可能是大写
+                const std::wstring &word = dict[word_cdf.empty() ? uniform(dict.size()) : sample(word_cdf)];
+                for (size_t i = 0; i < word.size(); ++i) {
+                    if (i > 0 && !stop_words.empty() && chance(options.stopNoise)) {
+                        msg.push_back(stop_words[uniform(stop_words.size())]);
+                    }
+                    wchar_t c = word[i];
+                    msg.push_back(c >= L'a' && c <= L'z' && chance(0.2) ? c - L'a' + L'A' : c);
+                }
+                continue;
+            }
+
+            size_t kind = uniform(100);
+            if (kind < 55) {
+                // 中文
+                for (size_t i = 1 + uniform(8); i > 0; --i) {
+                    msg.push_back(chance(0.8) ? commonCjk() : cjk());
+                }
+            } else if (kind < 80) {
+                // 英文单词和数字
+                msg += chance(0.8) ? asciiWord(1, 8) : std::to_wstring(uniform(100000));
+                msg.push_back(L' ');
+            } else if (kind < 90) {
+                // 全角字母
+                for (size_t i = 1 + uniform(4); i > 0; --i) {
+                    msg.push_back(static_cast<wchar_t>(0xFF41 + uniform(26)));
+                }
+            } else if (kind < 95) {
+                // emoji，BMP之外
+                msg.push_back(static_cast<wchar_t>(0x1F600 + uniform(0x50)));
+            } else if (!stop_words.empty()) {
+                msg.push_back(stop_words[uniform(stop_words.size())]);
+            }
+        }
+        result.push_back(std::move(msg));
+    }
+    return result;
+}
+
+std::vector<double> CorpusGenerator::zipfCdf(size_t distinct, double exponent) {
+    std::vector<double> cdf(distinct);
+    double sum = 0;
+    for (size_t k = 0; k < distinct; ++k) {
+        sum += 1.0 / std::pow(static_cast<double>(k + 1), exponent);
+        cdf[k] = sum;
+    }
+    return cdf;
+}
+
+size_t CorpusGenerator::sample(const std::vector<double> &cdf) {
+    double x = std::uniform_real_distribution<double>(0, cdf.back())(rng_);
+    auto rank = static_cast<size_t>(std::upper_bound(cdf.begin(), cdf.end(), x) - cdf.begin());
+    return std::min(rank, cdf.size() - 1);
+}
+
+std::vector<size_t> CorpusGenerator::zipf(size_t count, size_t distinct, double exponent) {
+    std::vector<size_t> result;
+    if (distinct == 0) {
+        return result;
+    }
+    // 随机打乱排名和下标的对应关系
+    std::vector<double> cdf = zipfCdf(distinct, exponent);
+    std::vector<size_t> ids(distinct);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::shuffle(ids.begin(), ids.end(), rng_);
+
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        result.push_back(ids[sample(cdf)]);
+    }
+    return result;
+}
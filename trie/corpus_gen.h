@@ -0,0 +1,82 @@
+/** @file corpus_gen.h
+  * @brief 基准测试用的合成词库和语料，固定随机种子，结果可以复现
+  * @author teng.qing
+  * @date 2021/7/24
+  */
+
+#ifndef INC_01_TRIE_TREE_CORPUS_GEN_H_
+#define INC_01_TRIE_TREE_CORPUS_GEN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/** @struct CorpusOptions
+  * @brief 语料参数
+  */
+struct CorpusOptions {
+    size_t messages = 20000;   // 消息数
+    size_t minLen = 20;        // 每条消息的最少字符数
+    size_t maxLen = 200;       // 每条消息的最多字符数
+    double hitDensity = 0.05;  // 每个片段是敏感词的概率
+    double stopNoise = 0.1;    // 插入的敏感词中，每两个字符之间插入停顿词的概率
+    double wordZipf = 0;       // 大于0时第k个敏感词被选中的概率正比于1/k^wordZipf（少数敏感词很常见），0为均匀
+};
+
+/** @class CorpusGenerator
+  * @brief 生成中文、ASCII、emoji、全角字符混合的消息，按比例插入敏感词和停顿词干扰
+  */
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(uint64_t seed = 20210724) : rng_(seed) {}
+
+    /** @fn words
+      * @brief 生成不重复的敏感词，约70%是2~5个汉字，其余是3~8个字母，汉字取自约3500个常用字，前缀有较多重叠
+      * @param [in]count: 个数
+      * @return 敏感词列表
+      */
+    std::vector<std::wstring> words(size_t count);
+
+    /** @fn messages
+      * @brief 生成消息
+      * @param [in]dict: 敏感词，从中随机选取插入到消息里
+      * @param [in]stop_words: 停顿词
+      * @param [in]options: 参数
+      * @return 消息列表
+      */
+    std::vector<std::wstring> messages(const std::vector<std::wstring> &dict, const std::vector<wchar_t> &stop_words,
+                                       const CorpusOptions &options);
+
+    /** @fn zipf
+      * @brief 生成服从Zipf分布的下标，模拟刷屏：少数消息反复出现，大多数消息只出现一两次
+      * @param [in]count: 个数
+      * @param [in]distinct: 下标的范围[0, distinct)，如messages生成的消息数
+      * @param [in]exponent: 指数，第k热门的下标出现的概率正比于1/k^exponent，0为均匀分布，越大越集中
+      * @return 下标列表，热门程度和下标大小无关
+      */
+    std::vector<size_t> zipf(size_t count, size_t distinct, double exponent);
+
+private:
+    size_t uniform(size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng_); }
+
+    bool chance(double p) { return std::uniform_real_distribution<double>(0, 1)(rng_) < p; }
+
+    wchar_t cjk() { return static_cast<wchar_t>(0x4E00 + uniform(0x9FA5 - 0x4E00 + 1)); }
+
+    wchar_t commonCjk();
+
+    // Zipf分布的累积概率，第k项为前k+1个排名的概率之和（未归一化）
+    static std::vector<double> zipfCdf(size_t distinct, double exponent);
+
+    size_t sample(const std::vector<double> &cdf);
+
+    std::wstring asciiWord(size_t min_len, size_t max_len);
+
+private:
+    std::mt19937_64 rng_;
+    std::vector<wchar_t> common_; // 常用字
+};
+
+#endif //INC_01_TRIE_TREE_CORPUS_GEN_H_
@@ -0,0 +1,279 @@
+/** @file dict_file.cpp
+  * @brief 编译好的二进制词库文件
+  * @author teng.qing
+  * @date 2021/7/22
+  */
+
+#include "dict_file.h"
+#include "fold_table.h"
+#include "frozen_trie.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const size_t DictFile::kStopWordsWords;
+
+namespace {
+
+const uint64_t kFnvOffset = 14695981039346656037ull;
+const uint64_t kFnvPrime = 1099511628211ull;
+
+// FNV-1a，按8字节为单位计算，比逐字节快，几十MB的词库也只需要几毫秒
+uint64_t checksum(const char *data, size_t size, uint64_t hash = kFnvOffset) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * kFnvPrime;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * kFnvPrime;
+    }
+    return hash;
+}
+
+uint64_t align8(uint64_t offset) { return (offset + 7) & ~uint64_t(7); }
+
+void setError(std::string *error, const std::string &msg) {
+    if (error != nullptr) {
+        *error = msg;
+    }
+}
+
+// 段在文件范围内并且按8字节对齐，count * elem不会溢出
+bool sectionOk(uint64_t offset, uint64_t count, size_t elem, size_t size) {
+    return offset % 8 == 0 && offset >= sizeof(DictHeader) && offset <= size && count <= (size - offset) / elem;
+}
+
+/** @fn structureError
+  * @brief 检查双数组、AC自动机和字符表的取值范围。不计算校验和时文件内容不可信，
+  * 这里保证匹配时的下标都不越界、check和fail链都会回到根节点
+  * @param [in]dict: 已经检查过段表的词库
+  * @return 错误原因，没有错误返回空
+  */
+std::string structureError(const DictFile &dict) {
+    const DictHeader &h = dict.header();
+    const DoubleArray::Unit *units = dict.units();
+    const int32_t *word_ids = dict.wordIds();
+    const AhoCorasick::Node *nodes = dict.nodes();
+    auto size = static_cast<int64_t>(h.size);
+    auto used = [&](int64_t t) { return t == DoubleArray::kRoot || units[t].check >= 0; };
+
+    const AhoCorasick::Node &root = nodes[DoubleArray::kRoot];
+    if (units[DoubleArray::kRoot].check != DoubleArray::kRoot || root.depth != 0 || root.fail != DoubleArray::kRoot) {
+        return "bad root state";
+    }
+    for (int64_t t = 0; t < size; ++t) {
+        const DoubleArray::Unit &unit = units[t];
+        const AhoCorasick::Node &node = nodes[t];
+        if (!used(t)) {
+            continue;
+        }
+        if (unit.base < 0) {
+            return "bad base at state " + std::to_string(t);
+        }
+        // 深度沿check严格加1，check链一定回到根节点；编号在字符表范围内，可以从状态还原出字符
+        if (t != DoubleArray::kRoot) {
+            int64_t parent = unit.check;
+            int64_t code = parent < size ? t - (units[parent].base >> 1) : -1;
+            if (parent >= size || !used(parent) || units[parent].base < 0 || code < 1 ||
+                static_cast<uint64_t>(code) >= h.alphabetSize || node.depth != nodes[parent].depth + 1) {
+                return "bad check at state " + std::to_string(t);
+            }
+        }
+        if (node.depth < 0 || static_cast<uint64_t>(node.depth) > h.maxDepth) {
+            return "bad depth at state " + std::to_string(t);
+        }
+        // fail指向更浅的状态，next()沿fail跳转一定会结束
+        if (t != DoubleArray::kRoot &&
+            (node.fail < 0 || node.fail >= size || !used(node.fail) || nodes[node.fail].depth >= node.depth)) {
+            return "bad fail at state " + std::to_string(t);
+        }
+        if (node.output != -1 && (node.output < 0 || node.output >= size || !used(node.output) ||
+                                  (units[node.output].base & 1) == 0 || nodes[node.output].depth > node.depth)) {
+            return "bad output at state " + std::to_string(t);
+        }
+        int32_t word_id = word_ids[t];
+        bool terminal = (unit.base & 1) != 0;
+        if (terminal ? (word_id < 0 || static_cast<uint32_t>(word_id) >= h.wordCount) : word_id != -1) {
+            return "bad word id at state " + std::to_string(t);
+        }
+    }
+
+    const uint16_t *bmp = dict.bmp();
+    for (uint32_t c = 0; c < Alphabet::kBmpSize; ++c) {
+        if (bmp[c] >= h.alphabetSize) {
+            return "bad alphabet";
+        }
+    }
+    const Alphabet::Astral *astral = dict.astral();
+    for (uint64_t i = 0; i < h.astralCount; ++i) {
+        if (astral[i].id >= h.alphabetSize || (i > 0 && astral[i - 1].code >= astral[i].code)) {
+            return "bad alphabet";
+        }
+    }
+    return std::string();
+}
+
+} // namespace
+
+DictFile::DictFile(const void *data, size_t size)
+        : data_(data), size_(size), header_(static_cast<const DictHeader *>(data)) {}
+
+DictFile::~DictFile() {
+    munmap(const_cast<void *>(data_), size_);
+}
+
+uint64_t DictFile::foldHash(const FoldTable &fold) {
+    // 编译和加载时的转换规则必须一致
+    uint64_t hash = checksum(reinterpret_cast<const char *>(fold.bmp()), FoldTable::kBmpSize * sizeof(uint16_t));
+    for (auto &item : fold.astral()) {
+        uint32_t pair[2] = {item.first, item.second};
+        hash = checksum(reinterpret_cast<const char *>(pair), sizeof(pair), hash);
+    }
+    return hash;
+}
+
+std::shared_ptr<const DictFile> DictFile::open(const std::string &file_name, bool verify, std::string *error,
+                                               const FoldTable *fold) {
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        setError(error, "open " + file_name + " failed: " + strerror(errno));
+        return nullptr;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(DictHeader)) {
+        close(fd);
+        setError(error, file_name + ": file too small");
+        return nullptr;
+    }
+    auto size = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        setError(error, "mmap " + file_name + " failed: " + strerror(errno));
+        return nullptr;
+    }
+    // 构造完成后由DictFile负责munmap
+    std::shared_ptr<const DictFile> dict(new DictFile(data, size));
+
+    const DictHeader &h = dict->header();
+    if (memcmp(h.magic, kDictMagic, sizeof(kDictMagic)) != 0) {
+        setError(error, file_name + ": not a dictionary file");
+        return nullptr;
+    }
+    if (h.byteOrder != kDictByteOrder) {
+        setError(error, file_name + ": byte order mismatch");
+        return nullptr;
+    }
+    if (h.version != kDictVersion) {
+        setError(error, file_name + ": unsupported version " + std::to_string(h.version));
+        return nullptr;
+    }
+    if (h.fileSize != size) {
+        setError(error, file_name + ": truncated file");
+        return nullptr;
+    }
+    // 每一段都必须在文件范围内，并且按8字节对齐（mmap的地址按页对齐）
+    if (h.size == 0 || h.size > INT32_MAX || h.stateCount > h.size || h.maxDepth > h.size ||
+        !sectionOk(h.unitsOffset, h.size, sizeof(DoubleArray::Unit), size) ||
+        !sectionOk(h.wordIdsOffset, h.size, sizeof(int32_t), size) ||
+        !sectionOk(h.nodesOffset, h.size, sizeof(AhoCorasick::Node), size) ||
+        !sectionOk(h.stopWordsOffset, kStopWordsWords, sizeof(uint64_t), size) ||
+        !sectionOk(h.astralStopOffset, h.astralStopCount, sizeof(uint32_t), size) ||
+        !sectionOk(h.bmpOffset, Alphabet::kBmpSize, sizeof(uint16_t), size) ||
+        !sectionOk(h.astralOffset, h.astralCount, sizeof(Alphabet::Astral), size) ||
+        !sectionOk(h.tagsOffset, h.wordCount, sizeof(WordTag), size) ||
+        h.alphabetSize == 0 || h.alphabetSize > Alphabet::kMaxSymbols + 1) {
+        setError(error, file_name + ": bad section table");
+        return nullptr;
+    }
+    if (h.foldHash != foldHash(fold != nullptr ? *fold : *FoldTable::defaultTable())) {
+        setError(error, file_name + ": compiled with different character conversion rules, please recompile");
+        return nullptr;
+    }
+    if (verify && checksum(static_cast<const char *>(data) + sizeof(DictHeader), size - sizeof(DictHeader)) !=
+                  h.checksum) {
+        setError(error, file_name + ": checksum mismatch");
+        return nullptr;
+    }
+    // 校验和只能发现损坏，跳过时也要保证加载后的匹配不会越界
+    std::string structure = structureError(*dict);
+    if (!structure.empty()) {
+        setError(error, file_name + ": " + structure);
+        return nullptr;
+    }
+    return dict;
+}
+
+bool DictFile::save(const FrozenTrie &frozen, uint32_t word_count, const std::string &file_name,
+                    std::string *error) {
+    const DoubleArray &dat = frozen.dat();
+    const AhoCorasick &ac = frozen.ac();
+    if (frozen.wordCount() < word_count) {
+        setError(error, "word count mismatch");
+        return false;
+    }
+
+    DictHeader h{};
+    memcpy(h.magic, kDictMagic, sizeof(kDictMagic));
+    h.version = kDictVersion;
+    h.byteOrder = kDictByteOrder;
+    h.foldHash = foldHash(frozen.foldTable());
+    h.size = dat.size();
+    h.stateCount = dat.stateCount();
+    h.maxDepth = static_cast<uint32_t>(ac.maxDepth());
+    h.wordCount = word_count;
+    h.unitsOffset = align8(sizeof(DictHeader));
+    h.wordIdsOffset = align8(h.unitsOffset + h.size * sizeof(DoubleArray::Unit));
+    h.nodesOffset = align8(h.wordIdsOffset + h.size * sizeof(int32_t));
+    h.stopWordsOffset = align8(h.nodesOffset + h.size * sizeof(AhoCorasick::Node));
+    h.astralStopOffset = align8(h.stopWordsOffset + kStopWordsWords * sizeof(uint64_t));
+    h.astralStopCount = frozen.astralStopWords().size();
+    h.alphabetSize = dat.alphabet().size();
+    h.bmpOffset = align8(h.astralStopOffset + h.astralStopCount * sizeof(uint32_t));
+    h.astralOffset = align8(h.bmpOffset + Alphabet::kBmpSize * sizeof(uint16_t));
+    h.astralCount = dat.alphabet().astralCount();
+    h.tagsOffset = align8(h.astralOffset + h.astralCount * sizeof(Alphabet::Astral));
+    h.fileSize = h.tagsOffset + uint64_t(word_count) * sizeof(WordTag);
+
+    std::vector<char> buf(h.fileSize, 0);
+    memcpy(&buf[h.unitsOffset], dat.units(), h.size * sizeof(DoubleArray::Unit));
+    memcpy(&buf[h.wordIdsOffset], dat.wordIds(), h.size * sizeof(int32_t));
+    memcpy(&buf[h.nodesOffset], ac.nodes(), h.size * sizeof(AhoCorasick::Node));
+    memcpy(&buf[h.stopWordsOffset], frozen.stopWords(), kStopWordsWords * sizeof(uint64_t));
+    if (h.astralStopCount > 0) {
+        memcpy(&buf[h.astralStopOffset], frozen.astralStopWords().data(), h.astralStopCount * sizeof(uint32_t));
+    }
+    memcpy(&buf[h.bmpOffset], dat.alphabet().bmp(), Alphabet::kBmpSize * sizeof(uint16_t));
+    if (h.astralCount > 0) {
+        memcpy(&buf[h.astralOffset], dat.alphabet().astral(), h.astralCount * sizeof(Alphabet::Astral));
+    }
+    if (word_count > 0) {
+        memcpy(&buf[h.tagsOffset], frozen.wordTags(), word_count * sizeof(WordTag));
+    }
+    h.checksum = checksum(buf.data() + sizeof(DictHeader), buf.size() - sizeof(DictHeader));
+    memcpy(buf.data(), &h, sizeof(DictHeader));
+
+    // 直接覆盖会改写其他进程正在mmap的页面，先写临时文件再rename
+    std::string tmp_name = file_name + ".tmp";
+    FILE *fp = fopen(tmp_name.c_str(), "wb");
+    if (fp == nullptr) {
+        setError(error, "open " + tmp_name + " failed: " + strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(buf.data(), 1, buf.size(), fp) == buf.size();
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp_name.c_str(), file_name.c_str()) != 0) {
+        setError(error, "write " + file_name + " failed: " + strerror(errno));
+        remove(tmp_name.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,134 @@
+/** @file dict_file.h
+  * @brief 编译好的二进制词库文件，mmap只读加载，多个进程共享同一份物理内存
+  * @author teng.qing
+  * @date 2021/7/22
+  */
+
+#ifndef INC_01_TRIE_TREE_DICT_FILE_H_
+#define INC_01_TRIE_TREE_DICT_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "aho_corasick.h"
+#include "double_array.h"
+#include "word_tag.h"
+
+class FoldTable;
+class FrozenTrie;
+
+/** @struct DictHeader
+  * @brief 文件头，所有偏移都相对于文件开头，文件内容和加载地址无关
+  *
+  * 文件布局：DictHeader | 双数组 | 敏感词编号 | AC自动机节点 | 停顿词位图 | BMP之外的停顿词 | 字符表 | 敏感词标签，
+  * 每段按8字节对齐
+  */
+struct DictHeader {
+    char magic[8];             // kDictMagic
+    uint32_t version;          // kDictVersion，格式变化时加1
+    uint32_t byteOrder;        // 写入时为kDictByteOrder，字节序不同的机器不能直接加载
+    uint64_t fileSize;         // 文件总长度
+    uint64_t checksum;         // 文件头之后所有内容的校验和
+    uint64_t foldHash;         // 编译时字符转换表（FoldTable）的指纹，转换规则变化后需要重新编译
+    uint64_t size;             // 双数组长度
+    uint64_t stateCount;       // 有效状态数
+    uint32_t maxDepth;         // 最长敏感词的长度
+    uint32_t wordCount;        // 敏感词数
+    uint64_t unitsOffset;      // DoubleArray::Unit[size]
+    uint64_t wordIdsOffset;    // int32_t[size]
+    uint64_t nodesOffset;      // AhoCorasick::Node[size]
+    uint64_t stopWordsOffset;  // uint64_t[kStopWordsWords]
+    uint64_t astralStopOffset; // uint32_t[astralStopCount]
+    uint64_t astralStopCount;
+    uint64_t alphabetSize;     // 字符编号数（含Alphabet::kOther）
+    uint64_t bmpOffset;        // uint16_t[Alphabet::kBmpSize]
+    uint64_t astralOffset;     // Alphabet::Astral[astralCount]
+    uint64_t astralCount;
+    uint64_t tagsOffset;       // WordTag[wordCount]
+};
+
+const char kDictMagic[8] = {'D', 'F', 'D', 'I', 'C', 'T', '\0', '\0'};
+const uint32_t kDictVersion = 3;
+const uint32_t kDictByteOrder = 0x01020304;
+
+/** @class DictFile
+  * @brief mmap打开的二进制词库，通过 std::shared_ptr<const DictFile> 持有，最后一个持有者释放时munmap
+  */
+class DictFile {
+public:
+    // 停顿词位图的长度（uint64_t个数），65536位
+    static const size_t kStopWordsWords = 65536 / 64;
+
+    ~DictFile();
+
+    DictFile(const DictFile &that) = delete;
+
+    DictFile &operator=(const DictFile &that) = delete;
+
+    /** @fn open
+      * @brief 只读mmap打开词库文件，检查文件头、长度和字符转换表指纹
+      * @param [in]file_name: 文件名
+      * @param [in]verify: 是否计算校验和，跳过可以更快启动，但文件损坏时无法发现。取值范围总是检查，损坏的文件不会导致越界访问
+      * @param [out]error: 失败原因，可以为nullptr
+      * @param [in]fold: 加载后使用的字符转换表，必须和编译时相同，nullptr为默认规则
+      * @return 失败返回nullptr
+      */
+    static std::shared_ptr<const DictFile> open(const std::string &file_name, bool verify = true,
+                                                std::string *error = nullptr, const FoldTable *fold = nullptr);
+
+    /** @fn save
+      * @brief 把匹配器的双数组、AC自动机、停顿词和敏感词标签写入文件，先写临时文件再rename，正在使用旧文件的进程不受影响
+      * @param [in]frozen: 匹配器
+      * @param [in]word_count: 敏感词数
+      * @param [in]file_name: 文件名
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 是否成功
+      */
+    static bool save(const FrozenTrie &frozen, uint32_t word_count, const std::string &file_name,
+                     std::string *error = nullptr);
+
+    /** @fn foldHash
+      * @brief 字符转换表的指纹，只有默认规则时和之前的版本相同，已经编译的词库不需要重新编译
+      * @param [in]fold: 转换表
+      * @return 指纹
+      */
+    static uint64_t foldHash(const FoldTable &fold);
+
+    const DictHeader &header() const { return *header_; }
+
+    const DoubleArray::Unit *units() const { return section<DoubleArray::Unit>(header_->unitsOffset); }
+
+    const int32_t *wordIds() const { return section<int32_t>(header_->wordIdsOffset); }
+
+    const AhoCorasick::Node *nodes() const { return section<AhoCorasick::Node>(header_->nodesOffset); }
+
+    const uint64_t *stopWords() const { return section<uint64_t>(header_->stopWordsOffset); }
+
+    const uint32_t *astralStopWords() const { return section<uint32_t>(header_->astralStopOffset); }
+
+    const uint16_t *bmp() const { return section<uint16_t>(header_->bmpOffset); }
+
+    const Alphabet::Astral *astral() const { return section<Alphabet::Astral>(header_->astralOffset); }
+
+    const WordTag *wordTags() const { return section<WordTag>(header_->tagsOffset); }
+
+    // 映射的长度，单位字节
+    size_t mappedSize() const { return size_; }
+
+private:
+    DictFile(const void *data, size_t size);
+
+    template<typename T>
+    const T *section(uint64_t offset) const {
+        return reinterpret_cast<const T *>(static_cast<const char *>(data_) + offset);
+    }
+
+private:
+    const void *data_;
+    size_t size_;
+    const DictHeader *header_;
+};
+
+#endif //INC_01_TRIE_TREE_DICT_FILE_H_
@@ -0,0 +1,256 @@
+/** @file dirtyfilter_codegen.cpp
+  * @brief 生成编译期词库：dirtyfilter-codegen [--fold=mapping.txt ...] [--name=StaticWordDict] <word.txt> <out.h>
+  *        [stopwd.txt]
+  *
+  * 把词库编译成双数组，和字符转换规则、停顿词一起写成constexpr数组的头文件，由StaticMatcher<类名>使用，
+  * 见static_matcher.h。一般不直接调用，而是在CMake中用dirtyfilter_static_dict在编译时生成。
+  *
+  * @author teng.qing
+  * @date 2021/8/10
+  */
+
+#include "sbc_convert.h"
+#include "trie.h"
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// BMP之外也要枚举，fold规则可以把数学字母等映射到敏感词中的字符
+const uint32_t kMaxUnicode = 0x10FFFF;
+
+// 每行不超过这么多列
+const size_t kLineWidth = 120;
+
+/** @class ListWriter
+  * @brief 输出以逗号分隔、自动换行的数组元素
+  */
+class ListWriter {
+public:
+    explicit ListWriter(std::ostream &out) : out_(out) {}
+
+    void add(const std::string &item) {
+        if (column_ > 0 && column_ + item.size() + 2 > kLineWidth) {
+            out_ << "\n";
+            column_ = 0;
+        }
+        if (column_ == 0) {
+            out_ << "        ";
+            column_ = 8;
+        } else {
+            out_ << " ";
+            ++column_;
+        }
+        out_ << item << ",";
+        column_ += item.size() + 1;
+    }
+
+    void finish() {
+        out_ << "\n";
+        column_ = 0;
+    }
+
+private:
+    std::ostream &out_;
+    size_t column_ = 0;
+};
+
+// C++字符串字面量，非ASCII按原样输出utf8，控制字符、引号、反斜杠用八进制转义（不会吞掉后面的数字）
+std::string quote(const std::string &text) {
+    std::string ret = "\"";
+    for (char ch : text) {
+        auto b = static_cast<unsigned char>(ch);
+        if (b == '"' || b == '\\' || b < 0x20 || b == 0x7F) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\%03o", b);
+            ret += buf;
+        } else {
+            ret += ch;
+        }
+    }
+    return ret + "\"";
+}
+
+std::string symbolItem(uint32_t unicode, uint16_t code, bool stop) {
+    return "{" + std::to_string(unicode) + "u, " + std::to_string(code) + ", " + (stop ? "true" : "false") + "}";
+}
+
+std::string baseName(const std::string &path) {
+    return path.substr(path.find_last_of('/') + 1);
+}
+
+std::string guardName(const std::string &file_name) {
+    std::string guard = "INC_01_TRIE_TREE_";
+    for (char ch : file_name) {
+        guard += isalnum(static_cast<unsigned char>(ch)) ? static_cast<char>(toupper(ch)) : '_';
+    }
+    return guard + "_";
+}
+
+/** @fn generate
+  * @brief 生成头文件的内容
+  * @param [in]frozen: 编译好的匹配器
+  * @param [in]name: 类名
+  * @param [in]source: 词库文件名，写在注释中
+  * @param [in]file_name: 头文件名
+  * @return 头文件内容
+  */
+std::string generate(const FrozenTrie &frozen, const std::string &name, const std::string &source,
+                     const std::string &file_name) {
+    std::string guard = guardName(file_name);
+    const DoubleArray &dat = frozen.dat();
+    const DoubleArray::Unit *units = dat.units();
+
+    // 字符表：输入字符fold之后在敏感词中出现，或者是停顿词
+    std::vector<uint32_t> chars(dat.alphabet().size(), 0); // 编号 -> fold之后的字符
+    std::vector<std::string> ascii, symbols;
+    std::vector<uint64_t> bmp(Alphabet::kBmpSize / 64, 0);
+    for (uint32_t c = 0; c <= kMaxUnicode; ++c) {
+        uint16_t own = dat.code(c);
+        if (own != Alphabet::kOther) {
+            chars[own] = c;
+        }
+        uint32_t folded = frozen.foldTable().fold(c);
+        uint16_t code = dat.code(folded);
+        bool stop = frozen.isStopWord(folded);
+        if (c < 128) {
+            ascii.push_back(symbolItem(c, code, stop));
+        } else if (code != Alphabet::kOther || stop) {
+            symbols.push_back(symbolItem(c, code, stop));
+            if (c < Alphabet::kBmpSize) {
+                bmp[c >> 6] |= uint64_t(1) << (c & 63);
+            }
+        }
+    }
+    // 哨兵，保证数组不为空
+    symbols.push_back(symbolItem(0xFFFFFFFFu, Alphabet::kOther, false));
+
+    // 敏感词：从结尾状态沿check找到根节点
+    std::vector<std::string> words(frozen.wordCount());
+    for (size_t t = DoubleArray::kRoot + 1; t < dat.size(); ++t) {
+        int id = dat.wordId(static_cast<int>(t));
+        if (id < 0 || !dat.isTerminal(static_cast<int>(t))) {
+            continue;
+        }
+        std::wstring word;
+        for (size_t s = t; s != DoubleArray::kRoot;) {
+            auto parent = static_cast<size_t>(units[s].check);
+            word.insert(word.begin(), static_cast<wchar_t>(chars[s - (units[parent].base >> 1)]));
+            s = parent;
+        }
+        words[id] = SBCConvert::ws2s(word);
+    }
+
+    std::ostringstream out;
+    out << "/** @file " << file_name << "\n"
+        << "  * @brief 编译期词库，由dirtyfilter-codegen从" << source << "生成，不要手动修改。用法见static_matcher.h\n"
+        << "  */\n\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n\n"
+        << "#include \"static_matcher.h\"\n\n"
+        << "// " << frozen.wordCount() << " words, " << dat.stateCount() << " states, " << symbols.size() - 1
+        << " symbols\n"
+        << "struct " << name << " {\n";
+
+    ListWriter list(out);
+    out << "    static constexpr DoubleArray::Unit kUnits[] = {\n";
+    for (size_t t = 0; t < dat.size(); ++t) {
+        list.add("{" + std::to_string(units[t].base) + ", " + std::to_string(units[t].check) + "}");
+    }
+    list.finish();
+    out << "    };\n\n    static constexpr int32_t kWordIds[] = {\n";
+    for (size_t t = 0; t < dat.size(); ++t) {
+        list.add(std::to_string(dat.wordId(static_cast<int>(t))));
+    }
+    list.finish();
+    out << "    };\n\n    static constexpr StaticSymbol kAscii[128] = {\n";
+    for (const std::string &item : ascii) {
+        list.add(item);
+    }
+    list.finish();
+    out << "    };\n\n    static constexpr StaticSymbol kSymbols[] = {\n";
+    for (const std::string &item : symbols) {
+        list.add(item);
+    }
+    list.finish();
+    out << "    };\n\n    static constexpr uint64_t kBmpSymbols[" << bmp.size() << "] = {\n";
+    for (uint64_t bits : bmp) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "0x%llxull", static_cast<unsigned long long>(bits));
+        list.add(buf);
+    }
+    list.finish();
+    out << "    };\n\n    static constexpr std::string_view kWords[] = {\n";
+    for (const std::string &word : words) {
+        list.add(quote(word));
+    }
+    list.finish();
+    out << "    };\n\n    static constexpr WordTag kTags[] = {\n";
+    for (size_t i = 0; i < frozen.wordCount(); ++i) {
+        const WordTag &tag = frozen.wordTag(static_cast<int>(i));
+        list.add("{" + std::to_string(tag.categories) + "u, " + std::to_string(tag.severity) + "u}");
+    }
+    list.finish();
+    out << "    };\n};\n\n"
+        << "#endif //" << guard << "\n";
+    return out.str();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> fold_files;
+    std::string name = "StaticWordDict";
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--fold=", 0) == 0) {
+            fold_files.push_back(arg.substr(7));
+        } else if (arg.rfind("--name=", 0) == 0) {
+            name = arg.substr(7);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() < 2 || args.size() > 3) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--fold=mapping.txt ...] [--name=StaticWordDict] <word.txt> <out.h> [stopwd.txt]" << std::endl;
+        return 2;
+    }
+
+    Trie trie;
+    std::string error;
+    if (!fold_files.empty() && !trie.loadFoldMappingFiles(fold_files, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    if (args.size() == 3 && !trie.loadStopWordFromFile(args[2], &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    if (!trie.loadFromFile(args[0], &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+    if (frozen->wordCount() == 0 || frozen->dat().empty()) {
+        std::cerr << "no words in " << args[0] << std::endl;
+        return 1;
+    }
+
+    std::string header = generate(*frozen, name, baseName(args[0]), baseName(args[1]));
+    std::ofstream ofs(args[1], std::ios::binary | std::ios::trunc);
+    if (!ofs.write(header.data(), static_cast<std::streamsize>(header.size()))) {
+        std::cerr << "failed to write " << args[1] << std::endl;
+        return 1;
+    }
+    std::cout << "generated " << args[1] << ", " << frozen->wordCount() << " words, "
+              << frozen->dat().stateCount() << " states, " << header.size() / 1024 << " KB" << std::endl;
+    return 0;
+}
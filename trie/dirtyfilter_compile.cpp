@@ -0,0 +1,80 @@
+/** @file dirtyfilter_compile.cpp
+  * @brief 离线编译词库：dirtyfilter-compile [--fold=mapping.txt ...] [--profile=sample.txt] <word.txt> <out.bin>
+  *        [stopwd.txt]
+  *
+  * --fold可以指定多次，按顺序叠加字符转换规则（见FoldTable），加载时必须使用同样的规则。
+  * --profile为样本流量（每行一条utf8消息），按其中的状态访问次数布局双数组（见LayoutProfile），布局保存在文件中。
+  *
+  * 生成的文件由Trie::loadFromBinaryFile通过mmap加载，启动时不需要解析文本和构建双数组。
+  *
+  * @author teng.qing
+  * @date 2021/7/22
+  */
+
+#include "trie.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> fold_files;
+    std::string profile_file;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--fold=", 0) == 0) {
+            fold_files.push_back(arg.substr(7));
+        } else if (arg.rfind("--profile=", 0) == 0) {
+            profile_file = arg.substr(10);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() < 2 || args.size() > 3) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--fold=mapping.txt ...] [--profile=sample.txt] <word.txt> <out.bin> [stopwd.txt]" << std::endl;
+        return 2;
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+    Trie trie;
+    std::string error;
+    if (!fold_files.empty() && !trie.loadFoldMappingFiles(fold_files, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    if (args.size() == 3 && !trie.loadStopWordFromFile(args[2], &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    if (!trie.loadFromFile(args[0], &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    if (!profile_file.empty()) {
+        std::shared_ptr<LayoutProfile> profile = trie.openProfile();
+        size_t lines = profile->recordFile(profile_file);
+        if (lines == 0) {
+            std::cerr << "no messages in " << profile_file << std::endl;
+            return 1;
+        }
+        trie.setLayoutProfile(profile);
+        std::cout << "profiled " << lines << " messages, " << profile->hotStates() << " hot states" << std::endl;
+    }
+    if (!trie.saveToBinaryFile(args[1])) {
+        return 1;
+    }
+
+    // 重新加载一遍，确认文件可用
+    Trie check;
+    check.setFoldTable(trie.foldTable());
+    if (!check.loadFromBinaryFile(args[1])) {
+        return 1;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+    std::cout << "compiled " << args[1] << ", " << check.freeze()->dat().stateCount() << " states, "
+              << check.freeze()->memoryUsage() / 1024 << " KB, " << ms << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,322 @@
+/** @file dirtyfilter_loadgen.cpp
+  * @brief dirtyfilter-server的压测工具：多个连接，每个连接保持depth个未完成的请求（流水线），统计吞吐和延迟
+  *
+  * dirtyfilter-loadgen [--socket=path] [--serve] [--connections=4] [--depth=16] [--requests=100000]
+  *                     [--op=search|getSensitive|replaceSensitive] [--density=0.05] [--verify]
+  *                     [--word-file=word.txt] [--stop-file=stopwd.txt] [--zipf=0] [--cache-mb=0]
+  *
+  * 消息由CorpusGenerator按word-file生成，和trie_bench相同。--serve时在本进程中启动服务端（使用word-file），
+  * 不需要先启动dirtyfilter-server；--verify时用本地构建的词库检查每个响应。
+  * --zipf大于0时消息按这个指数的Zipf分布重复出现（模拟刷屏），否则轮流发送；--cache-mb为--serve时服务端的结果缓存大小。
+  * 结果输出一行json。
+  *
+  * @author teng.qing
+  * @date 2021/8/9
+  */
+
+#include "corpus_gen.h"
+#include "filter_client.h"
+#include "filter_server.h"
+#include "trie.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+struct LoadOptions {
+    std::string socketPath = kDefaultSocketPath;
+    bool serve = false;
+    size_t connections = 4;
+    size_t depth = 16;
+    size_t requests = 100000; // 所有连接合计
+    FilterOp op = FilterOp::kGetSensitive;
+    double density = 0.05;
+    bool verify = false;
+    std::string wordFile = "word.txt";
+    std::string stopFile = "stopwd.txt";
+    double zipf = 0;
+    size_t cacheMb = 0;
+};
+
+const char *opName(FilterOp op) {
+    switch (op) {
+        case FilterOp::kSearch:
+            return "search";
+        case FilterOp::kGetSensitive:
+            return "getSensitive";
+        case FilterOp::kReplaceSensitive:
+            return "replaceSensitive";
+        default:
+            return "ping";
+    }
+}
+
+bool parseArgs(int argc, char *argv[], LoadOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.find('=') != std::string::npos ? arg.substr(arg.find('=') + 1) : "";
+        if (arg.rfind("--socket=", 0) == 0) {
+            options.socketPath = value;
+        } else if (arg == "--serve") {
+            options.serve = true;
+        } else if (arg.rfind("--connections=", 0) == 0) {
+            options.connections = std::max<size_t>(1, std::stoul(value));
+        } else if (arg.rfind("--depth=", 0) == 0) {
+            options.depth = std::max<size_t>(1, std::stoul(value));
+        } else if (arg.rfind("--requests=", 0) == 0) {
+            options.requests = std::stoul(value);
+        } else if (arg.rfind("--op=", 0) == 0) {
+            if (value == "search") {
+                options.op = FilterOp::kSearch;
+            } else if (value == "getSensitive") {
+                options.op = FilterOp::kGetSensitive;
+            } else if (value == "replaceSensitive") {
+                options.op = FilterOp::kReplaceSensitive;
+            } else {
+                return false;
+            }
+        } else if (arg.rfind("--density=", 0) == 0) {
+            options.density = std::stod(value);
+        } else if (arg == "--verify") {
+            options.verify = true;
+        } else if (arg.rfind("--word-file=", 0) == 0) {
+            options.wordFile = value;
+        } else if (arg.rfind("--stop-file=", 0) == 0) {
+            options.stopFile = value;
+        } else if (arg.rfind("--zipf=", 0) == 0) {
+            options.zipf = std::stod(value);
+        } else if (arg.rfind("--cache-mb=", 0) == 0) {
+            options.cacheMb = std::stoul(value);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::wstring> readLines(const std::string &file_name) {
+    std::vector<std::wstring> lines;
+    std::ifstream ifs(file_name);
+    std::string str;
+    while (getline(ifs, str)) {
+        lines.push_back(SBCConvert::s2ws(str));
+    }
+    return lines;
+}
+
+// 本地计算的期望结果，和响应的内容逐字节比较
+std::string expectedBody(const FrozenTrie &frozen, FilterOp op, const std::string &text) {
+    std::string body;
+    if (op == FilterOp::kSearch) {
+        body.push_back(frozen.search(std::string_view(text)) ? 1 : 0);
+    } else if (op == FilterOp::kReplaceSensitive) {
+        body = frozen.replaceSensitive(std::string_view(text));
+    } else {
+        uint32_t count = 0;
+        body.append(sizeof(count), '\0');
+        frozen.forEachSensitive(std::string_view(text), [&](const MatchSpan &span) {
+            const WordTag &tag = frozen.wordTag(span.wordId);
+            WireMatch match{static_cast<uint32_t>(span.offset), static_cast<uint32_t>(span.length),
+                            static_cast<uint32_t>(span.startIndex), static_cast<uint32_t>(span.len), span.wordId,
+                            tag.categories, tag.severity};
+            body.append(reinterpret_cast<const char *>(&match), sizeof(match));
+            ++count;
+            return true;
+        });
+        memcpy(&body[0], &count, sizeof(count));
+    }
+    return body;
+}
+
+double percentile(std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[static_cast<size_t>(p * static_cast<double>(sorted.size() - 1))];
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    LoadOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--socket=path] [--serve] [--connections=4] [--depth=16] [--requests=100000]"
+                     " [--op=search|getSensitive|replaceSensitive] [--density=0.05] [--verify]"
+                     " [--word-file=word.txt] [--stop-file=stopwd.txt] [--zipf=0] [--cache-mb=0]" << std::endl;
+        return 2;
+    }
+
+    std::vector<std::wstring> words = readLines(options.wordFile);
+    std::vector<wchar_t> stop_words;
+    for (const auto &line : readLines(options.stopFile)) {
+        if (line.size() <= 1) {
+            stop_words.push_back(line.empty() ? L' ' : line[0]);
+        }
+    }
+    if (words.empty()) {
+        std::cerr << "no words in " << options.wordFile << std::endl;
+        return 1;
+    }
+    CorpusOptions corpus_options;
+    corpus_options.messages = std::min<size_t>(options.requests, 20000);
+    corpus_options.hitDensity = options.density;
+    std::vector<std::string> corpus;
+    size_t corpus_bytes = 0;
+    for (const auto &msg : CorpusGenerator().messages(words, stop_words, corpus_options)) {
+        corpus.push_back(SBCConvert::ws2s(msg));
+        corpus_bytes += corpus.back().size();
+    }
+    // 第i个请求发送的消息
+    std::vector<size_t> order;
+    if (options.zipf > 0) {
+        order = CorpusGenerator().zipf(options.requests, corpus.size(), options.zipf);
+    } else {
+        for (size_t i = 0; i < options.requests; ++i) {
+            order.push_back(i % corpus.size());
+        }
+    }
+
+    std::unique_ptr<FilterServer> server;
+    std::thread server_thread;
+    if (options.serve) {
+        if (options.socketPath == kDefaultSocketPath) {
+            options.socketPath = "/tmp/dirtyfilter_loadgen_" + std::to_string(getpid()) + ".sock";
+        }
+        auto holder = std::make_shared<TrieHolder>();
+        std::string error;
+        if (!holder->reload(options.wordFile, options.stopFile, &error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        ServerOptions server_options;
+        server_options.socketPath = options.socketPath;
+        if (options.cacheMb > 0) {
+            CacheOptions cache_options;
+            cache_options.capacityBytes = options.cacheMb << 20;
+            server_options.cache = std::make_shared<ResultCache>(cache_options);
+        }
+        server.reset(new FilterServer(holder, server_options));
+        if (!server->listen(&error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        server_thread = std::thread([&server]() { server->run(); });
+    }
+
+    std::vector<std::string> expected;
+    if (options.verify) {
+        TrieHolder local;
+        std::string error;
+        if (!local.reload(options.wordFile, options.stopFile, &error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        for (const auto &text : corpus) {
+            expected.push_back(expectedBody(*local.get(), options.op, text));
+        }
+    }
+
+    // 每个连接一个线程，保持depth个未完成的请求，收到一个响应再发一个
+    std::atomic<size_t> errors{0}, hits{0}, bytes{0};
+    std::vector<std::vector<double>> latencies(options.connections);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < options.connections; ++c) {
+        threads.emplace_back([&, c]() {
+            size_t count = options.requests / options.connections + (c < options.requests % options.connections);
+            size_t first = c * (options.requests / options.connections) +
+                           std::min(c, options.requests % options.connections);
+            FilterClient client;
+            if (!client.connect(options.socketPath)) {
+                std::cerr << client.error() << std::endl;
+                errors += count;
+                return;
+            }
+            std::vector<std::chrono::steady_clock::time_point> sent_at(options.depth);
+            std::vector<size_t> sent_msg(options.depth);
+            FilterResponse response;
+            size_t sent = 0, received = 0, local_hits = 0, local_bytes = 0;
+            latencies[c].reserve(count);
+            while (received < count) {
+                while (sent < count && sent - received < options.depth) {
+                    size_t msg = order[first + sent];
+                    client.send(options.op, corpus[msg]);
+                    sent_at[sent % options.depth] = std::chrono::steady_clock::now();
+                    sent_msg[sent % options.depth] = msg;
+                    local_bytes += corpus[msg].size();
+                    ++sent;
+                }
+                if (!client.receive(response)) {
+                    std::cerr << client.error() << std::endl;
+                    errors += count - received;
+                    break;
+                }
+                size_t slot = received % options.depth;
+                latencies[c].push_back(std::chrono::duration<double, std::micro>(
+                        std::chrono::steady_clock::now() - sent_at[slot]).count());
+                if (response.status != FilterStatus::kOk ||
+                    (options.verify && response.body != expected[sent_msg[slot]])) {
+                    ++errors;
+                }
+                if (response.status == FilterStatus::kOk) {
+                    if (options.op == FilterOp::kGetSensitive) {
+                        uint32_t n = 0;
+                        memcpy(&n, response.body.data(), std::min(sizeof(n), response.body.size()));
+                        local_hits += n;
+                    } else if (options.op == FilterOp::kSearch) {
+                        local_hits += !response.body.empty() && response.body[0] != 0;
+                    }
+                }
+                ++received;
+            }
+            hits += local_hits;
+            bytes += local_bytes;
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    for (auto &item : latencies) {
+        all.insert(all.end(), item.begin(), item.end());
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << "{\"bench\":\"loadgen\",\"op\":\"" << opName(options.op) << "\",\"connections\":" << options.connections
+              << ",\"depth\":" << options.depth << ",\"requests\":" << all.size()
+              << ",\"avg_message_bytes\":" << corpus_bytes / std::max<size_t>(corpus.size(), 1)
+              << ",\"requests_per_s\":" << static_cast<double>(all.size()) / seconds
+              << ",\"mb_per_s\":" << static_cast<double>(bytes.load()) / 1048576.0 / seconds
+              << ",\"p50_us\":" << percentile(all, 0.5) << ",\"p99_us\":" << percentile(all, 0.99)
+              << ",\"p999_us\":" << percentile(all, 0.999) << ",\"max_us\":" << (all.empty() ? 0 : all.back());
+    if (options.zipf > 0) {
+        std::cout << ",\"zipf\":" << options.zipf;
+    }
+    if (server != nullptr && server->options().cache != nullptr) {
+        std::cout << ",\"cache_hit_rate\":" << server->options().cache->stats().hitRate();
+    }
+    if (server != nullptr) {
+        std::cout << ",\"avg_batch\":" << static_cast<double>(server->requestCount()) /
+                                          static_cast<double>(std::max<uint64_t>(server->batchCount(), 1));
+    }
+    std::cout << ",\"hits\":" << hits.load() << ",\"errors\":" << errors.load() << "}" << std::endl;
+
+    if (server != nullptr) {
+        server->stop();
+        server_thread.join();
+    }
+    return errors.load() == 0 ? 0 : 1;
+}
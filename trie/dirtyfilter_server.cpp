@@ -0,0 +1,117 @@
+/** @file dirtyfilter_server.cpp
+  * @brief 本机过滤服务：dirtyfilter-server [--socket=path] [--threads=N] [--max-batch=N] [--mode=trie|aho_corasick]
+  *        [--cache-mb=N] <word.txt> [stopwd.txt]
+  *
+  * 一台机器上只加载一份词库，其他进程通过FilterClient（Unix domain socket）调用，协议见filter_protocol.h。
+  * SIGHUP时从同样的文件重新加载词库（见TrieHolder），SIGINT/SIGTERM时退出。
+  * --cache-mb大于0时缓存响应（见ResultCache），适合同样的消息大量重复出现的场景，退出时输出缓存的统计。
+  *
+  * @author teng.qing
+  * @date 2021/8/9
+  */
+
+#include "filter_server.h"
+
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    ServerOptions options;
+    MatchMode mode = MatchMode::kTrie;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.find('=') != std::string::npos ? arg.substr(arg.find('=') + 1) : "";
+        if (arg.rfind("--socket=", 0) == 0) {
+            options.socketPath = value;
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            options.threads = std::stoul(value);
+        } else if (arg.rfind("--max-batch=", 0) == 0) {
+            options.maxBatch = std::stoul(value);
+        } else if (arg.rfind("--cache-mb=", 0) == 0) {
+            size_t mb = std::stoul(value);
+            if (mb > 0) {
+                CacheOptions cache_options;
+                cache_options.capacityBytes = mb << 20;
+                options.cache = std::make_shared<ResultCache>(cache_options);
+            }
+        } else if (arg == "--mode=aho_corasick") {
+            mode = MatchMode::kAhoCorasick;
+        } else if (arg == "--mode=trie") {
+            mode = MatchMode::kTrie;
+        } else if (arg.rfind("--", 0) == 0) {
+            args.clear();
+            break;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.empty() || args.size() > 2) {
+        std::cerr << "usage: " << argv[0] << " [--socket=" << kDefaultSocketPath
+                  << "] [--threads=N] [--max-batch=N] [--mode=trie|aho_corasick] [--cache-mb=N]"
+                     " <word.txt> [stopwd.txt]" << std::endl;
+        return 2;
+    }
+    std::string word_file = args[0];
+    std::string stop_file = args.size() > 1 ? args[1] : "";
+
+    // 信号只在下面的线程中用sigwait处理，其他线程（包括线程池）继承屏蔽字
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    auto holder = std::make_shared<TrieHolder>(mode);
+    std::string error;
+    if (!holder->reload(word_file, stop_file, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    FilterServer server(holder, options);
+    if (!server.listen(&error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cerr << "listening on " << options.socketPath << ", " << holder->get()->wordCount() << " words, "
+              << holder->lastBuildMs() << " ms" << std::endl;
+
+    std::thread signal_thread([&]() {
+        for (;;) {
+            int sig = 0;
+            if (sigwait(&signals, &sig) != 0) {
+                continue;
+            }
+            if (sig == SIGHUP) {
+                // 加载失败时继续使用当前词库
+                std::string reload_error;
+                if (!holder->reload(word_file, stop_file, &reload_error)) {
+                    std::cerr << "reload failed: " << reload_error << ", keep version " << holder->version()
+                              << std::endl;
+                    continue;
+                }
+                std::cerr << "reloaded " << holder->get()->wordCount() << " words, version " << holder->version()
+                          << ", " << holder->lastBuildMs() << " ms" << std::endl;
+                continue;
+            }
+            server.stop();
+            return;
+        }
+    });
+    server.run();
+    // run()因为错误返回时让信号线程也退出
+    kill(getpid(), SIGTERM);
+    signal_thread.join();
+    std::cerr << "served " << server.requestCount() << " requests in " << server.batchCount() << " batches"
+              << std::endl;
+    if (options.cache != nullptr) {
+        std::cerr << options.cache->stats().toPrometheus();
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+/** @file double_array.cpp
+  * @brief 双数组trie
+  *
+  * 构建方式参考 darts-clone: https://github.com/s-yata/darts-clone
+  *
+  * @author teng.qing
+  * @date 2021/7/2
+  */
+
+#include "double_array.h"
+#include "trie_arena.h"
+
+#include <algorithm>
+#include <iostream>
+#include <queue>
+#include <tuple>
+#include <utility>
+
+const int DoubleArray::kRoot;
+const int32_t DoubleArray::kFree;
+const uint8_t DoubleArray::kMaxTrials;
+
+void DoubleArray::clear() {
+    units_.clear();
+    units_.shrink_to_fit();
+    word_ids_.clear();
+    word_ids_.shrink_to_fit();
+    free_next_.clear();
+    free_next_.shrink_to_fit();
+    free_prev_.clear();
+    free_prev_.shrink_to_fit();
+    trials_.clear();
+    trials_.shrink_to_fit();
+    in_list_.clear();
+    in_list_.shrink_to_fit();
+    free_head_ = -1;
+    free_tail_ = -1;
+    unit_data_ = nullptr;
+    word_id_data_ = nullptr;
+    size_ = 0;
+    state_count_ = 0;
+}
+
+void DoubleArray::attach(const Unit *units, const int32_t *word_ids, size_t size, size_t state_count,
+                         const uint16_t *bmp, const Alphabet::Astral *astral, size_t astral_count,
+                         size_t alphabet_size) {
+    clear();
+    alphabet_.attach(bmp, astral, astral_count, alphabet_size);
+    unit_data_ = units;
+    word_id_data_ = word_ids;
+    size_ = size;
+    state_count_ = state_count;
+}
+
+void DoubleArray::reserve(size_t size) {
+    if (size <= units_.size()) {
+        return;
+    }
+    // 按倍数扩容，避免频繁拷贝
+    size_t old_size = units_.size();
+    size_t new_size = std::max(size, old_size * 2);
+    units_.resize(new_size, Unit{0, kFree});
+    free_next_.resize(new_size, -1);
+    free_prev_.resize(new_size, -1);
+    trials_.resize(new_size, 0);
+    in_list_.resize(new_size, true);
+
+    // 新的槽位接到空闲链表尾部
+    for (size_t pos = old_size; pos < new_size; ++pos) {
+        auto p = static_cast<int32_t>(pos);
+        free_prev_[pos] = free_tail_;
+        if (free_tail_ >= 0) {
+            free_next_[free_tail_] = p;
+        } else {
+            free_head_ = p;
+        }
+        free_tail_ = p;
+    }
+}
+
+void DoubleArray::unlinkFree(size_t pos) {
+    if (!in_list_[pos]) {
+        return;
+    }
+    in_list_[pos] = false;
+    int32_t prev = free_prev_[pos];
+    int32_t next = free_next_[pos];
+    if (prev >= 0) {
+        free_next_[prev] = next;
+    } else {
+        free_head_ = next;
+    }
+    if (next >= 0) {
+        free_prev_[next] = prev;
+    } else {
+        free_tail_ = prev;
+    }
+}
+
+size_t DoubleArray::findBase(const std::vector<uint16_t> &codes) {
+    // 第一个字符落在某个空闲槽位上，要求 base >= 1，保证子节点不会落在根节点上
+    size_t first = codes.front();
+    int32_t pos = free_head_;
+
+    for (;;) {
+        if (pos < 0) {
+            // 链表里的槽位都不合适，扩容后从新的槽位继续找
+            size_t old_size = units_.size();
+            reserve(old_size + 1);
+            pos = static_cast<int32_t>(old_size);
+        }
+
+        auto upos = static_cast<size_t>(pos);
+        if (upos > first) {
+            size_t base = upos - first;
+            reserve(base + codes.back() + 1);
+
+            bool ok = true;
+            for (size_t i = 1; i < codes.size(); ++i) {
+                if (units_[base + codes[i]].check != kFree) {
+                    ok = false;
+                    break;
+                }
+            }
+            if (ok) {
+                return base;
+            }
+        }
+
+        // reserve可能在链表尾部追加了槽位，所以扩容之后再取next
+        int32_t next = free_next_[upos];
+        if (++trials_[upos] >= kMaxTrials) {
+            unlinkFree(upos);
+        }
+        pos = next;
+    }
+}
+
+void DoubleArray::build(const TrieArena &trie, const std::vector<uint64_t> *weights) {
+    clear();
+    if (!alphabet_.build(trie, weights)) {
+        std::cout << "too many distinct characters, only " << Alphabet::kMaxSymbols << " can be matched" << std::endl;
+    }
+    reserve(1024);
+    units_[kRoot].check = kRoot;
+    unlinkFree(kRoot);
+    state_count_ = 1;
+    size_t used = 1;
+
+    // 广度优先，逐层分配子节点的位置。有访问次数时，访问过的节点按次数从多到少先处理（次数相同时按广度优先），
+    // 子节点的访问次数不会超过父节点，所以hot处理完之后nodes里只剩没有访问过的节点
+    std::queue<std::pair<uint32_t, int>> nodes;
+    std::priority_queue<std::tuple<uint64_t, int64_t, uint32_t, int>> hot; // 次数，-入队顺序，节点，状态
+    int64_t seq = 0;
+    auto push = [&](uint32_t id, int state) {
+        if (weights != nullptr && (*weights)[id] > 0) {
+            hot.emplace((*weights)[id], -seq++, id, state);
+        } else {
+            nodes.emplace(id, state);
+        }
+    };
+    push(TrieArena::kRoot, kRoot);
+
+    std::vector<std::pair<uint16_t, uint32_t>> children;
+    std::vector<uint16_t> codes;
+    while (!hot.empty() || !nodes.empty()) {
+        uint32_t id;
+        int state;
+        if (!hot.empty()) {
+            id = std::get<2>(hot.top());
+            state = std::get<3>(hot.top());
+            hot.pop();
+        } else {
+            id = nodes.front().first;
+            state = nodes.front().second;
+            nodes.pop();
+        }
+        const TrieArena::Node &node = trie.node(id);
+
+        bool terminal = node.wordId >= 0;
+        children.clear();
+        for (uint32_t i = node.firstChild; i < node.firstChild + node.childCount; ++i) {
+            uint16_t code = alphabet_.id(trie.node(i).code);
+            if (code != Alphabet::kOther) {
+                children.emplace_back(code, i);
+            }
+        }
+
+        size_t base = 0;
+        if (!children.empty()) {
+            std::sort(children.begin(), children.end());
+            codes.clear();
+            for (auto &child : children) {
+                codes.push_back(child.first);
+            }
+            base = findBase(codes);
+            for (auto &child : children) {
+                units_[base + child.first].check = state;
+                unlinkFree(base + child.first);
+                used = std::max(used, base + child.first + 1);
+                push(child.second, static_cast<int>(base + child.first));
+            }
+            state_count_ += children.size();
+        }
+        units_[state].base = static_cast<int32_t>(base << 1) | (terminal ? 1 : 0);
+        if (terminal) {
+            word_ids_.resize(std::max(word_ids_.size(), static_cast<size_t>(state) + 1), -1);
+            word_ids_[state] = node.wordId;
+        }
+    }
+
+    units_.resize(used);
+    units_.shrink_to_fit();
+    word_ids_.resize(used, -1);
+    word_ids_.shrink_to_fit();
+
+    // 空闲链表只在构建时使用
+    free_next_ = std::vector<int32_t>();
+    free_prev_ = std::vector<int32_t>();
+    trials_ = std::vector<uint8_t>();
+    in_list_ = std::vector<bool>();
+    free_head_ = -1;
+    free_tail_ = -1;
+
+    unit_data_ = units_.data();
+    word_id_data_ = word_ids_.data();
+    size_ = units_.size();
+}
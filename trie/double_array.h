@@ -0,0 +1,162 @@
+/** @file double_array.h
+  * @brief 双数组trie(base/check)，由敏感词树编译而来，供扫描使用
+  * @author teng.qing
+  * @date 2021/7/2
+  */
+
+#ifndef INC_01_TRIE_TREE_DOUBLE_ARRAY_H_
+#define INC_01_TRIE_TREE_DOUBLE_ARRAY_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "alphabet.h"
+
+class TrieArena;
+
+/** @class DoubleArray
+  * @brief 双数组trie
+  *
+  * 字符先通过Alphabet映射为连续的编号c，状态s经过c的转移为 t = base[s] + c，当且仅当 check[t] == s 时转移存在。
+  * base和check放在同一个Unit里，一次转移只读取一个8字节的Unit，
+  * 相比每个节点一个unordered_map，省去了hash计算和指针跳转，也更省内存。
+  */
+class DoubleArray {
+public:
+    struct Unit {
+        int32_t base;  // 最低位为结尾标识，其余位为base
+        int32_t check; // 父状态，空闲槽位为kFree
+    };
+
+    // 根节点状态
+    static const int kRoot = 0;
+
+    DoubleArray() = default;
+
+    // 数组可能指向自己的内存，不允许拷贝
+    DoubleArray(const DoubleArray &that) = delete;
+
+    DoubleArray &operator=(const DoubleArray &that) = delete;
+
+    /** @fn build
+      * @brief 从敏感词树编译双数组，会清空之前的内容
+      *
+      * 默认按广度优先逐层分配子节点块。给出weights时先按访问次数从多到少处理访问过的节点，
+      * 热路径上的子节点块集中在数组开头，再按广度优先处理其余节点，见LayoutProfile。两种顺序的匹配结果相同
+      * @param [in]trie: 敏感词树，wordId不为-1的节点视为敏感词结尾
+      * @param [in]weights: 每个节点的访问次数（LayoutProfile::nodeWeights），为nullptr时按广度优先
+      * @return void
+      */
+    void build(const TrieArena &trie, const std::vector<uint64_t> *weights = nullptr);
+
+    /** @fn attach
+      * @brief 直接使用外部内存（如mmap的词库文件）中的数组，不拷贝，会清空之前的内容。
+      * 调用者保证这段内存在DoubleArray使用期间有效
+      * @param [in]units: base/check数组
+      * @param [in]word_ids: 敏感词编号数组，和units等长
+      * @param [in]size: 数组长度
+      * @param [in]state_count: 有效状态数
+      * @param [in]bmp: 字符表，见Alphabet::attach
+      * @param [in]astral: 字符表，见Alphabet::attach
+      * @param [in]astral_count: 字符表，见Alphabet::attach
+      * @param [in]alphabet_size: 字符表，见Alphabet::attach
+      * @return void
+      */
+    void attach(const Unit *units, const int32_t *word_ids, size_t size, size_t state_count,
+                const uint16_t *bmp, const Alphabet::Astral *astral, size_t astral_count, size_t alphabet_size);
+
+    /** @fn code
+      * @brief 字符在字符表中的编号，作为transition的参数
+      * @param [in]unicode: 经过charConvert的unicode
+      * @return 编号，不在任何敏感词中的字符返回Alphabet::kOther
+      */
+    uint16_t code(uint32_t unicode) const { return alphabet_.id(unicode); }
+
+    /** @fn clear
+      * @brief 清空
+      * @return void
+      */
+    void clear();
+
+    /** @fn transition
+      * @brief 状态转移
+      * @param [in]state: 当前状态
+      * @param [in]code: 字符编号，见code()。Alphabet::kOther没有任何转移
+      * @return 转移后的状态，不存在返回-1
+      */
+    int transition(int state, uint16_t code) const {
+        size_t t = static_cast<size_t>(unit_data_[state].base >> 1) + code;
+        if (t < size_ && unit_data_[t].check == state) {
+            return static_cast<int>(t);
+        }
+        return -1;
+    }
+
+    /** @fn isTerminal
+      * @brief 该状态是否是某个敏感词的结尾
+      * @param [in]state: 状态
+      * @return bool
+      */
+    bool isTerminal(int state) const { return (unit_data_[state].base & 1) != 0; }
+
+    /** @fn wordId
+      * @brief 结尾状态对应的敏感词编号（insert的顺序），非结尾状态返回-1
+      * @param [in]state: 状态
+      * @return 敏感词编号
+      */
+    int wordId(int state) const { return word_id_data_[state]; }
+
+    bool empty() const { return size_ == 0; }
+
+    // 数组长度（包括空闲的槽位）
+    size_t size() const { return size_; }
+
+    // 有效状态数
+    size_t stateCount() const { return state_count_; }
+
+    // 数组和字符表占用的内存，单位字节，attach时为外部内存的大小
+    size_t memoryUsage() const { return size_ * (sizeof(Unit) + sizeof(int32_t)) + alphabet_.memoryUsage(); }
+
+    const Unit *units() const { return unit_data_; }
+
+    const int32_t *wordIds() const { return word_id_data_; }
+
+    const Alphabet &alphabet() const { return alphabet_; }
+
+private:
+    static const int32_t kFree = -1;
+
+    // 一个空闲槽位最多被尝试这么多次，之后从空闲链表中摘除，避免每次都从头扫描
+    static const uint8_t kMaxTrials = 16;
+
+    void reserve(size_t size);
+
+    size_t findBase(const std::vector<uint16_t> &codes);
+
+    // 从空闲链表中摘除，槽位被占用或者尝试次数太多时调用
+    void unlinkFree(size_t pos);
+
+private:
+    Alphabet alphabet_;
+
+    // 构建时使用，attach后为空
+    std::vector<Unit> units_;
+    std::vector<int32_t> word_ids_; // 只在命中时读取，和units_分开存放
+
+    // 空闲槽位的双向链表，按位置从小到大，findBase只遍历链表，不用扫描已经占用的槽位
+    std::vector<int32_t> free_next_;
+    std::vector<int32_t> free_prev_;
+    std::vector<uint8_t> trials_;
+    std::vector<bool> in_list_;
+    int32_t free_head_ = -1;
+    int32_t free_tail_ = -1;
+
+    // 查询时使用，指向units_/word_ids_或者外部内存
+    const Unit *unit_data_ = nullptr;
+    const int32_t *word_id_data_ = nullptr;
+    size_t size_ = 0;
+    size_t state_count_ = 0;
+};
+
+#endif //INC_01_TRIE_TREE_DOUBLE_ARRAY_H_
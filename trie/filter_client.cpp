@@ -0,0 +1,197 @@
+/** @file filter_client.cpp
+  * @brief dirtyfilter-server的客户端
+  * @author teng.qing
+  * @date 2021/8/9
+  */
+
+#include "filter_client.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+FilterClient::~FilterClient() { close(); }
+
+bool FilterClient::connect(const std::string &socket_path) {
+    close();
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+        return fail("bad socket path: " + socket_path);
+    }
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        return fail("connect " + socket_path + ": " + strerror(errno));
+    }
+    error_.clear();
+    return true;
+}
+
+void FilterClient::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    pending_ = 0;
+    out_.clear();
+    in_.clear();
+    in_pos_ = 0;
+}
+
+bool FilterClient::fail(const std::string &error) {
+    error_ = error;
+    close();
+    return false;
+}
+
+uint32_t FilterClient::send(FilterOp op, std::string_view text) {
+    uint32_t id = next_id_++;
+    appendFrame(out_, id, op, FilterStatus::kOk, text);
+    ++pending_;
+    return id;
+}
+
+bool FilterClient::flush() {
+    if (fd_ < 0) {
+        return fail(error_.empty() ? "not connected" : error_);
+    }
+    size_t pos = 0;
+    while (pos < out_.size()) {
+        ssize_t n = ::send(fd_, out_.data() + pos, out_.size() - pos, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return fail(std::string("send: ") + strerror(errno));
+        }
+        pos += static_cast<size_t>(n);
+    }
+    out_.clear();
+    return true;
+}
+
+bool FilterClient::receive(FilterResponse &response) {
+    if (pending_ == 0) {
+        error_ = "no pending request";
+        return false;
+    }
+    if (!out_.empty() && !flush()) {
+        return false;
+    }
+
+    FrameHeader header{};
+    for (;;) {
+        size_t total = peekFrame(in_.data() + in_pos_, in_.size() - in_pos_, header);
+        if (in_.size() - in_pos_ >= sizeof(FrameHeader) && header.length > kMaxFrameLength) {
+            return fail("response too large");
+        }
+        if (total > 0) {
+            response.requestId = header.requestId;
+            response.op = static_cast<FilterOp>(header.op);
+            response.status = static_cast<FilterStatus>(header.status);
+            response.body.assign(in_, in_pos_ + sizeof(FrameHeader), header.length);
+            in_pos_ += total;
+            if (in_pos_ == in_.size()) {
+                in_.clear();
+                in_pos_ = 0;
+            }
+            --pending_;
+            return true;
+        }
+
+        if (in_pos_ > 0) {
+            in_.erase(0, in_pos_);
+            in_pos_ = 0;
+        }
+        char buf[64 * 1024];
+        ssize_t n = read(fd_, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return fail(n == 0 ? "connection closed by server" : std::string("read: ") + strerror(errno));
+        }
+        in_.append(buf, static_cast<size_t>(n));
+    }
+}
+
+bool FilterClient::call(FilterOp op, std::string_view text, FilterResponse &response) {
+    if (pending_ > 0) {
+        error_ = "pipelined requests pending";
+        return false;
+    }
+    uint32_t id = send(op, text);
+    if (!receive(response)) {
+        return false;
+    }
+    if (response.requestId != id || response.op != op) {
+        return fail("unexpected response");
+    }
+    if (response.status != FilterStatus::kOk) {
+        error_ = "server status " + std::to_string(static_cast<int>(response.status));
+        return false;
+    }
+    return true;
+}
+
+bool FilterClient::ping(uint64_t &version) {
+    if (!call(FilterOp::kPing, std::string_view(), response_)) {
+        return false;
+    }
+    if (response_.body.size() != sizeof(version)) {
+        return fail("bad ping response");
+    }
+    memcpy(&version, response_.body.data(), sizeof(version));
+    return true;
+}
+
+bool FilterClient::search(std::string_view text, bool &found) {
+    if (!call(FilterOp::kSearch, text, response_)) {
+        return false;
+    }
+    if (response_.body.size() != 1) {
+        return fail("bad search response");
+    }
+    found = response_.body[0] != 0;
+    return true;
+}
+
+bool FilterClient::getSensitive(std::string_view text, std::vector<WireMatch> &matches) {
+    if (!call(FilterOp::kGetSensitive, text, response_)) {
+        return false;
+    }
+    if (!decodeMatches(response_.body, matches)) {
+        return fail("bad getSensitive response");
+    }
+    return true;
+}
+
+bool FilterClient::replaceSensitive(std::string_view text, std::string &result) {
+    if (!call(FilterOp::kReplaceSensitive, text, response_)) {
+        return false;
+    }
+    result.swap(response_.body);
+    return true;
+}
+
+bool FilterClient::decodeMatches(std::string_view body, std::vector<WireMatch> &matches) {
+    matches.clear();
+    uint32_t count;
+    if (body.size() < sizeof(count)) {
+        return false;
+    }
+    memcpy(&count, body.data(), sizeof(count));
+    if (body.size() != sizeof(count) + static_cast<size_t>(count) * sizeof(WireMatch)) {
+        return false;
+    }
+    matches.resize(count);
+    if (count > 0) {
+        memcpy(matches.data(), body.data() + sizeof(count), count * sizeof(WireMatch));
+    }
+    return true;
+}
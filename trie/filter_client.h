@@ -0,0 +1,144 @@
+/** @file filter_client.h
+  * @brief dirtyfilter-server的客户端，不依赖词库，只需要链接dirtyfilter_client
+  * @author teng.qing
+  * @date 2021/8/9
+  */
+
+#ifndef INC_01_TRIE_TREE_FILTER_CLIENT_H_
+#define INC_01_TRIE_TREE_FILTER_CLIENT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "filter_protocol.h"
+
+/** @struct FilterResponse
+  * @brief 一个响应，body的格式见FrameHeader
+  */
+struct FilterResponse {
+    uint32_t requestId = 0;
+    FilterOp op = FilterOp::kPing;
+    FilterStatus status = FilterStatus::kOk;
+    std::string body;
+};
+
+/** @class FilterClient
+  * @brief 一个连接，阻塞读写，不能被多个线程同时使用（每个线程一个FilterClient）
+  *
+  * 两种用法：
+  * 1. 同步：search/getSensitive/replaceSensitive，发送一个请求并等待它的响应
+  * 2. 流水线：连续send多个请求（先放在缓冲区，receive或flush时发出），再按顺序receive，
+  *    减少往返和系统调用。未收的请求不要太多（几百个以内），否则双方的socket缓冲区都满了会互相等待。
+  * 流水线中还有未收的响应时不能使用同步接口。
+  *
+  * 出错（连接断开、响应格式错误）后连接被关闭，error()为原因，可以重新connect。
+  */
+class FilterClient {
+public:
+    FilterClient() = default;
+
+    ~FilterClient();
+
+    FilterClient(const FilterClient &that) = delete;
+
+    FilterClient &operator=(const FilterClient &that) = delete;
+
+    /** @fn connect
+      * @brief 连接服务端，已经连接时先关闭
+      * @param [in]socket_path: socket路径
+      * @return 是否成功，失败原因见error()
+      */
+    bool connect(const std::string &socket_path = kDefaultSocketPath);
+
+    void close();
+
+    bool connected() const { return fd_ >= 0; }
+
+    // 最近一次失败的原因
+    const std::string &error() const { return error_; }
+
+    /** @fn ping
+      * @brief 检查服务端是否可用
+      * @param [out]version: 服务端词库的版本，每次热更新加1
+      * @return 是否成功
+      */
+    bool ping(uint64_t &version);
+
+    /** @fn search
+      * @brief 是否包含敏感词
+      * @param [in]text: utf8文本
+      * @param [out]found: 结果
+      * @return 是否成功
+      */
+    bool search(std::string_view text, bool &found);
+
+    /** @fn getSensitive
+      * @brief 命中的敏感词，text.substr(byteOffset, byteLength)为原文
+      * @param [in]text: utf8文本
+      * @param [out]matches: 结果
+      * @return 是否成功
+      */
+    bool getSensitive(std::string_view text, std::vector<WireMatch> &matches);
+
+    /** @fn replaceSensitive
+      * @brief 替换敏感词为*，每个字符一个*
+      * @param [in]text: utf8文本
+      * @param [out]result: 替换后的文本
+      * @return 是否成功
+      */
+    bool replaceSensitive(std::string_view text, std::string &result);
+
+    /** @fn send
+      * @brief 流水线：把请求放入发送缓冲区，不等响应
+      * @param [in]op: 请求类型
+      * @param [in]text: utf8文本
+      * @return 请求编号，和响应的requestId对应
+      */
+    uint32_t send(FilterOp op, std::string_view text);
+
+    /** @fn flush
+      * @brief 发出缓冲区中的请求
+      * @return 是否成功
+      */
+    bool flush();
+
+    /** @fn receive
+      * @brief 流水线：先flush，再等待下一个响应，响应的顺序和send的顺序相同
+      * @param [out]response: 响应
+      * @return 是否成功
+      */
+    bool receive(FilterResponse &response);
+
+    // 已经send还没有receive的请求数
+    size_t pending() const { return pending_; }
+
+    /** @fn decodeMatches
+      * @brief 解析kGetSensitive响应的内容
+      * @param [in]body: 响应内容
+      * @param [out]matches: 结果
+      * @return 格式是否正确
+      */
+    static bool decodeMatches(std::string_view body, std::vector<WireMatch> &matches);
+
+private:
+    // 同步调用：没有未收的请求时发送一个请求并等待响应，检查状态
+    bool call(FilterOp op, std::string_view text, FilterResponse &response);
+
+    // 记录错误原因并关闭连接
+    bool fail(const std::string &error);
+
+private:
+    int fd_ = -1;
+    uint32_t next_id_ = 1;
+    size_t pending_ = 0;
+    std::string out_;
+    std::string in_;
+    size_t in_pos_ = 0;
+    std::string error_;
+    FilterResponse response_; // 同步调用复用
+};
+
+#endif //INC_01_TRIE_TREE_FILTER_CLIENT_H_
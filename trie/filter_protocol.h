@@ -0,0 +1,108 @@
+/** @file filter_protocol.h
+  * @brief dirtyfilter-server和FilterClient之间的二进制协议，基于Unix domain socket
+  * @author teng.qing
+  * @date 2021/8/9
+  */
+
+#ifndef INC_01_TRIE_TREE_FILTER_PROTOCOL_H_
+#define INC_01_TRIE_TREE_FILTER_PROTOCOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/** @struct FrameHeader
+  * @brief 每个请求和响应都是 FrameHeader | 内容，length为内容的字节数
+  *
+  * 只在同一台机器的进程之间使用，所有整数都是本机字节序。
+  * 一个连接上可以连续发送多个请求（pipelining）不等响应，服务端按请求的顺序返回响应，requestId原样带回。
+  *
+  * 请求的内容都是utf8文本（kPing为空），响应的内容：
+  * - kPing：uint64_t 词库版本（TrieHolder::version）
+  * - kSearch：uint8_t 是否包含敏感词
+  * - kGetSensitive：uint32_t 个数 | WireMatch[个数]
+  * - kReplaceSensitive：替换后的utf8文本，每个字符替换为一个*
+  * status不为kOk时内容为空。
+  */
+struct FrameHeader {
+    uint32_t length;
+    uint32_t requestId;
+    uint8_t op;      // FilterOp
+    uint8_t status;  // FilterStatus，请求中为0
+    uint16_t reserved;
+};
+
+/** @enum FilterOp
+  * @brief 请求类型
+  */
+enum class FilterOp : uint8_t {
+    kPing = 0,
+    kSearch = 1,
+    kGetSensitive = 2,
+    kReplaceSensitive = 3,
+};
+
+/** @enum FilterStatus
+  * @brief 响应状态
+  */
+enum class FilterStatus : uint8_t {
+    kOk = 0,
+    kBadRequest = 1, // 未知的请求类型
+    kNotReady = 2,   // 服务端还没有加载词库
+};
+
+/** @struct WireMatch
+  * @brief kGetSensitive响应中的一个命中，byteOffset/byteLength为请求文本中的字节偏移
+  */
+struct WireMatch {
+    uint32_t byteOffset;
+    uint32_t byteLength;
+    uint32_t startIndex; // 第几个字符开始
+    uint32_t len;        // 字符数
+    int32_t wordId;      // 服务端词库中的敏感词编号，词库更新后会变化
+    uint32_t categories; // 见WordTag
+    uint32_t severity;
+};
+
+// 内容的最大长度，超过时服务端关闭连接
+const uint32_t kMaxFrameLength = 4u << 20;
+
+// 默认的socket路径
+const char kDefaultSocketPath[] = "/tmp/dirtyfilter.sock";
+
+/** @fn appendFrame
+  * @brief 在out后面追加一帧
+  * @param [in,out]out: 缓冲区
+  * @param [in]request_id: 请求编号
+  * @param [in]op: 请求类型
+  * @param [in]status: 响应状态，请求为kOk
+  * @param [in]body: 内容
+  * @return void
+  */
+inline void appendFrame(std::string &out, uint32_t request_id, FilterOp op, FilterStatus status,
+                        std::string_view body) {
+    FrameHeader header{static_cast<uint32_t>(body.size()), request_id, static_cast<uint8_t>(op),
+                       static_cast<uint8_t>(status), 0};
+    out.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.append(body.data(), body.size());
+}
+
+/** @fn peekFrame
+  * @brief 缓冲区开头是否已经有一个完整的帧
+  * @param [in]data: 缓冲区
+  * @param [in]size: 缓冲区长度
+  * @param [out]header: 帧头，缓冲区不足一个帧头时不变
+  * @return 完整帧的总长度（帧头+内容），不完整返回0
+  */
+inline size_t peekFrame(const char *data, size_t size, FrameHeader &header) {
+    if (size < sizeof(FrameHeader)) {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    size_t total = sizeof(FrameHeader) + header.length;
+    return size >= total ? total : 0;
+}
+
+#endif //INC_01_TRIE_TREE_FILTER_PROTOCOL_H_
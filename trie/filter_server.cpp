@@ -0,0 +1,379 @@
+/** @file filter_server.cpp
+  * @brief 本机过滤服务
+  * @author teng.qing
+  * @date 2021/8/9
+  */
+
+#include "filter_server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+#include <utility>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const uint64_t kListenId = 0;
+const uint64_t kWakeId = 1;
+
+// 每次read的长度
+const size_t kReadChunk = 64 * 1024;
+
+bool fail(std::string *error, const std::string &what) {
+    if (error != nullptr) {
+        *error = what + ": " + strerror(errno);
+    }
+    return false;
+}
+
+// search/getSensitive/replaceSensitive的响应体
+std::string encodeBody(const FrozenTrie &frozen, FilterOp op, std::string_view text) {
+    std::string body;
+    if (op == FilterOp::kSearch) {
+        body.push_back(frozen.search(text) ? 1 : 0);
+    } else if (op == FilterOp::kGetSensitive) {
+        uint32_t count = 0;
+        body.append(sizeof(count), '\0');
+        frozen.forEachSensitive(text, [&](const MatchSpan &span) {
+            const WordTag &tag = frozen.wordTag(span.wordId);
+            WireMatch match{static_cast<uint32_t>(span.offset), static_cast<uint32_t>(span.length),
+                            static_cast<uint32_t>(span.startIndex), static_cast<uint32_t>(span.len),
+                            span.wordId, tag.categories, tag.severity};
+            body.append(reinterpret_cast<const char *>(&match), sizeof(match));
+            ++count;
+            return true;
+        });
+        memcpy(&body[0], &count, sizeof(count));
+    } else {
+        body.assign(text.data(), text.size());
+        frozen.maskSensitive(body);
+    }
+    return body;
+}
+
+} // namespace
+
+FilterServer::FilterServer(std::shared_ptr<TrieHolder> holder, ServerOptions options)
+        : holder_(std::move(holder)), options_(std::move(options)), pool_(new ThreadPool(options_.threads)) {
+    if (options_.maxBatch == 0) {
+        options_.maxBatch = 1;
+    }
+}
+
+FilterServer::~FilterServer() {
+    // 先等线程池中的批处理完，它们会访问completed_和wake_fd_
+    pool_.reset();
+    for (auto &item : connections_) {
+        ::close(item.second->fd);
+    }
+    if (wake_fd_ >= 0) {
+        ::close(wake_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+        ::close(epoll_fd_);
+    }
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        unlink(options_.socketPath.c_str());
+    }
+}
+
+bool FilterServer::listen(std::string *error) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (options_.socketPath.empty() || options_.socketPath.size() >= sizeof(addr.sun_path)) {
+        if (error != nullptr) {
+            *error = "bad socket path: " + options_.socketPath;
+        }
+        return false;
+    }
+    memcpy(addr.sun_path, options_.socketPath.c_str(), options_.socketPath.size() + 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return fail(error, "socket");
+    }
+    unlink(options_.socketPath.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        bool ret = fail(error, "bind " + options_.socketPath);
+        ::close(fd);
+        return ret;
+    }
+    listen_fd_ = fd;
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0) {
+        return fail(error, "epoll");
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kListenId;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+    ev.data.u64 = kWakeId;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    return true;
+}
+
+void FilterServer::run() {
+    epoll_event events[64];
+    while (!stopping_.load()) {
+        int n = epoll_wait(epoll_fd_, events, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < n; ++i) {
+            uint64_t id = events[i].data.u64;
+            if (id == kListenId) {
+                accept();
+                continue;
+            }
+            if (id == kWakeId) {
+                uint64_t value;
+                if (read(wake_fd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                    break;
+                }
+                onCompleted();
+                continue;
+            }
+            // 同一次epoll_wait中前面的事件可能已经关闭了这个连接
+            auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                continue;
+            }
+            Connection &conn = *it->second;
+            if ((events[i].events & (EPOLLHUP | EPOLLERR)) != 0) {
+                // 对端已经完全关闭，响应没有人读了。只关闭写方向（shutdown）时为EPOLLIN + read返回0，见onReadable
+                close(conn);
+                continue;
+            }
+            if ((events[i].events & EPOLLIN) != 0 && !onReadable(conn)) {
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) != 0) {
+                onWritable(conn);
+            }
+        }
+    }
+
+    while (!connections_.empty()) {
+        close(*connections_.begin()->second);
+    }
+}
+
+void FilterServer::stop() {
+    stopping_ = true;
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0) {
+        // eventfd计数溢出时事件循环一定会被唤醒，忽略
+    }
+}
+
+void FilterServer::accept() {
+    for (;;) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN：没有更多连接；EMFILE等：下次可读时再试
+            return;
+        }
+        std::unique_ptr<Connection> conn(new Connection());
+        conn->fd = fd;
+        conn->id = next_id_++;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = conn->id;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            ::close(fd);
+            continue;
+        }
+        connections_[conn->id] = std::move(conn);
+        connection_count_++;
+    }
+}
+
+bool FilterServer::onReadable(Connection &conn) {
+    // 读到EAGAIN为止，但一次最多读maxPendingBytes，避免一个连接占住事件循环
+    size_t limit = conn.in.size() + options_.maxPendingBytes;
+    char buf[kReadChunk];
+    while (!conn.eof && conn.in.size() < limit) {
+        ssize_t n = read(conn.fd, buf, sizeof(buf));
+        if (n > 0) {
+            conn.in.append(buf, static_cast<size_t>(n));
+            continue;
+        }
+        if (n == 0) {
+            conn.eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN) {
+            close(conn);
+            return false;
+        }
+        break;
+    }
+    return dispatch(conn) && update(conn);
+}
+
+bool FilterServer::onWritable(Connection &conn) {
+    while (conn.outPos < conn.out.size()) {
+        ssize_t n = send(conn.fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.outPos += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && errno == EAGAIN) {
+            break;
+        } else {
+            close(conn);
+            return false;
+        }
+    }
+    if (conn.outPos == conn.out.size()) {
+        conn.out.clear();
+        conn.outPos = 0;
+    } else if (conn.outPos > conn.out.size() / 2) {
+        conn.out.erase(0, conn.outPos);
+        conn.outPos = 0;
+    }
+    // 发出去一部分后可能可以继续处理积压的请求
+    return dispatch(conn) && update(conn);
+}
+
+bool FilterServer::dispatch(Connection &conn) {
+    if (conn.busy || conn.out.size() - conn.outPos > options_.maxPendingBytes) {
+        return true;
+    }
+    size_t pos = 0;
+    size_t count = 0;
+    FrameHeader header{};
+    while (count < options_.maxBatch) {
+        size_t total = peekFrame(conn.in.data() + pos, conn.in.size() - pos, header);
+        if (conn.in.size() - pos >= sizeof(FrameHeader) && header.length > kMaxFrameLength) {
+            close(conn);
+            return false;
+        }
+        if (total == 0) {
+            break;
+        }
+        pos += total;
+        ++count;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    Batch *batch = new Batch();
+    batch->connection = conn.id;
+    batch->count = count;
+    if (pos == conn.in.size()) {
+        batch->requests.swap(conn.in);
+    } else {
+        batch->requests.assign(conn.in, 0, pos);
+        conn.in.erase(0, pos);
+    }
+    conn.busy = true;
+    batch_count_++;
+    pool_->post([this, batch](size_t) {
+        std::unique_ptr<Batch> owned(batch);
+        process(*owned);
+        {
+            std::lock_guard<std::mutex> lock(completed_mutex_);
+            completed_.push_back(std::move(owned));
+        }
+        uint64_t one = 1;
+        if (write(wake_fd_, &one, sizeof(one)) < 0) {
+            // 同stop()
+        }
+    });
+    return true;
+}
+
+bool FilterServer::update(Connection &conn) {
+    size_t pending = conn.out.size() - conn.outPos;
+    if (conn.eof && !conn.busy && pending == 0) {
+        // 对端不会再发请求，剩下的不完整的请求丢弃
+        close(conn);
+        return false;
+    }
+    bool reading = !conn.eof && pending <= options_.maxPendingBytes &&
+                   !(conn.busy && conn.in.size() >= options_.maxPendingBytes);
+    bool writing = pending > 0;
+    if (reading != conn.reading || writing != conn.writing) {
+        epoll_event ev{};
+        ev.events = (reading ? EPOLLIN : 0u) | (writing ? EPOLLOUT : 0u);
+        ev.data.u64 = conn.id;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &ev);
+        conn.reading = reading;
+        conn.writing = writing;
+    }
+    return true;
+}
+
+void FilterServer::onCompleted() {
+    std::vector<std::unique_ptr<Batch>> completed;
+    {
+        std::lock_guard<std::mutex> lock(completed_mutex_);
+        completed.swap(completed_);
+    }
+    for (auto &batch : completed) {
+        auto it = connections_.find(batch->connection);
+        if (it == connections_.end()) {
+            continue;
+        }
+        Connection &conn = *it->second;
+        conn.busy = false;
+        if (conn.out.empty()) {
+            conn.out.swap(batch->responses);
+        } else {
+            conn.out.append(batch->responses);
+        }
+        onWritable(conn);
+    }
+}
+
+void FilterServer::process(Batch &batch) {
+    std::shared_ptr<const FrozenTrie> snapshot = holder_->get();
+    std::string &out = batch.responses;
+    std::string body;
+    FrameHeader header{};
+    for (size_t pos = 0; pos < batch.requests.size();) {
+        size_t total = peekFrame(batch.requests.data() + pos, batch.requests.size() - pos, header);
+        std::string_view text(batch.requests.data() + pos + sizeof(FrameHeader), header.length);
+        pos += total;
+
+        auto op = static_cast<FilterOp>(header.op);
+        body.clear();
+        FilterStatus status = FilterStatus::kOk;
+        if (op == FilterOp::kPing) {
+            uint64_t version = holder_->version();
+            body.append(reinterpret_cast<const char *>(&version), sizeof(version));
+        } else if (op != FilterOp::kSearch && op != FilterOp::kGetSensitive && op != FilterOp::kReplaceSensitive) {
+            status = FilterStatus::kBadRequest;
+        } else if (snapshot == nullptr) {
+            status = FilterStatus::kNotReady;
+        } else if (options_.cache != nullptr) {
+            body = options_.cache->cached(static_cast<uint8_t>(ResultCache::kCustomKind + header.op), *snapshot, text,
+                                          [&]() { return encodeBody(*snapshot, op, text); });
+        } else {
+            body = encodeBody(*snapshot, op, text);
+        }
+        appendFrame(out, header.requestId, op, status, body);
+    }
+    request_count_ += batch.count;
+}
+
+void FilterServer::close(Connection &conn) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn.fd, nullptr);
+    ::close(conn.fd);
+    connection_count_--;
+    connections_.erase(conn.id);
+}
@@ -0,0 +1,154 @@
+/** @file filter_server.h
+  * @brief 本机过滤服务：一个进程常驻词库，同一台机器上的其他进程通过Unix domain socket调用
+  * @author teng.qing
+  * @date 2021/8/9
+  */
+
+#ifndef INC_01_TRIE_TREE_FILTER_SERVER_H_
+#define INC_01_TRIE_TREE_FILTER_SERVER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "filter_protocol.h"
+#include "result_cache.h"
+#include "thread_pool.h"
+#include "trie_holder.h"
+
+/** @struct ServerOptions
+  * @brief FilterServer的参数
+  */
+struct ServerOptions {
+    std::string socketPath = kDefaultSocketPath;
+    size_t threads = 0;                  // 工作线程数，0为CPU核数
+    size_t maxBatch = 256;               // 每批最多多少个请求
+    size_t maxPendingBytes = 4u << 20;   // 一个连接未发出的响应超过这么多字节时暂停读取，直到客户端读走
+    std::shared_ptr<ResultCache> cache;  // 结果缓存，为空时不缓存。缓存的是响应体，词库重新加载后自动失效
+};
+
+/** @class FilterServer
+  * @brief epoll事件循环 + 工作线程池
+  *
+  * 事件循环线程（调用run()的线程）只做读写和拆帧：每次读到数据后，把这个连接上已经完整的请求（最多maxBatch个）
+  * 打成一批交给线程池，工作线程用TrieHolder的当前快照处理整批请求并编码响应，再通过eventfd通知事件循环写回。
+  * 每个连接同时最多一批在处理，处理期间新到的请求累积到下一批，所以负载越高批越大，响应顺序和请求一致。
+  *
+  * 词库通过TrieHolder热更新，已经开始处理的批使用旧版本，之后的批使用新版本。
+  *
+  * 用法：
+  * @code
+  * auto holder = std::make_shared<TrieHolder>();
+  * holder->reload("word.txt", "stopwd.txt");
+  * FilterServer server(holder);
+  * if (server.listen(&error)) {
+  *     server.run(); // 另一个线程调用server.stop()后返回
+  * }
+  * @endcode
+  */
+class FilterServer {
+public:
+    FilterServer(std::shared_ptr<TrieHolder> holder, ServerOptions options = ServerOptions());
+
+    ~FilterServer();
+
+    FilterServer(const FilterServer &that) = delete;
+
+    FilterServer &operator=(const FilterServer &that) = delete;
+
+    /** @fn listen
+      * @brief 创建socket并开始监听，socket文件已经存在时先删除
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 是否成功
+      */
+    bool listen(std::string *error = nullptr);
+
+    /** @fn run
+      * @brief 运行事件循环，直到stop()，返回前关闭所有连接
+      * @return void
+      */
+    void run();
+
+    /** @fn stop
+      * @brief 让run()返回，可以在任意线程调用
+      * @return void
+      */
+    void stop();
+
+    // 当前连接数
+    size_t connectionCount() const { return connection_count_.load(); }
+
+    // 处理过的请求数
+    uint64_t requestCount() const { return request_count_.load(); }
+
+    // 提交给线程池的批数，requestCount()/batchCount()为平均每批的请求数
+    uint64_t batchCount() const { return batch_count_.load(); }
+
+    const ServerOptions &options() const { return options_; }
+
+private:
+    struct Connection {
+        int fd = -1;
+        uint64_t id = 0;
+        std::string in;       // 收到还没有处理的数据
+        std::string out;      // 还没有发出的响应
+        size_t outPos = 0;
+        bool busy = false;    // 有一批请求正在线程池中处理
+        bool reading = true;  // epoll是否关注EPOLLIN
+        bool writing = false; // epoll是否关注EPOLLOUT
+        bool eof = false;     // 对端已经关闭写
+    };
+
+    struct Batch {
+        uint64_t connection;
+        std::string requests; // 若干个完整的请求帧
+        std::string responses;
+        size_t count = 0;
+    };
+
+    void accept();
+
+    // 以下返回false表示连接已经关闭，conn不能再使用
+    bool onReadable(Connection &conn);
+
+    bool onWritable(Connection &conn);
+
+    // 连接空闲时把已经完整的请求打成一批交给线程池，请求过长时关闭连接
+    bool dispatch(Connection &conn);
+
+    // 按连接当前状态更新epoll关注的事件，响应都发出并且对端已关闭时关闭连接
+    bool update(Connection &conn);
+
+    void onCompleted();
+
+    // 在工作线程中执行
+    void process(Batch &batch);
+
+    void close(Connection &conn);
+
+private:
+    std::shared_ptr<TrieHolder> holder_;
+    ServerOptions options_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1; // eventfd，工作线程完成一批或stop()时写入
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> connection_count_{0};
+    std::atomic<uint64_t> request_count_{0};
+    std::atomic<uint64_t> batch_count_{0};
+    uint64_t next_id_ = 2; // epoll_event.data.u64：0为监听socket，1为wake_fd_，之后为连接
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+
+    std::mutex completed_mutex_;
+    std::vector<std::unique_ptr<Batch>> completed_;
+
+    // 最后声明，最先析构：析构时等所有任务执行完，任务会访问上面的成员
+    std::unique_ptr<ThreadPool> pool_;
+};
+
+#endif //INC_01_TRIE_TREE_FILTER_SERVER_H_
@@ -0,0 +1,168 @@
+/** @file fold_table.cpp
+  * @brief 字符归一化表
+  * @author teng.qing
+  * @date 2021/7/30
+  */
+
+#include "fold_table.h"
+#include "sbc_convert.h"
+#include "text_codec.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+const size_t FoldTable::kBmpSize;
+
+namespace {
+
+const uint32_t kMaxUnicode = 0x10FFFF;
+
+void setError(std::string *error, const std::string &msg) {
+    if (error != nullptr) {
+        *error = msg;
+    }
+}
+
+std::string hexCode(uint32_t c) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "U+%04X", c);
+    return buf;
+}
+
+// 解析一个字符：utf8的单个字符或者U+XXXX
+bool parseChar(const std::string &token, uint32_t &c) {
+    if (token.size() > 2 && (token[0] == 'U' || token[0] == 'u') && token[1] == '+') {
+        char *end = nullptr;
+        unsigned long value = strtoul(token.c_str() + 2, &end, 16);
+        if (*end != '\0' || value > kMaxUnicode) {
+            return false;
+        }
+        c = static_cast<uint32_t>(value);
+        return true;
+    }
+    if (token.empty()) {
+        return false;
+    }
+    size_t n;
+    c = decodeUtf8(token.data(), token.data() + token.size(), n);
+    return n == token.size() && (c != kReplacementChar || token == "\xEF\xBF\xBD");
+}
+
+// 默认规则
+uint32_t defaultFold(uint32_t c) {
+    return c < SBCConvert::kFoldTableSize ? SBCConvert::kFoldTable[c] : c;
+}
+
+} // namespace
+
+FoldTable::FoldTable() : bmp_data_(SBCConvert::kFoldTable.data()) {}
+
+std::shared_ptr<const FoldTable> FoldTable::defaultTable() {
+    static const std::shared_ptr<const FoldTable> table = std::make_shared<FoldTable>();
+    return table;
+}
+
+bool FoldTable::addMappingFile(const std::string &file_name, std::string *error) {
+    std::ifstream ifs(file_name, std::ios_base::in);
+    if (!ifs) {
+        setError(error, "open " + file_name + " failed");
+        return false;
+    }
+
+    std::unordered_map<uint32_t, uint32_t> mapping;
+    std::string line;
+    int line_no = 0;
+    while (getline(ifs, line)) {
+        ++line_no;
+        std::istringstream tokens(line);
+        std::string from_token;
+        std::string to_token;
+        if (!(tokens >> from_token) || from_token[0] == '#') {
+            continue;
+        }
+        uint32_t from;
+        uint32_t to;
+        if (!(tokens >> to_token) || !parseChar(from_token, from) || !parseChar(to_token, to)) {
+            setError(error, file_name + ":" + std::to_string(line_no) + ": expect \"<char> <char>\"");
+            return false;
+        }
+        mapping.emplace(from, to);
+    }
+
+    std::string msg;
+    if (!addMapping(mapping, &msg)) {
+        setError(error, file_name + ": " + msg);
+        return false;
+    }
+    return true;
+}
+
+bool FoldTable::addMapping(const std::unordered_map<uint32_t, uint32_t> &mapping, std::string *error) {
+    for (auto &item : mapping) {
+        if (item.first > kMaxUnicode || item.second > kMaxUnicode) {
+            setError(error, "code point out of range");
+            return false;
+        }
+        if (item.first < kBmpSize && item.second >= kBmpSize) {
+            setError(error, hexCode(item.first) + " -> " + hexCode(item.second) +
+                            ": BMP characters can only map to BMP characters");
+            return false;
+        }
+    }
+
+    // 本阶段：先映射，再执行一次默认规则
+    auto stage = [&](uint32_t c) {
+        auto it = mapping.find(c);
+        return defaultFold(it == mapping.end() ? c : it->second);
+    };
+
+    std::vector<uint16_t> bmp(kBmpSize);
+    for (uint32_t c = 0; c < kBmpSize; ++c) {
+        bmp[c] = static_cast<uint16_t>(stage(bmp_data_[c]));
+    }
+
+    // 结果可能变化的BMP之外的字符：之前已经有映射的，和本阶段的原字符
+    std::vector<uint32_t> keys;
+    for (auto &item : astral_) {
+        keys.push_back(item.first);
+    }
+    for (auto &item : mapping) {
+        if (item.first >= kBmpSize) {
+            keys.push_back(item.first);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    std::vector<std::pair<uint32_t, uint32_t>> astral;
+    for (uint32_t c : keys) {
+        uint32_t r = stage(fold(c));
+        if (r != c) {
+            astral.emplace_back(c, r);
+        }
+    }
+
+    bmp_ = std::move(bmp);
+    bmp_data_ = bmp_.data();
+    astral_ = std::move(astral);
+    ascii_default_ = true;
+    for (uint32_t c = 0; c < kBmpSize; ++c) {
+        bool simd_range = c < 0x80 || (c >= 0xFF01 && c <= 0xFF5E);
+        if (simd_range && bmp_data_[c] != SBCConvert::kFoldTable[c]) {
+            ascii_default_ = false;
+            break;
+        }
+    }
+    stages_++;
+    return true;
+}
+
+uint32_t FoldTable::foldAstral(uint32_t c) const {
+    auto it = std::lower_bound(astral_.begin(), astral_.end(), c,
+                               [](const std::pair<uint32_t, uint32_t> &item, uint32_t code) {
+                                   return item.first < code;
+                               });
+    return it != astral_.end() && it->first == c ? it->second : c;
+}
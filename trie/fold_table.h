@@ -0,0 +1,104 @@
+/** @file fold_table.h
+  * @brief 字符归一化表：默认的全角转半角、大写转小写，加上从映射文件加载的规则（繁转简、形近字母、带圈数字等）
+  * @author teng.qing
+  * @date 2021/7/30
+  */
+
+#ifndef INC_01_TRIE_TREE_FOLD_TABLE_H_
+#define INC_01_TRIE_TREE_FOLD_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** @class FoldTable
+  * @brief 预先合成的字符转换表，insert和匹配都使用同一张表，每个字符只需要查一次表
+  *
+  * 规则按阶段叠加：默认规则（SBCConvert::kFoldTable）之后依次执行每个映射文件，每个阶段之后再执行一次默认规则，
+  * 例如西里尔字母"А"先映射为"A"，再转为小写"a"。所有阶段在加载时合成一张表，阶段数不影响匹配速度。
+  *
+  * 映射文件为utf8，每行"原字符 目标字符"，以空白分隔，#开头为注释。字符可以写成U+XXXX。
+  * 每个阶段的输入是前面所有规则转换之后的字符，所以映射文件里的原字符应该写小写和半角形式。
+  * 一行有多个目标字符时（如OpenCC的TSCharacters.txt）取第一个。
+  * 只支持单个字符到单个字符的映射，转换前后的长度不变，命中位置可以直接对应到原文；
+  * BMP内的字符只能映射到BMP内，BMP之外的字符（如数学字母𝐀）可以映射到任意字符。
+  *
+  * 构造后只读，一般通过 std::shared_ptr<const FoldTable> 在Trie和FrozenTrie之间共享。
+  */
+class FoldTable {
+public:
+    static const size_t kBmpSize = 65536;
+
+    // 只有默认规则，直接使用SBCConvert::kFoldTable，不复制
+    FoldTable();
+
+    FoldTable(const FoldTable &that) = delete;
+
+    FoldTable &operator=(const FoldTable &that) = delete;
+
+    /** @fn defaultTable
+      * @brief 只有默认规则的表，所有使用默认规则的Trie共享
+      * @return 默认表
+      */
+    static std::shared_ptr<const FoldTable> defaultTable();
+
+    /** @fn addMappingFile
+      * @brief 从映射文件加载一个阶段，叠加在已有规则之后
+      * @param [in]file_name: 映射文件
+      * @param [out]error: 失败原因（文件无法打开、第几行格式错误），可以为nullptr
+      * @return 是否成功，失败时表不变
+      */
+    bool addMappingFile(const std::string &file_name, std::string *error = nullptr);
+
+    /** @fn addMapping
+      * @brief 同上，映射直接由参数给出
+      * @param [in]mapping: 原字符 -> 目标字符
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 是否成功，BMP内的字符映射到BMP之外时失败，表不变
+      */
+    bool addMapping(const std::unordered_map<uint32_t, uint32_t> &mapping, std::string *error = nullptr);
+
+    /** @fn fold
+      * @brief 转换一个字符
+      * @param [in]c: unicode
+      * @return 转换后的unicode
+      */
+    uint32_t fold(uint32_t c) const {
+        if (c < kBmpSize) {
+            return bmp_data_[c];
+        }
+        return astral_.empty() ? c : foldAstral(c);
+    }
+
+    // BMP的转换表，kBmpSize个
+    const uint16_t *bmp() const { return bmp_data_; }
+
+    // BMP之外的映射，按原字符有序，每项为 {原字符, 目标字符}
+    const std::vector<std::pair<uint32_t, uint32_t>> &astral() const { return astral_; }
+
+    // ASCII和全角ASCII的规则是否和默认规则相同，相同时SBCConvert::normalize可以用SIMD批量转换
+    bool asciiDefault() const { return ascii_default_; }
+
+    // 已经叠加的阶段数
+    size_t stageCount() const { return stages_; }
+
+    // 占用的内存，单位字节，默认表不占用
+    size_t memoryUsage() const {
+        return bmp_.capacity() * sizeof(uint16_t) + astral_.capacity() * sizeof(std::pair<uint32_t, uint32_t>);
+    }
+
+private:
+    uint32_t foldAstral(uint32_t c) const;
+
+private:
+    std::vector<uint16_t> bmp_;      // 有映射文件时的转换表，默认规则时为空
+    const uint16_t *bmp_data_;       // 指向bmp_或者SBCConvert::kFoldTable
+    std::vector<std::pair<uint32_t, uint32_t>> astral_;
+    bool ascii_default_ = true;
+    size_t stages_ = 0;
+};
+
+#endif //INC_01_TRIE_TREE_FOLD_TABLE_H_
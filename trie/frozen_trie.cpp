@@ -0,0 +1,458 @@
+/** @file frozen_trie.cpp
+  * @brief 只读的敏感词匹配器
+  * @author teng.qing
+  * @date 2021/7/8
+  */
+
+#include "frozen_trie.h"
+#include "layout_profile.h"
+#include "sbc_convert.h"
+#include "text_codec.h"
+#include "trie_arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+std::atomic<uint64_t> g_generation{0};
+
+} // namespace
+
+FrozenTrie::FrozenTrie(const TrieArena &trie, const std::unordered_set<uint32_t> &stop_words, MatchMode mode,
+                       std::shared_ptr<const FoldTable> fold, std::vector<WordTag> tags, const LayoutProfile *profile)
+        : stop_words_(DictFile::kStopWordsWords, 0), mode_(mode), fold_(std::move(fold)),
+          tag_storage_(std::move(tags)), generation_(++g_generation) {
+    tag_storage_.resize(std::max(tag_storage_.size(), trie.wordCount()));
+    tags_ = tag_storage_.data();
+    word_count_ = tag_storage_.size();
+    if (profile != nullptr) {
+        std::vector<uint64_t> weights = profile->nodeWeights(trie);
+        dat_.build(trie, &weights);
+    } else {
+        dat_.build(trie);
+    }
+    ac_.build(trie, dat_);
+    setStopWords(stop_words);
+    prefilter_.build(dat_, stop_words_.data());
+#ifdef DIRTYFILTER_METRICS
+    initMetrics();
+#endif
+}
+
+FrozenTrie::FrozenTrie(std::shared_ptr<const DictFile> dict, const std::unordered_set<uint32_t> &stop_words,
+                       MatchMode mode, std::shared_ptr<const FoldTable> fold)
+        : stop_words_(DictFile::kStopWordsWords, 0), mode_(mode), fold_(std::move(fold)), dict_(std::move(dict)),
+          generation_(++g_generation) {
+    const DictHeader &h = dict_->header();
+    tags_ = dict_->wordTags();
+    word_count_ = h.wordCount;
+    dat_.attach(dict_->units(), dict_->wordIds(), h.size, h.stateCount, dict_->bmp(), dict_->astral(), h.astralCount,
+                h.alphabetSize);
+    ac_.attach(dat_, dict_->nodes(), static_cast<int>(h.maxDepth));
+    setStopWords(stop_words);
+    prefilter_.build(dat_, stop_words_.data());
+#ifdef DIRTYFILTER_METRICS
+    initMetrics();
+#endif
+}
+
+void FrozenTrie::setStopWords(const std::unordered_set<uint32_t> &stop_words) {
+    for (uint32_t code : stop_words) {
+        if (dat_.code(code) != Alphabet::kOther) {
+            stop_in_words_ = true;
+        }
+        if (code < Alphabet::kBmpSize) {
+            stop_words_[code >> 6] |= uint64_t(1) << (code & 63);
+        } else {
+            astral_stop_words_.push_back(code);
+        }
+    }
+    std::sort(astral_stop_words_.begin(), astral_stop_words_.end());
+}
+
+bool FrozenTrie::isAstralStopWord(uint32_t unicode) const {
+    return std::binary_search(astral_stop_words_.begin(), astral_stop_words_.end(), unicode);
+}
+
+size_t FrozenTrie::memoryUsage() const {
+    return dat_.memoryUsage() + ac_.memoryUsage() + stop_words_.capacity() * sizeof(uint64_t) +
+           astral_stop_words_.capacity() * sizeof(uint32_t) + prefilter_.memoryUsage() + fold_->memoryUsage() +
+           tag_storage_.capacity() * sizeof(WordTag);
+}
+
+template<typename Text>
+int FrozenTrie::getSensitiveLength(const Text &text, size_t offset, size_t &end, int &word_id) const {
+    int state = DoubleArray::kRoot;
+    int wordLen = 0;
+
+    uint32_t c;
+    while (text.decode(offset, c)) {
+        uint32_t unicode = text.fold(c);
+        int next = dat_.transition(state, dat_.code(unicode));
+        if (next < 0) {
+            // 如果是停顿词，直接往下继续查找
+            if (isStopWord(unicode)) {
+                ++wordLen;
+                continue;
+            }
+            return 0;
+        }
+
+        ++wordLen;
+        // 结尾标识已经编译到状态里，不需要再查一次kEndFlag
+        if (dat_.isTerminal(next)) {
+            end = offset;
+            word_id = dat_.wordId(next);
+            return wordLen;
+        }
+        state = next;
+    }
+
+    // 没找到尾巴
+    return 0;
+}
+
+template<typename Text>
+bool FrozenTrie::searchText(const Text &text) const {
+    size_t offset = 0;
+    size_t end;
+    int word_id;
+    int index = 0;
+    uint32_t c = 0;
+
+    if (mode_ == MatchMode::kTrie || stop_in_words_) {
+        // 以停顿词开头的命中，从后面的首字符开始也一定命中，只需要检查首字符
+        while ((offset = text.skip(offset, prefilter_, index)) < text.size()) {
+            size_t pos = offset;
+            text.decode(offset, c);
+            if (dat_.transition(DoubleArray::kRoot, dat_.code(text.fold(c))) >= 0 &&
+                getSensitiveLength(text, pos, end, word_id) > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int state = DoubleArray::kRoot;
+    while (true) {
+        if (state == DoubleArray::kRoot) {
+            offset = text.skip(offset, prefilter_, index);
+        }
+        if (!text.decode(offset, c)) {
+            break;
+        }
+        uint32_t unicode = text.fold(c);
+        uint16_t code = dat_.code(unicode);
+        if (dat_.transition(state, code) < 0 && isStopWord(unicode)) {
+            continue;
+        }
+        state = ac_.next(state, code);
+        if (ac_.output(state) >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef DIRTYFILTER_METRICS
+
+void FrozenTrie::initMetrics() {
+    for (size_t state = 0; state < dat_.size(); ++state) {
+        int id = dat_.wordId(static_cast<int>(state));
+        if (id >= 0) {
+            word_states_.resize(std::max(word_states_.size(), static_cast<size_t>(id) + 1), DoubleArray::kRoot);
+            word_states_[id] = static_cast<int32_t>(state);
+        }
+    }
+    metrics_.reset(new Metrics(word_states_.size()));
+}
+
+MetricsSnapshot FrozenTrie::metrics() const {
+    // 字符编号 -> 字符
+    const Alphabet &alphabet = dat_.alphabet();
+    std::vector<uint32_t> symbols(alphabet.size(), 0);
+    for (uint32_t c = 0; c < Alphabet::kBmpSize; ++c) {
+        if (alphabet.bmp()[c] != Alphabet::kOther) {
+            symbols[alphabet.bmp()[c]] = c;
+        }
+    }
+    for (size_t i = 0; i < alphabet.astralCount(); ++i) {
+        symbols[alphabet.astral()[i].id] = alphabet.astral()[i].code;
+    }
+
+    // 从结尾状态沿check回到根节点，还原出敏感词
+    const DoubleArray::Unit *units = dat_.units();
+    return metrics_->snapshot([&](int word_id) {
+        std::wstring word;
+        for (int state = word_states_[word_id]; state != DoubleArray::kRoot; state = units[state].check) {
+            int parent = units[state].check;
+            word += static_cast<wchar_t>(symbols[state - (units[parent].base >> 1)]);
+        }
+        std::reverse(word.begin(), word.end());
+        return SBCConvert::ws2s(word);
+    });
+}
+
+#else
+
+MetricsSnapshot FrozenTrie::metrics() const { return MetricsSnapshot(); }
+
+#endif
+
+template<typename Text, typename Emit>
+void FrozenTrie::scanText(const Text &text, Emit &&emit) const {
+#ifdef DIRTYFILTER_METRICS
+    Metrics::Shard &shard = metrics_->local();
+    Metrics::ScanTimer timer(shard, text.size());
+    scanSpans(text, [&](const MatchSpan &span) {
+        countHit(shard, span);
+        return emit(span);
+    });
+#else
+    scanSpans(text, emit);
+#endif
+}
+
+template<typename Text, typename Emit>
+void FrozenTrie::scanSpans(const Text &text, Emit &&emit) const {
+    size_t offset = 0;
+    int index = 0;
+    uint32_t c = 0;
+
+    // 停顿词也出现在敏感词里时，AC自动机只看当前（最长）状态决定是否跳过停顿词，会漏掉从其他起点开始的敏感词
+    if (mode_ == MatchMode::kTrie || stop_in_words_) {
+        size_t end;
+        int word_id;
+        // 当前这段连续停顿词的开始位置。从这里开始匹配，和从后面第一个首字符开始匹配的结果只差前面的停顿词，
+        // 所以只需要在首字符处匹配，命中后再把前面的停顿词算进去
+        size_t run_offset = 0;
+        int run_index = 0;
+        while (offset < text.size()) {
+            size_t next = text.skip(offset, prefilter_, index);
+            if (next != offset) {
+                offset = next;
+                run_offset = next;
+                run_index = index;
+                if (offset >= text.size()) {
+                    break;
+                }
+            }
+
+            size_t pos = offset;
+            text.decode(offset, c);
+            uint32_t unicode = text.fold(c);
+            if (dat_.transition(DoubleArray::kRoot, dat_.code(unicode)) >= 0) {
+                int wordLen = getSensitiveLength(text, pos, end, word_id);
+                if (wordLen > 0) {
+                    int len = wordLen + (index - run_index);
+                    if (!emit(MatchSpan{run_offset, end - run_offset, run_index, len, word_id})) {
+                        return;
+                    }
+                    offset = end;
+                    index = run_index + len;
+                } else {
+                    ++index;
+                }
+                run_offset = offset;
+                run_index = index;
+            } else if (isStopWord(unicode)) {
+                ++index;
+            } else {
+                ++index;
+                run_offset = offset;
+                run_index = index;
+            }
+        }
+        return;
+    }
+
+    // 回调返回false后不再输出，并尽快结束扫描
+    bool stopped = false;
+    auto guard = [&](const MatchSpan &span) {
+        if (!stopped && !emit(span)) {
+            stopped = true;
+        }
+    };
+
+    AhoCorasick::Scanner scanner(ac_);
+    size_t start = 0;
+    while (!stopped) {
+        // 没有匹配中的状态时，跳过的字符不会影响结果，只需要告诉scanner敏感词不能从这些字符之前开始
+        if (scanner.idle()) {
+            size_t next = text.skip(offset, prefilter_, index);
+            if (next != offset) {
+                offset = next;
+                scanner.barrier(index, offset);
+            }
+        }
+        start = offset;
+        if (!text.decode(offset, c)) {
+            break;
+        }
+        uint32_t unicode = text.fold(c);
+        scanner.push(dat_.code(unicode), isStopWord(unicode), index, start, offset, guard);
+        ++index;
+    }
+    if (!stopped) {
+        scanner.finish(guard);
+    }
+}
+
+void FrozenTrie::forEachSensitive(const std::wstring &word, MatchVisitor &visitor) const {
+    scanText(WideText(word, *fold_), [&](const MatchSpan &span) { return visitor.onMatch(span); });
+}
+
+void FrozenTrie::forEachSensitive(std::string_view text, MatchVisitor &visitor) const {
+    scanText(Utf8Text(text, *fold_), [&](const MatchSpan &span) { return visitor.onMatch(span); });
+}
+
+size_t FrozenTrie::maskSensitive(char *data, size_t size, MaskMode mode, char mask) const {
+    if (mode == MaskMode::kPreserveBytes) {
+        scanText(Utf8Text(std::string_view(data, size), *fold_), [&](const MatchSpan &span) {
+            memset(data + span.offset, mask, span.length);
+            return true;
+        });
+        return size;
+    }
+
+    // 回调时命中结尾之前的内容都已经读过，之后只会读后面的字节，所以可以一边扫描一边向前移动
+    size_t out = 0;
+    size_t last = 0;
+    scanText(Utf8Text(std::string_view(data, size), *fold_), [&](const MatchSpan &span) {
+        memmove(data + out, data + last, span.offset - last);
+        out += span.offset - last;
+        memset(data + out, mask, span.len);
+        out += span.len;
+        last = span.offset + span.length;
+        return true;
+    });
+    memmove(data + out, data + last, size - last);
+    return out + size - last;
+}
+
+template<typename Text>
+SensitiveScore FrozenTrie::scoreText(const Text &text, uint32_t categories, uint64_t threshold) const {
+    SensitiveScore ret;
+    scanText(text, [&](const MatchSpan &span) {
+        const WordTag &tag = tags_[span.wordId];
+        if ((tag.categories & categories) == 0) {
+            return true;
+        }
+        ret.score += tag.severity;
+        ret.categories |= tag.categories & categories;
+        ret.hits++;
+        ret.reached = threshold > 0 && ret.score >= threshold;
+        return !ret.reached;
+    });
+    return ret;
+}
+
+// 不预先转换整个文本，提前结束时后面的部分不需要处理
+SensitiveScore FrozenTrie::score(const std::wstring &word, uint32_t categories, uint64_t threshold) const {
+    return scoreText(WideText(word, *fold_), categories, threshold);
+}
+
+SensitiveScore FrozenTrie::score(std::string_view text, uint32_t categories, uint64_t threshold) const {
+    return scoreText(Utf8Text(text, *fold_), categories, threshold);
+}
+
+namespace {
+
+// 先批量转换再匹配，kTrie模式下每个字符会被匹配多次，只需要转换一次
+std::wstring normalized(const std::wstring &word, const FoldTable &fold) {
+    std::wstring ret(word.size(), L'\0');
+    SBCConvert::normalize(word.data(), word.size(), &ret[0], fold);
+    return ret;
+}
+
+} // namespace
+
+// search找到第一个就返回，不知道是哪个敏感词，只统计扫描
+bool FrozenTrie::search(const std::wstring &word) const {
+#ifdef DIRTYFILTER_METRICS
+    Metrics::ScanTimer timer(metrics_->local(), word.size());
+#endif
+    std::wstring text = normalized(word, *fold_);
+    return searchText(NormalizedWideText(text));
+}
+
+bool FrozenTrie::search(std::string_view text) const {
+#ifdef DIRTYFILTER_METRICS
+    Metrics::ScanTimer timer(metrics_->local(), text.size());
+#endif
+    return searchText(Utf8Text(text, *fold_));
+}
+
+bool FrozenTrie::startsWith(const std::wstring &prefix) const {
+    int state = DoubleArray::kRoot;
+    for (wchar_t item : prefix) {
+        state = dat_.transition(state, dat_.code(fold_->fold(static_cast<uint32_t>(item))));
+        if (state < 0)
+            return false;
+    }
+    return true;
+}
+
+std::set<SensitiveWord> FrozenTrie::getSensitive(const std::wstring &word) const {
+    std::set<SensitiveWord> sensitiveSet;
+    std::wstring text = normalized(word, *fold_);
+    scanText(NormalizedWideText(text), [&](const MatchSpan &span) {
+        SensitiveWord wordObj;
+        wordObj.word = word.substr(span.offset, span.length);
+        wordObj.startIndex = span.startIndex;
+        wordObj.len = span.len;
+        sensitiveSet.insert(wordObj);
+        return true;
+    });
+    return sensitiveSet;
+}
+
+std::set<Utf8SensitiveWord> FrozenTrie::getSensitive(std::string_view text) const {
+    std::set<Utf8SensitiveWord> sensitiveSet;
+    scanText(Utf8Text(text, *fold_), [&](const MatchSpan &span) {
+        Utf8SensitiveWord wordObj;
+        wordObj.word = std::string(text.substr(span.offset, span.length));
+        wordObj.startIndex = span.startIndex;
+        wordObj.len = span.len;
+        wordObj.byteOffset = span.offset;
+        wordObj.byteLen = span.length;
+        sensitiveSet.insert(wordObj);
+        return true;
+    });
+    return sensitiveSet;
+}
+
+std::wstring FrozenTrie::replaceSensitive(const std::wstring &word) const {
+    std::wstring scratch;
+    return replaceSensitive(word, scratch);
+}
+
+std::wstring FrozenTrie::replaceSensitive(const std::wstring &word, std::wstring &scratch) const {
+    std::wstring ret = word;
+    scratch.resize(word.size());
+    SBCConvert::normalize(word.data(), word.size(), &scratch[0], *fold_);
+    scanText(NormalizedWideText(scratch), [&](const MatchSpan &span) {
+        for (size_t i = span.offset; i < span.offset + span.length; ++i) {
+            ret[i] = L'*';
+        }
+        return true;
+    });
+    return ret;
+}
+
+std::string FrozenTrie::replaceSensitive(std::string_view text) const {
+    std::string ret;
+    ret.reserve(text.size());
+    size_t last = 0;
+    scanText(Utf8Text(text, *fold_), [&](const MatchSpan &span) {
+        ret.append(text.data() + last, span.offset - last);
+        ret.append(span.len, '*');
+        last = span.offset + span.length;
+        return true;
+    });
+    ret.append(text.data() + last, text.size() - last);
+    return ret;
+}
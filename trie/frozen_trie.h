@@ -0,0 +1,373 @@
+/** @file frozen_trie.h
+  * @brief 只读的敏感词匹配器，由Trie::freeze()生成，可以被多个线程同时使用
+  * @author teng.qing
+  * @date 2021/7/8
+  */
+
+#ifndef INC_01_TRIE_TREE_FROZEN_TRIE_H_
+#define INC_01_TRIE_TREE_FROZEN_TRIE_H_
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+#include "aho_corasick.h"
+#include "dict_file.h"
+#include "double_array.h"
+#include "fold_table.h"
+#include "metrics.h"
+#include "prefilter.h"
+#include "word_tag.h"
+
+class LayoutProfile;
+class TrieArena;
+
+struct SensitiveWord {
+    std::wstring word;
+    int startIndex;
+    int len;
+
+    friend bool operator<(struct SensitiveWord const &a,
+                          struct SensitiveWord const &b) {
+        return a.startIndex < b.startIndex;
+    }
+};
+
+/** @struct Utf8SensitiveWord
+  * @brief utf8文本的命中结果，同时给出字节偏移和字符偏移
+  */
+struct Utf8SensitiveWord {
+    std::string word;  // 命中的原文，utf8
+    int startIndex;    // 第几个字符开始
+    int len;           // 字符数
+    size_t byteOffset; // 字节偏移
+    size_t byteLen;    // 字节数
+
+    friend bool operator<(struct Utf8SensitiveWord const &a,
+                          struct Utf8SensitiveWord const &b) {
+        return a.startIndex < b.startIndex;
+    }
+};
+
+/** @struct SensitiveScore
+  * @brief FrozenTrie::score的结果，只统计分类符合的命中
+  */
+struct SensitiveScore {
+    uint64_t score = 0;      // 权重之和，达到阈值时停止扫描，之后的命中不计入
+    uint32_t categories = 0; // 命中的敏感词的分类的并集（和过滤条件相与之后）
+    int hits = 0;            // 命中次数
+    bool reached = false;    // 是否达到阈值
+};
+
+/** @class MatchVisitor
+  * @brief 命中回调，用于forEachSensitive，不需要构造std::set和拷贝命中的字符串
+  */
+class MatchVisitor {
+public:
+    virtual ~MatchVisitor() = default;
+
+    /** @fn onMatch
+      * @brief 按出现顺序回调每个命中的敏感词
+      * @param [in]span: 命中位置和敏感词编号
+      * @return 返回false停止扫描
+      */
+    virtual bool onMatch(const MatchSpan &span) = 0;
+};
+
+/** @enum MatchMode
+  * @brief 匹配算法
+  */
+enum class MatchMode {
+    kTrie,        // 从每个位置开始在trie上匹配（默认）
+    kAhoCorasick, // AC自动机，一次遍历。停顿词同时出现在敏感词里时按kTrie匹配
+};
+
+/** @enum MaskMode
+  * @brief 原地替换utf8文本时的方式
+  */
+enum class MaskMode {
+    kPerCodepoint, // 每个字符替换为一个mask字符，和replaceSensitive一致，中文等多字节字符的文本会变短
+    kPreserveBytes, // 每个字节替换为一个mask字符，长度不变，偏移和原文一致
+};
+
+/** @class FrozenTrie
+  * @brief 冻结后的敏感词匹配器
+  *
+  * 包含编译好的双数组、AC自动机和停顿词表，构造完成后不再修改，
+  * 所有查询接口都是const且查找过程中不写任何共享数据，多线程可以不加锁同时使用。
+  * 一般通过 std::shared_ptr<const FrozenTrie> 持有。
+  */
+class FrozenTrie {
+public:
+    /** @fn FrozenTrie
+      * @brief 从敏感词树编译，编译完成后不再引用trie
+      * @param [in]trie: 敏感词树（insert构建的树转换而来或者批量构建）
+      * @param [in]stop_words: 停顿词（已经过fold转换）
+      * @param [in]mode: 匹配算法
+      * @param [in]fold: 字符转换表，必须和insert时使用的相同
+      * @param [in]tags: 敏感词编号 -> 分类和严重程度，不足的部分为默认值
+      * @param [in]profile: 样本流量的状态访问次数，不为nullptr时热的状态排在双数组前面，见LayoutProfile
+      */
+    FrozenTrie(const TrieArena &trie, const std::unordered_set<uint32_t> &stop_words, MatchMode mode,
+               std::shared_ptr<const FoldTable> fold = FoldTable::defaultTable(),
+               std::vector<WordTag> tags = std::vector<WordTag>(), const LayoutProfile *profile = nullptr);
+
+    /** @fn FrozenTrie
+      * @brief 直接使用mmap的词库文件中的双数组和AC自动机，不需要构建，几乎不占用私有内存
+      * @param [in]dict: DictFile::open打开的词库，FrozenTrie析构前保持映射
+      * @param [in]stop_words: 停顿词（已经过fold转换），代替文件中保存的停顿词
+      * @param [in]mode: 匹配算法
+      * @param [in]fold: 字符转换表，必须和编译词库时使用的相同（DictFile::open时已检查）
+      */
+    FrozenTrie(std::shared_ptr<const DictFile> dict, const std::unordered_set<uint32_t> &stop_words,
+               MatchMode mode, std::shared_ptr<const FoldTable> fold = FoldTable::defaultTable());
+
+    // AhoCorasick引用了dat_，不允许拷贝
+    FrozenTrie(const FrozenTrie &that) = delete;
+
+    FrozenTrie &operator=(const FrozenTrie &that) = delete;
+
+    /** @fn search
+      * @brief 是否包含敏感词
+      * @param [in]word: 原始字符串
+      * @return bool result
+      */
+    bool search(const std::wstring &word) const;
+
+    /** @fn startsWith
+      * @brief 是否有敏感词以prefix开头
+      * @param [in]prefix: prefix
+      * @return bool result
+      */
+    bool startsWith(const std::wstring &prefix) const;
+
+    /** @fn getSensitive
+      * @brief 过滤敏感词并返回敏感词命中位置和信息
+      * @param [in]word: 原始字符串
+      * @return 命中敏感词信息
+      */
+    std::set<SensitiveWord> getSensitive(const std::wstring &word) const;
+
+    /** @fn replaceSensitive
+      * @brief 替换敏感词为*
+      * @param [in]word: 字符串内容
+      * @return 替换后的文本
+      */
+    std::wstring replaceSensitive(const std::wstring &word) const;
+
+    /** @fn replaceSensitive
+      * @brief 同上，scratch为调用者提供的临时缓冲区，多次调用时复用可以减少内存申请
+      * @param [in]word: 字符串内容
+      * @param [in]scratch: 临时缓冲区
+      * @return 替换后的文本
+      */
+    std::wstring replaceSensitive(const std::wstring &word, std::wstring &scratch) const;
+
+    /** @fn search
+      * @brief utf8版本，边解码边匹配，不需要转换成宽字符串
+      * @param [in]text: utf8字符串
+      * @return bool result
+      */
+    bool search(std::string_view text) const;
+
+    /** @fn getSensitive
+      * @brief utf8版本，结果同时包含字节偏移和字符偏移
+      * @param [in]text: utf8字符串
+      * @return 命中敏感词信息
+      */
+    std::set<Utf8SensitiveWord> getSensitive(std::string_view text) const;
+
+    /** @fn replaceSensitive
+      * @brief utf8版本，每个字符（不是每个字节）替换为一个*
+      * @param [in]text: utf8字符串
+      * @return 替换后的utf8文本
+      */
+    std::string replaceSensitive(std::string_view text) const;
+
+    /** @fn maskSensitive
+      * @brief 直接在调用者的utf8缓冲区上替换敏感词，不拷贝也不申请内存。
+      * kPerCodepoint时命中之后的内容向前移动，返回新的长度
+      * @param [in,out]data: utf8文本
+      * @param [in]size: 字节数
+      * @param [in]mode: 替换方式
+      * @param [in]mask: 替换成的字符，必须是ASCII，否则结果不是合法的utf8
+      * @return 替换后的字节数，kPreserveBytes时等于size
+      */
+    size_t maskSensitive(char *data, size_t size, MaskMode mode = MaskMode::kPerCodepoint, char mask = '*') const;
+
+    /** @fn maskSensitive
+      * @brief 同上，kPerCodepoint时缩短text，只会变短，不会重新申请内存
+      * @param [in,out]text: utf8文本
+      * @param [in]mode: 替换方式
+      * @param [in]mask: 替换成的字符，必须是ASCII
+      * @return void
+      */
+    void maskSensitive(std::string &text, MaskMode mode = MaskMode::kPerCodepoint, char mask = '*') const {
+        text.resize(maskSensitive(&text[0], text.size(), mode, mask));
+    }
+
+    /** @fn forEachSensitive
+      * @brief 按顺序回调每个命中的敏感词，扫描过程不申请堆内存
+      * @param [in]word: 原始字符串
+      * @param [in]visitor: 命中回调，返回false时停止
+      * @return void
+      */
+    void forEachSensitive(const std::wstring &word, MatchVisitor &visitor) const;
+
+    /** @fn forEachSensitive
+      * @brief utf8版本，MatchSpan的offset/length为字节
+      * @param [in]text: utf8字符串
+      * @param [in]visitor: 命中回调，返回false时停止
+      * @return void
+      */
+    void forEachSensitive(std::string_view text, MatchVisitor &visitor) const;
+
+    /** @fn forEachSensitive
+      * @brief 回调为函数对象 bool(const MatchSpan &)，返回false时停止
+      */
+    template<typename Text, typename Func,
+            typename = std::enable_if_t<!std::is_base_of<MatchVisitor, std::decay_t<Func>>::value>>
+    void forEachSensitive(const Text &text, Func &&func) const {
+        FuncVisitor<Func> visitor(func);
+        forEachSensitive(text, static_cast<MatchVisitor &>(visitor));
+    }
+
+    /** @fn score
+      * @brief 按顺序累加分类和categories有交集的命中的权重（WordTag::severity），达到阈值后立即停止扫描，
+      * 用于只需要判断是否拒绝的场景，不需要扫描完长文本，也不需要收集所有命中
+      * @param [in]word: 原始字符串
+      * @param [in]categories: 只统计这些分类（位掩码），kAllCategories为所有分类
+      * @param [in]threshold: 阈值，为0时扫描完整个文本
+      * @return 得分
+      */
+    SensitiveScore score(const std::wstring &word, uint32_t categories, uint64_t threshold) const;
+
+    /** @fn score
+      * @brief utf8版本
+      */
+    SensitiveScore score(std::string_view text, uint32_t categories, uint64_t threshold) const;
+
+    // 敏感词的分类和严重程度，word_id为MatchSpan::wordId
+    const WordTag &wordTag(int word_id) const { return tags_[word_id]; }
+
+    // 所有敏感词的标签，wordCount()个
+    const WordTag *wordTags() const { return tags_; }
+
+    // 敏感词编号的范围为 [0, wordCount())
+    size_t wordCount() const { return word_count_; }
+
+    MatchMode matchMode() const { return mode_; }
+
+    // 是否有停顿词同时出现在敏感词里。这时kAhoCorasick模式实际按kTrie匹配，MatchStream逐起点匹配，保证结果一致
+    bool stopWordsInWords() const { return stop_in_words_; }
+
+    bool isStopWord(uint32_t unicode) const {
+        if (unicode < Alphabet::kBmpSize) {
+            return (stop_words_[unicode >> 6] >> (unicode & 63)) & 1;
+        }
+        return isAstralStopWord(unicode);
+    }
+
+    const DoubleArray &dat() const { return dat_; }
+
+    const AhoCorasick &ac() const { return ac_; }
+
+    // 停顿词位图，DictFile::kStopWordsWords个uint64_t
+    const uint64_t *stopWords() const { return stop_words_.data(); }
+
+    const Prefilter &prefilter() const { return prefilter_; }
+
+    const FoldTable &foldTable() const { return *fold_; }
+
+    // BMP之外的停顿词（如emoji），有序
+    const std::vector<uint32_t> &astralStopWords() const { return astral_stop_words_; }
+
+    // 占用的内存，单位字节
+    size_t memoryUsage() const;
+
+    // 进程内每构造一个FrozenTrie加1，不会重复，词库或停顿词变化后重新build的匹配器编号不同。ResultCache用它区分词库版本
+    uint64_t generation() const { return generation_; }
+
+    /** @fn metrics
+      * @brief 这个匹配器的运行时统计（见Metrics），重新build后从0开始。编译时没有定义DIRTYFILTER_METRICS时为空
+      * @return 统计结果
+      */
+    MetricsSnapshot metrics() const;
+
+#ifdef DIRTYFILTER_METRICS
+    // 当前线程的计数器，MatchStream等在FrozenTrie之外扫描时使用
+    Metrics::Shard &metricsShard() const { return metrics_->local(); }
+
+    // 记录一次命中，命中的字符数减去敏感词的长度就是其中跳过的停顿词数
+    void countHit(Metrics::Shard &shard, const MatchSpan &span) const {
+        shard.addHit(span.wordId, span.len - ac_.depth(word_states_[span.wordId]));
+    }
+#endif
+
+private:
+    template<typename Func>
+    class FuncVisitor : public MatchVisitor {
+    public:
+        explicit FuncVisitor(Func &func) : func_(func) {}
+
+        bool onMatch(const MatchSpan &span) override { return func_(span); }
+
+    private:
+        Func &func_;
+    };
+
+    // 以下模板只在frozen_trie.cpp中实例化，Text为WideText或Utf8Text
+
+    // 从offset开始匹配，返回命中的字符数，没有命中返回0，end返回结尾偏移，word_id返回敏感词编号
+    void setStopWords(const std::unordered_set<uint32_t> &stop_words);
+
+    bool isAstralStopWord(uint32_t unicode) const;
+
+    template<typename Text>
+    int getSensitiveLength(const Text &text, size_t offset, size_t &end, int &word_id) const;
+
+    template<typename Text>
+    bool searchText(const Text &text) const;
+
+    template<typename Text>
+    SensitiveScore scoreText(const Text &text, uint32_t categories, uint64_t threshold) const;
+
+    // 按顺序回调每个命中位置 bool emit(const MatchSpan &)，返回false时停止
+    template<typename Text, typename Emit>
+    void scanText(const Text &text, Emit &&emit) const;
+
+    // scanText的实现，scanText在其外面加上统计
+    template<typename Text, typename Emit>
+    void scanSpans(const Text &text, Emit &&emit) const;
+
+#ifdef DIRTYFILTER_METRICS
+    void initMetrics();
+#endif
+
+private:
+    DoubleArray dat_;
+    AhoCorasick ac_;
+    std::vector<uint64_t> stop_words_;         // BMP的停顿词，65536位的位图
+    std::vector<uint32_t> astral_stop_words_; // BMP之外的停顿词，有序
+    Prefilter prefilter_;                      // 首字符和停顿词，扫描时跳过其他字符
+    MatchMode mode_;
+    bool stop_in_words_ = false;               // 见stopWordsInWords
+    std::shared_ptr<const FoldTable> fold_;
+    std::shared_ptr<const DictFile> dict_; // 从词库文件加载时持有映射
+    std::vector<WordTag> tag_storage_;     // 从TrieArena构建时使用，从词库文件加载时为空
+    const WordTag *tags_;                  // 指向tag_storage_或者词库文件
+    size_t word_count_;
+    uint64_t generation_;
+#ifdef DIRTYFILTER_METRICS
+    std::unique_ptr<Metrics> metrics_;
+    std::vector<int32_t> word_states_; // 敏感词编号 -> 结尾状态，用于统计时计算敏感词的长度和还原文本
+#endif
+
+};
+
+#endif //INC_01_TRIE_TREE_FROZEN_TRIE_H_
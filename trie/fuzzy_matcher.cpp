@@ -0,0 +1,268 @@
+/** @file fuzzy_matcher.cpp
+  * @brief 模糊匹配
+  * @author teng.qing
+  * @date 2021/8/6
+  */
+
+#include "fuzzy_matcher.h"
+#include "text_codec.h"
+
+#include <algorithm>
+#include <utility>
+
+const int FuzzyMatcher::kMaxDistance;
+const int FuzzyMatcher::kBandWidth;
+
+namespace {
+
+// 超过上限的编辑距离，加1之后也不会溢出uint8_t
+const int kInf = 0x3F;
+
+} // namespace
+
+FuzzyMatcher::FuzzyMatcher(std::shared_ptr<const FrozenTrie> frozen, int max_distance, int min_word_length)
+        : frozen_(std::move(frozen)), max_distance_(std::min(std::max(max_distance, 1), kMaxDistance)),
+          min_word_length_(std::max(min_word_length, 2)) {
+    // 双数组只能按字符查找子节点，替换和删除需要遍历所有子节点，这里按父状态建立索引
+    const DoubleArray &dat = frozen_->dat();
+    const DoubleArray::Unit *units = dat.units();
+    size_t size = dat.size();
+    child_begin_.assign(size + 1, 0);
+    for (size_t t = 1; t < size; ++t) {
+        if (units[t].check >= 0) {
+            child_begin_[units[t].check + 1]++;
+        }
+    }
+    for (size_t s = 0; s < size; ++s) {
+        child_begin_[s + 1] += child_begin_[s];
+    }
+    children_.resize(child_begin_[size]);
+    std::vector<uint32_t> next(child_begin_.begin(), child_begin_.end() - 1);
+    for (size_t t = 1; t < size; ++t) {
+        int32_t parent = units[t].check;
+        if (parent >= 0) {
+            auto code = static_cast<uint16_t>(t - static_cast<size_t>(units[parent].base >> 1));
+            children_[next[parent]++] = Child{static_cast<int32_t>(t), code};
+        }
+    }
+}
+
+size_t FuzzyMatcher::memoryUsage() const {
+    return child_begin_.capacity() * sizeof(uint32_t) + children_.capacity() * sizeof(Child);
+}
+
+template<typename Text>
+void FuzzyMatcher::decode(const Text &text, std::vector<Symbol> &symbols) const {
+    const DoubleArray &dat = frozen_->dat();
+    size_t offset = 0;
+    int32_t index = 0;
+    uint32_t c;
+    while (true) {
+        size_t start = offset;
+        if (!text.decode(offset, c)) {
+            break;
+        }
+        uint32_t unicode = text.fold(c);
+        uint16_t code = dat.code(unicode);
+        if (code != Alphabet::kOther || !frozen_->isStopWord(unicode)) {
+            symbols.push_back(Symbol{code, index, start, offset});
+        }
+        ++index;
+    }
+}
+
+bool FuzzyMatcher::matchAt(const std::vector<Symbol> &symbols, size_t start, std::vector<Frame> &stack, size_t &len,
+                           int &word_id, int &distance) const {
+    const DoubleArray &dat = frozen_->dat();
+    const Symbol *text = symbols.data() + start;
+    const auto remain = static_cast<int>(std::min(symbols.size() - start, size_t(INT32_MAX)));
+    const int k = max_distance_;
+    const int width = std::min(2 * k + 1, kBandWidth);
+
+    // 首字符必须一致
+    int first = dat.transition(DoubleArray::kRoot, text[0].code);
+    if (first < 0) {
+        return false;
+    }
+
+    int best = kInf;
+    int best_len = 0;
+    int best_id = -1;
+    auto accept = [&](int dist, int j, int id) {
+        if (dist < best || (dist == best && j < best_len)) {
+            best = dist;
+            best_len = j;
+            best_id = id;
+        }
+    };
+    if (dat.isTerminal(first)) {
+        accept(0, 1, dat.wordId(first));
+    }
+
+    // 深度1：首字符和text[0]对齐，之后的字符只能是插入
+    Frame root{first, 1, kInf, {}};
+    for (int x = 0; x < width; ++x) {
+        int j = 1 + x - k;
+        root.band[x] = static_cast<uint8_t>(j < 1 || j > remain ? kInf : j - 1);
+        root.low = std::min(root.low, root.band[x]);
+    }
+    stack.clear();
+    stack.push_back(root);
+
+    // 计算子节点的一列，可能命中时记录，带内还有希望时入栈
+    auto expand = [&](const Frame &frame, int32_t state, uint16_t code) {
+        Frame next{state, frame.depth + 1, kInf, {}};
+        for (int x = 0; x < width; ++x) {
+            int j = next.depth + x - k; // 文本字符数
+            int d = kInf;
+            if (j >= 1 && j <= remain) {
+                // 删除敏感词中的字符、插入文本中的字符、替换或相同
+                if (x + 1 < width) {
+                    d = std::min(d, frame.band[x + 1] + 1);
+                }
+                if (x > 0) {
+                    d = std::min(d, next.band[x - 1] + 1);
+                }
+                d = std::min(d, frame.band[x] + (text[j - 1].code != code ? 1 : 0));
+            }
+            next.band[x] = static_cast<uint8_t>(std::min(d, kInf));
+            next.low = std::min(next.low, next.band[x]);
+        }
+
+        // 尾字符也必须一致：最后一步是敏感词的最后一个字符和文本字符相同
+        if (dat.isTerminal(state)) {
+            int limit = next.depth >= min_word_length_ ? k : 0;
+            for (int x = 0; x < width; ++x) {
+                int j = next.depth + x - k;
+                if (j >= 1 && j <= remain && text[j - 1].code == code && frame.band[x] <= limit) {
+                    accept(frame.band[x], j, dat.wordId(state));
+                }
+            }
+        }
+
+        // 带内最小值超过上限，或者不可能比已经找到的更好，剪掉整棵子树
+        if (next.low <= k && next.low <= best) {
+            stack.push_back(next);
+        }
+    };
+
+    while (!stack.empty()) {
+        Frame frame = stack.back();
+        stack.pop_back();
+
+        if (frame.low < k) {
+            for (uint32_t i = child_begin_[frame.state]; i < child_begin_[frame.state + 1]; ++i) {
+                expand(frame, children_[i].state, children_[i].code);
+            }
+            continue;
+        }
+
+        // 编辑次数已经用完，只有和文本相同的字符才能留在上限以内，直接按字符查找，不用遍历所有子节点
+        for (int x = 0; x < width; ++x) {
+            int j = frame.depth + 1 + x - k;
+            if (frame.band[x] != k || j < 1 || j > remain) {
+                continue;
+            }
+            uint16_t code = text[j - 1].code;
+            bool seen = false;
+            for (int y = 0; y < x && !seen; ++y) {
+                int jy = frame.depth + 1 + y - k;
+                seen = frame.band[y] == k && jy >= 1 && text[jy - 1].code == code;
+            }
+            int state = seen ? -1 : dat.transition(frame.state, code);
+            if (state >= 0) {
+                expand(frame, state, code);
+            }
+        }
+    }
+
+    if (best_id < 0) {
+        return false;
+    }
+    len = static_cast<size_t>(best_len);
+    word_id = best_id;
+    distance = best;
+    return true;
+}
+
+void FuzzyMatcher::scan(const std::vector<Symbol> &symbols,
+                        const std::function<bool(const MatchSpan &, int)> &func) const {
+    std::vector<Frame> stack;
+    size_t i = 0;
+    while (i < symbols.size()) {
+        size_t len;
+        int word_id;
+        int distance;
+        if (!matchAt(symbols, i, stack, len, word_id, distance)) {
+            ++i;
+            continue;
+        }
+        const Symbol &first = symbols[i];
+        const Symbol &last = symbols[i + len - 1];
+        MatchSpan span{first.offset, last.end - first.offset, first.index, last.index - first.index + 1, word_id};
+        if (!func(span, distance)) {
+            return;
+        }
+        i += len;
+    }
+}
+
+void FuzzyMatcher::forEachSensitive(const std::wstring &word,
+                                    const std::function<bool(const MatchSpan &, int)> &func) const {
+    std::vector<Symbol> symbols;
+    decode(WideText(word, frozen_->foldTable()), symbols);
+    scan(symbols, func);
+}
+
+void FuzzyMatcher::forEachSensitive(std::string_view text,
+                                    const std::function<bool(const MatchSpan &, int)> &func) const {
+    std::vector<Symbol> symbols;
+    decode(Utf8Text(text, frozen_->foldTable()), symbols);
+    scan(symbols, func);
+}
+
+bool FuzzyMatcher::search(const std::wstring &word) const {
+    bool found = false;
+    forEachSensitive(word, [&found](const MatchSpan &, int) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+std::set<SensitiveWord> FuzzyMatcher::getSensitive(const std::wstring &word) const {
+    std::set<SensitiveWord> sensitiveSet;
+    forEachSensitive(word, [&](const MatchSpan &span, int) {
+        SensitiveWord wordObj;
+        wordObj.word = word.substr(span.offset, span.length);
+        wordObj.startIndex = static_cast<int>(span.startIndex);
+        wordObj.len = span.len;
+        sensitiveSet.insert(wordObj);
+        return true;
+    });
+    return sensitiveSet;
+}
+
+std::wstring FuzzyMatcher::replaceSensitive(const std::wstring &word) const {
+    std::wstring ret = word;
+    forEachSensitive(word, [&](const MatchSpan &span, int) {
+        std::fill(ret.begin() + static_cast<std::ptrdiff_t>(span.offset),
+                  ret.begin() + static_cast<std::ptrdiff_t>(span.offset + span.length), L'*');
+        return true;
+    });
+    return ret;
+}
+
+std::string FuzzyMatcher::replaceSensitive(std::string_view text) const {
+    std::string ret;
+    ret.reserve(text.size());
+    size_t last = 0;
+    forEachSensitive(text, [&](const MatchSpan &span, int) {
+        ret.append(text.data() + last, span.offset - last);
+        ret.append(span.len, '*');
+        last = span.offset + span.length;
+        return true;
+    });
+    ret.append(text.data() + last, text.size() - last);
+    return ret;
+}
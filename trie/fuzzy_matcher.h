@@ -0,0 +1,140 @@
+/** @file fuzzy_matcher.h
+  * @brief 模糊匹配：在敏感词树上运行Levenshtein自动机，找出编辑距离不超过1~2的变体（如"微X信"、"fuxk"）
+  * @author teng.qing
+  * @date 2021/8/6
+  */
+
+#ifndef INC_01_TRIE_TREE_FUZZY_MATCHER_H_
+#define INC_01_TRIE_TREE_FUZZY_MATCHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frozen_trie.h"
+
+/** @class FuzzyMatcher
+  * @brief 近似匹配，不需要在词库里列出插入、替换、删除了字符的变体
+  *
+  * 从每个敏感词首字符开始，沿双数组深度优先遍历，同时维护敏感词前缀和文本之间的编辑距离。
+  * 编辑距离超过上限的位置不可能再回到上限以内，所以只需要计算对角线两侧各maxDistance个单元（Ukkonen带），
+  * 带内的最小值超过上限时整棵子树剪掉，不会枚举变体。
+  *
+  * 规则：
+  * 1. 敏感词的首尾字符必须和文本中的字符一致，只允许中间的插入、删除、替换，
+  *    否则"微信"的删除变体"微"会命中所有包含"微"的文本
+  * 2. 长度小于minWordLength的敏感词只做精确匹配
+  * 3. 不出现在任何敏感词中的停顿词直接忽略，其他停顿词按普通字符计算
+  * 4. 同一个位置有多个结果时取编辑距离最小的，再取最短的；命中后从结尾继续，结果不重叠
+  *
+  * 构造时为双数组建立子节点索引（每个状态约12字节），之后只读，可以被多个线程同时使用。
+  * 每次扫描需要解码整个文本，会申请一次内存，比精确匹配慢，适合对少量可疑文本做二次检查。
+  */
+class FuzzyMatcher {
+public:
+    static const int kMaxDistance = 2;
+
+    /** @fn FuzzyMatcher
+      * @param [in]frozen: 匹配器，FuzzyMatcher持有
+      * @param [in]max_distance: 每个敏感词最大的编辑距离，1或2，超出范围时取最近的值
+      * @param [in]min_word_length: 至少这么多个字符的敏感词才允许编辑，小于2时为2
+      */
+    FuzzyMatcher(std::shared_ptr<const FrozenTrie> frozen, int max_distance, int min_word_length = 2);
+
+    FuzzyMatcher(const FuzzyMatcher &that) = delete;
+
+    FuzzyMatcher &operator=(const FuzzyMatcher &that) = delete;
+
+    /** @fn forEachSensitive
+      * @brief 按顺序回调每个命中的敏感词
+      * @param [in]word: 原始字符串
+      * @param [in]func: 回调 bool(const MatchSpan &span, int distance)，distance为编辑距离，返回false时停止
+      * @return void
+      */
+    void forEachSensitive(const std::wstring &word, const std::function<bool(const MatchSpan &, int)> &func) const;
+
+    /** @fn forEachSensitive
+      * @brief utf8版本，MatchSpan的offset/length为字节
+      */
+    void forEachSensitive(std::string_view text, const std::function<bool(const MatchSpan &, int)> &func) const;
+
+    /** @fn search
+      * @brief 是否包含敏感词或者它的变体
+      * @param [in]word: 原始字符串
+      * @return bool result
+      */
+    bool search(const std::wstring &word) const;
+
+    /** @fn getSensitive
+      * @brief 命中位置，word为文本中的原文（变体）
+      * @param [in]word: 原始字符串
+      * @return 命中敏感词信息
+      */
+    std::set<SensitiveWord> getSensitive(const std::wstring &word) const;
+
+    /** @fn replaceSensitive
+      * @brief 替换敏感词和它的变体为*
+      * @param [in]word: 字符串内容
+      * @return 替换后的文本
+      */
+    std::wstring replaceSensitive(const std::wstring &word) const;
+
+    /** @fn replaceSensitive
+      * @brief utf8版本，每个字符替换为一个*
+      */
+    std::string replaceSensitive(std::string_view text) const;
+
+    int maxDistance() const { return max_distance_; }
+
+    const std::shared_ptr<const FrozenTrie> &frozen() const { return frozen_; }
+
+    // 子节点索引占用的内存，单位字节，不包括FrozenTrie
+    size_t memoryUsage() const;
+
+private:
+    // 文本中的一个字符
+    struct Symbol {
+        uint16_t code; // 字符编号，见DoubleArray::code
+        int32_t index; // 在原文中是第几个字符，忽略的停顿词也计数
+        size_t offset; // 在原文中的偏移
+        size_t end;
+    };
+
+    struct Child {
+        int32_t state;
+        uint16_t code;
+    };
+
+    static const int kBandWidth = 2 * kMaxDistance + 1;
+
+    // 遍历到的一个状态，band[x]为深度为depth的前缀和从起点开始 depth+x-maxDistance 个字符的编辑距离
+    struct Frame {
+        int32_t state;
+        int32_t depth;
+        uint8_t low; // band中的最小值
+        uint8_t band[kBandWidth];
+    };
+
+    template<typename Text>
+    void decode(const Text &text, std::vector<Symbol> &symbols) const;
+
+    void scan(const std::vector<Symbol> &symbols, const std::function<bool(const MatchSpan &, int)> &func) const;
+
+    // 从symbols[start]开始的最佳匹配，没有返回false
+    bool matchAt(const std::vector<Symbol> &symbols, size_t start, std::vector<Frame> &stack, size_t &len,
+                 int &word_id, int &distance) const;
+
+private:
+    std::shared_ptr<const FrozenTrie> frozen_;
+    int max_distance_;
+    int min_word_length_;
+    std::vector<uint32_t> child_begin_; // 状态s的子节点为children_[child_begin_[s], child_begin_[s+1])
+    std::vector<Child> children_;
+};
+
+#endif //INC_01_TRIE_TREE_FUZZY_MATCHER_H_
@@ -0,0 +1,270 @@
+/** @file layered_matcher.cpp
+  * @brief 多租户的叠加匹配
+  * @author teng.qing
+  * @date 2021/8/8
+  */
+
+#include "layered_matcher.h"
+#include "text_codec.h"
+
+#include <algorithm>
+#include <utility>
+
+const size_t LayeredMatcher::kFirstCharBits;
+
+LayeredMatcher::LayeredMatcher(std::shared_ptr<const FrozenTrie> base, const std::vector<std::wstring> &additions,
+                               const std::vector<std::wstring> &suppressions, const std::vector<WordTag> &tags)
+        : base_(std::move(base)), base_word_count_(base_->wordCount()) {
+    const FoldTable &fold = base_->foldTable();
+    TrieArena::WordList words;
+    for (size_t i = 0; i < additions.size(); ++i) {
+        words.add(additions[i], fold, i < tags.size() ? tags[i] : WordTag());
+    }
+    overlay_.build(words, nullptr, &tags_);
+    tags_.resize(overlay_.wordCount());
+
+    // 首字符：位图先过滤掉大部分字符，再查散列表，根节点的子节点很多，二分查找太慢
+    const TrieArena::Node &root = overlay_.node(TrieArena::kRoot);
+    if (root.childCount > 0) {
+        size_t slots = 2;
+        root_shift_ = 31;
+        while (slots < root.childCount + root.childCount / 2) {
+            slots <<= 1;
+            --root_shift_;
+        }
+        root_slots_.assign(slots, 0);
+        for (uint32_t i = root.firstChild; i < root.firstChild + root.childCount; ++i) {
+            uint32_t code = overlay_.node(i).code;
+            size_t bit = code & (kFirstCharBits - 1);
+            first_chars_[bit >> 6] |= uint64_t(1) << (bit & 63);
+            size_t slot = (code * 0x9E3779B1u) >> root_shift_;
+            while (root_slots_[slot] != 0) {
+                slot = (slot + 1) & (root_slots_.size() - 1);
+            }
+            root_slots_[slot] = i;
+        }
+    }
+
+    // 屏蔽的敏感词在基础词库中查出编号
+    const DoubleArray &dat = base_->dat();
+    for (const std::wstring &word : suppressions) {
+        int state = word.empty() ? -1 : DoubleArray::kRoot;
+        for (size_t i = 0; i < word.size() && state >= 0; ++i) {
+            state = dat.transition(state, dat.code(fold.fold(static_cast<uint32_t>(word[i]))));
+        }
+        if (state >= 0 && dat.isTerminal(state)) {
+            suppressed_.push_back(dat.wordId(state));
+        }
+    }
+    std::sort(suppressed_.begin(), suppressed_.end());
+    suppressed_.erase(std::unique(suppressed_.begin(), suppressed_.end()), suppressed_.end());
+    suppressed_.shrink_to_fit();
+}
+
+size_t LayeredMatcher::memoryUsage() const {
+    return sizeof(LayeredMatcher) + overlay_.memoryUsage() + tags_.capacity() * sizeof(WordTag) +
+           suppressed_.capacity() * sizeof(int32_t) + root_slots_.capacity() * sizeof(uint32_t);
+}
+
+int LayeredMatcher::overlayChild(uint32_t node, uint32_t code) const {
+    const TrieArena::Node &parent = overlay_.node(node);
+    uint32_t lo = parent.firstChild;
+    uint32_t hi = parent.firstChild + parent.childCount;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (overlay_.node(mid).code < code) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < parent.firstChild + parent.childCount && overlay_.node(lo).code == code ? static_cast<int>(lo) : -1;
+}
+
+int LayeredMatcher::overlayRootChild(uint32_t code) const {
+    size_t slot = (code * 0x9E3779B1u) >> root_shift_;
+    for (uint32_t i; (i = root_slots_[slot]) != 0; slot = (slot + 1) & (root_slots_.size() - 1)) {
+        if (overlay_.node(i).code == code) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool LayeredMatcher::suppressed(int word_id) const {
+    return !suppressed_.empty() && std::binary_search(suppressed_.begin(), suppressed_.end(), word_id);
+}
+
+template<typename Text>
+int LayeredMatcher::getSensitiveLength(const Text &text, size_t offset, bool in_base, bool in_overlay, size_t &end,
+                                       int &word_id) const {
+    const DoubleArray &dat = base_->dat();
+    int best = 0;
+
+    // 基础词库，和FrozenTrie::getSensitiveLength相同，只是遇到屏蔽的敏感词时继续往后找
+    int state = DoubleArray::kRoot;
+    int wordLen = 0;
+    size_t pos = offset;
+    uint32_t c;
+    while (in_base && text.decode(pos, c)) {
+        uint32_t unicode = text.fold(c);
+        int next = dat.transition(state, dat.code(unicode));
+        if (next < 0) {
+            if (base_->isStopWord(unicode)) {
+                ++wordLen;
+                continue;
+            }
+            break;
+        }
+        ++wordLen;
+        if (dat.isTerminal(next) && !suppressed(dat.wordId(next))) {
+            end = pos;
+            word_id = dat.wordId(next);
+            best = wordLen;
+            break;
+        }
+        state = next;
+    }
+
+    // 叠加层，只找比基础词库更短的
+    auto node = static_cast<int>(TrieArena::kRoot);
+    wordLen = 0;
+    pos = offset;
+    while (in_overlay && (best == 0 || wordLen + 1 < best) && text.decode(pos, c)) {
+        uint32_t unicode = text.fold(c);
+        int next = node == static_cast<int>(TrieArena::kRoot) ? overlayRootChild(unicode)
+                                                              : overlayChild(static_cast<uint32_t>(node), unicode);
+        if (next < 0) {
+            if (base_->isStopWord(unicode)) {
+                ++wordLen;
+                continue;
+            }
+            break;
+        }
+        ++wordLen;
+        int id = overlay_.node(static_cast<uint32_t>(next)).wordId;
+        if (id >= 0) {
+            end = pos;
+            word_id = static_cast<int>(base_word_count_) + id;
+            best = wordLen;
+            break;
+        }
+        node = next;
+    }
+    return best;
+}
+
+template<typename Text, typename Emit>
+void LayeredMatcher::scanSpans(const Text &text, Emit &&emit) const {
+    const DoubleArray &dat = base_->dat();
+    const Prefilter &prefilter = base_->prefilter();
+    size_t offset = 0;
+    int index = 0;
+    size_t end;
+    int word_id;
+    uint32_t c = 0;
+
+    // 和FrozenTrie::scanSpans的kTrie模式相同，首字符同时检查两层。
+    // 叠加层的首字符不在基础词库的预过滤里，不能批量跳过，逐个字符检查
+    size_t run_offset = 0;
+    int run_index = 0;
+    while (offset < text.size()) {
+        size_t pos = offset;
+        text.decode(offset, c);
+        uint32_t unicode = text.fold(c);
+        bool in_overlay = mayStartOverlay(unicode) && overlayRootChild(unicode) >= 0;
+        if (!in_overlay && !prefilter.candidate(unicode)) {
+            ++index;
+            run_offset = offset;
+            run_index = index;
+            continue;
+        }
+
+        bool in_base = dat.transition(DoubleArray::kRoot, dat.code(unicode)) >= 0;
+        if (in_base || in_overlay) {
+            int wordLen = getSensitiveLength(text, pos, in_base, in_overlay, end, word_id);
+            if (wordLen > 0) {
+                int len = wordLen + (index - run_index);
+                if (!emit(MatchSpan{run_offset, end - run_offset, run_index, len, word_id})) {
+                    return;
+                }
+                offset = end;
+                index = run_index + len;
+            } else {
+                ++index;
+            }
+            run_offset = offset;
+            run_index = index;
+        } else if (base_->isStopWord(unicode)) {
+            ++index;
+        } else {
+            ++index;
+            run_offset = offset;
+            run_index = index;
+        }
+    }
+}
+
+void LayeredMatcher::forEachSensitive(const std::wstring &word,
+                                      const std::function<bool(const MatchSpan &)> &func) const {
+    scanSpans(WideText(word, base_->foldTable()), func);
+}
+
+void LayeredMatcher::forEachSensitive(std::string_view text, const std::function<bool(const MatchSpan &)> &func) const {
+    scanSpans(Utf8Text(text, base_->foldTable()), func);
+}
+
+bool LayeredMatcher::search(const std::wstring &word) const {
+    bool found = false;
+    scanSpans(WideText(word, base_->foldTable()), [&found](const MatchSpan &) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+bool LayeredMatcher::search(std::string_view text) const {
+    bool found = false;
+    scanSpans(Utf8Text(text, base_->foldTable()), [&found](const MatchSpan &) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+std::set<SensitiveWord> LayeredMatcher::getSensitive(const std::wstring &word) const {
+    std::set<SensitiveWord> sensitiveSet;
+    scanSpans(WideText(word, base_->foldTable()), [&](const MatchSpan &span) {
+        SensitiveWord wordObj;
+        wordObj.word = word.substr(span.offset, span.length);
+        wordObj.startIndex = static_cast<int>(span.startIndex);
+        wordObj.len = span.len;
+        sensitiveSet.insert(wordObj);
+        return true;
+    });
+    return sensitiveSet;
+}
+
+std::wstring LayeredMatcher::replaceSensitive(const std::wstring &word) const {
+    std::wstring ret = word;
+    scanSpans(WideText(word, base_->foldTable()), [&](const MatchSpan &span) {
+        std::fill(ret.begin() + static_cast<std::ptrdiff_t>(span.offset),
+                  ret.begin() + static_cast<std::ptrdiff_t>(span.offset + span.length), L'*');
+        return true;
+    });
+    return ret;
+}
+
+std::string LayeredMatcher::replaceSensitive(std::string_view text) const {
+    std::string ret;
+    ret.reserve(text.size());
+    size_t last = 0;
+    scanSpans(Utf8Text(text, base_->foldTable()), [&](const MatchSpan &span) {
+        ret.append(text.data() + last, span.offset - last);
+        ret.append(span.len, '*');
+        last = span.offset + span.length;
+        return true;
+    });
+    ret.append(text.data() + last, text.size() - last);
+    return ret;
+}
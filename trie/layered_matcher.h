@@ -0,0 +1,158 @@
+/** @file layered_matcher.h
+  * @brief 多租户：所有租户共享一个只读的基础词库，每个租户只保存自己增加和屏蔽的敏感词
+  * @author teng.qing
+  * @date 2021/8/8
+  */
+
+#ifndef INC_01_TRIE_TREE_LAYERED_MATCHER_H_
+#define INC_01_TRIE_TREE_LAYERED_MATCHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frozen_trie.h"
+#include "trie_arena.h"
+#include "word_tag.h"
+
+/** @class LayeredMatcher
+  * @brief 基础词库 + 租户的叠加层，一遍扫描同时匹配两层
+  *
+  * 基础词库（FrozenTrie）通过shared_ptr在所有租户之间共享，叠加层只包含：
+  * 1. 增加的敏感词：一棵TrieArena（每个节点16字节，子节点有序，二分查找；根节点另有散列表），不建双数组，
+  *    没有双数组的字符表（128KB）、停顿词位图等固定开销
+  * 2. 屏蔽的敏感词：基础词库中的敏感词编号，有序数组
+  * 所以租户占用的内存只和叠加层的大小有关，和基础词库的大小无关。
+  *
+  * 扫描时每个位置先在基础词库上匹配，跳过被屏蔽的敏感词继续往后找，再在叠加层上找更短的命中，
+  * 结果和把两层合并后重新构建的Trie（kTrie模式）相同：同一个起点取最短的敏感词，长度相同时取基础词库的。
+  * 字符转换和停顿词使用基础词库的；停顿词同时出现在两层敏感词中时，跳过与否按各自的树判断，极少数情况下和合并后不同。
+  *
+  * MatchSpan::wordId小于baseWordCount()时为基础词库中的编号，否则为增加的第 wordId-baseWordCount() 个敏感词
+  * （去重后，按第一次出现的顺序）。
+  * 基础词库热更新后，屏蔽的敏感词编号会变化，需要用新的基础词库重新构造（构造只和叠加层的大小有关，很快）。
+  * 构造后只读，可以被多个线程同时使用。
+  */
+class LayeredMatcher {
+public:
+    /** @fn LayeredMatcher
+      * @param [in]base: 基础词库，LayeredMatcher持有
+      * @param [in]additions: 增加的敏感词
+      * @param [in]suppressions: 屏蔽的敏感词，不在基础词库中的忽略
+      * @param [in]tags: 增加的敏感词的分类和严重程度，和additions一一对应，不足的部分为默认值
+      */
+    LayeredMatcher(std::shared_ptr<const FrozenTrie> base, const std::vector<std::wstring> &additions,
+                   const std::vector<std::wstring> &suppressions = std::vector<std::wstring>(),
+                   const std::vector<WordTag> &tags = std::vector<WordTag>());
+
+    LayeredMatcher(const LayeredMatcher &that) = delete;
+
+    LayeredMatcher &operator=(const LayeredMatcher &that) = delete;
+
+    /** @fn forEachSensitive
+      * @brief 按顺序回调每个命中的敏感词
+      * @param [in]word: 原始字符串
+      * @param [in]func: 回调 bool(const MatchSpan &span)，返回false时停止
+      * @return void
+      */
+    void forEachSensitive(const std::wstring &word, const std::function<bool(const MatchSpan &)> &func) const;
+
+    /** @fn forEachSensitive
+      * @brief utf8版本，MatchSpan的offset/length为字节
+      */
+    void forEachSensitive(std::string_view text, const std::function<bool(const MatchSpan &)> &func) const;
+
+    /** @fn search
+      * @brief 是否包含敏感词
+      * @param [in]word: 原始字符串
+      * @return bool result
+      */
+    bool search(const std::wstring &word) const;
+
+    /** @fn search
+      * @brief utf8版本
+      */
+    bool search(std::string_view text) const;
+
+    /** @fn getSensitive
+      * @brief 过滤敏感词并返回敏感词命中位置和信息
+      * @param [in]word: 原始字符串
+      * @return 命中敏感词信息
+      */
+    std::set<SensitiveWord> getSensitive(const std::wstring &word) const;
+
+    /** @fn replaceSensitive
+      * @brief 替换敏感词为*
+      * @param [in]word: 字符串内容
+      * @return 替换后的文本
+      */
+    std::wstring replaceSensitive(const std::wstring &word) const;
+
+    /** @fn replaceSensitive
+      * @brief utf8版本，每个字符替换为一个*
+      */
+    std::string replaceSensitive(std::string_view text) const;
+
+    // 敏感词的分类和严重程度，word_id为MatchSpan::wordId
+    const WordTag &wordTag(int word_id) const {
+        return static_cast<size_t>(word_id) < base_word_count_ ? base_->wordTag(word_id)
+                                                               : tags_[word_id - base_word_count_];
+    }
+
+    // 基础词库的敏感词数，MatchSpan::wordId不小于这个值时为增加的敏感词
+    size_t baseWordCount() const { return base_word_count_; }
+
+    // 增加的敏感词数（去重后）
+    size_t addedWordCount() const { return overlay_.wordCount(); }
+
+    // 屏蔽的基础词库中的敏感词数
+    size_t suppressedWordCount() const { return suppressed_.size(); }
+
+    const std::shared_ptr<const FrozenTrie> &base() const { return base_; }
+
+    // 叠加层占用的内存，单位字节，不包括共享的基础词库
+    size_t memoryUsage() const;
+
+private:
+    // 首字符过滤的位数，按unicode的低位
+    static const size_t kFirstCharBits = 1024;
+
+    // 叠加层中node经过code的子节点，不存在返回-1
+    int overlayChild(uint32_t node, uint32_t code) const;
+
+    // 同上，node为根节点，查root_slots_
+    int overlayRootChild(uint32_t code) const;
+
+    bool suppressed(int word_id) const;
+
+    // 叠加层中可能有以c开头的敏感词
+    bool mayStartOverlay(uint32_t c) const {
+        size_t bit = c & (kFirstCharBits - 1);
+        return (first_chars_[bit >> 6] >> (bit & 63)) & 1;
+    }
+
+    // 从offset开始两层中最短的命中，返回命中的字符数，没有命中返回0。in_base/in_overlay: 首字符在该层中是否有转移
+    template<typename Text>
+    int getSensitiveLength(const Text &text, size_t offset, bool in_base, bool in_overlay, size_t &end,
+                           int &word_id) const;
+
+    template<typename Text, typename Emit>
+    void scanSpans(const Text &text, Emit &&emit) const;
+
+private:
+    std::shared_ptr<const FrozenTrie> base_;
+    size_t base_word_count_;
+    TrieArena overlay_;               // 增加的敏感词，已经过基础词库的FoldTable转换
+    std::vector<WordTag> tags_;       // 增加的敏感词的标签
+    std::vector<int32_t> suppressed_; // 屏蔽的基础词库中的敏感词编号，有序
+    std::vector<uint32_t> root_slots_; // 根节点的子节点的开放寻址散列表，0为空，大小为2的幂
+    uint32_t root_shift_ = 31;
+    uint64_t first_chars_[kFirstCharBits / 64] = {};
+};
+
+#endif //INC_01_TRIE_TREE_LAYERED_MATCHER_H_
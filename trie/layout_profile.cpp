@@ -0,0 +1,106 @@
+/** @file layout_profile.cpp
+  * @brief 状态访问统计
+  * @author teng.qing
+  * @date 2021/8/10
+  */
+
+#include "layout_profile.h"
+#include "text_codec.h"
+#include "trie_arena.h"
+
+#include <fstream>
+#include <utility>
+
+LayoutProfile::LayoutProfile(std::shared_ptr<const FrozenTrie> frozen)
+        : frozen_(std::move(frozen)), visits_(frozen_->dat().size(), 0) {}
+
+template<typename Text>
+void LayoutProfile::walk(const Text &text) {
+    const DoubleArray &dat = frozen_->dat();
+    if (dat.empty()) {
+        return;
+    }
+    size_t offset = 0;
+    int index = 0;
+    uint32_t c = 0;
+    while ((offset = text.skip(offset, frozen_->prefilter(), index)) < text.size()) {
+        // 和FrozenTrie::getSensitiveLength相同的路径：根节点的子节点块每个候选字符都要读一次
+        ++visits_[DoubleArray::kRoot];
+        ++total_visits_;
+        size_t pos = offset;
+        int state = DoubleArray::kRoot;
+        while (text.decode(pos, c)) {
+            uint32_t unicode = text.fold(c);
+            int next = dat.transition(state, dat.code(unicode));
+            if (next < 0) {
+                if (state != DoubleArray::kRoot && frozen_->isStopWord(unicode)) {
+                    continue;
+                }
+                break;
+            }
+            ++visits_[next];
+            ++total_visits_;
+            if (dat.isTerminal(next)) {
+                break;
+            }
+            state = next;
+        }
+        text.decode(offset, c);
+        ++index;
+    }
+}
+
+void LayoutProfile::record(const std::wstring &word) {
+    walk(WideText(word, frozen_->foldTable()));
+    ++messages_;
+}
+
+void LayoutProfile::record(std::string_view text) {
+    walk(Utf8Text(text, frozen_->foldTable()));
+    ++messages_;
+}
+
+size_t LayoutProfile::recordFile(const std::string &file_name) {
+    std::ifstream ifs(file_name);
+    std::string line;
+    size_t lines = 0;
+    while (getline(ifs, line)) {
+        record(std::string_view(line));
+        ++lines;
+    }
+    return lines;
+}
+
+std::vector<uint64_t> LayoutProfile::nodeWeights(const TrieArena &trie) const {
+    const DoubleArray &dat = frozen_->dat();
+    std::vector<uint64_t> weights(trie.size(), 0);
+    if (dat.empty()) {
+        return weights;
+    }
+    // 从根节点同时遍历树和双数组，只进入访问过的状态
+    std::vector<std::pair<uint32_t, int>> stack;
+    stack.emplace_back(TrieArena::kRoot, DoubleArray::kRoot);
+    while (!stack.empty()) {
+        uint32_t id = stack.back().first;
+        int state = stack.back().second;
+        stack.pop_back();
+        weights[id] = visits_[state];
+
+        const TrieArena::Node &node = trie.node(id);
+        for (uint32_t i = node.firstChild; i < node.firstChild + node.childCount; ++i) {
+            int next = dat.transition(state, dat.code(trie.node(i).code));
+            if (next >= 0 && visits_[next] > 0) {
+                stack.emplace_back(i, next);
+            }
+        }
+    }
+    return weights;
+}
+
+size_t LayoutProfile::hotStates() const {
+    size_t count = 0;
+    for (uint64_t v : visits_) {
+        count += v > 0;
+    }
+    return count;
+}
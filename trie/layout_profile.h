@@ -0,0 +1,89 @@
+/** @file layout_profile.h
+  * @brief 状态访问统计：用样本流量统计双数组每个状态被访问的次数，重新构建时热的状态排在前面
+  * @author teng.qing
+  * @date 2021/8/10
+  */
+
+#ifndef INC_01_TRIE_TREE_LAYOUT_PROFILE_H_
+#define INC_01_TRIE_TREE_LAYOUT_PROFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "frozen_trie.h"
+
+class TrieArena;
+
+/** @class LayoutProfile
+  * @brief 双数组状态的访问次数
+  *
+  * 双数组默认按广度优先分配位置：所有首字符的子节点块先排完，才轮到第二层，词库越大，
+  * "微"、"小"、"f"、"v"这些常用前缀下面的状态离得越远，扫描时每次转移都可能是一次缓存未命中。
+  * 用样本流量（如一段时间的线上消息）逐字符走一遍双数组，记录每个状态被访问的次数，
+  * 再交给DoubleArray::build：访问多的字符编号小，访问多的节点先分配子节点块（热的优先的广度优先），
+  * 热路径上的状态就集中在数组开头的少数缓存行和页里。
+  *
+  * 统计按kTrie的方式从每个候选首字符开始匹配，和AC自动机沿goto走过的状态基本相同。
+  * 只影响布局，不影响匹配结果。
+  */
+class LayoutProfile {
+public:
+    /** @fn LayoutProfile
+      * @param [in]frozen: 被统计的匹配器，统计结果按它的状态编号记录
+      */
+    explicit LayoutProfile(std::shared_ptr<const FrozenTrie> frozen);
+
+    /** @fn record
+      * @brief 统计一条消息
+      * @param [in]word: 消息
+      * @return void
+      */
+    void record(const std::wstring &word);
+
+    void record(std::string_view text);
+
+    /** @fn recordFile
+      * @brief 统计样本文件，每行一条utf8消息
+      * @param [in]file_name: 文件名
+      * @return 统计的行数，打开失败返回0
+      */
+    size_t recordFile(const std::string &file_name);
+
+    /** @fn nodeWeights
+      * @brief 把状态的访问次数换算到树的节点上，用于DoubleArray::build。
+      * 两者按字符路径对应，树可以和被统计的词库不同（如增加了敏感词），统计中没有的节点为0
+      * @param [in]trie: 将要编译的树
+      * @return 每个节点的访问次数，和trie.size()等长
+      */
+    std::vector<uint64_t> nodeWeights(const TrieArena &trie) const;
+
+    // 状态被访问的次数
+    uint64_t visits(int state) const { return visits_[state]; }
+
+    // 所有状态被访问的次数之和
+    uint64_t totalVisits() const { return total_visits_; }
+
+    // 统计过的消息数
+    size_t messages() const { return messages_; }
+
+    // 访问次数大于0的状态数
+    size_t hotStates() const;
+
+    const std::shared_ptr<const FrozenTrie> &frozen() const { return frozen_; }
+
+private:
+    template<typename Text>
+    void walk(const Text &text);
+
+private:
+    std::shared_ptr<const FrozenTrie> frozen_;
+    std::vector<uint64_t> visits_; // 状态 -> 访问次数，和双数组等长
+    uint64_t total_visits_ = 0;
+    size_t messages_ = 0;
+};
+
+#endif //INC_01_TRIE_TREE_LAYOUT_PROFILE_H_
@@ -4,12 +4,42 @@
   * @date 2021/6/17
   */
 
+#include "filter_client.h"
+#include "filter_server.h"
+#include "static_word_dict.h"
+#include "text_codec.h"
 #include "trie.h"
+#include "trie_holder.h"
 #include <iostream>
 #include <thread>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <tuple>
+#include <unistd.h>
+
+// 统计堆内存申请次数，用于验证forEachSensitive扫描过程不申请内存
+static std::atomic<size_t> g_alloc_count{0};
+
+// new和delete都不内联：否则编译器在调用处看到malloc返回的指针被operator delete释放，报-Wmismatched-new-delete
+__attribute__((noinline)) void *operator new(std::size_t size) {
+    g_alloc_count++;
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept { std::free(p); }
+
+__attribute__((noinline)) void operator delete(void *p, std::size_t) noexcept { std::free(p); }
 
 int example1() {
     std::unordered_set<std::wstring> sensitive = {
@@ -32,6 +62,21 @@ int example1() {
     return 0;
 }
 
+// utf8直接匹配，不需要s2ws/ws2s
+int example_utf8() {
+    Trie trie;
+    trie.loadFromFile("word.txt");
+    trie.loadStopWordFromFile("stopwd.txt");
+
+    std::string str = "fUcK，你是逗比吗？ｆｕｃｋ，你竟然用微信，微@!!%%%。信";
+    for (auto &&i : trie.getSensitive(std::string_view(str))) {
+        std::cout << "[index=" << i.startIndex << ",len=" << i.len << ",byteOffset=" << i.byteOffset
+                  << ",byteLen=" << i.byteLen << ",word=" << i.word << "]" << std::endl;
+    }
+    std::cout << trie.replaceSensitive(std::string_view(str)) << std::endl;
+    return 0;
+}
+
 int exmaple2() {
     std::vector<std::string> words = {
             // 字母
@@ -103,16 +148,17 @@ void test_time(Trie &t, const std::wstring &origin_word) {
     std::cout << SBCConvert::ws2s(t.replaceSensitive(origin_word)) << std::endl << std::endl;
 }
 
-// thread safe
+// thread safe: 所有线程同时运行，而不是一个一个join
 void test_concurrent(Trie &t, const std::wstring &origin_word) {
+    std::vector<std::thread> threads;
     for (int i = 0; i < 20; i++) {
-        std::thread thd([&]() {
-            std::cout << "thread: " << SBCConvert::ws2s(t.replaceSensitive(origin_word)) << std::endl;
+        threads.emplace_back([&]() {
+            std::cout << "thread: " + SBCConvert::ws2s(t.replaceSensitive(origin_word)) + "\n";
         });
+    }
+    for (auto &thd : threads) {
         thd.join();
     }
-
-    std::this_thread::sleep_for(std::chrono::microseconds(3000));
 }
 
 void test_time_by_find(std::vector<std::wstring> &words, std::wstring &origin_word) {
@@ -209,9 +255,1932 @@ int exmaple3() {
     return 0;
 }
 
+// 树（unordered_map节点）、双数组、AC自动机的性能对比
+void benchmark_double_array() {
+    std::vector<std::wstring> words;
+    std::ifstream ifs("word.txt", std::ios_base::in);
+    std::string str;
+    while (getline(ifs, str)) {
+        words.emplace_back(SBCConvert::s2ws(str));
+    }
+
+    // 只insert不build，走树
+    Trie map_trie;
+    // insert之后build，走双数组
+    Trie dat_trie;
+    for (auto &item : words) {
+        map_trie.insert(item);
+        dat_trie.insert(item);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    dat_trie.build();
+    std::cout << "build double array: " << get_time_diff(t1) << " ms" << std::endl;
+
+    std::wstring text;
+    for (int i = 0; i < 200; i++) {
+        text += L"你个傻逼，小姐姐还不赶紧加VX，微信，扣扣是Qq3306 4343，你奶奶的。。。赶快加。"
+                L"今天天气不错，我们一起去公园散步吧，hello world! ";
+    }
+
+    const int kLoop = 20;
+    auto run = [&](Trie &t, const char *name) {
+        size_t hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLoop; i++) {
+            hits += t.getSensitive(text).size();
+        }
+        double ms = get_time_diff(start);
+        double chars = static_cast<double>(text.length()) * kLoop;
+        std::cout << name << ": " << ms << " ms, " << chars / ms / 1000 << " M chars/s, hits=" << hits
+                  << std::endl;
+    };
+    run(map_trie, "unordered_map");
+    run(dat_trie, "double array ");
+    dat_trie.setMatchMode(MatchMode::kAhoCorasick);
+    run(dat_trie, "aho-corasick ");
+}
+
+std::vector<std::wstring> sample_messages() {
+    return {
+            L"你个傻逼，小姐姐还不赶紧加VX，微信，扣扣是Qq3306 4343，你奶奶的。。。赶快加",
+            L"fUcK，你是逗比吗？ｆｕｃｋ，你竟然用微信，微@!!%%%。信",
+            L"今天天气不错，我们一起去公园散步吧，hello world!",
+            L"微【】、。？《》信，V&X，扣_扣，F&uc&&&k",
+    };
+}
+
+// 冻结后的匹配器，32个线程同时读，主线程同时修改原来的Trie
+void test_frozen_concurrent() {
+    Trie trie;
+    trie.loadFromFile("word.txt");
+    trie.loadStopWordFromFile("stopwd.txt");
+
+    for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+        trie.setMatchMode(mode);
+        std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+
+        std::vector<std::wstring> messages = sample_messages();
+        std::vector<std::wstring> expected;
+        for (auto &item : messages) {
+            expected.push_back(frozen->replaceSensitive(item));
+        }
+
+        const int kThreads = 32;
+        std::atomic<bool> start{false};
+        std::atomic<int> errors{0};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < kThreads; i++) {
+            threads.emplace_back([&, i]() {
+                while (!start.load()) {
+                    std::this_thread::yield();
+                }
+                for (int j = 0; j < 2000; j++) {
+                    size_t index = (i + j) % messages.size();
+                    if (frozen->replaceSensitive(messages[index]) != expected[index] ||
+                        !frozen->search(messages[index % 2])) {
+                        errors++;
+                    }
+                }
+            });
+        }
+        start = true;
+        // 冻结的匹配器和Trie互不影响
+        for (int i = 0; i < 100; i++) {
+            trie.insert(L"今天天气" + std::to_wstring(i));
+        }
+        for (auto &thd : threads) {
+            thd.join();
+        }
+        std::cout << "frozen concurrent " << (mode == MatchMode::kTrie ? "trie" : "aho-corasick") << ": "
+                  << kThreads << " threads, errors=" << errors << std::endl;
+        if (errors != 0) {
+            std::abort();
+        }
+    }
+}
+
+// 字符转换：原来的分支判断、查表、SIMD批量转换
+void benchmark_char_convert() {
+    std::wstring text;
+    for (int i = 0; i < 20000; i++) {
+        text += L"Hello World，ＦＵｃｋ ＶＸ，加我微信QQ12345678，ABCdefGHIjklMNOpqrSTUvwxYZ!";
+    }
+    std::wstring out(text.size(), L'\0');
+
+    // 原来的charConvert：qj2bj + 大小写判断
+    auto legacy = [](wchar_t c) {
+        int r = SBCConvert::qj2bj(c);
+        return (r >= 'A' && r <= 'Z') ? r + 32 : r;
+    };
+
+    const int kLoop = 20;
+    auto t1 = std::chrono::steady_clock::now();
+    for (int n = 0; n < kLoop; n++) {
+        for (size_t i = 0; i < text.size(); i++) {
+            out[i] = static_cast<wchar_t>(legacy(text[i]));
+        }
+    }
+    double legacy_ms = get_time_diff(t1);
+    size_t check = out[text.size() / 2];
+
+    t1 = std::chrono::steady_clock::now();
+    for (int n = 0; n < kLoop; n++) {
+        for (size_t i = 0; i < text.size(); i++) {
+            out[i] = static_cast<wchar_t>(SBCConvert::charConvert(text[i]));
+        }
+    }
+    double table_ms = get_time_diff(t1);
+    check += out[text.size() / 2];
+
+    t1 = std::chrono::steady_clock::now();
+    for (int n = 0; n < kLoop; n++) {
+        SBCConvert::normalize(text.data(), text.size(), &out[0]);
+    }
+    double simd_ms = get_time_diff(t1);
+    check += out[text.size() / 2];
+
+    double chars = static_cast<double>(text.size()) * kLoop / 1000;
+    std::cout << "charConvert branch: " << chars / legacy_ms << " M chars/s, table: " << chars / table_ms
+              << " M chars/s, normalize: " << chars / simd_ms << " M chars/s (" << check << ")" << std::endl;
+}
+
+// forEachSensitive不申请堆内存
+void test_visitor_no_alloc() {
+    class CountVisitor : public MatchVisitor {
+    public:
+        bool onMatch(const MatchSpan &span) override {
+            hits++;
+            word_ids += span.wordId;
+            return true;
+        }
+
+        size_t hits = 0;
+        size_t word_ids = 0;
+    };
+
+    Trie trie;
+    trie.loadFromFile("word.txt");
+    trie.loadStopWordFromFile("stopwd.txt");
+    std::vector<std::wstring> messages = sample_messages();
+    std::vector<std::string> utf8_messages;
+    for (auto &item : messages) {
+        utf8_messages.push_back(SBCConvert::ws2s(item));
+    }
+
+    for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+        trie.setMatchMode(mode);
+        std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+        CountVisitor visitor;
+        // 打开统计（DIRTYFILTER_METRICS）时，每个线程第一次扫描会创建自己的计数器
+        CountVisitor warm_up;
+        frozen->forEachSensitive(messages[0], warm_up);
+
+        size_t before = g_alloc_count;
+        for (int i = 0; i < 1000; i++) {
+            for (size_t j = 0; j < messages.size(); j++) {
+                frozen->forEachSensitive(messages[j], visitor);
+                frozen->forEachSensitive(std::string_view(utf8_messages[j]), visitor);
+            }
+        }
+        size_t allocs = g_alloc_count - before;
+        std::cout << "visitor " << (mode == MatchMode::kTrie ? "trie" : "aho-corasick") << ": hits="
+                  << visitor.hits << ", allocs=" << allocs << std::endl;
+        if (allocs != 0) {
+            std::abort();
+        }
+    }
+}
+
+// 多线程吞吐量，线程数从1到32
+void benchmark_thread_scaling() {
+    Trie trie;
+    trie.loadFromFile("word.txt");
+    trie.loadStopWordFromFile("stopwd.txt");
+    std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+    std::vector<std::wstring> messages = sample_messages();
+
+    const int kPerThread = 20000;
+    for (int threads_num : {1, 2, 4, 8, 16, 32}) {
+        std::vector<std::thread> threads;
+        std::atomic<size_t> hits{0};
+        auto t1 = std::chrono::steady_clock::now();
+        for (int i = 0; i < threads_num; i++) {
+            threads.emplace_back([&, i]() {
+                size_t local = 0;
+                for (int j = 0; j < kPerThread; j++) {
+                    local += frozen->getSensitive(messages[(i + j) % messages.size()]).size();
+                }
+                hits += local;
+            });
+        }
+        for (auto &thd : threads) {
+            thd.join();
+        }
+        double ms = get_time_diff(t1);
+        std::cout << "threads=" << threads_num << ", " << (threads_num * kPerThread) / ms * 1000
+                  << " msg/s, hits=" << hits << std::endl;
+    }
+}
+
+// 批量接口：结果和逐条调用一致，统计不同线程数下的吞吐
+void benchmark_batch() {
+    Trie trie;
+    trie.loadFromFile("word.txt");
+    trie.loadStopWordFromFile("stopwd.txt");
+    std::vector<std::wstring> samples = sample_messages();
+
+    const size_t kMessages = 200000;
+    std::vector<std::wstring> messages;
+    messages.reserve(kMessages);
+    for (size_t i = 0; i < kMessages; i++) {
+        messages.push_back(samples[i % samples.size()]);
+    }
+    std::vector<std::wstring> expected;
+    expected.reserve(kMessages);
+    for (const auto &msg : messages) {
+        expected.push_back(trie.replaceSensitive(msg));
+    }
+
+    for (size_t threads_num : {1, 2, 4, 8, 16}) {
+        trie.setBatchThreads(threads_num);
+        trie.replaceSensitiveBatch(messages.data(), 1); // 预先创建线程
+        auto t1 = std::chrono::steady_clock::now();
+        std::vector<std::wstring> result = trie.replaceSensitiveBatch(messages);
+        double ms = get_time_diff(t1);
+        assert(result == expected);
+        if (result != expected) {
+            std::cout << "batch result mismatch, threads=" << threads_num << std::endl;
+            std::abort();
+        }
+        std::cout << "batch threads=" << threads_num << ", " << kMessages / ms * 1000 << " msg/s" << std::endl;
+    }
+}
+
+// 二进制词库：和从文本加载的结果一致，比较两种方式的加载耗时，损坏的文件不能加载
+void test_binary_dict() {
+    auto t1 = std::chrono::steady_clock::now();
+    Trie text_trie;
+    text_trie.loadStopWordFromFile("stopwd.txt");
+    text_trie.loadFromFile("word.txt");
+    double text_ms = get_time_diff(t1);
+    bool ok = text_trie.saveToBinaryFile("dict.bin");
+    assert(ok);
+
+    t1 = std::chrono::steady_clock::now();
+    Trie bin_trie;
+    ok = bin_trie.loadFromBinaryFile("dict.bin") && ok;
+    double bin_ms = get_time_diff(t1);
+    std::cout << "load text: " << text_ms << " ms, load binary: " << bin_ms << " ms" << std::endl;
+
+    int errors = 0;
+    for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+        text_trie.setMatchMode(mode);
+        bin_trie.setMatchMode(mode);
+        for (const auto &msg : sample_messages()) {
+            if (text_trie.replaceSensitive(msg) != bin_trie.replaceSensitive(msg)) {
+                errors++;
+            }
+        }
+    }
+
+    // 在二进制词库上追加敏感词，原有的敏感词、编号和标签不变
+    Trie appended;
+    ok = appended.loadFromBinaryFile("dict.bin") && ok;
+    size_t base_count = appended.freeze()->wordCount();
+    appended.insert(L"新词汇");
+    appended.build();
+    text_trie.insert(L"新词汇");
+    text_trie.build();
+    std::shared_ptr<const FrozenTrie> frozen = appended.freeze();
+    int new_id = -1;
+    frozen->forEachSensitive(std::wstring(L"一个新词汇"), [&](const MatchSpan &span) {
+        new_id = span.wordId;
+        return true;
+    });
+    if (frozen->wordCount() != base_count + 1 || new_id != static_cast<int>(base_count) || !appended.search(L"微信")) {
+        errors++;
+    }
+    for (const auto &msg : sample_messages()) {
+        if (appended.replaceSensitive(msg) != text_trie.replaceSensitive(msg)) {
+            errors++;
+        }
+    }
+
+    // 改掉一个字节，校验和应该不通过
+    std::string data;
+    {
+        std::ifstream ifs("dict.bin", std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    data[data.size() / 2] ^= 1;
+    std::ofstream("dict_bad.bin", std::ios::binary).write(data.data(), data.size());
+    Trie bad_trie;
+    if (bad_trie.loadFromBinaryFile("dict_bad.bin")) {
+        errors++;
+    }
+
+    // 不计算校验和时，随机改掉一位的文件要么加载失败，要么可以正常匹配，不能越界（用sanitizer运行）
+    std::mt19937 rng(20210722);
+    int loaded = 0;
+    for (int i = 0; i < 300; i++) {
+        std::string flipped = data;
+        flipped[data.size() / 2] ^= 1; // 还原上面改掉的字节
+        flipped[rng() % flipped.size()] ^= static_cast<char>(1 << (rng() % 8));
+        std::ofstream("dict_bad.bin", std::ios::binary | std::ios::trunc).write(flipped.data(), flipped.size());
+        Trie flipped_trie;
+        if (!flipped_trie.loadFromBinaryFile("dict_bad.bin", false)) {
+            continue;
+        }
+        loaded++;
+        for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+            flipped_trie.setMatchMode(mode);
+            std::unique_ptr<MatchStream> stream = flipped_trie.openStream();
+            for (const auto &msg : sample_messages()) {
+                flipped_trie.replaceSensitive(msg);
+                stream->feed(std::wstring_view(msg), [](const MatchSpan &) { return true; });
+            }
+            stream->finish([](const MatchSpan &) { return true; });
+        }
+        flipped_trie.insert(L"新词汇");
+        flipped_trie.build();
+    }
+    std::cout << "binary dict: " << loaded << " of 300 flipped files loaded without checksum" << std::endl;
+    std::remove("dict_bad.bin");
+    std::remove("dict.bin");
+
+    std::cout << "binary dict: errors=" << errors << std::endl;
+    if (!ok || errors != 0) {
+        std::abort();
+    }
+}
+
+// 流式匹配：把消息切成任意大小的块（包括把一个utf8字符切开）输入，结果应该和整条消息一次匹配相同
+void test_stream() {
+    Trie trie;
+    trie.loadStopWordFromFile("stopwd.txt");
+    trie.loadFromFile("word.txt");
+    trie.setMatchMode(MatchMode::kAhoCorasick);
+    std::unique_ptr<MatchStream> stream = trie.openStream();
+
+    std::string all;
+    for (const auto &msg : sample_messages()) {
+        all += SBCConvert::ws2s(msg);
+    }
+    std::set<Utf8SensitiveWord> expected = trie.getSensitive(std::string_view(all));
+
+    int errors = 0;
+    for (size_t chunk = 1; chunk <= 16; chunk++) {
+        std::vector<MatchSpan> spans;
+        auto collect = [&](const MatchSpan &span) {
+            spans.push_back(span);
+            return true;
+        };
+        for (size_t i = 0; i < all.size(); i += chunk) {
+            stream->feed(std::string_view(all).substr(i, chunk), collect);
+        }
+        stream->finish(collect);
+        if (spans.size() != expected.size()) {
+            errors++;
+            continue;
+        }
+        auto it = expected.begin();
+        for (const MatchSpan &span : spans) {
+            if (span.offset != it->byteOffset || span.length != it->byteLen || span.startIndex != it->startIndex ||
+                span.len != it->len) {
+                errors++;
+            }
+            ++it;
+        }
+    }
+
+    // 长时间运行的流，内存不增长，偏移是整个流中的位置
+    size_t memory = stream->memoryUsage();
+    std::string msg = SBCConvert::ws2s(sample_messages()[0]);
+    size_t hits = 0;
+    size_t last_offset = 0;
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100000; i++) {
+        stream->feed(msg, [&](const MatchSpan &span) {
+            if (span.offset < last_offset) {
+                errors++;
+            }
+            last_offset = span.offset;
+            hits++;
+            return true;
+        });
+    }
+    size_t fed = stream->offset();
+    stream->finish([&](const MatchSpan &) {
+        hits++;
+        return true;
+    });
+    double ms = get_time_diff(t1);
+    if (fed != msg.size() * 100000 || stream->memoryUsage() != memory ||
+        hits < trie.getSensitive(std::string_view(msg)).size() * 100000) {
+        errors++;
+    }
+    std::cout << "stream: " << fed / 1024 / 1024 << " MB, " << hits << " hits, " << (fed / 1024.0 / 1024.0) / (ms / 1000)
+              << " MB/s, memory " << memory << " bytes, errors=" << errors << std::endl;
+    if (errors != 0) {
+        std::abort();
+    }
+}
+
+// AC自动机（包括流式匹配）和逐位置匹配的结果一致，停顿词同时出现在敏感词里时也一致
+void test_ac_stop_words() {
+    auto spans = [](Trie &t, const std::wstring &text) {
+        std::vector<MatchSpan> ret;
+        t.forEachSensitive(text, [&](const MatchSpan &span) {
+            ret.push_back(span);
+            return true;
+        });
+        return ret;
+    };
+    auto same = [](const std::vector<MatchSpan> &a, const std::vector<MatchSpan> &b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const MatchSpan &x, const MatchSpan &y) {
+            return x.offset == y.offset && x.length == y.length && x.startIndex == y.startIndex && x.len == y.len &&
+                   x.wordId == y.wordId;
+        });
+    };
+
+    int errors = 0;
+    // 当前（最长）状态在"X微"，不能跳过"@"，但从"@"开始可以命中
+    {
+        std::unordered_set<wchar_t> stop_words{L'@'};
+        Trie trie;
+        trie.loadStopWordFromMemory(stop_words);
+        trie.loadFromMemory(std::vector<std::wstring>{L"X微a", L"@"});
+        trie.setMatchMode(MatchMode::kAhoCorasick);
+        std::unique_ptr<MatchStream> stream = trie.openStream();
+        std::vector<MatchSpan> streamed;
+        auto collect = [&](const MatchSpan &span) {
+            streamed.push_back(span);
+            return true;
+        };
+        stream->feed(std::wstring_view(L"X@"), collect);
+        stream->finish(collect);
+        if (trie.getSensitive(L"X@").size() != 1 || !trie.search(L"X@") || trie.replaceSensitive(L"X@") != L"X*" ||
+            streamed.size() != 1 || streamed[0].startIndex != 1) {
+            errors++;
+        }
+    }
+
+    // 敏感词中间很长的一段停顿词，流式匹配的缓冲区需要扩容
+    {
+        std::unordered_set<wchar_t> stop_words{L'@'};
+        Trie trie;
+        trie.loadStopWordFromMemory(stop_words);
+        trie.loadFromMemory(std::vector<std::wstring>{L"a@b"});
+        trie.setMatchMode(MatchMode::kAhoCorasick);
+        std::unique_ptr<MatchStream> stream = trie.openStream();
+        std::wstring text = L"xa" + std::wstring(300, L'@') + L"bx";
+        std::vector<MatchSpan> streamed;
+        auto collect = [&](const MatchSpan &span) {
+            streamed.push_back(span);
+            return true;
+        };
+        stream->feed(std::wstring_view(text), collect);
+        stream->finish(collect);
+        if (!same(streamed, spans(trie, text)) || streamed.size() != 1 || streamed[0].len != 302) {
+            errors++;
+        }
+    }
+
+    // 随机的词库和文本，停顿词分别出现和不出现在敏感词里
+    std::mt19937 rng(20210618);
+    const std::wstring with_stop = L"abcd@-微X";
+    const std::wstring without_stop = L"abcd微X";
+    size_t rounds = 0;
+    for (const std::wstring *letters : {&with_stop, &without_stop}) {
+        auto random_text = [&](size_t max_len, const std::wstring &from) {
+            std::wstring text(rng() % (max_len + 1), L' ');
+            for (auto &ch : text) {
+                ch = from[rng() % from.size()];
+            }
+            return text;
+        };
+        for (int round = 0; round < 300; round++, rounds++) {
+            std::vector<std::wstring> words;
+            for (size_t i = 0, n = 1 + rng() % 12; i < n; i++) {
+                std::wstring word = random_text(4, *letters);
+                if (!word.empty()) {
+                    words.push_back(word);
+                }
+            }
+            std::unordered_set<wchar_t> stop_words{L'@', L'-'};
+            Trie by_trie, by_ac;
+            for (Trie *t : {&by_trie, &by_ac}) {
+                t->loadStopWordFromMemory(stop_words);
+                t->loadFromMemory(words);
+            }
+            by_ac.setMatchMode(MatchMode::kAhoCorasick);
+            bool stop_in_words = std::any_of(words.begin(), words.end(), [](const std::wstring &word) {
+                return word.find_first_of(L"@-") != std::wstring::npos;
+            });
+            if (by_ac.freeze()->stopWordsInWords() != stop_in_words) {
+                errors++;
+            }
+            std::unique_ptr<MatchStream> stream = by_ac.openStream();
+            for (int i = 0; i < 20; i++) {
+                std::wstring text = random_text(40, with_stop + L"?");
+                std::vector<MatchSpan> expected = spans(by_trie, text);
+                if (!same(spans(by_ac, text), expected) ||
+                    by_ac.replaceSensitive(text) != by_trie.replaceSensitive(text) ||
+                    by_ac.search(text) != !expected.empty()) {
+                    errors++;
+                }
+                std::vector<MatchSpan> streamed;
+                auto collect = [&](const MatchSpan &span) {
+                    streamed.push_back(span);
+                    return true;
+                };
+                for (size_t pos = 0; pos < text.size();) {
+                    size_t chunk = 1 + rng() % 5;
+                    stream->feed(std::wstring_view(text).substr(pos, chunk), collect);
+                    pos += chunk;
+                }
+                stream->finish(collect);
+                if (!same(streamed, expected)) {
+                    errors++;
+                }
+            }
+        }
+    }
+    std::cout << "ac stop words: " << rounds << " rounds, errors=" << errors << std::endl;
+    if (errors != 0) {
+        std::abort();
+    }
+}
+
+// 字符转换规则：映射文件合成一张表，敏感词只需要写一种形式
+void test_fold_mapping() {
+    {
+        std::ofstream ofs("fold_test.txt");
+        ofs << "# 测试用映射\n"
+            << "愛\t爱\n"
+            << "妳 你 妳\n"      // 多个目标取第一个
+            << "а a\n"           // 西里尔字母
+            << "U+2460 1\n"      // ①
+            << "\U0001D400 a\n"; // 数学粗体A，BMP之外
+    }
+    int errors = 0;
+    Trie trie;
+    std::string error;
+    if (!trie.loadFoldMappingFiles({"fold_test.txt"}, &error)) {
+        std::cout << error << std::endl;
+        errors++;
+    }
+    trie.loadStopWordFromFile("stopwd.txt");
+    std::unordered_set<std::wstring> words = {L"爱你", L"abc1"};
+    trie.loadFromMemory(words);
+    // 已经加载了敏感词，不能再改规则
+    if (trie.setFoldTable(FoldTable::defaultTable())) {
+        errors++;
+    }
+
+    std::vector<std::pair<std::wstring, std::wstring>> cases = {
+            {L"我愛妳", L"我**"},
+            {L"我爱你", L"我**"},
+            {L"аBC①!", L"****!"},
+            {L"\U0001D400bx1", L"\U0001D400bx1"},
+            {L"\U0001D400bc1", L"****"},
+    };
+    for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+        trie.setMatchMode(mode);
+        for (auto &item : cases) {
+            if (trie.replaceSensitive(item.first) != item.second) {
+                errors++;
+            }
+            std::string utf8 = SBCConvert::ws2s(item.first);
+            if (trie.replaceSensitive(std::string_view(utf8)) != SBCConvert::ws2s(item.second)) {
+                errors++;
+            }
+        }
+    }
+
+    // 二进制词库记录了转换表的指纹，加载时规则不同会被拒绝
+    trie.saveToBinaryFile("dict_fold.bin");
+    Trie default_rules;
+    if (default_rules.loadFromBinaryFile("dict_fold.bin")) {
+        errors++;
+    }
+    Trie same_rules;
+    same_rules.setFoldTable(trie.foldTable());
+    if (!same_rules.loadFromBinaryFile("dict_fold.bin") || same_rules.replaceSensitive(L"我愛妳") != L"我**") {
+        errors++;
+    }
+    std::remove("dict_fold.bin");
+
+    // 格式错误和BMP映射到BMP之外都会失败
+    FoldTable bad;
+    if (bad.addMapping({{L'a', 0x1F600}}) || bad.addMappingFile("no_such_file.txt")) {
+        errors++;
+    }
+    std::remove("fold_test.txt");
+
+    // 有映射时normalize仍然走SIMD（ASCII规则没有变化），和默认表的速度对比
+    std::wstring text;
+    for (int i = 0; i < 10000; i++) {
+        text += sample_messages()[i % sample_messages().size()];
+    }
+    std::wstring out(text.size(), L'\0');
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20; i++) {
+        SBCConvert::normalize(text.data(), text.size(), &out[0]);
+    }
+    double default_ms = get_time_diff(t1);
+    t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20; i++) {
+        SBCConvert::normalize(text.data(), text.size(), &out[0], *trie.foldTable());
+    }
+    double mapped_ms = get_time_diff(t1);
+    double chars = text.size() * 20 / 1000000.0;
+    std::cout << "fold mapping: default " << chars / default_ms * 1000 << " M chars/s, mapped "
+              << chars / mapped_ms * 1000 << " M chars/s, errors=" << errors << std::endl;
+    if (errors != 0) {
+        std::abort();
+    }
+}
+
+// 批量构建和逐个insert的结果完全一致（包括敏感词编号），批量构建之后还可以继续insert
+void test_bulk_build() {
+    // 随机敏感词：字符集很小，有大量重复和互为前缀的词，再加上大小写、空词、BMP之外的字符
+    std::vector<std::wstring> words;
+    std::ifstream ifs("word.txt");
+    std::string line;
+    while (getline(ifs, line)) {
+        words.push_back(SBCConvert::s2ws(line));
+    }
+    const std::wstring chars = L"abAB你好傻逼\U0001F600";
+    srand(15);
+    for (int i = 0; i < 20000; i++) {
+        std::wstring word;
+        for (int len = 1 + rand() % 6; len > 0; len--) {
+            word += chars[rand() % chars.size()];
+        }
+        words.push_back(word);
+    }
+    words.insert(words.begin() + 100, L"");
+    words.emplace_back(L"");
+
+    auto t1 = std::chrono::steady_clock::now();
+    Trie inserted;
+    inserted.loadStopWordFromFile("stopwd.txt");
+    for (auto &word : words) {
+        inserted.insert(word);
+    }
+    inserted.build();
+    double insert_ms = get_time_diff(t1);
+
+    t1 = std::chrono::steady_clock::now();
+    Trie bulk;
+    bulk.loadStopWordFromFile("stopwd.txt");
+    bulk.loadFromMemory(words);
+    double bulk_ms = get_time_diff(t1);
+
+    int errors = 0;
+    auto compare = [&]() {
+        if (bulk.freeze()->dat().stateCount() != inserted.freeze()->dat().stateCount()) {
+            errors++;
+        }
+        for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+            bulk.setMatchMode(mode);
+            inserted.setMatchMode(mode);
+            for (int i = 0; i < 2000; i++) {
+                // 随机字符，或者随机的几个敏感词拼接
+                std::wstring text;
+                for (int len = rand() % 40; len > 0; len--) {
+                    text += chars[rand() % chars.size()];
+                }
+                for (int n = i % 2 == 0 ? 0 : rand() % 6; n > 0; n--) {
+                    text += words[rand() % words.size()] + L"，";
+                }
+                std::vector<MatchSpan> a;
+                std::vector<MatchSpan> b;
+                bulk.forEachSensitive(text, [&](const MatchSpan &span) {
+                    a.push_back(span);
+                    return true;
+                });
+                inserted.forEachSensitive(text, [&](const MatchSpan &span) {
+                    b.push_back(span);
+                    return true;
+                });
+                if (a.size() != b.size()) {
+                    errors++;
+                    continue;
+                }
+                for (size_t j = 0; j < a.size(); j++) {
+                    if (a[j].offset != b[j].offset || a[j].len != b[j].len || a[j].wordId != b[j].wordId) {
+                        errors++;
+                    }
+                }
+            }
+        }
+    };
+    compare();
+
+    // 批量构建之后insert，还原为树再追加，编号接着往后排
+    for (const wchar_t *word : {L"新词", L"你好", L"好傻"}) {
+        bulk.insert(word);
+        inserted.insert(word);
+    }
+    bulk.build();
+    inserted.build();
+    compare();
+
+    std::cout << "bulk build: words=" << words.size() << ", insert " << insert_ms << " ms, bulk " << bulk_ms
+              << " ms, errors=" << errors << std::endl;
+    if (errors != 0) {
+        std::abort();
+    }
+}
+
+// 热更新：读线程一直在扫描，主线程反复reload，统计reload耗时和读线程的延迟
+void benchmark_hot_reload() {
+    TrieHolder holder;
+    holder.reload("word.txt", "stopwd.txt");
+    std::vector<std::wstring> messages = sample_messages();
+
+    const int kReaders = 4;
+    std::atomic<bool> stop{false};
+    std::vector<std::vector<double>> latencies(kReaders);
+    // 读者释放快照的最长耗时，旧快照由reload的线程析构，这里不应该出现析构的耗时
+    std::vector<double> max_release(kReaders, 0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kReaders; i++) {
+        threads.emplace_back([&, i]() {
+            latencies[i].reserve(1 << 20);
+            for (size_t j = 0; !stop.load(); j++) {
+                auto t1 = std::chrono::steady_clock::now();
+                std::shared_ptr<const FrozenTrie> snapshot = holder.get();
+                snapshot->replaceSensitive(messages[j % messages.size()]);
+                auto t2 = std::chrono::steady_clock::now();
+                snapshot.reset();
+                max_release[i] = std::max(max_release[i], get_time_diff(t2));
+                latencies[i].push_back(get_time_diff(t1));
+            }
+        });
+    }
+
+    const int kReloads = 10;
+    double total_build_ms = 0;
+    for (int i = 0; i < kReloads; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        holder.reloadAsync("word.txt", "stopwd.txt").wait();
+        total_build_ms += holder.lastBuildMs();
+    }
+    stop = true;
+    for (auto &thd : threads) {
+        thd.join();
+    }
+
+    std::vector<double> all;
+    for (auto &item : latencies) {
+        all.insert(all.end(), item.begin(), item.end());
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << "hot reload: reloads=" << kReloads << ", version=" << holder.version()
+              << ", avg build=" << total_build_ms / kReloads << " ms" << std::endl;
+    std::cout << "readers: ops=" << all.size() << ", p50=" << all[all.size() / 2] * 1000
+              << " us, p99=" << all[all.size() * 99 / 100] * 1000 << " us, max=" << all.back() * 1000
+              << " us, max release=" << *std::max_element(max_release.begin(), max_release.end()) * 1000 << " us"
+              << std::endl;
+}
+
+// 词库文件无法读取时不发布空词库，继续使用当前快照
+void test_reload_missing_file() {
+    int errors = 0;
+    TrieHolder holder;
+    if (!holder.reload("word.txt", "stopwd.txt")) {
+        errors++;
+    }
+    std::shared_ptr<const FrozenTrie> snapshot = holder.get();
+    uint64_t version = holder.version();
+
+    std::string error;
+    if (holder.reload("no_such_word.txt", "stopwd.txt", &error) || error.find("no_such_word.txt") == std::string::npos) {
+        errors++;
+    }
+    if (holder.reload("word.txt", "no_such_stopwd.txt") || holder.reloadAsync("no_such_word.txt", "").get()) {
+        errors++;
+    }
+    if (holder.get() != snapshot || holder.version() != version || !holder.get()->search(L"微信")) {
+        errors++;
+    }
+
+    Trie trie;
+    if (trie.loadFromFile("no_such_word.txt") || trie.loadStopWordFromFile("no_such_stopwd.txt") ||
+        !trie.loadFromFile("word.txt") || trie.freeze()->wordCount() == 0) {
+        errors++;
+    }
+    std::cout << "reload missing file: version=" << holder.version() << ", errors=" << errors << std::endl;
+    if (errors != 0) {
+        std::abort();
+    }
+}
+
+// 被替换的快照由reload的线程析构，读者释放最后一个引用时不析构
+void test_reload_retire() {
+    int errors = 0;
+    TrieHolder holder;
+    holder.reload("word.txt", "");
+    std::weak_ptr<const FrozenTrie> first = holder.get();
+    // 没有读者持有，reload返回前已经析构
+    holder.reload("word.txt", "");
+    if (!first.expired()) {
+        errors++;
+    }
+
+    // 读者在reload等待期间释放
+    std::shared_ptr<const FrozenTrie> reader = holder.get();
+    std::weak_ptr<const FrozenTrie> second = reader;
+    std::thread release([&reader]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        reader.reset();
+    });
+    holder.reload("word.txt", "");
+    release.join();
+    if (!second.expired()) {
+        errors++;
+    }
+
+    // 读者持有超过等待时间：读者释放后仍不析构，留到下一次reload
+    reader = holder.get();
+    std::weak_ptr<const FrozenTrie> third = reader;
+    holder.reload("word.txt", "");
+    reader.reset();
+    if (third.expired()) {
+        errors++;
+    }
+    holder.reload("word.txt", "");
+    if (!third.expired()) {
+        errors++;
+    }
+    std::cout << "reload retire: version=" << holder.version() << ", errors=" << errors << std::endl;
+    if (errors != 0) {
+        std::abort();
+    }
+}
+
+void test_metrics() {
+    int errors = 0;
+    for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+        Trie trie;
+        std::unordered_set<wchar_t> stop_words = {L'*'};
+        trie.loadStopWordFromMemory(stop_words);
+        std::unordered_set<std::wstring> words = {L"微信", L"色情", L"a\"b"};
+        trie.loadFromMemory(words);
+        trie.setMatchMode(mode);
+
+        trie.replaceSensitive(L"加微*信，看色情");                       // 2次命中，跳过1个停顿词
+        trie.getSensitive(std::string_view(SBCConvert::ws2s(L"微信a\"b"))); // 2次命中
+        trie.search(L"没有");
+        std::unique_ptr<MatchStream> stream = trie.openStream();         // 2块算2次扫描
+        stream->feed(std::wstring_view(L"微"), [](const MatchSpan &) { return true; });
+        stream->feed(std::wstring_view(L"信"), [](const MatchSpan &) { return true; });
+        stream->finish([](const MatchSpan &) { return true; });
+
+        MetricsSnapshot snapshot = trie.metrics();
+        if (!Metrics::enabled()) {
+            // 编译时没有打开，不记录
+            if (snapshot.scans != 0 || snapshot.hits != 0 || !snapshot.wordHits.empty()) {
+                errors++;
+            }
+            continue;
+        }
+        if (snapshot.scans != 5 || snapshot.hits != 5 || snapshot.stopWordSkips != 1 ||
+            snapshot.wordHits.size() != 3 || snapshot.wordHits["微信"] != 3 || snapshot.wordHits["a\"b"] != 1 ||
+            snapshot.latency.count != 5 || snapshot.inputLength.count != 5) {
+            errors++;
+        }
+        std::string text = snapshot.toPrometheus();
+        for (const char *line : {"dirtyfilter_scans_total 5\n", "dirtyfilter_word_hits_total{word=\"微信\"} 3\n",
+                                 "dirtyfilter_word_hits_total{word=\"a\\\"b\"} 1\n",
+                                 "dirtyfilter_scan_input_length_bucket{le=\"+Inf\"} 5\n"}) {
+            if (text.find(line) == std::string::npos) {
+                errors++;
+            }
+        }
+
+        // 合并
+        MetricsSnapshot merged = snapshot;
+        merged.merge(snapshot);
+        if (merged.hits != 10 || merged.wordHits["色情"] != 2 || merged.latency.count != 10) {
+            errors++;
+        }
+
+        std::string error;
+        if (!snapshot.writePrometheus("metrics_test.prom", "dirtyfilter", &error)) {
+            std::cout << error << std::endl;
+            errors++;
+        }
+        std::ifstream ifs("metrics_test.prom");
+        if (std::string(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()) != text) {
+            errors++;
+        }
+        std::remove("metrics_test.prom");
+    }
+
+    // 热更新：替换掉的版本的统计保留在holder中
+    TrieHolder holder;
+    Trie trie;
+    std::unordered_set<std::wstring> words = {L"微信"};
+    trie.loadFromMemory(words);
+    holder.publish(trie.freeze());
+    holder.get()->replaceSensitive(L"微信");
+    holder.publish(trie.freeze()); // 同一个匹配器
+    trie.insert(L"色情");
+    holder.publish(trie.freeze());
+    holder.get()->replaceSensitive(L"微信色情");
+    MetricsSnapshot total = holder.metrics();
+    if (total.hits != (Metrics::enabled() ? 3 : 0)) {
+        errors++;
+    }
+
+    std::cout << "metrics: enabled=" << Metrics::enabled() << ", errors=" << errors << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+void test_word_tags() {
+    {
+        std::ofstream ofs("tag_test.txt");
+        ofs << "微信\t0x2\t5\n"
+            << "色情\t4\t10\n"
+            << "赌博\n"          // 默认分类和权重
+            << "坏词\tabc\t3\n"  // 格式错误，使用默认值
+            << "微信\t8\t100\n"; // 重复，保留第一次的
+    }
+    int errors = 0;
+    auto check = [&](Trie &trie) {
+        const std::wstring text = L"加微信看色情，赌博坏词";
+        std::string utf8 = SBCConvert::ws2s(text);
+        for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+            trie.setMatchMode(mode);
+            // 所有分类，不提前结束
+            SensitiveScore all = trie.score(text, kAllCategories, 0);
+            if (all.score != 17 || all.hits != 4 || all.categories != 7 || all.reached) {
+                errors++;
+            }
+            // 达到阈值后停止，后面的赌博、坏词不计入
+            SensitiveScore early = trie.score(std::string_view(utf8), 0x2 | 0x4, 12);
+            if (early.score != 15 || early.hits != 2 || early.categories != 6 || !early.reached) {
+                errors++;
+            }
+            SensitiveScore one = trie.score(text, 0x4, 0);
+            if (one.score != 10 || one.hits != 1 || one.categories != 4) {
+                errors++;
+            }
+        }
+    };
+
+    Trie bulk;
+    bulk.loadFromFile("tag_test.txt");
+    check(bulk);
+
+    // 逐个insert
+    Trie inserted;
+    inserted.insert(L"微信", WordTag{2, 5});
+    inserted.insert(L"色情", WordTag{4, 10});
+    inserted.insert(L"微信", WordTag{8, 100});
+    inserted.loadFromMemory(std::vector<std::pair<std::wstring, WordTag>>{{L"赌博", WordTag()}, {L"坏词", WordTag()}});
+    check(inserted);
+
+    // 二进制词库保存了标签
+    bulk.saveToBinaryFile("dict_tag.bin");
+    Trie binary;
+    if (!binary.loadFromBinaryFile("dict_tag.bin")) {
+        errors++;
+    }
+    check(binary);
+    std::remove("dict_tag.bin");
+    std::remove("tag_test.txt");
+
+    // 长文本开头就达到阈值时，不需要扫描剩下的部分
+    std::wstring text = L"看色情";
+    for (int i = 0; i < 10000; i++) {
+        text += sample_messages()[2];
+    }
+    bulk.setMatchMode(MatchMode::kAhoCorasick);
+    const int kLoops = 100;
+    auto t1 = std::chrono::steady_clock::now();
+    size_t hits = 0;
+    for (int i = 0; i < kLoops; i++) {
+        hits += bulk.getSensitive(text).size();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (int i = 0; i < kLoops; i++) {
+        hits += bulk.score(text, kAllCategories, 10).hits;
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    if (hits != 2 * kLoops) {
+        errors++;
+    }
+
+    std::cout << "word tags: " << text.size() << " chars, getSensitive "
+              << std::chrono::duration<double, std::micro>(t2 - t1).count() / kLoops << " us, score "
+              << std::chrono::duration<double, std::micro>(t3 - t2).count() / kLoops << " us, errors=" << errors
+              << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+void test_mask_utf8() {
+    Trie trie;
+    trie.loadStopWordFromFile("stopwd.txt");
+    trie.loadFromFile("word.txt");
+
+    // 样例消息、截断的utf8和非法字节
+    std::vector<std::string> texts;
+    for (const auto &msg : sample_messages()) {
+        std::string utf8 = SBCConvert::ws2s(msg);
+        texts.push_back(utf8);
+        texts.push_back(utf8.substr(0, utf8.size() - 1));
+        texts.push_back("\xff" + utf8 + "\xe5\xbe");
+    }
+
+    int errors = 0;
+    for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+        trie.setMatchMode(mode);
+        std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+        for (const std::string &text : texts) {
+            // 每个字符一个*，和replaceSensitive一致
+            std::string buf = text;
+            frozen->maskSensitive(buf);
+            if (buf != frozen->replaceSensitive(std::string_view(text))) {
+                errors++;
+            }
+
+            // 长度不变，命中的字节都是*，其余不变
+            std::string expected = text;
+            for (auto &item : frozen->getSensitive(std::string_view(text))) {
+                expected.replace(item.byteOffset, item.byteLen, item.byteLen, '#');
+            }
+            buf = text;
+            if (frozen->maskSensitive(&buf[0], buf.size(), MaskMode::kPreserveBytes, '#') != text.size() ||
+                buf != expected) {
+                errors++;
+            }
+        }
+    }
+
+    // 不申请内存。s2ws不接受非法的utf8，和原来的写法比较时只用样例消息
+    std::vector<std::string> messages;
+    for (const auto &msg : sample_messages()) {
+        messages.push_back(SBCConvert::ws2s(msg));
+    }
+    std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+    std::string buf;
+    buf.reserve(1024);
+    frozen->maskSensitive(buf); // 打开统计时创建本线程的计数器
+    const int kLoops = 10000;
+    size_t bytes = 0;
+    size_t before = g_alloc_count;
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i = 0; i < kLoops; i++) {
+        for (const std::string &text : messages) {
+            buf.assign(text);
+            frozen->maskSensitive(buf);
+            bytes += text.size();
+        }
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    size_t allocs = g_alloc_count - before;
+    if (allocs != 0) {
+        errors++;
+    }
+
+    // 原来的写法：转换为宽字符串替换，再转换回utf8
+    for (int i = 0; i < kLoops; i++) {
+        for (const std::string &text : messages) {
+            buf = SBCConvert::ws2s(frozen->replaceSensitive(SBCConvert::s2ws(text)));
+        }
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    double mb = static_cast<double>(bytes) / 1024 / 1024;
+    std::cout << "mask utf8: in place " << mb / std::chrono::duration<double>(t2 - t1).count()
+              << " MB/s, allocs=" << allocs << ", via wstring " << mb / std::chrono::duration<double>(t3 - t2).count()
+              << " MB/s, errors=" << errors << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+// 首尾字符对齐的编辑距离：中间部分的Levenshtein距离，首尾不同时返回一个很大的值
+int anchored_distance(const std::wstring &word, const std::wstring &text) {
+    if (word.front() != text.front() || word.back() != text.back() || (word.size() == 1) != (text.size() == 1)) {
+        return 100;
+    }
+    if (word.size() == 1) {
+        return 0;
+    }
+    std::wstring a = word.substr(1, word.size() - 2);
+    std::wstring b = text.substr(1, text.size() - 2);
+    std::vector<int> row(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); j++) {
+        row[j] = static_cast<int>(j);
+    }
+    for (size_t i = 1; i <= a.size(); i++) {
+        int diag = row[0];
+        row[0] = static_cast<int>(i);
+        for (size_t j = 1; j <= b.size(); j++) {
+            int up = row[j];
+            row[j] = std::min({row[j] + 1, row[j - 1] + 1, diag + (a[i - 1] != b[j - 1] ? 1 : 0)});
+            diag = up;
+        }
+    }
+    return row[b.size()];
+}
+
+void test_fuzzy() {
+    int errors = 0;
+
+    // 和暴力枚举比较：每个位置取编辑距离最小、再最短的命中
+    srand(19);
+    for (int round = 0; round < 200; round++) {
+        std::vector<std::wstring> words;
+        for (int n = 1 + rand() % 8; n > 0; n--) {
+            std::wstring word;
+            for (int len = 1 + rand() % 6; len > 0; len--) {
+                word += static_cast<wchar_t>(L'a' + rand() % 4);
+            }
+            words.push_back(word);
+        }
+        Trie trie;
+        trie.loadFromMemory(words);
+        std::wstring text;
+        for (int len = rand() % 30; len > 0; len--) {
+            text += static_cast<wchar_t>(L'a' + rand() % 5);
+        }
+
+        for (int k = 1; k <= FuzzyMatcher::kMaxDistance; k++) {
+            std::vector<std::pair<int, int>> expected;
+            for (size_t i = 0; i < text.size();) {
+                int best = 100;
+                size_t best_len = 0;
+                for (size_t j = 1; i + j <= text.size(); j++) {
+                    for (auto &word : words) {
+                        int limit = word.size() >= 2 ? k : 0;
+                        int d = anchored_distance(word, text.substr(i, j));
+                        if (d <= limit && (d < best || (d == best && j < best_len))) {
+                            best = d;
+                            best_len = j;
+                        }
+                    }
+                }
+                if (best_len == 0) {
+                    i++;
+                    continue;
+                }
+                expected.emplace_back(static_cast<int>(i), static_cast<int>(best_len));
+                expected.emplace_back(best, 0);
+                i += best_len;
+            }
+
+            std::vector<std::pair<int, int>> actual;
+            trie.openFuzzy(k)->forEachSensitive(text, [&](const MatchSpan &span, int distance) {
+                actual.emplace_back(static_cast<int>(span.startIndex), span.len);
+                actual.emplace_back(distance, 0);
+                return true;
+            });
+            if (actual != expected) {
+                errors++;
+            }
+        }
+    }
+
+    Trie trie;
+    trie.loadStopWordFromFile("stopwd.txt");
+    trie.loadFromFile("word.txt");
+    std::unique_ptr<FuzzyMatcher> fuzzy1 = trie.openFuzzy(1);
+    std::unique_ptr<FuzzyMatcher> fuzzy2 = trie.openFuzzy(2);
+    std::vector<std::tuple<std::wstring, std::wstring, std::wstring>> cases = {
+            // 原文, 距离1, 距离2
+            {L"加微X信", L"加***", L"加***"},
+            {L"fuxk you", L"**** you", L"**** you"},
+            {L"加微XY信", L"加微XY信", L"加****"},
+            {L"加微！信", L"加***", L"加***"}, // 停顿词仍然忽略
+            {L"微", L"微", L"微"},             // 不允许删除首尾字符
+            {L"今天天气不错", L"今天天气不错", L"今天天气不错"},
+    };
+    for (auto &item : cases) {
+        if (fuzzy1->replaceSensitive(std::get<0>(item)) != std::get<1>(item) ||
+            fuzzy2->replaceSensitive(std::get<0>(item)) != std::get<2>(item) ||
+            fuzzy1->replaceSensitive(std::string_view(SBCConvert::ws2s(std::get<0>(item)))) !=
+            SBCConvert::ws2s(std::get<1>(item))) {
+            std::cout << "fuzzy: " << SBCConvert::ws2s(std::get<0>(item)) << " => "
+                      << SBCConvert::ws2s(fuzzy1->replaceSensitive(std::get<0>(item))) << ", "
+                      << SBCConvert::ws2s(fuzzy2->replaceSensitive(std::get<0>(item))) << std::endl;
+            errors++;
+        }
+    }
+    // 精确命中的编辑距离为0
+    for (const auto &msg : sample_messages()) {
+        if (trie.search(msg) != fuzzy1->search(msg)) {
+            errors++;
+        }
+    }
+    // 2个字符的敏感词只做精确匹配
+    if (trie.openFuzzy(1, 3)->search(L"加微X信") || !trie.openFuzzy(1, 3)->search(L"fuxk")) {
+        errors++;
+    }
+
+    std::cout << "fuzzy: index " << fuzzy1->memoryUsage() / 1024 << " KB, errors=" << errors << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+void test_pinyin() {
+    int errors = 0;
+
+    auto table = std::make_shared<PinyinTable>();
+    std::string error;
+    if (!table->addReadings({{L'微', {"wēi"}}, {L'威', {"wei1"}}, {L'信', {"xin"}}, {L'心', {"XIN"}},
+                             {L'色', {"se", "shai"}}, {L'情', {"qing"}}, {L'西', {"xi"}}, {L'安', {"an"}},
+                             {L'先', {"xian"}}}, &error)) {
+        std::cout << "pinyin: " << error << std::endl;
+        errors++;
+    }
+    if (table->addReadings({{L'微', {"wei!"}}}) || table->syllableCount() != 8) {
+        errors++;
+    }
+
+    Trie trie;
+    std::unordered_set<wchar_t> stop_words = {L' ', L'.'};
+    trie.loadStopWordFromMemory(stop_words);
+    trie.loadFromMemory(std::vector<std::wstring>{L"色情", L"微信", L"威心", L"西安", L"微"});
+    std::unique_ptr<PinyinIndex> index = trie.openPinyin(table);
+    // 微信和威心读音相同，只保留第一个；"微"少于2个音节
+    if (index->wordCount() != 4 || index->sequenceCount() != 4) {
+        errors++;
+    }
+    std::vector<std::pair<std::wstring, std::wstring>> cases = {
+            {L"加weixin好友", L"加******好友"},
+            {L"加wei信", L"加****"},
+            {L"加威信", L"加**"},             // 同音字
+            {L"加WEI XIN", L"加*******"},      // 大小写，停顿词
+            {L"加Ｗｅｉ.心", L"加*****"},       // 全角
+            {L"weixing", L"weixing"},         // 拼音必须是完整的单词
+            {L"aweixin", L"aweixin"},
+            {L"shaiqing", L"********"},       // 多音字
+            {L"xian xi an", L"**** *****"},   // 连续的字母尝试所有切分方式
+            {L"西an", L"***"},
+            {L"微", L"微"},
+            {L"wei1xin", L"wei1xin"},          // 数字中断匹配
+    };
+    for (auto &item : cases) {
+        if (index->replaceSensitive(item.first) != item.second ||
+            index->replaceSensitive(std::string_view(SBCConvert::ws2s(item.first))) != SBCConvert::ws2s(item.second)) {
+            std::cout << "pinyin: " << SBCConvert::ws2s(item.first) << " => "
+                      << SBCConvert::ws2s(index->replaceSensitive(item.first)) << std::endl;
+            errors++;
+        }
+    }
+    // 命中的编号为主词库中的编号，同音的敏感词取第一个
+    std::vector<int> ids;
+    index->forEachSensitive(std::wstring(L"威心 and 色情"), [&](const MatchSpan &span) {
+        ids.push_back(span.wordId);
+        return true;
+    });
+    if (ids != std::vector<int>{1, 0}) {
+        errors++;
+    }
+
+    // word.txt：每个加入索引的敏感词，随机改写为拼音、同音字后仍然命中
+    auto full = std::make_shared<PinyinTable>();
+    if (!full->loadFromFile("pinyin.txt", &error)) {
+        std::cout << "pinyin: " << error << std::endl;
+        errors++;
+    }
+    std::unordered_map<std::wstring, std::vector<wchar_t>> homophones;
+    std::vector<std::wstring> syllables(full->syllableCount());
+    for (size_t i = 0; i < full->syllableCount(); ++i) {
+        syllables[i] = SBCConvert::s2ws(full->syllable(i));
+    }
+    for (wchar_t c = 0x4E00; c <= 0x9FFF; ++c) {
+        auto r = full->readings(c);
+        if (r.first != r.second) {
+            homophones[syllables[*r.first]].push_back(c);
+        }
+    }
+
+    Trie dict;
+    dict.loadStopWordFromFile("stopwd.txt");
+    dict.loadFromFile("word.txt");
+    auto t1 = std::chrono::steady_clock::now();
+    std::unique_ptr<PinyinIndex> pinyin = dict.openPinyin(full);
+    double index_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+
+    auto has_readings = [&full](const std::wstring &word) {
+        return word.size() >= 2 && std::all_of(word.begin(), word.end(), [&full](wchar_t c) {
+            return full->readings(c).first != full->readings(c).second;
+        });
+    };
+    srand(20);
+    std::vector<std::wstring> variants;
+    std::set<std::wstring> indexed;
+    double homophone_variants = 0;
+    std::ifstream ifs("word.txt");
+    std::string line;
+    while (getline(ifs, line)) {
+        std::wstring word = SBCConvert::s2ws(line);
+        if (!has_readings(word) || !indexed.insert(word).second) {
+            continue;
+        }
+        std::wstring text = L"1";
+        for (wchar_t c : word) {
+            const std::wstring &py = syllables[*full->readings(c).first];
+            switch (rand() % 3) {
+                case 0:
+                    text += c;
+                    break;
+                case 1:
+                    text += py + L" ";
+                    break;
+                default:
+                    text += homophones[py][rand() % homophones[py].size()];
+                    break;
+            }
+        }
+        text += L"2";
+        if (!pinyin->search(text)) {
+            std::cout << "pinyin: miss " << SBCConvert::ws2s(text) << std::endl;
+            errors++;
+        }
+
+        // 在主词库中列出变体需要的数量：每个字写成汉字或者拼音，再加上同音字时是每个字可选写法数的乘积
+        double product = 1;
+        for (wchar_t c : word) {
+            product *= static_cast<double>(homophones[syllables[*full->readings(c).first]].size() + 1);
+        }
+        homophone_variants += product;
+        size_t n = std::min(word.size(), size_t(10));
+        for (size_t mask = 0; mask < (size_t(1) << n); ++mask) {
+            std::wstring variant;
+            for (size_t i = 0; i < word.size(); ++i) {
+                variant += i < n && (mask >> i & 1) ? syllables[*full->readings(word[i]).first]
+                                                    : std::wstring(1, word[i]);
+            }
+            variants.push_back(variant);
+        }
+    }
+    if (indexed.size() != pinyin->wordCount()) {
+        errors++;
+    }
+    // 精确的汉字也会命中
+    for (const auto &msg : sample_messages()) {
+        for (const auto &hit : dict.getSensitive(msg)) {
+            if (has_readings(hit.word) && !pinyin->search(hit.word)) {
+                errors++;
+            }
+        }
+    }
+
+    Trie enumerated;
+    enumerated.loadStopWordFromFile("stopwd.txt");
+    auto t2 = std::chrono::steady_clock::now();
+    enumerated.loadFromMemory(variants);
+    std::shared_ptr<const FrozenTrie> frozen = enumerated.freeze();
+    double enum_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t2).count();
+
+    std::cout << "pinyin: " << pinyin->wordCount() << " words, index " << pinyin->memoryUsage() / 1024 << " KB "
+              << index_ms << " ms (table " << full->memoryUsage() / 1024 << " KB), enumerated " << variants.size()
+              << " variants " << frozen->memoryUsage() / 1024 << " KB " << enum_ms << " ms (with homophones "
+              << homophone_variants << "), errors=" << errors << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+void test_layered() {
+    int errors = 0;
+
+    // 和合并后重新构建的Trie比较：基础词库去掉屏蔽的，加上增加的
+    srand(21);
+    std::unordered_set<wchar_t> stop_words = {L' ', L'.'};
+    auto random_word = [](int max_len) {
+        std::wstring word;
+        for (int len = 1 + rand() % max_len; len > 0; len--) {
+            word += static_cast<wchar_t>(L'a' + rand() % 5);
+        }
+        return word;
+    };
+    for (int round = 0; round < 500; round++) {
+        std::vector<std::wstring> base_words, additions, suppressions;
+        for (int n = 1 + rand() % 10; n > 0; n--) {
+            base_words.push_back(random_word(4));
+        }
+        for (int n = rand() % 6; n > 0; n--) {
+            additions.push_back(random_word(4));
+        }
+        for (int n = rand() % 4; n > 0; n--) {
+            suppressions.push_back(rand() % 2 ? base_words[rand() % base_words.size()] : random_word(3));
+        }
+
+        Trie base;
+        base.loadStopWordFromMemory(stop_words);
+        base.loadFromMemory(base_words);
+        std::unique_ptr<LayeredMatcher> layered = base.openLayered(additions, suppressions);
+
+        std::vector<std::wstring> merged;
+        for (auto &word : base_words) {
+            if (std::find(suppressions.begin(), suppressions.end(), word) == suppressions.end()) {
+                merged.push_back(word);
+            }
+        }
+        merged.insert(merged.end(), additions.begin(), additions.end());
+        Trie expected;
+        expected.loadStopWordFromMemory(stop_words);
+        expected.loadFromMemory(merged);
+
+        std::wstring text;
+        for (int len = rand() % 40; len > 0; len--) {
+            text += L"abcdeF. "[rand() % 8];
+        }
+        auto spans = [](const std::set<SensitiveWord> &words) {
+            std::vector<std::tuple<std::wstring, int, int>> ret;
+            for (auto &word : words) {
+                ret.emplace_back(word.word, word.startIndex, word.len);
+            }
+            return ret;
+        };
+        if (spans(layered->getSensitive(text)) != spans(expected.getSensitive(text)) ||
+            layered->replaceSensitive(text) != expected.replaceSensitive(text) ||
+            layered->replaceSensitive(SBCConvert::ws2s(text)) != SBCConvert::ws2s(expected.replaceSensitive(text)) ||
+            layered->search(text) != expected.search(text)) {
+            if (errors++ < 5) {
+                std::cout << "layered mismatch: " << SBCConvert::ws2s(text) << std::endl;
+            }
+        }
+    }
+
+    // 编号、长度相同时基础词库优先、标签、字符转换
+    Trie trie;
+    trie.loadStopWordFromMemory(stop_words);
+    trie.loadFromMemory(std::vector<std::wstring>{L"微信", L"qq", L"赌博"});
+    WordTag tag;
+    tag.severity = 5;
+    std::unique_ptr<LayeredMatcher> tenant = trie.openLayered({L"QQ", L"代开发票", L"代开", L"代开"}, {L"赌博", L"不存在"},
+                                                              {WordTag(), WordTag(), tag});
+    if (tenant->baseWordCount() != 3 || tenant->addedWordCount() != 3 || tenant->suppressedWordCount() != 1) {
+        errors++;
+    }
+    std::vector<std::pair<int, int>> hits;
+    tenant->forEachSensitive(std::string("加微 信，代开发票，赌博，Qq"), [&](const MatchSpan &span) {
+        hits.emplace_back(span.startIndex, span.wordId);
+        return true;
+    });
+    // qq在两层中都有，取基础词库的编号；"代开"比"代开发票"短
+    if (hits != std::vector<std::pair<int, int>>{{1, 0}, {5, 5}, {13, 1}} || tenant->wordTag(5).severity != 5 ||
+        tenant->wordTag(4).severity != 1 || tenant->wordTag(0).severity != trie.freeze()->wordTag(0).severity) {
+        errors++;
+    }
+    if (tenant->replaceSensitive(std::wstring(L"赌博代开")) != L"赌博**" || !trie.search(L"赌博") ||
+        tenant->search(L"赌博") || tenant->memoryUsage() >= trie.freeze()->memoryUsage()) {
+        errors++;
+    }
+
+    std::cout << "layered: tenant " << tenant->memoryUsage() << " bytes, base " << trie.freeze()->memoryUsage()
+              << " bytes, errors=" << errors << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+void test_filter_server() {
+    int errors = 0;
+
+    auto holder = std::make_shared<TrieHolder>();
+    holder->reload("word.txt", "stopwd.txt");
+    std::shared_ptr<const FrozenTrie> local = holder->get();
+    ServerOptions options;
+    options.socketPath = "/tmp/dirtyfilter_test_" + std::to_string(getpid()) + ".sock";
+    options.threads = 4;
+    options.maxBatch = 8;
+    options.cache = std::make_shared<ResultCache>();
+    FilterServer server(holder, options);
+    std::string error;
+    if (!server.listen(&error)) {
+        std::cout << "filter server: " << error << std::endl;
+        abort();
+    }
+    std::thread loop([&server]() { server.run(); });
+
+    std::vector<std::string> texts = {"", "你好", "FUCK，你是逗比吗？ｆｕｃｋ，你竟然用微信，微@!!%%%。信",
+                                      "加V&X，扣_扣，QQ", "没有敏感词的一段比较长的消息，没有敏感词的一段比较长的消息"};
+    auto matches_equal = [&](const std::string &text, const std::vector<WireMatch> &matches) {
+        std::vector<std::tuple<size_t, size_t, int64_t, int>> expected, actual;
+        local->forEachSensitive(std::string_view(text), [&](const MatchSpan &span) {
+            expected.emplace_back(span.offset, span.length, span.startIndex, span.wordId);
+            return true;
+        });
+        for (const WireMatch &match : matches) {
+            actual.emplace_back(match.byteOffset, match.byteLength, match.startIndex, match.wordId);
+        }
+        return expected == actual;
+    };
+
+    // 同步调用
+    FilterClient client;
+    uint64_t version = 0;
+    if (!client.connect(options.socketPath) || !client.ping(version) || version != holder->version()) {
+        std::cout << "filter server: " << client.error() << std::endl;
+        errors++;
+    }
+    for (const std::string &text : texts) {
+        bool found = false;
+        std::vector<WireMatch> matches;
+        std::string replaced;
+        if (!client.search(text, found) || found != local->search(std::string_view(text)) ||
+            !client.getSensitive(text, matches) || !matches_equal(text, matches) ||
+            !client.replaceSensitive(text, replaced) || replaced != local->replaceSensitive(std::string_view(text))) {
+            errors++;
+        }
+    }
+
+    // 流水线：先全部发出再按顺序收，多个连接同时进行
+    std::vector<std::thread> threads;
+    std::atomic<int> pipeline_errors{0};
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            FilterClient pipelined;
+            if (!pipelined.connect(options.socketPath)) {
+                pipeline_errors++;
+                return;
+            }
+            for (int round = 0; round < 20; round++) {
+                std::vector<uint32_t> ids;
+                for (int i = 0; i < 50; i++) {
+                    const std::string &text = texts[(t + round + i) % texts.size()];
+                    ids.push_back(pipelined.send(i % 2 ? FilterOp::kGetSensitive : FilterOp::kReplaceSensitive, text));
+                }
+                FilterResponse response;
+                std::vector<WireMatch> matches;
+                for (int i = 0; i < 50; i++) {
+                    const std::string &text = texts[(t + round + i) % texts.size()];
+                    if (!pipelined.receive(response) || response.requestId != ids[i] ||
+                        response.status != FilterStatus::kOk ||
+                        (i % 2 ? !FilterClient::decodeMatches(response.body, matches) || !matches_equal(text, matches)
+                               : response.body != local->replaceSensitive(std::string_view(text)))) {
+                        pipeline_errors++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    errors += pipeline_errors;
+
+    // 未知的请求类型；请求过长时服务端关闭连接；热更新后版本变化
+    FilterResponse response;
+    client.send(static_cast<FilterOp>(99), "abc");
+    if (!client.receive(response) || response.status != FilterStatus::kBadRequest) {
+        errors++;
+    }
+    holder->reload("word.txt", "stopwd.txt");
+    if (!client.ping(version) || version != holder->version()) {
+        errors++;
+    }
+    FilterClient bad;
+    bad.connect(options.socketPath);
+    bad.send(FilterOp::kSearch, std::string(kMaxFrameLength + 1, 'a'));
+    if (bad.receive(response) || bad.connected()) {
+        errors++;
+    }
+
+    // 同样的消息反复出现，大部分响应来自缓存
+    if (options.cache->stats().hits == 0) {
+        errors++;
+    }
+
+    uint64_t requests = server.requestCount();
+    uint64_t batches = server.batchCount();
+    server.stop();
+    loop.join();
+    std::cout << "filter server: " << requests << " requests in " << batches << " batches, errors=" << errors
+              << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+void test_result_cache() {
+    int errors = 0;
+
+    // 命中和未命中时的结果都和不用缓存时一致
+    Trie trie;
+    trie.loadStopWordFromFile("stopwd.txt");
+    trie.loadFromFile("word.txt");
+    std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+    auto cache = std::make_shared<ResultCache>();
+    std::vector<std::string> texts = {"", "你好", "FUCK，你是逗比吗？ｆｕｃｋ，你竟然用微信，微@!!%%%。信",
+                                      "加V&X，扣_扣，QQ", "没有敏感词的一段比较长的消息，没有敏感词的一段比较长的消息"};
+    auto wide_spans = [](const std::set<SensitiveWord> &words) {
+        std::vector<std::tuple<std::wstring, int, int>> ret;
+        for (auto &word : words) {
+            ret.emplace_back(word.word, word.startIndex, word.len);
+        }
+        return ret;
+    };
+    auto utf8_spans = [](const std::set<Utf8SensitiveWord> &words) {
+        std::vector<std::tuple<std::string, int, int, size_t, size_t>> ret;
+        for (auto &word : words) {
+            ret.emplace_back(word.word, word.startIndex, word.len, word.byteOffset, word.byteLen);
+        }
+        return ret;
+    };
+    for (int round = 0; round < 2; round++) {
+        for (const std::string &text : texts) {
+            std::wstring wide = SBCConvert::s2ws(text);
+            if (cache->search(*frozen, wide) != frozen->search(wide) ||
+                cache->search(*frozen, std::string_view(text)) != frozen->search(std::string_view(text)) ||
+                wide_spans(cache->getSensitive(*frozen, wide)) != wide_spans(frozen->getSensitive(wide)) ||
+                utf8_spans(cache->getSensitive(*frozen, std::string_view(text))) !=
+                utf8_spans(frozen->getSensitive(std::string_view(text))) ||
+                cache->replaceSensitive(*frozen, wide) != frozen->replaceSensitive(wide) ||
+                cache->replaceSensitive(*frozen, std::string_view(text)) !=
+                frozen->replaceSensitive(std::string_view(text))) {
+                errors++;
+            }
+        }
+    }
+    CacheStats stats = cache->stats();
+    if (stats.hits != texts.size() * 6 || stats.misses != texts.size() * 6 || stats.entries != texts.size() * 6 ||
+        stats.hitRate() != 0.5 || stats.toPrometheus().find("dirtyfilter_cache_hits_total 30\n") == std::string::npos) {
+        errors++;
+    }
+
+    // Trie使用缓存，词库变化后不会返回旧的结果；两个词库共用一个缓存
+    Trie small;
+    small.setResultCache(cache);
+    small.loadFromMemory(std::vector<std::wstring>{L"abc"});
+    trie.setResultCache(cache);
+    if (small.replaceSensitive(std::string_view("xabcd")) != "x***d" ||
+        small.replaceSensitive(std::string_view("xabcd")) != "x***d" ||
+        small.replaceSensitive(std::string_view("acdx")) != "acdx" ||
+        trie.replaceSensitive(std::string_view("xabcd")) != frozen->replaceSensitive(std::string_view("xabcd"))) {
+        errors++;
+    }
+    small.insert(L"cd");
+    small.build();
+    uint64_t stale = cache->stats().staleMisses;
+    if (small.replaceSensitive(std::string_view("acdx")) != "a**x" || small.search(L"cd") != true ||
+        cache->stats().staleMisses != stale + 1) {
+        errors++;
+    }
+    trie.setResultCache(nullptr);
+
+    // 内存上限：只保留一部分，结果仍然正确；CLOCK保留反复命中的项
+    CacheOptions options;
+    options.capacityBytes = 4096;
+    options.shards = 1;
+    options.maxTextBytes = 64;
+    ResultCache bounded(options);
+    std::string hot = "热门消息，加微信";
+    for (int i = 0; i < 1000; i++) {
+        std::string text = "消息" + std::to_string(i) + "，加QQ";
+        std::string expected = frozen->replaceSensitive(std::string_view(text));
+        if (bounded.replaceSensitive(*frozen, std::string_view(text)) != expected ||
+            bounded.replaceSensitive(*frozen, std::string_view(hot)) != frozen->replaceSensitive(std::string_view(hot))) {
+            errors++;
+        }
+    }
+    stats = bounded.stats();
+    if (stats.bytes > options.capacityBytes || stats.evictions == 0 || stats.hits != 999 || stats.entries < 2) {
+        errors++;
+    }
+    std::string long_text(100, 'a');
+    bounded.search(*frozen, std::string_view(long_text));
+    if (bounded.stats().skipped != 1) {
+        errors++;
+    }
+    bounded.clear();
+    if (bounded.stats().entries != 0 || bounded.stats().bytes != 0) {
+        errors++;
+    }
+
+    // 多线程同时查询和淘汰
+    std::vector<std::thread> threads;
+    std::atomic<int> thread_errors{0};
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 2000; i++) {
+                std::string text = texts[(t + i) % texts.size()] + std::to_string(i % 37);
+                if (bounded.replaceSensitive(*frozen, std::string_view(text)) !=
+                    frozen->replaceSensitive(std::string_view(text))) {
+                    thread_errors++;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    errors += thread_errors;
+    if (bounded.stats().bytes > options.capacityBytes) {
+        errors++;
+    }
+
+    std::cout << "result cache: hit rate " << stats.hitRate() << " with " << stats.entries << " entries, errors="
+              << errors << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+// 按样本流量重排双数组：只改变状态的位置，匹配结果、增量修改和二进制词库都和广度优先布局相同
+void test_layout_profile() {
+    int errors = 0;
+    Trie bfs;
+    bfs.loadStopWordFromFile("stopwd.txt");
+    bfs.loadFromFile("word.txt");
+    std::shared_ptr<LayoutProfile> profile = bfs.openProfile();
+    std::vector<std::wstring> messages = sample_messages();
+    for (int i = 0; i < 100; i++) {
+        for (const auto &msg : messages) {
+            profile->record(msg);
+        }
+        profile->record(std::string_view("加V&X，扣_扣，QQ，微@!!%%%。信"));
+    }
+    if (profile->messages() != 100 * (messages.size() + 1) || profile->hotStates() == 0 ||
+        profile->totalVisits() == 0 || profile->visits(DoubleArray::kRoot) == 0 ||
+        profile->recordFile("not_exist.txt") != 0) {
+        errors++;
+    }
+
+    Trie profiled;
+    profiled.loadStopWordFromFile("stopwd.txt");
+    profiled.loadFromFile("word.txt");
+    profiled.setLayoutProfile(profile);
+    // 热的状态集中在数组开头
+    const DoubleArray &old_dat = bfs.freeze()->dat();
+    const DoubleArray &new_dat = profiled.freeze()->dat();
+    auto hot_span = [&](const DoubleArray &dat) {
+        int state = DoubleArray::kRoot, last = 0;
+        for (wchar_t c : std::wstring(L"微信")) {
+            state = dat.transition(state, dat.code(c));
+            last = std::max(last, state);
+        }
+        return state < 0 ? -1 : last;
+    };
+    if (new_dat.size() == 0 || hot_span(new_dat) < 0 || hot_span(new_dat) > hot_span(old_dat)) {
+        errors++;
+    }
+
+    auto compare = [&](Trie &a, Trie &b, const std::vector<std::wstring> &texts) {
+        for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+            a.setMatchMode(mode);
+            b.setMatchMode(mode);
+            for (const auto &text : texts) {
+                std::string utf8 = SBCConvert::ws2s(text);
+                if (a.replaceSensitive(text) != b.replaceSensitive(text) ||
+                    a.replaceSensitive(std::string_view(utf8)) != b.replaceSensitive(std::string_view(utf8)) ||
+                    a.getSensitive(text).size() != b.getSensitive(text).size()) {
+                    errors++;
+                }
+            }
+        }
+    };
+    // 随机消息：敏感词的字符和常用字混在一起
+    std::vector<std::wstring> texts = messages;
+    std::wstring chars = L"微信加扣QQ你好逗比fuckFUCK习近平@!。，";
+    srand(7);
+    for (int i = 0; i < 2000; i++) {
+        std::wstring text;
+        for (int j = rand() % 24; j > 0; j--) {
+            text += chars[rand() % chars.size()];
+        }
+        texts.push_back(text);
+    }
+    compare(bfs, profiled, texts);
+
+    // 增加敏感词后重新编译，统计中没有的节点排在后面
+    bfs.insert(L"你好逗比");
+    profiled.insert(L"你好逗比");
+    bfs.build();
+    profiled.build();
+    texts.emplace_back(L"说你好逗比呀");
+    compare(bfs, profiled, texts);
+
+    // 二进制词库保存的是重排之后的布局
+    bool ok = profiled.saveToBinaryFile("dict_profiled.bin");
+    Trie loaded;
+    ok = loaded.loadFromBinaryFile("dict_profiled.bin") && ok;
+    std::remove("dict_profiled.bin");
+    if (!ok) {
+        errors++;
+    }
+    compare(bfs, loaded, texts);
+
+    std::cout << "layout profile: " << profile->hotStates() << " hot states of " << old_dat.size()
+              << ", errors=" << errors << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
+// 编译期词库：dirtyfilter-codegen由word.txt和stopwd.txt生成（见CMakeLists.txt），结果和运行时构建的kTrie相同
+typedef StaticMatcher<StaticWordDict> StaticWordMatcher;
+static_assert(StaticWordMatcher::search("小姐姐还不赶紧加VX"), "matched at compile time");
+static_assert(!StaticWordMatcher::search("今天天气不错"), "no sensitive words");
+static_assert(StaticWordMatcher::countSensitive("ＳＭ，小 姐") == 2, "fold and stop words are compiled in");
+
+void test_static_matcher() {
+    int errors = 0;
+    Trie trie;
+    trie.loadStopWordFromFile("stopwd.txt");
+    trie.loadFromFile("word.txt");
+    std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+    if (StaticWordMatcher::wordCount() != frozen->wordCount() || StaticWordMatcher::word(0) != "小姐") {
+        errors++;
+    }
+    for (size_t i = 0; i < StaticWordMatcher::wordCount(); i++) {
+        if (!(StaticWordMatcher::wordTag(static_cast<int>(i)) == frozen->wordTag(static_cast<int>(i)))) {
+            errors++;
+        }
+    }
+
+    std::vector<std::string> texts;
+    for (const auto &msg : sample_messages()) {
+        texts.push_back(SBCConvert::ws2s(msg));
+    }
+    // 随机消息：敏感词的字符、全角、大写、停顿词、emoji和非法utf8混在一起
+    std::vector<std::string> pieces = {"小", "姐", "微", "信", "加", "ＳＭ", "s", "M", "3", "p", "P", "，", " ", "*",
+                                       "!", "😀", "你", "好", "\xff", "\xe4\xbd", "口", "交", "Ｑ", "q"};
+    srand(11);
+    for (int i = 0; i < 3000; i++) {
+        std::string text;
+        for (int j = rand() % 20; j > 0; j--) {
+            text += pieces[rand() % pieces.size()];
+        }
+        texts.push_back(text);
+    }
+    auto spans = [](auto &&for_each) {
+        std::vector<std::tuple<size_t, size_t, int64_t, int, int>> ret;
+        for_each([&](const MatchSpan &span) {
+            ret.emplace_back(span.offset, span.length, span.startIndex, span.len, span.wordId);
+            return true;
+        });
+        return ret;
+    };
+    for (const std::string &text : texts) {
+        std::string_view utf8(text);
+        // s2ws不接受非法utf8，按扫描时的方式解码
+        std::wstring wide;
+        for (size_t pos = 0, n = 0; pos < text.size(); pos += n) {
+            wide += static_cast<wchar_t>(decodeUtf8(text.data() + pos, text.data() + text.size(), n));
+        }
+        if (spans([&](auto &&f) { StaticWordMatcher::forEachSensitive(utf8, f); }) !=
+            spans([&](auto &&f) { frozen->forEachSensitive(utf8, f); }) ||
+            spans([&](auto &&f) { StaticWordMatcher::forEachSensitive(std::wstring_view(wide), f); }) !=
+            spans([&](auto &&f) { frozen->forEachSensitive(wide, f); }) ||
+            StaticWordMatcher::replaceSensitive(utf8) != frozen->replaceSensitive(utf8) ||
+            StaticWordMatcher::replaceSensitive(std::wstring_view(wide)) != frozen->replaceSensitive(wide) ||
+            StaticWordMatcher::search(utf8) != frozen->search(utf8)) {
+            errors++;
+        }
+    }
+
+    std::cout << "static matcher: " << StaticWordMatcher::wordCount() << " words, " << StaticWordMatcher::size()
+              << " units, errors=" << errors << std::endl;
+    if (errors > 0) {
+        abort();
+    }
+}
+
 int main() {
     example1();
+    example_utf8();
     exmaple2();
+    benchmark_char_convert();
+    benchmark_double_array();
+    test_frozen_concurrent();
+    test_visitor_no_alloc();
+    benchmark_thread_scaling();
+    benchmark_batch();
+    test_binary_dict();
+    test_stream();
+    test_ac_stop_words();
+    test_reload_missing_file();
+    test_reload_retire();
+    test_fold_mapping();
+    test_bulk_build();
+    test_metrics();
+    test_word_tags();
+    test_mask_utf8();
+    test_fuzzy();
+    test_pinyin();
+    test_layered();
+    test_filter_server();
+    test_result_cache();
+    test_layout_profile();
+    test_static_matcher();
+    benchmark_hot_reload();
     //exmaple3();
     return 0;
 }
\ No newline at end of file
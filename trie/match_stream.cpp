@@ -0,0 +1,153 @@
+/** @file match_stream.cpp
+  * @brief 流式匹配
+  * @author teng.qing
+  * @date 2021/7/29
+  */
+
+#include "match_stream.h"
+#include "text_codec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// utf8首字节对应的字符长度，非法的首字节按1个字节处理（和decodeUtf8一致）
+size_t utf8Length(unsigned char b) {
+    if ((b & 0xE0) == 0xC0) {
+        return 2;
+    } else if ((b & 0xF0) == 0xE0) {
+        return 3;
+    } else if ((b & 0xF8) == 0xF0) {
+        return 4;
+    }
+    return 1;
+}
+
+bool isContinuation(unsigned char b) { return (b & 0xC0) == 0x80; }
+
+} // namespace
+
+MatchStream::MatchStream(std::shared_ptr<const FrozenTrie> frozen)
+        : frozen_(std::move(frozen)), scanner_(frozen_->ac(), frozen_->stopWordsInWords()) {}
+
+void MatchStream::reset() {
+    scanner_.reset();
+    offset_ = 0;
+    index_ = 0;
+    partial_size_ = 0;
+    stopped_ = false;
+}
+
+template<typename Text>
+void MatchStream::scan(const Text &text, MatchVisitor &visitor) {
+    const FrozenTrie &frozen = *frozen_;
+#ifdef DIRTYFILTER_METRICS
+    Metrics::Shard &shard = frozen.metricsShard();
+#endif
+    auto guard = [&](const MatchSpan &span) {
+#ifdef DIRTYFILTER_METRICS
+        frozen.countHit(shard, span);
+#endif
+        if (!stopped_ && !visitor.onMatch(span)) {
+            stopped_ = true;
+        }
+    };
+
+    size_t offset = 0;
+    uint32_t c;
+    while (!stopped_) {
+        // 和FrozenTrie::scanText一样，idle时跳过预过滤认为不需要匹配的字符
+        if (scanner_.idle()) {
+            int skipped = 0;
+            size_t next = text.skip(offset, frozen.prefilter(), skipped);
+            if (next != offset) {
+                offset = next;
+                index_ += skipped;
+                scanner_.barrier(index_, offset_ + offset);
+            }
+        }
+        size_t start = offset;
+        if (!text.decode(offset, c)) {
+            break;
+        }
+        uint32_t unicode = text.fold(c);
+        scanner_.push(frozen.dat().code(unicode), frozen.isStopWord(unicode), index_, offset_ + start,
+                      offset_ + offset, guard);
+        ++index_;
+    }
+    offset_ += text.size();
+}
+
+void MatchStream::feed(std::string_view chunk, MatchVisitor &visitor) {
+    if (stopped_) {
+        offset_ += chunk.size();
+        return;
+    }
+#ifdef DIRTYFILTER_METRICS
+    // 每一块算一次扫描
+    Metrics::ScanTimer timer(frozen_->metricsShard(), chunk.size());
+#endif
+
+    // 先补全上一块结尾被截断的字符，只拼接后续字节，遇到其他字节说明是非法序列，按原样解码
+    if (partial_size_ > 0) {
+        size_t need = utf8Length(static_cast<unsigned char>(partial_[0]));
+        size_t n = 0;
+        while (partial_size_ < need && n < chunk.size() && isContinuation(static_cast<unsigned char>(chunk[n]))) {
+            partial_[partial_size_++] = chunk[n++];
+        }
+        chunk.remove_prefix(n);
+        if (partial_size_ < need && chunk.empty()) {
+            return;
+        }
+        size_t size = partial_size_;
+        partial_size_ = 0;
+        scan(Utf8Text(std::string_view(partial_, size), frozen_->foldTable()), visitor);
+    }
+
+    // 结尾不完整的字符留到下一块
+    size_t keep = 0;
+    for (size_t i = chunk.size(); i > 0 && chunk.size() - i < 3; --i) {
+        auto b = static_cast<unsigned char>(chunk[i - 1]);
+        if (!isContinuation(b)) {
+            if (i - 1 + utf8Length(b) > chunk.size()) {
+                keep = chunk.size() - (i - 1);
+            }
+            break;
+        }
+    }
+    scan(Utf8Text(chunk.substr(0, chunk.size() - keep), frozen_->foldTable()), visitor);
+    memcpy(partial_, chunk.data() + chunk.size() - keep, keep);
+    partial_size_ = keep;
+}
+
+void MatchStream::feed(std::wstring_view chunk, MatchVisitor &visitor) {
+    if (stopped_) {
+        offset_ += chunk.size();
+        return;
+    }
+#ifdef DIRTYFILTER_METRICS
+    Metrics::ScanTimer timer(frozen_->metricsShard(), chunk.size());
+#endif
+    scan(WideText(chunk.data(), chunk.size(), frozen_->foldTable()), visitor);
+}
+
+void MatchStream::finish(MatchVisitor &visitor) {
+    if (!stopped_ && partial_size_ > 0) {
+        size_t size = partial_size_;
+        partial_size_ = 0;
+        scan(Utf8Text(std::string_view(partial_, size), frozen_->foldTable()), visitor);
+    }
+    if (!stopped_) {
+        scanner_.finish([&](const MatchSpan &span) {
+#ifdef DIRTYFILTER_METRICS
+            frozen_->countHit(frozen_->metricsShard(), span);
+#endif
+            if (!stopped_ && !visitor.onMatch(span)) {
+                stopped_ = true;
+            }
+        });
+    }
+    reset();
+}
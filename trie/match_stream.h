@@ -0,0 +1,125 @@
+/** @file match_stream.h
+  * @brief 流式匹配：文本分多次输入，跨块的敏感词也能找到
+  * @author teng.qing
+  * @date 2021/7/29
+  */
+
+#ifndef INC_01_TRIE_TREE_MATCH_STREAM_H_
+#define INC_01_TRIE_TREE_MATCH_STREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+
+#include "aho_corasick.h"
+#include "frozen_trie.h"
+
+/** @class MatchStream
+  * @brief 有状态的流式匹配器，用于直播弹幕、分块上传等文本按块到达的场景
+  *
+  * 每次feed一块文本，未完成的匹配状态、停顿词和被截断的utf8字符都保留到下一块，
+  * 命中结果的offset/startIndex是整个流中的位置。不缓存已经输入的文本，
+  * 内存占用只和最长敏感词有关，和流的长度无关（停顿词同时出现在敏感词里时，还和敏感词中间连续的停顿词个数有关）。
+  *
+  * 内部使用AC自动机（AhoCorasick::Scanner），结果和getSensitive一致（见Scanner的说明）。
+  * 同一个流只能使用一种编码（utf8或宽字符），不能交替使用。
+  * 不是线程安全的，每个流同时只能被一个线程使用；多个流可以共享同一个FrozenTrie。
+  */
+class MatchStream {
+public:
+    /** @fn MatchStream
+      * @param [in]frozen: 匹配器，流结束前保持有效，之后词库更新不影响这个流
+      */
+    explicit MatchStream(std::shared_ptr<const FrozenTrie> frozen);
+
+    MatchStream(const MatchStream &that) = delete;
+
+    MatchStream &operator=(const MatchStream &that) = delete;
+
+    /** @fn feed
+      * @brief 输入一块utf8文本，块结尾被截断的字符和下一块拼起来再解码
+      * @param [in]chunk: utf8文本，可以在任意字节处切分
+      * @param [in]visitor: 命中回调，MatchSpan的offset/length为流中的字节位置，返回false后不再输出
+      * @return void
+      */
+    void feed(std::string_view chunk, MatchVisitor &visitor);
+
+    /** @fn feed
+      * @brief 输入一块宽字符文本，MatchSpan的offset/length单位为wchar_t
+      * @param [in]chunk: 宽字符文本
+      * @param [in]visitor: 命中回调
+      * @return void
+      */
+    void feed(std::wstring_view chunk, MatchVisitor &visitor);
+
+    /** @fn finish
+      * @brief 流结束，输出剩余的待定结果，之后回到初始状态，可以开始一个新的流
+      * @param [in]visitor: 命中回调
+      * @return void
+      */
+    void finish(MatchVisitor &visitor);
+
+    /** @fn feed
+      * @brief 回调为函数对象 bool(const MatchSpan &)
+      */
+    template<typename Chunk, typename Func,
+            typename = std::enable_if_t<!std::is_base_of<MatchVisitor, std::decay_t<Func>>::value>>
+    void feed(const Chunk &chunk, Func &&func) {
+        FuncVisitor<Func> visitor(func);
+        feed(chunk, static_cast<MatchVisitor &>(visitor));
+    }
+
+    template<typename Func,
+            typename = std::enable_if_t<!std::is_base_of<MatchVisitor, std::decay_t<Func>>::value>>
+    void finish(Func &&func) {
+        FuncVisitor<Func> visitor(func);
+        finish(static_cast<MatchVisitor &>(visitor));
+    }
+
+    /** @fn reset
+      * @brief 丢弃当前状态，回到初始状态
+      * @return void
+      */
+    void reset();
+
+    // 已经输入的编码单元数（utf8为字节）
+    size_t offset() const { return offset_ + partial_size_; }
+
+    // 已经解码的字符数
+    int64_t index() const { return index_; }
+
+    // 回调是否返回过false
+    bool stopped() const { return stopped_; }
+
+    // 占用的内存，单位字节，不随流的长度增长
+    size_t memoryUsage() const { return sizeof(MatchStream) + scanner_.memoryUsage(); }
+
+private:
+    template<typename Func>
+    class FuncVisitor : public MatchVisitor {
+    public:
+        explicit FuncVisitor(Func &func) : func_(func) {}
+
+        bool onMatch(const MatchSpan &span) override { return func_(span); }
+
+    private:
+        Func &func_;
+    };
+
+    // 扫描一段完整的文本，offset_为这段文本在流中的开始位置
+    template<typename Text>
+    void scan(const Text &text, MatchVisitor &visitor);
+
+private:
+    std::shared_ptr<const FrozenTrie> frozen_;
+    AhoCorasick::Scanner scanner_;
+    size_t offset_ = 0;       // 已经扫描的编码单元数
+    int64_t index_ = 0;       // 已经扫描的字符数
+    char partial_[4]{};       // 上一块结尾被截断的utf8字符
+    size_t partial_size_ = 0;
+    bool stopped_ = false;
+};
+
+#endif //INC_01_TRIE_TREE_MATCH_STREAM_H_
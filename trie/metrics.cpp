@@ -0,0 +1,228 @@
+/** @file metrics.cpp
+  * @brief 运行时统计
+  * @author teng.qing
+  * @date 2021/8/2
+  */
+
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+const size_t Metrics::kLatencyBuckets;
+const size_t Metrics::kLengthBuckets;
+
+namespace {
+
+// 第一个桶的上界为 2^kLatencyShift 纳秒和 2^kLengthShift 个编码单元
+const unsigned kLatencyShift = 8;
+const unsigned kLengthShift = 4;
+
+// 所在的桶：上界为 2^(shift+i) 的第i个桶，超出范围为最后的+Inf桶
+size_t bucketOf(uint64_t value, unsigned shift, size_t buckets) {
+    if (value <= (uint64_t(1) << shift)) {
+        return 0;
+    }
+    auto bits = static_cast<size_t>(64 - __builtin_clzll(value - 1));
+    return std::min(bits - shift, buckets);
+}
+
+MetricsHistogram emptyHistogram(unsigned shift, size_t buckets) {
+    MetricsHistogram histogram;
+    for (size_t i = 0; i < buckets; ++i) {
+        histogram.bounds.push_back(uint64_t(1) << (shift + i));
+    }
+    histogram.counts.assign(buckets + 1, 0);
+    return histogram;
+}
+
+uint64_t load(const std::atomic<uint64_t> &counter) { return counter.load(std::memory_order_relaxed); }
+
+// 每个Metrics对象的编号，从1开始，0表示缓存为空
+std::atomic<uint64_t> g_next_id{1};
+
+// Prometheus标签值的转义：反斜杠、双引号、换行
+std::string escapeLabel(const std::string &value) {
+    std::string ret;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            ret += '\\';
+            ret += c;
+        } else if (c == '\n') {
+            ret += "\\n";
+        } else {
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+std::string number(double value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", value);
+    return buf;
+}
+
+void appendHeader(std::string &out, const std::string &name, const char *type, const char *help) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+// scale: 桶的上界和sum乘以这个系数，耗时从纳秒转换为秒
+void appendHistogram(std::string &out, const std::string &name, const char *help, const MetricsHistogram &histogram,
+                     double scale) {
+    appendHeader(out, name, "histogram", help);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < histogram.counts.size(); ++i) {
+        cumulative += histogram.counts[i];
+        std::string le = i < histogram.bounds.size() ? number(static_cast<double>(histogram.bounds[i]) * scale)
+                                                     : "+Inf";
+        out += name + "_bucket{le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+    }
+    out += name + "_sum " + number(static_cast<double>(histogram.sum) * scale) + "\n";
+    out += name + "_count " + std::to_string(histogram.count) + "\n";
+}
+
+void mergeHistogram(MetricsHistogram &to, const MetricsHistogram &from) {
+    if (to.counts.empty()) {
+        to = from;
+        return;
+    }
+    for (size_t i = 0; i < to.counts.size() && i < from.counts.size(); ++i) {
+        to.counts[i] += from.counts[i];
+    }
+    to.sum += from.sum;
+    to.count += from.count;
+}
+
+} // namespace
+
+Metrics::Shard::Shard(size_t word_count)
+        : word_count_(word_count), word_hits_(new std::atomic<uint64_t>[word_count]()) {}
+
+void Metrics::Shard::addScan(size_t length, uint64_t nanos) {
+    add(scans_, 1);
+    add(latency_sum_, nanos);
+    add(latency_[bucketOf(nanos, kLatencyShift, kLatencyBuckets)], 1);
+    add(length_sum_, length);
+    add(length_[bucketOf(length, kLengthShift, kLengthBuckets)], 1);
+}
+
+Metrics::Metrics(size_t word_count) : id_(g_next_id++), word_count_(word_count) {}
+
+Metrics::Shard &Metrics::local() {
+    // 每个线程缓存最近使用的几个Metrics的计数器，同时使用多个匹配器（如热更新前后）时也不用每次加锁
+    struct Entry {
+        uint64_t id;
+        Shard *shard;
+    };
+    static const size_t kCacheSize = 4;
+    static thread_local Entry cache[kCacheSize] = {};
+    static thread_local size_t next = 0;
+    for (const Entry &entry : cache) {
+        if (entry.id == id_) {
+            return *entry.shard;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // 线程退出后编号可能被新线程复用，新线程接着使用原来的计数器
+    std::unique_ptr<Shard> &shard = shards_[std::this_thread::get_id()];
+    if (shard == nullptr) {
+        shard.reset(new Shard(word_count_));
+    }
+    cache[next++ % kCacheSize] = Entry{id_, shard.get()};
+    return *shard;
+}
+
+MetricsSnapshot Metrics::snapshot(const std::function<std::string(int)> &word_text) const {
+    MetricsSnapshot ret;
+    ret.latency = emptyHistogram(kLatencyShift, kLatencyBuckets);
+    ret.inputLength = emptyHistogram(kLengthShift, kLengthBuckets);
+    std::vector<uint64_t> word_hits(word_count_, 0);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &item : shards_) {
+        const Shard &shard = *item.second;
+        ret.scans += load(shard.scans_);
+        ret.hits += load(shard.hits_);
+        ret.stopWordSkips += load(shard.stop_word_skips_);
+        ret.latency.sum += load(shard.latency_sum_);
+        ret.inputLength.sum += load(shard.length_sum_);
+        for (size_t i = 0; i <= kLatencyBuckets; ++i) {
+            ret.latency.counts[i] += load(shard.latency_[i]);
+        }
+        for (size_t i = 0; i <= kLengthBuckets; ++i) {
+            ret.inputLength.counts[i] += load(shard.length_[i]);
+        }
+        for (size_t i = 0; i < word_count_; ++i) {
+            word_hits[i] += load(shard.word_hits_[i]);
+        }
+    }
+    // count由桶累加，和桶保持一致（计数器是分别读取的，scans可能多算或少算正在进行的扫描）
+    for (uint64_t n : ret.latency.counts) {
+        ret.latency.count += n;
+    }
+    for (uint64_t n : ret.inputLength.counts) {
+        ret.inputLength.count += n;
+    }
+    for (size_t i = 0; i < word_count_; ++i) {
+        if (word_hits[i] > 0) {
+            ret.wordHits[word_text(static_cast<int>(i))] += word_hits[i];
+        }
+    }
+    return ret;
+}
+
+void MetricsSnapshot::merge(const MetricsSnapshot &that) {
+    scans += that.scans;
+    hits += that.hits;
+    stopWordSkips += that.stopWordSkips;
+    for (auto &item : that.wordHits) {
+        wordHits[item.first] += item.second;
+    }
+    mergeHistogram(latency, that.latency);
+    mergeHistogram(inputLength, that.inputLength);
+}
+
+std::string MetricsSnapshot::toPrometheus(const std::string &prefix) const {
+    std::string out;
+    appendHeader(out, prefix + "_scans_total", "counter", "Number of scanned texts.");
+    out += prefix + "_scans_total " + std::to_string(scans) + "\n";
+    appendHeader(out, prefix + "_hits_total", "counter", "Number of sensitive word hits.");
+    out += prefix + "_hits_total " + std::to_string(hits) + "\n";
+    appendHeader(out, prefix + "_stop_word_skips_total", "counter", "Stop words skipped inside hits.");
+    out += prefix + "_stop_word_skips_total " + std::to_string(stopWordSkips) + "\n";
+    appendHeader(out, prefix + "_word_hits_total", "counter", "Hits per sensitive word (after folding).");
+    for (auto &item : wordHits) {
+        out += prefix + "_word_hits_total{word=\"" + escapeLabel(item.first) + "\"} " + std::to_string(item.second) +
+               "\n";
+    }
+    appendHistogram(out, prefix + "_scan_duration_seconds", "Scan latency.", latency, 1e-9);
+    appendHistogram(out, prefix + "_scan_input_length", "Scanned text length in code units.", inputLength, 1);
+    return out;
+}
+
+bool MetricsSnapshot::writePrometheus(const std::string &file_name, const std::string &prefix,
+                                      std::string *error) const {
+    std::string tmp = file_name + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios_base::out | std::ios_base::trunc);
+        ofs << toPrometheus(prefix);
+        if (!ofs.flush()) {
+            if (error != nullptr) {
+                *error = "write " + tmp + " failed";
+            }
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), file_name.c_str()) != 0) {
+        if (error != nullptr) {
+            *error = "rename " + tmp + " to " + file_name + " failed";
+        }
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,194 @@
+/** @file metrics.h
+  * @brief 运行时统计：每个敏感词的命中次数、扫描耗时和输入长度的分布、停顿词跳过次数
+  * @author teng.qing
+  * @date 2021/8/2
+  */
+
+#ifndef INC_01_TRIE_TREE_METRICS_H_
+#define INC_01_TRIE_TREE_METRICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/** @struct MetricsHistogram
+  * @brief 直方图，桶的上界为2的幂
+  */
+struct MetricsHistogram {
+    std::vector<uint64_t> bounds; // 每个桶的上界（含），之后还有一个+Inf桶
+    std::vector<uint64_t> counts; // 每个桶的次数（不累加），比bounds多一个
+    uint64_t sum = 0;
+    uint64_t count = 0;
+};
+
+/** @struct MetricsSnapshot
+  * @brief 某一时刻的统计结果，可以合并多个匹配器（如热更新前后的版本、多个进程）的结果
+  */
+struct MetricsSnapshot {
+    uint64_t scans = 0;         // 扫描次数：每次search/getSensitive/replaceSensitive/forEachSensitive，流式匹配的每一块
+    uint64_t hits = 0;          // 命中次数
+    uint64_t stopWordSkips = 0; // 命中的文本中跳过的停顿词数（包括紧挨在敏感词前面、算进命中的停顿词）
+    std::map<std::string, uint64_t> wordHits; // 敏感词（utf8，经过字符转换之后的形式） -> 命中次数，只包含命中过的
+    MetricsHistogram latency;                 // 扫描耗时，单位纳秒
+    MetricsHistogram inputLength;             // 输入长度，单位为编码单元（宽字符串为wchar_t，utf8为字节）
+
+    /** @fn merge
+      * @brief 把另一份结果加到这一份上，敏感词按文本合并
+      * @param [in]that: 另一份结果
+      * @return void
+      */
+    void merge(const MetricsSnapshot &that);
+
+    /** @fn toPrometheus
+      * @brief 输出为Prometheus文本格式（text/plain; version=0.0.4）
+      * @param [in]prefix: 指标名前缀
+      * @return 文本
+      */
+    std::string toPrometheus(const std::string &prefix = "dirtyfilter") const;
+
+    /** @fn writePrometheus
+      * @brief 同上，写入文件（先写临时文件再rename，node_exporter的textfile collector不会读到一半的内容）
+      * @param [in]file_name: 文件名
+      * @param [in]prefix: 指标名前缀
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 是否成功
+      */
+    bool writePrometheus(const std::string &file_name, const std::string &prefix = "dirtyfilter",
+                         std::string *error = nullptr) const;
+};
+
+/** @class Metrics
+  * @brief 一个匹配器（FrozenTrie）的计数器
+  *
+  * 只有定义了DIRTYFILTER_METRICS（cmake -DDIRTYFILTER_METRICS=ON）时，扫描才会记录，
+  * 否则统计代码不会编译进扫描路径，没有任何开销，FrozenTrie::metrics()返回空的结果。
+  *
+  * 每个线程有自己的计数器（Shard），只有这个线程写，不需要加锁也没有原子的读改写，线程之间不会争用缓存行；
+  * snapshot()汇总所有线程的计数，可以和扫描同时进行。每个扫描过的线程占用 敏感词数 * 8 字节。
+  */
+class Metrics {
+public:
+    static const size_t kLatencyBuckets = 24; // 256ns ~ 2^31ns（约2.1秒），再加+Inf
+    static const size_t kLengthBuckets = 17;  // 16 ~ 2^20，再加+Inf
+
+    // 编译时是否打开了统计
+    static constexpr bool enabled() {
+#ifdef DIRTYFILTER_METRICS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /** @class Shard
+      * @brief 一个线程的计数器
+      */
+    class Shard {
+    public:
+        explicit Shard(size_t word_count);
+
+        /** @fn addScan
+          * @brief 记录一次扫描
+          * @param [in]length: 输入长度
+          * @param [in]nanos: 耗时，单位纳秒
+          * @return void
+          */
+        void addScan(size_t length, uint64_t nanos);
+
+        /** @fn addHit
+          * @brief 记录一次命中
+          * @param [in]word_id: 敏感词编号
+          * @param [in]stop_words: 命中的文本中跳过的停顿词数
+          * @return void
+          */
+        void addHit(int word_id, int stop_words) {
+            add(hits_, 1);
+            add(stop_word_skips_, static_cast<uint64_t>(stop_words));
+            if (word_id >= 0 && static_cast<size_t>(word_id) < word_count_) {
+                add(word_hits_[word_id], 1);
+            }
+        }
+
+    private:
+        friend class Metrics;
+
+        // 只有所属线程写，读和写分开，不需要lock前缀的原子加法
+        static void add(std::atomic<uint64_t> &counter, uint64_t n) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+    private:
+        size_t word_count_;
+        std::atomic<uint64_t> scans_{0};
+        std::atomic<uint64_t> hits_{0};
+        std::atomic<uint64_t> stop_word_skips_{0};
+        std::atomic<uint64_t> latency_sum_{0};
+        std::atomic<uint64_t> length_sum_{0};
+        std::atomic<uint64_t> latency_[kLatencyBuckets + 1]{};
+        std::atomic<uint64_t> length_[kLengthBuckets + 1]{};
+        std::unique_ptr<std::atomic<uint64_t>[]> word_hits_;
+    };
+
+    /** @class ScanTimer
+      * @brief 记录一次扫描，析构时把耗时和输入长度写入计数器
+      */
+    class ScanTimer {
+    public:
+        ScanTimer(Shard &shard, size_t length)
+                : shard_(shard), length_(length), start_(std::chrono::steady_clock::now()) {}
+
+        ~ScanTimer() {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            shard_.addScan(length_, static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+
+        ScanTimer(const ScanTimer &that) = delete;
+
+        ScanTimer &operator=(const ScanTimer &that) = delete;
+
+    private:
+        Shard &shard_;
+        size_t length_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    /** @fn Metrics
+      * @param [in]word_count: 敏感词编号的范围为 [0, word_count)
+      */
+    explicit Metrics(size_t word_count);
+
+    Metrics(const Metrics &that) = delete;
+
+    Metrics &operator=(const Metrics &that) = delete;
+
+    /** @fn local
+      * @brief 当前线程的计数器，第一次调用时创建，之后从线程局部的缓存中直接取到
+      * @return 计数器，Metrics析构前有效
+      */
+    Shard &local();
+
+    /** @fn snapshot
+      * @brief 汇总所有线程的计数
+      * @param [in]word_text: 敏感词编号 -> 文本，只对命中过的敏感词调用
+      * @return 统计结果
+      */
+    MetricsSnapshot snapshot(const std::function<std::string(int)> &word_text) const;
+
+private:
+    const uint64_t id_; // 全局唯一，用于线程局部的缓存，地址可能被之后的对象复用，不能用地址
+    const size_t word_count_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<Shard>> shards_;
+};
+
+#endif //INC_01_TRIE_TREE_METRICS_H_
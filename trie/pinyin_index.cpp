@@ -0,0 +1,547 @@
+/** @file pinyin_index.cpp
+  * @brief 拼音索引
+  * @author teng.qing
+  * @date 2021/8/7
+  */
+
+#include "pinyin_index.h"
+#include "text_codec.h"
+#include "trie_arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_set>
+
+const size_t PinyinTable::kMaxSyllables;
+const int PinyinTable::kLetterRoot;
+const size_t PinyinIndex::kMaxReadings;
+
+namespace {
+
+// 音节编号加上这个值作为索引中的"字符"，放在私用区，默认的字符转换不会改变它们
+const uint32_t kSyllableBase = 0xE000;
+
+const uint32_t kMaxUnicode = 0x10FFFF;
+
+void setError(std::string *error, const std::string &msg) {
+    if (error != nullptr) {
+        *error = msg;
+    }
+}
+
+// 解码utf8，非法序列返回false
+bool decodeAll(const std::string &s, std::u32string &out) {
+    out.clear();
+    const char *p = s.data();
+    const char *end = p + s.size();
+    while (p < end) {
+        size_t n;
+        uint32_t c = decodeUtf8(p, end, n);
+        if (c == kReplacementChar) {
+            return false;
+        }
+        out.push_back(c);
+        p += n;
+    }
+    return true;
+}
+
+// 带声调的元音 -> 不带声调的字母，ü写作v
+char baseLetter(uint32_t c) {
+    switch (c) {
+        case 0x0101: case 0x00E1: case 0x01CE: case 0x00E0:
+            return 'a';
+        case 0x0113: case 0x00E9: case 0x011B: case 0x00E8: case 0x00EA: case 0x1EBF: case 0x1EC1:
+            return 'e';
+        case 0x012B: case 0x00ED: case 0x01D0: case 0x00EC:
+            return 'i';
+        case 0x014D: case 0x00F3: case 0x01D2: case 0x00F2:
+            return 'o';
+        case 0x016B: case 0x00FA: case 0x01D4: case 0x00F9:
+            return 'u';
+        case 0x00FC: case 0x01D6: case 0x01D8: case 0x01DA: case 0x01DC:
+            return 'v';
+        case 0x0144: case 0x0148: case 0x01F9:
+            return 'n';
+        case 0x1E3F:
+            return 'm';
+        default:
+            break;
+    }
+    if (c >= 'a' && c <= 'z') {
+        return static_cast<char>(c);
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return static_cast<char>(c - 'A' + 'a');
+    }
+    return 0;
+}
+
+// 解析一个字符：utf8的单个字符或者U+XXXX
+bool parseChar(const std::string &token, uint32_t &c) {
+    if (token.size() > 2 && (token[0] == 'U' || token[0] == 'u') && token[1] == '+') {
+        char *end = nullptr;
+        unsigned long value = strtoul(token.c_str() + 2, &end, 16);
+        if (*end != '\0' || value > kMaxUnicode) {
+            return false;
+        }
+        c = static_cast<uint32_t>(value);
+        return true;
+    }
+    std::u32string chars;
+    if (!decodeAll(token, chars) || chars.size() != 1) {
+        return false;
+    }
+    c = chars[0];
+    return true;
+}
+
+// 按空白和逗号切分
+std::vector<std::string> splitTokens(const std::string &s) {
+    std::vector<std::string> tokens;
+    std::string token;
+    for (char ch : s) {
+        if (ch == ' ' || ch == '\t' || ch == ',' || ch == '\r') {
+            if (!token.empty()) {
+                tokens.push_back(token);
+                token.clear();
+            }
+        } else {
+            token += ch;
+        }
+    }
+    if (!token.empty()) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+} // namespace
+
+int PinyinTable::parseSyllable(const std::string &token, std::vector<std::string> &syllables,
+                               std::unordered_map<std::string, uint16_t> &ids) {
+    std::u32string chars;
+    if (!decodeAll(token, chars)) {
+        return -1;
+    }
+    std::string spelling;
+    for (uint32_t c : chars) {
+        if (c >= 0x0300 && c <= 0x036F) {
+            continue; // 组合用的声调符号
+        }
+        char letter = baseLetter(c);
+        if (letter == 0) {
+            if (c >= '1' && c <= '5' && !spelling.empty()) {
+                continue; // 声调数字
+            }
+            return -1;
+        }
+        spelling += letter;
+    }
+    if (spelling.empty()) {
+        return -1;
+    }
+
+    auto it = ids.find(spelling);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    if (syllables.size() >= kMaxSyllables) {
+        return -1;
+    }
+    auto id = static_cast<uint16_t>(syllables.size());
+    syllables.push_back(spelling);
+    ids.emplace(spelling, id);
+    return id;
+}
+
+bool PinyinTable::loadFromFile(const std::string &file_name, std::string *error) {
+    std::ifstream ifs(file_name, std::ios_base::in);
+    if (!ifs) {
+        setError(error, "open " + file_name + " failed");
+        return false;
+    }
+
+    std::unordered_map<uint32_t, std::vector<std::string>> readings;
+    std::string line;
+    int line_no = 0;
+    while (getline(ifs, line)) {
+        ++line_no;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.resize(comment);
+        }
+        // pinyin-data的格式：U+5FAE: wēi
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            line[colon] = ' ';
+        }
+        std::vector<std::string> tokens = splitTokens(line);
+        if (tokens.empty()) {
+            continue;
+        }
+        uint32_t c;
+        if (tokens.size() < 2 || !parseChar(tokens[0], c)) {
+            setError(error, file_name + ":" + std::to_string(line_no) + ": bad line");
+            return false;
+        }
+        if (c >= Alphabet::kBmpSize) {
+            continue;
+        }
+        auto &list = readings[c];
+        list.insert(list.end(), tokens.begin() + 1, tokens.end());
+    }
+
+    std::string msg;
+    if (!addReadings(readings, &msg)) {
+        setError(error, file_name + ": " + msg);
+        return false;
+    }
+    return true;
+}
+
+bool PinyinTable::addReadings(const std::unordered_map<uint32_t, std::vector<std::string>> &readings,
+                              std::string *error) {
+    // 先在副本上解析，失败时表不变
+    std::vector<std::string> syllables = syllables_;
+    std::unordered_map<std::string, uint16_t> ids = syllable_ids_;
+    std::unordered_map<uint32_t, std::vector<uint16_t>> chars = chars_;
+    for (const auto &item : readings) {
+        if (item.first >= Alphabet::kBmpSize) {
+            continue;
+        }
+        for (const std::string &token : item.second) {
+            int id = parseSyllable(token, syllables, ids);
+            if (id < 0) {
+                setError(error, "bad pinyin \"" + token + "\"");
+                return false;
+            }
+            auto &list = chars[item.first];
+            if (std::find(list.begin(), list.end(), static_cast<uint16_t>(id)) == list.end()) {
+                list.push_back(static_cast<uint16_t>(id));
+            }
+        }
+    }
+
+    syllables_.swap(syllables);
+    syllable_ids_.swap(ids);
+    chars_.swap(chars);
+    rebuild();
+    return true;
+}
+
+void PinyinTable::rebuild() {
+    reading_begin_.assign(Alphabet::kBmpSize + 1, 0);
+    for (const auto &item : chars_) {
+        reading_begin_[item.first + 1] = static_cast<uint32_t>(item.second.size());
+    }
+    for (size_t c = 0; c < Alphabet::kBmpSize; ++c) {
+        reading_begin_[c + 1] += reading_begin_[c];
+    }
+    reading_data_.assign(reading_begin_.back(), 0);
+    for (const auto &item : chars_) {
+        std::copy(item.second.begin(), item.second.end(), reading_data_.begin() + reading_begin_[item.first]);
+    }
+
+    // 所有音节的字母树
+    LetterNode empty{};
+    std::fill(std::begin(empty.next), std::end(empty.next), -1);
+    empty.syllable = -1;
+    letters_.assign(1, empty);
+    for (size_t id = 0; id < syllables_.size(); ++id) {
+        int node = kLetterRoot;
+        for (char letter : syllables_[id]) {
+            int &next = letters_[node].next[letter - 'a'];
+            if (next < 0) {
+                next = static_cast<int>(letters_.size());
+                letters_.push_back(empty);
+            }
+            node = letters_[node].next[letter - 'a'];
+        }
+        letters_[node].syllable = static_cast<int32_t>(id);
+    }
+}
+
+size_t PinyinTable::memoryUsage() const {
+    size_t bytes = reading_begin_.capacity() * sizeof(uint32_t) + reading_data_.capacity() * sizeof(uint16_t) +
+                   letters_.capacity() * sizeof(LetterNode);
+    for (const auto &s : syllables_) {
+        bytes += sizeof(std::string) + s.capacity();
+    }
+    for (const auto &item : chars_) {
+        bytes += sizeof(item) + item.second.capacity() * sizeof(uint16_t);
+    }
+    return bytes;
+}
+
+PinyinIndex::PinyinIndex(std::shared_ptr<const FrozenTrie> frozen, std::shared_ptr<const PinyinTable> table,
+                         int min_syllables)
+        : frozen_(std::move(frozen)), table_(std::move(table)) {
+    const size_t min_length = static_cast<size_t>(std::max(min_syllables, 1));
+    const DoubleArray &dat = frozen_->dat();
+    const DoubleArray::Unit *units = dat.units();
+
+    // 字符编号 -> 字符
+    const Alphabet &alphabet = dat.alphabet();
+    std::vector<uint32_t> symbols(alphabet.size(), 0);
+    for (uint32_t c = 0; c < Alphabet::kBmpSize; ++c) {
+        if (alphabet.bmp()[c] != Alphabet::kOther) {
+            symbols[alphabet.bmp()[c]] = c;
+        }
+    }
+    for (size_t i = 0; i < alphabet.astralCount(); ++i) {
+        symbols[alphabet.astral()[i].id] = alphabet.astral()[i].code;
+    }
+
+    // 从每个结尾状态沿check回到根节点，还原出敏感词，再展开为音节序列
+    TrieArena::WordList words;
+    std::vector<int32_t> word_ids;
+    std::vector<uint32_t> chars;
+    std::vector<std::pair<const uint16_t *, const uint16_t *>> readings;
+    for (size_t t = 1; t < dat.size(); ++t) {
+        if (units[t].check < 0 || !dat.isTerminal(static_cast<int>(t))) {
+            continue;
+        }
+        chars.clear();
+        for (auto state = static_cast<int>(t); state != DoubleArray::kRoot; state = units[state].check) {
+            int parent = units[state].check;
+            chars.push_back(symbols[state - (units[parent].base >> 1)]);
+        }
+        if (chars.size() < min_length) {
+            continue;
+        }
+        std::reverse(chars.begin(), chars.end());
+
+        readings.clear();
+        size_t combinations = 1;
+        for (uint32_t c : chars) {
+            auto r = table_->readings(c);
+            if (r.first == r.second) {
+                break;
+            }
+            readings.push_back(r);
+            combinations *= static_cast<size_t>(r.second - r.first);
+            combinations = std::min(combinations, kMaxReadings);
+        }
+        if (readings.size() != chars.size()) {
+            continue;
+        }
+
+        // 按第一个字的读音变化最快的顺序展开，超过kMaxReadings种时只保留前面的组合
+        ++word_count_;
+        std::vector<size_t> choice(chars.size(), 0);
+        std::wstring sequence(chars.size(), L'\0');
+        for (size_t n = 0; n < combinations; ++n) {
+            for (size_t i = 0; i < chars.size(); ++i) {
+                sequence[i] = static_cast<wchar_t>(kSyllableBase + readings[i].first[choice[i]]);
+            }
+            words.add(sequence, *FoldTable::defaultTable());
+            word_ids.push_back(dat.wordId(static_cast<int>(t)));
+            for (size_t i = 0; i < chars.size(); ++i) {
+                if (++choice[i] < static_cast<size_t>(readings[i].second - readings[i].first)) {
+                    break;
+                }
+                choice[i] = 0;
+            }
+        }
+    }
+
+    // 重复的音节序列（如同音的两个敏感词）保留第一次出现的编号，和arena的编号顺序一致
+    TrieArena arena;
+    arena.build(words);
+    dat_.build(arena);
+    std::unordered_set<std::wstring> seen;
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (seen.emplace(words.word(i), words.word(i) + words.length(i)).second) {
+            word_ids_.push_back(word_ids[i]);
+        }
+    }
+
+    syllable_codes_.resize(table_->syllableCount());
+    for (size_t id = 0; id < syllable_codes_.size(); ++id) {
+        syllable_codes_[id] = dat_.code(kSyllableBase + static_cast<uint32_t>(id));
+    }
+}
+
+size_t PinyinIndex::memoryUsage() const {
+    return dat_.memoryUsage() + syllable_codes_.capacity() * sizeof(uint16_t) +
+           word_ids_.capacity() * sizeof(int32_t);
+}
+
+template<typename Text>
+void PinyinIndex::decode(const Text &text, std::vector<Symbol> &symbols) const {
+    size_t offset = 0;
+    int32_t index = 0;
+    uint32_t c;
+    while (true) {
+        size_t start = offset;
+        if (!text.decode(offset, c)) {
+            break;
+        }
+        uint32_t unicode = text.fold(c);
+        SymbolKind kind = kOtherSymbol;
+        auto r = table_->readings(unicode);
+        if (unicode >= 'a' && unicode <= 'z') {
+            kind = kLetter;
+        } else if (r.first != r.second) {
+            kind = kHanzi;
+        } else if (frozen_->isStopWord(unicode)) {
+            kind = kStopWord;
+        }
+        symbols.push_back(Symbol{unicode, kind, index, start, offset});
+        ++index;
+    }
+}
+
+bool PinyinIndex::matchAt(const std::vector<Symbol> &symbols, size_t start, std::vector<Frame> &stack, size_t &end,
+                          int &word_id) const {
+    const size_t n = symbols.size();
+    size_t best = SIZE_MAX;
+    int best_id = -1;
+
+    // 转移到t，下一个要读的是symbols[next]
+    auto step = [&](int t, size_t next) {
+        // 拼音必须读完一段连续的字母
+        bool inside_word = next < n && symbols[next].kind == kLetter && symbols[next - 1].kind == kLetter;
+        if (dat_.isTerminal(t) && !inside_word && next < best) {
+            best = next;
+            best_id = word_ids_[dat_.wordId(t)];
+        }
+        if (next < best) {
+            stack.push_back(Frame{t, static_cast<uint32_t>(next)});
+        }
+    };
+
+    stack.clear();
+    stack.push_back(Frame{DoubleArray::kRoot, static_cast<uint32_t>(start)});
+    while (!stack.empty()) {
+        Frame frame = stack.back();
+        stack.pop_back();
+        size_t pos = frame.pos;
+        if (pos >= n || pos >= best) {
+            continue;
+        }
+
+        const Symbol &symbol = symbols[pos];
+        if (symbol.kind == kHanzi) {
+            // 多音字的每个读音
+            auto r = table_->readings(symbol.c);
+            for (const uint16_t *p = r.first; p != r.second; ++p) {
+                int t = dat_.transition(frame.state, syllable_codes_[*p]);
+                if (t >= 0) {
+                    step(t, pos + 1);
+                }
+            }
+        } else if (symbol.kind == kLetter) {
+            // 从这里开始的每个完整音节
+            int node = PinyinTable::kLetterRoot;
+            for (size_t q = pos; q < n && symbols[q].kind == kLetter; ++q) {
+                node = table_->letterStep(node, symbols[q].c);
+                if (node < 0) {
+                    break;
+                }
+                int syllable = table_->syllableAt(node);
+                if (syllable >= 0) {
+                    int t = dat_.transition(frame.state, syllable_codes_[syllable]);
+                    if (t >= 0) {
+                        step(t, q + 1);
+                    }
+                }
+            }
+        } else if (symbol.kind == kStopWord && frame.state != DoubleArray::kRoot) {
+            stack.push_back(Frame{frame.state, static_cast<uint32_t>(pos + 1)});
+        }
+    }
+
+    if (best_id < 0) {
+        return false;
+    }
+    end = best;
+    word_id = best_id;
+    return true;
+}
+
+void PinyinIndex::scan(const std::vector<Symbol> &symbols, const std::function<bool(const MatchSpan &)> &func) const {
+    std::vector<Frame> stack;
+    size_t i = 0;
+    while (i < symbols.size()) {
+        size_t end;
+        int word_id;
+        SymbolKind kind = symbols[i].kind;
+        if ((kind == kHanzi || kind == kLetter) && matchAt(symbols, i, stack, end, word_id)) {
+            const Symbol &first = symbols[i];
+            const Symbol &last = symbols[end - 1];
+            MatchSpan span{first.offset, last.end - first.offset, first.index, last.index - first.index + 1,
+                           word_id};
+            if (!func(span)) {
+                return;
+            }
+            i = end;
+            continue;
+        }
+        // 拼音只能从一段字母的开头开始
+        ++i;
+        while (kind == kLetter && i < symbols.size() && symbols[i].kind == kLetter) {
+            ++i;
+        }
+    }
+}
+
+void PinyinIndex::forEachSensitive(const std::wstring &word, const std::function<bool(const MatchSpan &)> &func) const {
+    std::vector<Symbol> symbols;
+    decode(WideText(word, frozen_->foldTable()), symbols);
+    scan(symbols, func);
+}
+
+void PinyinIndex::forEachSensitive(std::string_view text, const std::function<bool(const MatchSpan &)> &func) const {
+    std::vector<Symbol> symbols;
+    decode(Utf8Text(text, frozen_->foldTable()), symbols);
+    scan(symbols, func);
+}
+
+bool PinyinIndex::search(const std::wstring &word) const {
+    bool found = false;
+    forEachSensitive(word, [&found](const MatchSpan &) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+std::set<SensitiveWord> PinyinIndex::getSensitive(const std::wstring &word) const {
+    std::set<SensitiveWord> sensitiveSet;
+    forEachSensitive(word, [&](const MatchSpan &span) {
+        SensitiveWord wordObj;
+        wordObj.word = word.substr(span.offset, span.length);
+        wordObj.startIndex = static_cast<int>(span.startIndex);
+        wordObj.len = span.len;
+        sensitiveSet.insert(wordObj);
+        return true;
+    });
+    return sensitiveSet;
+}
+
+std::wstring PinyinIndex::replaceSensitive(const std::wstring &word) const {
+    std::wstring ret = word;
+    forEachSensitive(word, [&](const MatchSpan &span) {
+        std::fill(ret.begin() + static_cast<std::ptrdiff_t>(span.offset),
+                  ret.begin() + static_cast<std::ptrdiff_t>(span.offset + span.length), L'*');
+        return true;
+    });
+    return ret;
+}
+
+std::string PinyinIndex::replaceSensitive(std::string_view text) const {
+    std::string ret;
+    ret.reserve(text.size());
+    size_t last = 0;
+    forEachSensitive(text, [&](const MatchSpan &span) {
+        ret.append(text.data() + last, span.offset - last);
+        ret.append(span.len, '*');
+        last = span.offset + span.length;
+        return true;
+    });
+    ret.append(text.data() + last, text.size() - last);
+    return ret;
+}
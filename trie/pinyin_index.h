@@ -0,0 +1,254 @@
+/** @file pinyin_index.h
+  * @brief 拼音索引：按拼音匹配汉字和拼音混写（"weixin"、"wei信"）以及同音字替换（"威信"）的敏感词
+  * @author teng.qing
+  * @date 2021/8/7
+  */
+
+#ifndef INC_01_TRIE_TREE_PINYIN_INDEX_H_
+#define INC_01_TRIE_TREE_PINYIN_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "double_array.h"
+#include "frozen_trie.h"
+
+/** @class PinyinTable
+  * @brief 汉字 -> 拼音（不带声调的音节）
+  *
+  * 读音相同的汉字属于同一个同音类，匹配时只比较音节，不比较字。
+  * 字表文件为utf8，每行"汉字 拼音 [拼音...]"，以空白或逗号分隔，#开头为注释，汉字可以写成U+XXXX；
+  * 也可以直接使用pinyin-data的pinyin.txt（"U+5FAE: wēi  # 微"）。声调符号和末尾的声调数字会去掉，ü写作v。
+  * 只支持BMP内的汉字，BMP之外的行忽略。
+  *
+  * 构造后只读，一般通过 std::shared_ptr<const PinyinTable> 在多个PinyinIndex之间共享。
+  */
+class PinyinTable {
+public:
+    // 音节编号的上限，见PinyinIndex
+    static const size_t kMaxSyllables = 6400;
+
+    PinyinTable() = default;
+
+    PinyinTable(const PinyinTable &that) = delete;
+
+    PinyinTable &operator=(const PinyinTable &that) = delete;
+
+    /** @fn loadFromFile
+      * @brief 从字表文件加载，和已有的读音合并
+      * @param [in]file_name: 字表文件
+      * @param [out]error: 失败原因（文件无法打开、第几行格式错误），可以为nullptr
+      * @return 是否成功，失败时表不变
+      */
+    bool loadFromFile(const std::string &file_name, std::string *error = nullptr);
+
+    /** @fn addReadings
+      * @brief 同上，读音直接由参数给出
+      * @param [in]readings: 汉字 -> 拼音，拼音的格式同字表文件
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 是否成功，失败时表不变
+      */
+    bool addReadings(const std::unordered_map<uint32_t, std::vector<std::string>> &readings,
+                     std::string *error = nullptr);
+
+    /** @fn readings
+      * @brief 汉字的所有读音
+      * @param [in]c: 经过字符转换的unicode
+      * @return 音节编号的范围 [first, second)，没有读音时为空
+      */
+    std::pair<const uint16_t *, const uint16_t *> readings(uint32_t c) const {
+        if (c >= Alphabet::kBmpSize || reading_begin_.empty()) {
+            return {nullptr, nullptr};
+        }
+        return {reading_data_.data() + reading_begin_[c], reading_data_.data() + reading_begin_[c + 1]};
+    }
+
+    /** @fn letterStep
+      * @brief 在音节的字母树上前进一个字母，用于把连续的拼音字母切分为音节
+      * @param [in]node: 当前节点，从kLetterRoot开始
+      * @param [in]letter: 'a'~'z'
+      * @return 下一个节点，没有以这些字母开头的音节返回-1
+      */
+    int letterStep(int node, uint32_t letter) const {
+        if (letters_.empty()) {
+            return -1;
+        }
+        return letters_[node].next[letter - 'a'];
+    }
+
+    // 字母树的节点正好是一个完整的音节时返回音节编号，否则返回-1
+    int syllableAt(int node) const { return letters_[node].syllable; }
+
+    static const int kLetterRoot = 0;
+
+    // 音节数
+    size_t syllableCount() const { return syllables_.size(); }
+
+    // 音节的拼写
+    const std::string &syllable(size_t id) const { return syllables_[id]; }
+
+    // 有读音的汉字数
+    size_t charCount() const { return chars_.size(); }
+
+    // 占用的内存，单位字节
+    size_t memoryUsage() const;
+
+private:
+    // 解析一个拼音，成功时返回音节编号，新的音节加入syllables，超过kMaxSyllables时失败
+    static int parseSyllable(const std::string &token, std::vector<std::string> &syllables,
+                             std::unordered_map<std::string, uint16_t> &ids);
+
+    // 读音变化后重建查询用的数组
+    void rebuild();
+
+private:
+    struct LetterNode {
+        int32_t next[26];
+        int32_t syllable;
+    };
+
+    std::vector<std::string> syllables_;
+    std::unordered_map<std::string, uint16_t> syllable_ids_;
+    std::unordered_map<uint32_t, std::vector<uint16_t>> chars_;
+
+    // 查询时使用：汉字c的读音为reading_data_[reading_begin_[c], reading_begin_[c+1])
+    std::vector<uint32_t> reading_begin_;
+    std::vector<uint16_t> reading_data_;
+    std::vector<LetterNode> letters_;
+};
+
+/** @class PinyinIndex
+  * @brief 敏感词的拼音索引，和主词库分开，不需要在词库里列出拼音和同音字的变体
+  *
+  * 构造时把词库中每个全部由有读音的汉字组成的敏感词转换为音节序列（多音字的每种组合，最多kMaxReadings种），
+  * 编译为以音节为字符的双数组。扫描时文本中的汉字按它的所有读音转移，连续的拼音字母按音节切分后转移，
+  * 一遍扫描同时匹配汉字、拼音和两者混写。
+  *
+  * 规则：
+  * 1. 音节数少于minSyllables的敏感词不加入索引，单个音节太容易误伤
+  * 2. 拼音必须是完整的单词：从一段连续字母的开头开始，到一段连续字母的结尾结束，"weixing"不会命中"微信"
+  * 3. 敏感词中间的停顿词跳过，和FrozenTrie一致；其他字符（数字、不在字表中的字）会中断匹配
+  * 4. 同一个位置取最短的结果，命中后从结尾继续，结果不重叠；MatchSpan::wordId为主词库中的敏感词编号
+  *
+  * 同音字是按读音匹配的结果，"威信"这样的正常词语也会命中"微信"，适合对可疑文本做二次检查，
+  * 或者只对分类中需要的敏感词（如联系方式）建立索引的场景。
+  * 构造后只读，可以被多个线程同时使用。
+  */
+class PinyinIndex {
+public:
+    // 每个敏感词最多展开这么多种多音字的组合
+    static const size_t kMaxReadings = 16;
+
+    /** @fn PinyinIndex
+      * @param [in]frozen: 匹配器，PinyinIndex持有，使用它的词库、字符转换和停顿词
+      * @param [in]table: 字表
+      * @param [in]min_syllables: 至少这么多个音节的敏感词才加入索引，小于1时为1
+      */
+    PinyinIndex(std::shared_ptr<const FrozenTrie> frozen, std::shared_ptr<const PinyinTable> table,
+                int min_syllables = 2);
+
+    PinyinIndex(const PinyinIndex &that) = delete;
+
+    PinyinIndex &operator=(const PinyinIndex &that) = delete;
+
+    /** @fn forEachSensitive
+      * @brief 按顺序回调每个命中的敏感词
+      * @param [in]word: 原始字符串
+      * @param [in]func: 回调 bool(const MatchSpan &span)，返回false时停止
+      * @return void
+      */
+    void forEachSensitive(const std::wstring &word, const std::function<bool(const MatchSpan &)> &func) const;
+
+    /** @fn forEachSensitive
+      * @brief utf8版本，MatchSpan的offset/length为字节
+      */
+    void forEachSensitive(std::string_view text, const std::function<bool(const MatchSpan &)> &func) const;
+
+    /** @fn search
+      * @brief 是否包含读音和敏感词相同的文本
+      * @param [in]word: 原始字符串
+      * @return bool result
+      */
+    bool search(const std::wstring &word) const;
+
+    /** @fn getSensitive
+      * @brief 命中位置，word为文本中的原文
+      * @param [in]word: 原始字符串
+      * @return 命中敏感词信息
+      */
+    std::set<SensitiveWord> getSensitive(const std::wstring &word) const;
+
+    /** @fn replaceSensitive
+      * @brief 替换命中的文本为*
+      * @param [in]word: 字符串内容
+      * @return 替换后的文本
+      */
+    std::wstring replaceSensitive(const std::wstring &word) const;
+
+    /** @fn replaceSensitive
+      * @brief utf8版本，每个字符替换为一个*
+      */
+    std::string replaceSensitive(std::string_view text) const;
+
+    // 加入索引的敏感词数
+    size_t wordCount() const { return word_count_; }
+
+    // 音节序列数（包括多音字的组合，去重之后）
+    size_t sequenceCount() const { return word_ids_.size(); }
+
+    const std::shared_ptr<const FrozenTrie> &frozen() const { return frozen_; }
+
+    const std::shared_ptr<const PinyinTable> &table() const { return table_; }
+
+    // 索引占用的内存，单位字节，不包括FrozenTrie和PinyinTable
+    size_t memoryUsage() const;
+
+private:
+    enum SymbolKind : uint8_t {
+        kOtherSymbol,
+        kHanzi,
+        kLetter,
+        kStopWord,
+    };
+
+    // 文本中的一个字符
+    struct Symbol {
+        uint32_t c;      // 经过字符转换的unicode
+        SymbolKind kind;
+        int32_t index;   // 在原文中是第几个字符
+        size_t offset;   // 在原文中的偏移
+        size_t end;
+    };
+
+    struct Frame {
+        int32_t state;
+        uint32_t pos; // 下一个要读的symbols下标
+    };
+
+    template<typename Text>
+    void decode(const Text &text, std::vector<Symbol> &symbols) const;
+
+    void scan(const std::vector<Symbol> &symbols, const std::function<bool(const MatchSpan &)> &func) const;
+
+    // 从symbols[start]开始的最短匹配，没有返回false
+    bool matchAt(const std::vector<Symbol> &symbols, size_t start, std::vector<Frame> &stack, size_t &end,
+                 int &word_id) const;
+
+private:
+    std::shared_ptr<const FrozenTrie> frozen_;
+    std::shared_ptr<const PinyinTable> table_;
+    DoubleArray dat_;                      // 字符为音节，见kSyllableBase
+    std::vector<uint16_t> syllable_codes_; // 音节编号 -> dat_中的字符编号
+    std::vector<int32_t> word_ids_;        // 音节序列编号 -> 主词库中的敏感词编号
+    size_t word_count_ = 0;
+};
+
+#endif //INC_01_TRIE_TREE_PINYIN_INDEX_H_
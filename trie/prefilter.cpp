@@ -0,0 +1,69 @@
+/** @file prefilter.cpp
+  * @brief 首字符预过滤
+  * @author teng.qing
+  * @date 2021/7/28
+  */
+
+#include "prefilter.h"
+#include "double_array.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+const size_t Prefilter::kBmpSize;
+
+void Prefilter::build(const DoubleArray &dat, const uint64_t *stop_words) {
+    bits_.assign(kBmpSize / 32, 0);
+    count_ = 0;
+    for (uint32_t c = 0; c < kBmpSize; ++c) {
+        bool stop = ((stop_words[c >> 6] >> (c & 63)) & 1) != 0;
+        if (stop || dat.transition(DoubleArray::kRoot, dat.code(c)) >= 0) {
+            bits_[c >> 5] |= uint32_t(1) << (c & 31);
+            ++count_;
+        }
+    }
+}
+
+size_t Prefilter::skipNormalized(const wchar_t *data, size_t offset, size_t size) const {
+    static_assert(sizeof(wchar_t) == 4, "wchar_t must be 32 bits");
+
+#if defined(__AVX2__)
+    // 一次检查8个字符：按 c >> 5 从位图中gather出8个32位字，再按 c & 31 取出对应的位
+    const __m256i bmp_limit = _mm256_set1_epi32(static_cast<int>(kBmpSize - 1));
+    const __m256i low5 = _mm256_set1_epi32(31);
+    const __m256i one = _mm256_set1_epi32(1);
+    const auto *table = reinterpret_cast<const int *>(bits_.data());
+    while (offset + 8 <= size) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + offset));
+        // BMP之外的字符（按有符号比较，负数也算）视为候选
+        __m256i astral = _mm256_or_si256(_mm256_cmpgt_epi32(chars, bmp_limit),
+                                         _mm256_cmpgt_epi32(_mm256_setzero_si256(), chars));
+        __m256i index = _mm256_and_si256(_mm256_srli_epi32(chars, 5), _mm256_set1_epi32(kBmpSize / 32 - 1));
+        __m256i words = _mm256_i32gather_epi32(table, index, 4);
+        __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(chars, low5)), one);
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi32(bits, one), astral);
+        auto mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(hit)));
+        if (mask != 0) {
+            return offset + static_cast<size_t>(__builtin_ctz(mask));
+        }
+        offset += 8;
+    }
+#else
+    // 没有gather指令，展开为4个一组的查表，减少分支
+    while (offset + 4 <= size) {
+        bool hit0 = candidate(static_cast<uint32_t>(data[offset]));
+        bool hit1 = candidate(static_cast<uint32_t>(data[offset + 1]));
+        bool hit2 = candidate(static_cast<uint32_t>(data[offset + 2]));
+        bool hit3 = candidate(static_cast<uint32_t>(data[offset + 3]));
+        if (hit0 | hit1 | hit2 | hit3) {
+            return offset + (hit0 ? 0 : hit1 ? 1 : hit2 ? 2 : 3);
+        }
+        offset += 4;
+    }
+#endif
+    while (offset < size && !candidate(static_cast<uint32_t>(data[offset]))) {
+        ++offset;
+    }
+    return offset;
+}
@@ -0,0 +1,68 @@
+/** @file prefilter.h
+  * @brief 首字符预过滤：快速跳过不可能是敏感词开头、也不是停顿词的字符
+  * @author teng.qing
+  * @date 2021/7/28
+  */
+
+#ifndef INC_01_TRIE_TREE_PREFILTER_H_
+#define INC_01_TRIE_TREE_PREFILTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class DoubleArray;
+
+/** @class Prefilter
+  * @brief 首字符位图
+  *
+  * 大部分消息不包含敏感词，逐位置在双数组上匹配时，绝大多数位置第一步就失败了。
+  * 位图记录所有敏感词的首字符和停顿词（停顿词会计入紧随其后的敏感词，不能跳过），
+  * 扫描时先跳过位图中没有的字符，只在剩下的位置上匹配；没有任何候选位置的消息不会访问双数组。
+  *
+  * 只覆盖BMP，BMP之外的字符一律视为候选，由匹配过程精确判断。
+  */
+class Prefilter {
+public:
+    static const size_t kBmpSize = 65536;
+
+    Prefilter() = default;
+
+    /** @fn build
+      * @brief 从双数组根节点的转移和停顿词位图生成
+      * @param [in]dat: 双数组
+      * @param [in]stop_words: 停顿词位图，65536位
+      * @return void
+      */
+    void build(const DoubleArray &dat, const uint64_t *stop_words);
+
+    /** @fn candidate
+      * @brief 是否需要在该字符处匹配
+      * @param [in]unicode: 经过charConvert的unicode
+      * @return 敏感词首字符、停顿词以及BMP之外的字符返回true
+      */
+    bool candidate(uint32_t unicode) const {
+        return unicode >= kBmpSize || ((bits_[unicode >> 5] >> (unicode & 31)) & 1) != 0;
+    }
+
+    /** @fn skipNormalized
+      * @brief 在已经fold过的宽字符串中找到下一个候选位置，AVX2时每次8个字符，否则为标量查表
+      * @param [in]data: 字符串
+      * @param [in]offset: 开始位置
+      * @param [in]size: 字符串长度
+      * @return 下一个候选位置，没有返回size
+      */
+    size_t skipNormalized(const wchar_t *data, size_t offset, size_t size) const;
+
+    // 候选字符数（BMP内）
+    size_t count() const { return count_; }
+
+    // 占用的内存，单位字节
+    size_t memoryUsage() const { return bits_.capacity() * sizeof(uint32_t); }
+
+private:
+    std::vector<uint32_t> bits_ = std::vector<uint32_t>(kBmpSize / 32, 0);
+    size_t count_ = 0;
+};
+
+#endif //INC_01_TRIE_TREE_PREFILTER_H_
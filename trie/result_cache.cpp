@@ -0,0 +1,280 @@
+/** @file result_cache.cpp
+  * @brief 扫描结果缓存
+  * @author teng.qing
+  * @date 2021/8/10
+  */
+
+#include "result_cache.h"
+
+#include <cstring>
+
+namespace {
+
+// 每项除了key和value之外的开销：Entry本身、unordered_map的节点和桶
+const size_t kEntryOverhead = 64;
+
+void appendHeader(std::string &out, const std::string &name, const char *type, const char *help) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+void appendValue(std::string &out, const std::string &name, const char *type, const char *help, uint64_t value) {
+    appendHeader(out, name, type, help);
+    out += name + " " + std::to_string(value) + "\n";
+}
+
+std::string_view wideBytes(const std::wstring &word) {
+    return std::string_view(reinterpret_cast<const char *>(word.data()), word.size() * sizeof(wchar_t));
+}
+
+// getSensitive的结果只缓存命中位置，命中的原文从输入中截取
+std::string encodeSpans(const FrozenTrie &frozen, const std::wstring &word) {
+    std::string value;
+    frozen.forEachSensitive(word, [&](const MatchSpan &span) {
+        value.append(reinterpret_cast<const char *>(&span), sizeof(span));
+        return true;
+    });
+    return value;
+}
+
+std::string encodeSpans(const FrozenTrie &frozen, std::string_view text) {
+    std::string value;
+    frozen.forEachSensitive(text, [&](const MatchSpan &span) {
+        value.append(reinterpret_cast<const char *>(&span), sizeof(span));
+        return true;
+    });
+    return value;
+}
+
+template<typename Func>
+void decodeSpans(const std::string &value, Func &&func) {
+    MatchSpan span{};
+    for (size_t pos = 0; pos + sizeof(span) <= value.size(); pos += sizeof(span)) {
+        memcpy(&span, value.data() + pos, sizeof(span));
+        func(span);
+    }
+}
+
+} // namespace
+
+const uint8_t ResultCache::kCustomKind = 16;
+
+std::string CacheStats::toPrometheus(const std::string &prefix) const {
+    std::string out;
+    appendValue(out, prefix + "_hits_total", "counter", "Result cache hits.", hits);
+    appendValue(out, prefix + "_misses_total", "counter", "Result cache misses, including stale entries.", misses);
+    appendValue(out, prefix + "_stale_misses_total", "counter", "Entries computed by an older dictionary.",
+                staleMisses);
+    appendValue(out, prefix + "_inserts_total", "counter", "Results inserted into the cache.", inserts);
+    appendValue(out, prefix + "_evictions_total", "counter", "Results evicted by the memory cap.", evictions);
+    appendValue(out, prefix + "_skipped_total", "counter", "Texts too long to be cached.", skipped);
+    appendValue(out, prefix + "_entries", "gauge", "Cached results.", entries);
+    appendValue(out, prefix + "_bytes", "gauge", "Memory used by cached results.", bytes);
+    appendValue(out, prefix + "_capacity_bytes", "gauge", "Memory cap of the cache.", capacityBytes);
+    return out;
+}
+
+ResultCache::ResultCache(CacheOptions options) : options_(options) {
+    size_t shards = 1;
+    while (shards < options_.shards) {
+        shards <<= 1;
+    }
+    options_.shards = shards;
+    shard_capacity_ = options_.capacityBytes / shards;
+    for (size_t i = 0; i < shards; ++i) {
+        shards_.emplace_back(new Shard());
+    }
+}
+
+uint64_t ResultCache::hash(const void *data, size_t size, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    uint64_t h = seed ^ (size * m);
+    auto p = static_cast<const unsigned char *>(data);
+    for (; size >= 8; p += 8, size -= 8) {
+        uint64_t k;
+        memcpy(&k, p, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (size > 0) {
+        uint64_t k = 0;
+        memcpy(&k, p, size);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+size_t ResultCache::entryBytes(size_t key_size, size_t value_size) {
+    return key_size + value_size + kEntryOverhead;
+}
+
+bool ResultCache::lookup(uint8_t kind, const FrozenTrie &frozen, std::string_view key, std::string &value) {
+    uint64_t h = hash(key.data(), key.size(), kind);
+    Shard &shard = *shards_[(h >> 32) & (shards_.size() - 1)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(h);
+    if (it != shard.index.end()) {
+        Entry &entry = shard.entries[it->second];
+        if (entry.kind == kind && entry.key == key) {
+            if (entry.generation == frozen.generation()) {
+                entry.referenced = true;
+                value = entry.value;
+                ++shard.hits;
+                return true;
+            }
+            ++shard.staleMisses;
+        }
+    }
+    ++shard.misses;
+    return false;
+}
+
+void ResultCache::insert(uint8_t kind, const FrozenTrie &frozen, std::string_view key, std::string_view value) {
+    size_t bytes = entryBytes(key.size(), value.size());
+    if (bytes > shard_capacity_) {
+        return;
+    }
+    uint64_t h = hash(key.data(), key.size(), kind);
+    Shard &shard = *shards_[(h >> 32) & (shards_.size() - 1)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // 同一个哈希已有结果时（旧词库的结果、其他线程刚插入的结果或哈希冲突）直接覆盖
+    auto it = shard.index.find(h);
+    if (it != shard.index.end()) {
+        Entry &entry = shard.entries[it->second];
+        shard.bytes -= entryBytes(entry.key.size(), entry.value.size());
+        shard.index.erase(it);
+        entry.used = false;
+        entry.key.clear();
+        entry.value.clear();
+        shard.free.push_back(static_cast<uint32_t>(&entry - shard.entries.data()));
+    }
+
+    // CLOCK：访问过的项清除访问位后跳过，没有访问过的项淘汰
+    while (shard.bytes + bytes > shard_capacity_) {
+        Entry &entry = shard.entries[shard.hand];
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+        if (!entry.used) {
+            continue;
+        }
+        if (entry.referenced) {
+            entry.referenced = false;
+            continue;
+        }
+        shard.bytes -= entryBytes(entry.key.size(), entry.value.size());
+        shard.index.erase(entry.hash);
+        entry.used = false;
+        std::string().swap(entry.key);
+        std::string().swap(entry.value);
+        shard.free.push_back(static_cast<uint32_t>(&entry - shard.entries.data()));
+        ++shard.evictions;
+    }
+
+    uint32_t slot;
+    if (!shard.free.empty()) {
+        slot = shard.free.back();
+        shard.free.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(shard.entries.size());
+        shard.entries.emplace_back();
+    }
+    Entry &entry = shard.entries[slot];
+    entry.hash = h;
+    entry.generation = frozen.generation();
+    entry.key.assign(key.data(), key.size());
+    entry.value.assign(value.data(), value.size());
+    entry.kind = kind;
+    entry.used = true;
+    entry.referenced = false;
+    shard.index.emplace(h, slot);
+    shard.bytes += bytes;
+    ++shard.inserts;
+}
+
+bool ResultCache::search(const FrozenTrie &frozen, const std::wstring &word) {
+    return cached(kSearchWide, frozen, wideBytes(word), [&]() {
+        return std::string(1, frozen.search(word) ? 1 : 0);
+    })[0] != 0;
+}
+
+bool ResultCache::search(const FrozenTrie &frozen, std::string_view text) {
+    return cached(kSearchUtf8, frozen, text, [&]() {
+        return std::string(1, frozen.search(text) ? 1 : 0);
+    })[0] != 0;
+}
+
+std::set<SensitiveWord> ResultCache::getSensitive(const FrozenTrie &frozen, const std::wstring &word) {
+    std::set<SensitiveWord> sensitiveSet;
+    decodeSpans(cached(kSpansWide, frozen, wideBytes(word), [&]() { return encodeSpans(frozen, word); }),
+                [&](const MatchSpan &span) {
+                    SensitiveWord wordObj;
+                    wordObj.word = word.substr(span.offset, span.length);
+                    wordObj.startIndex = static_cast<int>(span.startIndex);
+                    wordObj.len = span.len;
+                    sensitiveSet.insert(wordObj);
+                });
+    return sensitiveSet;
+}
+
+std::set<Utf8SensitiveWord> ResultCache::getSensitive(const FrozenTrie &frozen, std::string_view text) {
+    std::set<Utf8SensitiveWord> sensitiveSet;
+    decodeSpans(cached(kSpansUtf8, frozen, text, [&]() { return encodeSpans(frozen, text); }),
+                [&](const MatchSpan &span) {
+                    Utf8SensitiveWord wordObj;
+                    wordObj.word = std::string(text.substr(span.offset, span.length));
+                    wordObj.startIndex = static_cast<int>(span.startIndex);
+                    wordObj.len = span.len;
+                    wordObj.byteOffset = span.offset;
+                    wordObj.byteLen = span.length;
+                    sensitiveSet.insert(wordObj);
+                });
+    return sensitiveSet;
+}
+
+std::wstring ResultCache::replaceSensitive(const FrozenTrie &frozen, const std::wstring &word) {
+    std::string value = cached(kReplaceWide, frozen, wideBytes(word), [&]() {
+        std::wstring ret = frozen.replaceSensitive(word);
+        return std::string(wideBytes(ret));
+    });
+    return std::wstring(reinterpret_cast<const wchar_t *>(value.data()), value.size() / sizeof(wchar_t));
+}
+
+std::string ResultCache::replaceSensitive(const FrozenTrie &frozen, std::string_view text) {
+    return cached(kReplaceUtf8, frozen, text, [&]() { return frozen.replaceSensitive(text); });
+}
+
+void ResultCache::clear() {
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        shard->index.clear();
+        shard->entries.clear();
+        shard->free.clear();
+        shard->hand = 0;
+        shard->bytes = 0;
+    }
+}
+
+CacheStats ResultCache::stats() const {
+    CacheStats stats;
+    for (auto &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.staleMisses += shard->staleMisses;
+        stats.inserts += shard->inserts;
+        stats.evictions += shard->evictions;
+        stats.entries += shard->index.size();
+        stats.bytes += shard->bytes;
+    }
+    stats.skipped = skipped_.load();
+    stats.capacityBytes = options_.capacityBytes;
+    return stats;
+}
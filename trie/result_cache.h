@@ -0,0 +1,193 @@
+/** @file result_cache.h
+  * @brief 扫描结果缓存：刷屏时同样的消息反复出现，直接返回上次的结果
+  * @author teng.qing
+  * @date 2021/8/10
+  */
+
+#ifndef INC_01_TRIE_TREE_RESULT_CACHE_H_
+#define INC_01_TRIE_TREE_RESULT_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "frozen_trie.h"
+
+/** @struct CacheOptions
+  * @brief ResultCache的参数
+  */
+struct CacheOptions {
+    size_t capacityBytes = 64u << 20; // 内存上限，包括文本、结果和索引，按分片平均分配
+    size_t shards = 16;               // 分片数，向上取2的幂，每个分片一把锁
+    size_t maxTextBytes = 4096;       // 超过这个长度的文本不缓存，长消息很少重复，缓存只会挤掉短消息
+};
+
+/** @struct CacheStats
+  * @brief 缓存的统计，所有分片合计
+  */
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;      // 包括staleMisses
+    uint64_t staleMisses = 0; // 找到了，但是是旧词库的结果
+    uint64_t inserts = 0;
+    uint64_t evictions = 0;
+    uint64_t skipped = 0;     // 太长没有缓存的文本
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t capacityBytes = 0;
+
+    // 命中率，没有查询过时为0
+    double hitRate() const { return hits + misses == 0 ? 0 : static_cast<double>(hits) / (hits + misses); }
+
+    /** @fn toPrometheus
+      * @brief 输出为Prometheus文本格式，和MetricsSnapshot::toPrometheus拼在一起输出
+      * @param [in]prefix: 指标名前缀
+      * @return 文本
+      */
+    std::string toPrometheus(const std::string &prefix = "dirtyfilter_cache") const;
+};
+
+/** @class ResultCache
+  * @brief 分片的CLOCK缓存，key为原始输入（不做字符转换）的64位哈希和结果种类，结果和FrozenTrie的同名接口完全相同
+  *
+  * 每个结果记录计算它的FrozenTrie::generation()，查询时版本不同视为未命中并在插入时覆盖，
+  * 所以词库热更新、Trie重新build之后不会返回旧词库的结果，也不需要清空缓存。
+  * 哈希相同时还会比较原文，哈希冲突不会返回错误的结果。
+  *
+  * 淘汰使用CLOCK（二次机会）：命中时只设置访问位，空间不够时转动指针，淘汰访问位为0的项、清除访问位为1的项。
+  * 比LRU少了命中时移动链表节点，每项只多一个字节。
+  *
+  * 线程安全，可以被多个线程、多个FrozenTrie（如TrieHolder的各个版本）同时使用。
+  */
+class ResultCache {
+public:
+    explicit ResultCache(CacheOptions options = CacheOptions());
+
+    ResultCache(const ResultCache &that) = delete;
+
+    ResultCache &operator=(const ResultCache &that) = delete;
+
+    /** @fn search
+      * @brief 同FrozenTrie::search，结果不在缓存中时用frozen扫描并缓存
+      * @param [in]frozen: 匹配器
+      * @param [in]word: 原始字符串
+      * @return bool result
+      */
+    bool search(const FrozenTrie &frozen, const std::wstring &word);
+
+    bool search(const FrozenTrie &frozen, std::string_view text);
+
+    /** @fn getSensitive
+      * @brief 同FrozenTrie::getSensitive
+      */
+    std::set<SensitiveWord> getSensitive(const FrozenTrie &frozen, const std::wstring &word);
+
+    std::set<Utf8SensitiveWord> getSensitive(const FrozenTrie &frozen, std::string_view text);
+
+    /** @fn replaceSensitive
+      * @brief 同FrozenTrie::replaceSensitive
+      */
+    std::wstring replaceSensitive(const FrozenTrie &frozen, const std::wstring &word);
+
+    std::string replaceSensitive(const FrozenTrie &frozen, std::string_view text);
+
+    /** @fn cached
+      * @brief 通用接口，缓存调用者自己编码的结果（如FilterServer的响应体）：命中时返回缓存的结果，
+      * 否则调用compute()计算并插入
+      * @param [in]kind: 结果种类，不小于kCustomKind，不同种类的结果互不影响
+      * @param [in]frozen: 计算结果使用的匹配器
+      * @param [in]key: 原始输入
+      * @param [in]compute: 返回std::string的函数，未命中时调用
+      * @return 结果
+      */
+    template<typename Compute>
+    std::string cached(uint8_t kind, const FrozenTrie &frozen, std::string_view key, Compute &&compute) {
+        if (key.size() > options_.maxTextBytes) {
+            ++skipped_;
+            return compute();
+        }
+        std::string value;
+        if (lookup(kind, frozen, key, value)) {
+            return value;
+        }
+        value = compute();
+        insert(kind, frozen, key, value);
+        return value;
+    }
+
+    // 清空所有结果，统计不变
+    void clear();
+
+    CacheStats stats() const;
+
+    const CacheOptions &options() const { return options_; }
+
+    /** @fn hash
+      * @brief key使用的64位哈希（MurmurHash64A），每次处理8个字节
+      * @param [in]data: 数据
+      * @param [in]size: 字节数
+      * @param [in]seed: 种子，这里为结果种类
+      * @return 哈希
+      */
+    static uint64_t hash(const void *data, size_t size, uint64_t seed);
+
+    // 自定义结果种类的起始值，更小的值由ResultCache自己的接口使用
+    static const uint8_t kCustomKind;
+
+private:
+    enum Kind : uint8_t {
+        kSearchWide,
+        kSearchUtf8,
+        kSpansWide,
+        kSpansUtf8,
+        kReplaceWide,
+        kReplaceUtf8,
+    };
+
+    struct Entry {
+        uint64_t hash = 0;
+        uint64_t generation = 0;
+        std::string key;   // 原始输入的字节
+        std::string value; // 结果：search为1字节，getSensitive为MatchSpan数组，replaceSensitive为替换后的字节
+        uint8_t kind = 0;
+        bool used = false;
+        bool referenced = false;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, uint32_t> index; // 哈希 -> entries下标
+        std::vector<Entry> entries;
+        std::vector<uint32_t> free;                   // 空闲的entries下标
+        size_t hand = 0;                              // CLOCK指针
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t staleMisses = 0;
+        uint64_t inserts = 0;
+        uint64_t evictions = 0;
+    };
+
+    // 查找，命中时结果写入value
+    bool lookup(uint8_t kind, const FrozenTrie &frozen, std::string_view key, std::string &value);
+
+    void insert(uint8_t kind, const FrozenTrie &frozen, std::string_view key, std::string_view value);
+
+    // 一项占用的字节数
+    static size_t entryBytes(size_t key_size, size_t value_size);
+
+private:
+    CacheOptions options_;
+    size_t shard_capacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t> skipped_{0};
+};
+
+#endif //INC_01_TRIE_TREE_RESULT_CACHE_H_
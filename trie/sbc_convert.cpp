@@ -5,9 +5,16 @@
   */
 
 #include "sbc_convert.h"
+#include "fold_table.h"
 #include <locale>
 #include <codecvt>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 // ASCII表中可见字符从!开始，偏移位值为33(Decimal)
 const char kDBCCharStart = 33; // 半角!
 const char kDBCCharEnd = 126;  // 半角~
@@ -70,10 +77,120 @@ std::wstring SBCConvert::ws_qj2bj(const std::wstring &src) {
     return result;
 }
 
-int SBCConvert::charConvert(const wchar_t &src) {
-    int r = qj2bj(src);
+namespace {
+
+// 和qj2bj + 大写转小写的逻辑一致，编译期生成整张表
+constexpr uint16_t foldChar(uint32_t c) {
+    uint32_t r = c;
+    if (c >= static_cast<uint32_t>(kSBCCharStart) && c <= static_cast<uint32_t>(kSBCCharEnd)) {
+        r = c - kConvertStep;
+    } else if (c == static_cast<uint32_t>(kSBCSpace)) {
+        r = kDBCSpace;
+    }
     // 小写字母在大写字母后32位
-    return (r >= 'A' && r <= 'Z') ? r + 32 : r;
+    return static_cast<uint16_t>((r >= 'A' && r <= 'Z') ? r + 32 : r);
+}
+
+constexpr std::array<uint16_t, SBCConvert::kFoldTableSize> makeFoldTable() {
+    std::array<uint16_t, SBCConvert::kFoldTableSize> table{};
+    for (uint32_t c = 0; c < SBCConvert::kFoldTableSize; ++c) {
+        table[c] = foldChar(c);
+    }
+    return table;
+}
+
+} // namespace
+
+const size_t SBCConvert::kFoldTableSize;
+
+const std::array<uint16_t, SBCConvert::kFoldTableSize> SBCConvert::kFoldTable = makeFoldTable();
+
+int SBCConvert::charConvert(const wchar_t &src) {
+    return static_cast<int>(fold(static_cast<uint32_t>(src)));
+}
+
+namespace {
+
+// simd为false时逐个查表，fold为单个字符的转换
+template<typename Fold>
+void normalizeWith(const wchar_t *src, size_t len, wchar_t *dst, bool simd, Fold fold) {
+    size_t i = 0;
+
+#if defined(__SSE2__) || defined(__AVX2__)
+    if (simd && sizeof(wchar_t) == 4) {
+#if defined(__AVX2__)
+        using Vec = __m256i;
+        const size_t kLanes = 8;
+        auto load = [](const wchar_t *p) { return _mm256_loadu_si256(reinterpret_cast<const Vec *>(p)); };
+        auto store = [](wchar_t *p, Vec v) { _mm256_storeu_si256(reinterpret_cast<Vec *>(p), v); };
+        auto set1 = [](int v) { return _mm256_set1_epi32(v); };
+        auto gt = [](Vec a, Vec b) { return _mm256_cmpgt_epi32(a, b); };
+        auto band = [](Vec a, Vec b) { return _mm256_and_si256(a, b); };
+        auto bor = [](Vec a, Vec b) { return _mm256_or_si256(a, b); };
+        auto add = [](Vec a, Vec b) { return _mm256_add_epi32(a, b); };
+        auto sub = [](Vec a, Vec b) { return _mm256_sub_epi32(a, b); };
+        auto all = [](Vec m) { return _mm256_movemask_epi8(m) == -1; };
+#else
+        using Vec = __m128i;
+        const size_t kLanes = 4;
+        auto load = [](const wchar_t *p) { return _mm_loadu_si128(reinterpret_cast<const Vec *>(p)); };
+        auto store = [](wchar_t *p, Vec v) { _mm_storeu_si128(reinterpret_cast<Vec *>(p), v); };
+        auto set1 = [](int v) { return _mm_set1_epi32(v); };
+        auto gt = [](Vec a, Vec b) { return _mm_cmpgt_epi32(a, b); };
+        auto band = [](Vec a, Vec b) { return _mm_and_si128(a, b); };
+        auto bor = [](Vec a, Vec b) { return _mm_or_si128(a, b); };
+        auto add = [](Vec a, Vec b) { return _mm_add_epi32(a, b); };
+        auto sub = [](Vec a, Vec b) { return _mm_sub_epi32(a, b); };
+        auto all = [](Vec m) { return _mm_movemask_epi8(m) == 0xFFFF; };
+#endif
+        const Vec ascii_end = set1(0x80);
+        const Vec fw_lo = set1(kSBCCharStart - 1);
+        const Vec fw_hi = set1(kSBCCharEnd + 1);
+        const Vec upper_lo = set1('A' - 1);
+        const Vec upper_hi = set1('Z' + 1);
+        const Vec step = set1(kConvertStep);
+        const Vec case_step = set1(32);
+
+        // 一次处理4个寄存器，SSE2为16个字符，AVX2为32个字符
+        const size_t kBlock = kLanes * 4;
+        for (; i + kBlock <= len; i += kBlock) {
+            Vec v[4];
+            Vec fw[4];
+            bool ok = true;
+            for (size_t j = 0; j < 4; ++j) {
+                v[j] = load(src + i + j * kLanes);
+                fw[j] = band(gt(v[j], fw_lo), gt(fw_hi, v[j]));
+                ok = ok && all(bor(fw[j], gt(ascii_end, v[j])));
+            }
+            if (!ok) {
+                // 有ASCII和全角ASCII以外的字符，逐个查表
+                for (size_t j = i; j < i + kBlock; ++j) {
+                    dst[j] = static_cast<wchar_t>(fold(static_cast<uint32_t>(src[j])));
+                }
+                continue;
+            }
+            for (size_t j = 0; j < 4; ++j) {
+                Vec r = sub(v[j], band(fw[j], step));
+                Vec upper = band(gt(r, upper_lo), gt(upper_hi, r));
+                store(dst + i + j * kLanes, add(r, band(upper, case_step)));
+            }
+        }
+    }
+#endif
+
+    for (; i < len; ++i) {
+        dst[i] = static_cast<wchar_t>(fold(static_cast<uint32_t>(src[i])));
+    }
+}
+
+} // namespace
+
+void SBCConvert::normalize(const wchar_t *src, size_t len, wchar_t *dst) {
+    normalizeWith(src, len, dst, true, [](uint32_t c) { return SBCConvert::fold(c); });
+}
+
+void SBCConvert::normalize(const wchar_t *src, size_t len, wchar_t *dst, const FoldTable &fold) {
+    normalizeWith(src, len, dst, fold.asciiDefault(), [&](uint32_t c) { return fold.fold(c); });
 }
 
 #ifdef UNIT_TEST
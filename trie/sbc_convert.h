@@ -8,8 +8,13 @@
 #ifndef INC_01_TRIE_TREE_SBC_CONVERT_H_
 #define INC_01_TRIE_TREE_SBC_CONVERT_H_
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+class FoldTable;
+
 /** @class sbc_convert
   * @brief
   */
@@ -50,6 +55,37 @@ public:
       * @return unicode编码
       */
     static int qj2bj(const wchar_t &src);
+
+    /** @fn fold
+      * @brief 同charConvert，BMP内的字符直接查预先计算好的表，一次查表完成全角转半角和大写转小写
+      * @param [in]c: unicode
+      * @return 转换后的unicode
+      */
+    static uint32_t fold(uint32_t c) { return c < kFoldTableSize ? kFoldTable[c] : c; }
+
+    /** @fn normalize
+      * @brief 批量执行fold。ASCII和全角ASCII连续出现时用SSE2/AVX2一次处理16/32个字符，其他字符查表
+      * @param [in]src: 原始字符
+      * @param [in]len: 字符数
+      * @param [out]dst: 转换结果，长度为len，可以和src相同
+      * @return void
+      */
+    static void normalize(const wchar_t *src, size_t len, wchar_t *dst);
+
+    /** @fn normalize
+      * @brief 同上，使用指定的转换表（见FoldTable），表中ASCII和全角ASCII的规则和默认规则相同时仍然使用SIMD
+      * @param [in]src: 原始字符
+      * @param [in]len: 字符数
+      * @param [out]dst: 转换结果，长度为len，可以和src相同
+      * @param [in]fold: 转换表
+      * @return void
+      */
+    static void normalize(const wchar_t *src, size_t len, wchar_t *dst, const FoldTable &fold);
+
+    static const size_t kFoldTableSize = 65536;
+
+    // charConvert的结果表，只包含BMP，编译期生成
+    static const std::array<uint16_t, kFoldTableSize> kFoldTable;
 };
 
 #ifdef UNIT_TEST
@@ -0,0 +1,255 @@
+/** @file static_matcher.h
+  * @brief 编译期词库的匹配器：词库由dirtyfilter-codegen生成为constexpr数组，启动时不需要加载和构建
+  * @author teng.qing
+  * @date 2021/8/10
+  */
+
+#ifndef INC_01_TRIE_TREE_STATIC_MATCHER_H_
+#define INC_01_TRIE_TREE_STATIC_MATCHER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#include "aho_corasick.h"
+#include "text_codec.h"
+#include "word_tag.h"
+
+/** @struct StaticSymbol
+  * @brief 编译期词库的字符表：输入的字符（未经过fold） -> 双数组中的编号和是否停顿词。
+  * 生成时已经套用了字符转换规则（FoldTable），匹配时不需要再查转换表
+  */
+struct StaticSymbol {
+    uint32_t unicode;
+    uint16_t code; // 不在任何敏感词中为Alphabet::kOther
+    bool stop;
+};
+
+/** @class StaticMatcher
+  * @brief 在dirtyfilter-codegen生成的constexpr数组上匹配，结果和FrozenTrie的kTrie模式相同
+  *
+  * 用于词表固定、只有几百个词的场景（如嵌入式服务），不需要在启动时insert和build，数据都在.rodata中，
+  * 所有进程共享同一份物理内存。Dict为生成的类，包含：
+  * kUnits/kWordIds：双数组（同DoubleArray）；kAscii：ASCII字符的字符表，128项；
+  * kSymbols：其余字符的字符表，按unicode排序，最后一项为哨兵；
+  * kBmpSymbols：BMP内的字符是否在kSymbols中的位图，正常文本的大部分字符查一次位图就可以跳过；
+  * kWords/kTags：敏感词编号 -> 敏感词（fold之后）和标签。
+  *
+  * 扫描接口都是constexpr，可以在编译期检查固定文本，如 static_assert(StaticMatcher<Dict>::search("加微信"))。
+  * 词库变化时需要重新生成并编译，需要热更新的场景使用Trie/TrieHolder。
+  *
+  * 在CMake中用dirtyfilter_static_dict(<target> <头文件> <类名> <word.txt> [stopwd.txt])生成，见CMakeLists.txt。
+  */
+template<typename Dict>
+class StaticMatcher {
+public:
+    /** @fn search
+      * @brief 是否包含敏感词
+      * @param [in]text: utf8字符串
+      * @return bool result
+      */
+    static constexpr bool search(std::string_view text) {
+        bool found = false;
+        forEachSensitive(text, [&](const MatchSpan &) {
+            found = true;
+            return false;
+        });
+        return found;
+    }
+
+    static constexpr bool search(std::wstring_view text) {
+        bool found = false;
+        forEachSensitive(text, [&](const MatchSpan &) {
+            found = true;
+            return false;
+        });
+        return found;
+    }
+
+    /** @fn forEachSensitive
+      * @brief 按顺序回调每个命中的敏感词，同FrozenTrie::forEachSensitive，offset/length为字节
+      * @param [in]text: utf8字符串
+      * @param [in]func: bool(const MatchSpan &)，返回false时停止
+      * @return void
+      */
+    template<typename Func>
+    static constexpr void forEachSensitive(std::string_view text, Func &&func) {
+        scan(text, func);
+    }
+
+    /** @fn forEachSensitive
+      * @brief 宽字符串版本，offset/length为wchar_t
+      */
+    template<typename Func>
+    static constexpr void forEachSensitive(std::wstring_view text, Func &&func) {
+        scan(text, func);
+    }
+
+    /** @fn countSensitive
+      * @brief 命中的敏感词个数
+      * @param [in]text: utf8字符串
+      * @return 个数
+      */
+    static constexpr size_t countSensitive(std::string_view text) {
+        size_t count = 0;
+        forEachSensitive(text, [&](const MatchSpan &) {
+            ++count;
+            return true;
+        });
+        return count;
+    }
+
+    /** @fn replaceSensitive
+      * @brief 每个字符（不是每个字节）替换为一个*，同FrozenTrie::replaceSensitive
+      * @param [in]text: utf8字符串
+      * @return 替换后的utf8文本
+      */
+    static std::string replaceSensitive(std::string_view text) {
+        std::string ret;
+        ret.reserve(text.size());
+        size_t last = 0;
+        forEachSensitive(text, [&](const MatchSpan &span) {
+            ret.append(text.data() + last, span.offset - last);
+            ret.append(span.len, '*');
+            last = span.offset + span.length;
+            return true;
+        });
+        ret.append(text.data() + last, text.size() - last);
+        return ret;
+    }
+
+    static std::wstring replaceSensitive(std::wstring_view text) {
+        std::wstring ret(text);
+        forEachSensitive(text, [&](const MatchSpan &span) {
+            ret.replace(span.offset, span.length, span.length, L'*');
+            return true;
+        });
+        return ret;
+    }
+
+    // 敏感词编号的范围为 [0, wordCount())
+    static constexpr size_t wordCount() { return std::size(Dict::kWords); }
+
+    // 敏感词（fold之后），utf8，word_id为MatchSpan::wordId
+    static constexpr std::string_view word(int word_id) { return Dict::kWords[word_id]; }
+
+    static constexpr const WordTag &wordTag(int word_id) { return Dict::kTags[word_id]; }
+
+    // 双数组长度
+    static constexpr size_t size() { return std::size(Dict::kUnits); }
+
+    /** @fn symbol
+      * @brief 查字符表
+      * @param [in]c: 输入的unicode，不需要fold
+      * @return 编号和是否停顿词，不在表中时code为Alphabet::kOther
+      */
+    static constexpr StaticSymbol symbol(uint32_t c) {
+        if (c < 128) {
+            return Dict::kAscii[c];
+        }
+        if (c < Alphabet::kBmpSize && ((Dict::kBmpSymbols[c >> 6] >> (c & 63)) & 1) == 0) {
+            return StaticSymbol{c, Alphabet::kOther, false};
+        }
+        size_t lo = 0;
+        size_t hi = std::size(Dict::kSymbols);
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (Dict::kSymbols[mid].unicode < c) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < std::size(Dict::kSymbols) && Dict::kSymbols[lo].unicode == c) {
+            return Dict::kSymbols[lo];
+        }
+        return StaticSymbol{c, Alphabet::kOther, false};
+    }
+
+    // 同DoubleArray::transition
+    static constexpr int transition(int state, uint16_t code) {
+        size_t t = static_cast<size_t>(Dict::kUnits[state].base >> 1) + code;
+        if (t < size() && Dict::kUnits[t].check == state) {
+            return static_cast<int>(t);
+        }
+        return -1;
+    }
+
+private:
+    static constexpr uint32_t decode(std::string_view text, size_t &offset) {
+        size_t n = 1;
+        uint32_t c = decodeUtf8(text.data() + offset, text.data() + text.size(), n);
+        offset += n;
+        return c;
+    }
+
+    static constexpr uint32_t decode(std::wstring_view text, size_t &offset) {
+        return static_cast<uint32_t>(text[offset++]);
+    }
+
+    // 同FrozenTrie::getSensitiveLength
+    template<typename View>
+    static constexpr int getSensitiveLength(View text, size_t offset, size_t &end, int &word_id) {
+        int state = DoubleArray::kRoot;
+        int wordLen = 0;
+        while (offset < text.size()) {
+            StaticSymbol s = symbol(decode(text, offset));
+            int next = transition(state, s.code);
+            if (next < 0) {
+                if (s.stop) {
+                    ++wordLen;
+                    continue;
+                }
+                return 0;
+            }
+            ++wordLen;
+            if ((Dict::kUnits[next].base & 1) != 0) {
+                end = offset;
+                word_id = Dict::kWordIds[next];
+                return wordLen;
+            }
+            state = next;
+        }
+        return 0;
+    }
+
+    // 同FrozenTrie::scanSpans的kTrie模式。没有预过滤，不是首字符也不是停顿词的字符直接结束当前这段停顿词
+    template<typename View, typename Func>
+    static constexpr void scan(View text, Func &func) {
+        size_t offset = 0;
+        int index = 0;
+        size_t run_offset = 0;
+        int run_index = 0;
+        while (offset < text.size()) {
+            size_t pos = offset;
+            StaticSymbol s = symbol(decode(text, offset));
+            if (transition(DoubleArray::kRoot, s.code) >= 0) {
+                size_t end = 0;
+                int word_id = -1;
+                int wordLen = getSensitiveLength(text, pos, end, word_id);
+                if (wordLen > 0) {
+                    int len = wordLen + (index - run_index);
+                    if (!func(MatchSpan{run_offset, end - run_offset, run_index, len, word_id})) {
+                        return;
+                    }
+                    offset = end;
+                    index = run_index + len;
+                } else {
+                    ++index;
+                }
+                run_offset = offset;
+                run_index = index;
+            } else if (s.stop) {
+                ++index;
+            } else {
+                ++index;
+                run_offset = offset;
+                run_index = index;
+            }
+        }
+    }
+};
+
+#endif //INC_01_TRIE_TREE_STATIC_MATCHER_H_
@@ -0,0 +1,200 @@
+/** @file text_codec.h
+  * @brief 扫描用的文本适配器，宽字符串和utf8字符串按同样的方式逐字符解码
+  * @author teng.qing
+  * @date 2021/7/15
+  */
+
+#ifndef INC_01_TRIE_TREE_TEXT_CODEC_H_
+#define INC_01_TRIE_TREE_TEXT_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "fold_table.h"
+#include "prefilter.h"
+
+// 非法utf8序列解码为U+FFFD
+const uint32_t kReplacementChar = 0xFFFD;
+
+/** @fn decodeUtf8
+  * @brief 解码一个utf8字符，非法序列（截断、过长编码、代理区、超出范围）返回U+FFFD并只前进1个字节。
+  * constexpr，StaticMatcher可以在编译期使用
+  * @param [in]p: 当前位置
+  * @param [in]end: 结束位置
+  * @param [out]n: 该字符占用的字节数
+  * @return unicode
+  */
+constexpr uint32_t decodeUtf8(const char *p, const char *end, size_t &n) {
+    auto b0 = static_cast<unsigned char>(p[0]);
+    if (b0 < 0x80) {
+        n = 1;
+        return b0;
+    }
+
+    uint32_t cp = 0;
+    size_t len = 0;
+    uint32_t min = 0;
+    if ((b0 & 0xE0) == 0xC0) {
+        cp = b0 & 0x1F;
+        len = 2;
+        min = 0x80;
+    } else if ((b0 & 0xF0) == 0xE0) {
+        cp = b0 & 0x0F;
+        len = 3;
+        min = 0x800;
+    } else if ((b0 & 0xF8) == 0xF0) {
+        cp = b0 & 0x07;
+        len = 4;
+        min = 0x10000;
+    } else {
+        n = 1;
+        return kReplacementChar;
+    }
+
+    if (static_cast<size_t>(end - p) < len) {
+        n = 1;
+        return kReplacementChar;
+    }
+    for (size_t i = 1; i < len; ++i) {
+        auto b = static_cast<unsigned char>(p[i]);
+        if ((b & 0xC0) != 0x80) {
+            n = 1;
+            return kReplacementChar;
+        }
+        cp = (cp << 6) | (b & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        n = 1;
+        return kReplacementChar;
+    }
+    n = len;
+    return cp;
+}
+
+/** @class WideText
+  * @brief 宽字符串，偏移单位为wchar_t
+  *
+  * 每个适配器提供：
+  * decode(offset, c)：解码offset处的字符并前进
+  * fold(c)：匹配前的字符转换，见FoldTable
+  * skip(offset, prefilter, index)：跳过预过滤认为不需要匹配的字符
+  */
+class WideText {
+public:
+    WideText(const std::wstring &text, const FoldTable &fold) : WideText(text.data(), text.size(), fold) {}
+
+    WideText(const wchar_t *data, size_t size, const FoldTable &fold) : data_(data), size_(size), fold_(&fold) {}
+
+    size_t size() const { return size_; }
+
+    /** @fn decode
+      * @brief 解码offset处的字符并前进
+      * @param [in,out]offset: 偏移
+      * @param [out]c: unicode
+      * @return 已经到结尾返回false
+      */
+    bool decode(size_t &offset, uint32_t &c) const {
+        if (offset >= size_) {
+            return false;
+        }
+        c = static_cast<uint32_t>(data_[offset++]);
+        return true;
+    }
+
+    uint32_t fold(uint32_t c) const { return fold_->fold(c); }
+
+    /** @fn skip
+      * @brief 从offset开始跳过Prefilter::candidate为false的字符
+      * @param [in]offset: 偏移
+      * @param [in]prefilter: 预过滤
+      * @param [in,out]index: 字符序号，加上跳过的字符数
+      * @return 下一个候选字符的偏移，没有返回size()
+      */
+    size_t skip(size_t offset, const Prefilter &prefilter, int &index) const {
+        size_t start = offset;
+        while (offset < size_ && !prefilter.candidate(fold(static_cast<uint32_t>(data_[offset])))) {
+            ++offset;
+        }
+        index += static_cast<int>(offset - start);
+        return offset;
+    }
+
+protected:
+    // 不需要转换的文本（NormalizedWideText）使用
+    WideText(const wchar_t *data, size_t size) : data_(data), size_(size), fold_(nullptr) {}
+
+    const wchar_t *data_;
+    size_t size_;
+    const FoldTable *fold_;
+};
+
+/** @class Utf8Text
+  * @brief utf8字符串，偏移单位为字节，边解码边匹配，不需要转换成宽字符串
+  */
+class Utf8Text {
+public:
+    Utf8Text(std::string_view text, const FoldTable &fold) : text_(text), fold_(&fold) {}
+
+    size_t size() const { return text_.size(); }
+
+    bool decode(size_t &offset, uint32_t &c) const {
+        if (offset >= text_.size()) {
+            return false;
+        }
+        size_t n;
+        c = decodeUtf8(text_.data() + offset, text_.data() + text_.size(), n);
+        offset += n;
+        return true;
+    }
+
+    uint32_t fold(uint32_t c) const { return fold_->fold(c); }
+
+    size_t skip(size_t offset, const Prefilter &prefilter, int &index) const {
+        while (offset < text_.size()) {
+            auto b = static_cast<unsigned char>(text_[offset]);
+            if (b < 0x80) {
+                // ASCII不需要解码
+                if (prefilter.candidate(fold(b))) {
+                    break;
+                }
+                ++offset;
+            } else {
+                size_t n;
+                uint32_t c = decodeUtf8(text_.data() + offset, text_.data() + text_.size(), n);
+                if (prefilter.candidate(fold(c))) {
+                    break;
+                }
+                offset += n;
+            }
+            ++index;
+        }
+        return offset;
+    }
+
+private:
+    std::string_view text_;
+    const FoldTable *fold_;
+};
+
+/** @class NormalizedWideText
+  * @brief 已经用SBCConvert::normalize批量转换过的宽字符串，匹配时不需要再转换
+  */
+class NormalizedWideText : public WideText {
+public:
+    explicit NormalizedWideText(const std::wstring &text) : WideText(text.data(), text.size()) {}
+
+    NormalizedWideText(const wchar_t *data, size_t size) : WideText(data, size) {}
+
+    static uint32_t fold(uint32_t c) { return c; }
+
+    // 不需要fold，可以一次检查多个字符
+    size_t skip(size_t offset, const Prefilter &prefilter, int &index) const {
+        size_t next = prefilter.skipNormalized(data_, offset, size_);
+        index += static_cast<int>(next - offset);
+        return next;
+    }
+};
+
+#endif //INC_01_TRIE_TREE_TEXT_CODEC_H_
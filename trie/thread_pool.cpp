@@ -0,0 +1,118 @@
+/** @file thread_pool.cpp
+  * @brief 工作窃取线程池
+  * @author teng.qing
+  * @date 2021/7/20
+  */
+
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this, i]() { run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::push(size_t index, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // 和run()里的等待条件配合，避免丢失唤醒
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_++;
+    }
+    cond_.notify_one();
+}
+
+bool ThreadPool::popTask(size_t index, Task &task) {
+    // 先从自己的队列头部取
+    {
+        Worker &self = *workers_[index];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if (!self.tasks.empty()) {
+            task = std::move(self.tasks.front());
+            self.tasks.pop_front();
+            pending_--;
+            return true;
+        }
+    }
+    // 再从其他线程的队列尾部窃取
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker &other = *workers_[(index + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.back());
+            other.tasks.pop_back();
+            pending_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(size_t index) {
+    Task task;
+    for (;;) {
+        if (popTask(index, task)) {
+            task(index);
+            task = nullptr;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+        if (stop_ && pending_ == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t, size_t)> &func) {
+    if (count == 0) {
+        return;
+    }
+    // 每个线程分到几段，段数多一些方便窃取，负载更均衡
+    size_t chunks = std::max<size_t>(1, std::min(count / std::max<size_t>(grain, 1), workers_.size() * 4));
+    size_t step = (count + chunks - 1) / chunks;
+
+    struct Batch {
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t remaining;
+    };
+    auto batch = std::make_shared<Batch>();
+    batch->remaining = (count + step - 1) / step;
+
+    for (size_t begin = 0; begin < count; begin += step) {
+        size_t end = std::min(count, begin + step);
+        push(next_++ % workers_.size(), [batch, begin, end, &func](size_t worker) {
+            func(begin, end, worker);
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            if (--batch->remaining == 0) {
+                batch->cond.notify_all();
+            }
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->cond.wait(lock, [&batch]() { return batch->remaining == 0; });
+}
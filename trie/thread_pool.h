@@ -0,0 +1,84 @@
+/** @file thread_pool.h
+  * @brief 工作窃取（work-stealing）线程池，用于批量过滤
+  * @author teng.qing
+  * @date 2021/7/20
+  */
+
+#ifndef INC_01_TRIE_TREE_THREAD_POOL_H_
+#define INC_01_TRIE_TREE_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** @class ThreadPool
+  * @brief 每个工作线程有自己的任务队列，自己的队列空了从其他线程的队列尾部窃取任务。
+  *
+  * 任务回调会带上工作线程的编号（0 ~ size()-1），调用者可以按编号准备每个线程独享的临时缓冲区。
+  */
+class ThreadPool {
+public:
+    // 任务，参数为执行该任务的工作线程编号
+    using Task = std::function<void(size_t worker)>;
+
+    /** @fn ThreadPool
+      * @brief 创建线程池
+      * @param [in]threads: 线程数，为0时使用std::thread::hardware_concurrency()
+      */
+    explicit ThreadPool(size_t threads = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &that) = delete;
+
+    ThreadPool &operator=(const ThreadPool &that) = delete;
+
+    // 工作线程数
+    size_t size() const { return workers_.size(); }
+
+    /** @fn parallelFor
+      * @brief 把[0, count)分成若干段并行执行，所有段执行完才返回，可以被多个线程同时调用
+      * @param [in]count: 总数
+      * @param [in]grain: 每段的最小长度
+      * @param [in]func: func(begin, end, worker)
+      * @return void
+      */
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t, size_t)> &func);
+
+    /** @fn post
+      * @brief 异步执行一个任务，不等待完成，轮流放入各个线程的队列。析构时会等所有已提交的任务执行完
+      * @param [in]task: 任务
+      * @return void
+      */
+    void post(Task task) { push(next_++ % workers_.size(), std::move(task)); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void run(size_t index);
+
+    bool popTask(size_t index, Task &task);
+
+    void push(size_t index, Task task);
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_; // 保护cond_等待
+    std::condition_variable cond_;
+    std::atomic<size_t> pending_{0}; // 队列中未执行的任务数
+    std::atomic<size_t> next_{0};    // 轮流分配到各个队列
+    bool stop_ = false;
+};
+
+#endif //INC_01_TRIE_TREE_THREAD_POOL_H_
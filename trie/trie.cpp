@@ -12,10 +12,14 @@
   */
 
 #include "trie.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 
-const wchar_t kEndFlag = L'ﾰ'; // unicode: FFB0
+// 结束标识，超出unicode的范围，不会和敏感词中的任何字符冲突
+const uint32_t kEndCode = 0x110000;
 
 TrieNode::TrieNode() = default;
 
@@ -34,10 +38,20 @@ Trie::~Trie() {
     root_ = nullptr;
 }
 
-void Trie::insert(const std::wstring &word) {
+void Trie::insert(const std::wstring &word, const WordTag &tag) {
+    // 二进制词库里没有树，先从双数组还原
+    if (dict_ != nullptr) {
+        restoreTree();
+    }
+    // 批量构建的词库先还原为树
+    if (arena_ != nullptr) {
+        arena_->toTree(root_, kEndCode);
+        arena_ = nullptr;
+    }
+
     TrieNode *curNode = root_;
     for (wchar_t code : word) {
-        int unicode = SBCConvert::charConvert(code);
+        uint32_t unicode = fold_->fold(static_cast<uint32_t>(code));
         TrieNode *subNode = curNode->getSubNode(unicode);
 
         // 如果没有这个节点则新建
@@ -48,12 +62,111 @@ void Trie::insert(const std::wstring &word) {
         // 指向子节点，进入下一循环
         curNode = subNode;
     }
-    // 设置结束标识
-    int unicode = SBCConvert::charConvert(kEndFlag);
-    curNode->addSubNode(unicode, new TrieNode());
+    // 设置结束标识，重复insert的敏感词保留第一次的编号
+    if (curNode->getSubNode(kEndCode) == nullptr) {
+        curNode->addSubNode(kEndCode, new TrieNode());
+        curNode->setWordId(word_count_++);
+        tags_.push_back(tag);
+    }
+    // 树已经变化，需要重新build
+    frozen_ = nullptr;
+}
+
+void Trie::build() {
+    if (dict_ != nullptr) {
+        frozen_ = std::make_shared<FrozenTrie>(dict_, stop_words_, match_mode_, fold_);
+        return;
+    }
+    if (arena_ != nullptr) {
+        frozen_ = std::make_shared<FrozenTrie>(*arena_, stop_words_, match_mode_, fold_, tags_, layout_.get());
+        return;
+    }
+    TrieArena arena;
+    arena.assign(root_, kEndCode);
+    frozen_ = std::make_shared<FrozenTrie>(arena, stop_words_, match_mode_, fold_, tags_, layout_.get());
+}
+
+void Trie::setLayoutProfile(std::shared_ptr<const LayoutProfile> profile) {
+    layout_ = std::move(profile);
+    if (frozen_ != nullptr && dict_ == nullptr) {
+        build();
+    }
+}
+
+// 至少这么多个敏感词时才在线程池中并行构建
+const size_t kBulkParallelWords = 4096;
+
+void Trie::bulkLoad(const TrieArena::WordList &words) {
+    std::unique_ptr<TrieArena> arena(new TrieArena());
+    arena->build(words, words.size() >= kBulkParallelWords ? batchPool().get() : nullptr, &tags_);
+    dict_ = nullptr;
+    word_count_ = static_cast<int>(arena->wordCount());
+    arena_ = std::move(arena);
+    frozen_ = nullptr;
+}
+
+void Trie::restoreTree() {
+    const DoubleArray &dat = freeze()->dat();
+    const DoubleArray::Unit *units = dat.units();
+
+    // 字符编号 -> 字符（fold之后）
+    const Alphabet &alphabet = dat.alphabet();
+    std::vector<uint32_t> symbols(alphabet.size(), 0);
+    for (uint32_t c = 0; c < Alphabet::kBmpSize; ++c) {
+        if (alphabet.bmp()[c] != Alphabet::kOther) {
+            symbols[alphabet.bmp()[c]] = c;
+        }
+    }
+    for (size_t i = 0; i < alphabet.astralCount(); ++i) {
+        symbols[alphabet.astral()[i].id] = alphabet.astral()[i].code;
+    }
+
+    // 从每个结尾状态沿check回到根节点，还原出敏感词，编号和tags_保持不变
+    std::vector<uint32_t> chars;
+    for (size_t t = DoubleArray::kRoot + 1; t < dat.size(); ++t) {
+        if (units[t].check < 0 || !dat.isTerminal(static_cast<int>(t))) {
+            continue;
+        }
+        chars.clear();
+        for (auto state = static_cast<int>(t); state != DoubleArray::kRoot; state = units[state].check) {
+            int parent = units[state].check;
+            chars.push_back(symbols[state - (units[parent].base >> 1)]);
+        }
+        TrieNode *curNode = root_;
+        for (auto it = chars.rbegin(); it != chars.rend(); ++it) {
+            TrieNode *subNode = curNode->getSubNode(*it);
+            if (subNode == nullptr) {
+                subNode = new TrieNode();
+                curNode->addSubNode(*it, subNode);
+            }
+            curNode = subNode;
+        }
+        curNode->addSubNode(kEndCode, new TrieNode());
+        curNode->setWordId(dat.wordId(static_cast<int>(t)));
+    }
+    dict_ = nullptr;
+    frozen_ = nullptr;
+}
+
+std::shared_ptr<const FrozenTrie> Trie::freeze() {
+    if (frozen_ == nullptr) {
+        build();
+    }
+    return frozen_;
+}
+
+void Trie::setMatchMode(MatchMode mode) {
+    match_mode_ = mode;
+    if (frozen_ != nullptr && frozen_->matchMode() != mode) {
+        build();
+    }
 }
 
 bool Trie::search(const std::wstring &word) {
+    if (frozen_ != nullptr) {
+        return cache_ != nullptr ? cache_->search(*frozen_, word) : frozen_->search(word);
+    }
+
     bool is_contain = false;
     for (int p2 = 0; p2 < word.length(); ++p2) {
         int wordLen = getSensitiveLength(word, p2);
@@ -66,9 +179,13 @@ bool Trie::search(const std::wstring &word) {
 }
 
 bool Trie::startsWith(const std::wstring &prefix) {
+    if (frozen_ != nullptr) {
+        return frozen_->startsWith(prefix);
+    }
+
     TrieNode *curNode = root_;
     for (wchar_t item : prefix) {
-        int unicode = SBCConvert::charConvert(item);
+        uint32_t unicode = fold_->fold(static_cast<uint32_t>(item));
         curNode = curNode->getSubNode(unicode);
         if (curNode == nullptr)
             return false;
@@ -77,6 +194,10 @@ bool Trie::startsWith(const std::wstring &prefix) {
 }
 
 std::set<SensitiveWord> Trie::getSensitive(const std::wstring &word) {
+    if (frozen_ != nullptr) {
+        return cache_ != nullptr ? cache_->getSensitive(*frozen_, word) : frozen_->getSensitive(word);
+    }
+
     std::set<SensitiveWord> sensitiveSet;
 
     for (int p2 = 0; p2 < word.length(); ++p2) {
@@ -96,13 +217,13 @@ std::set<SensitiveWord> Trie::getSensitive(const std::wstring &word) {
     return sensitiveSet;
 }
 
-int Trie::getSensitiveLength(std::wstring word, int startIndex) {
+int Trie::getSensitiveLength(const std::wstring &word, int startIndex) {
     TrieNode *p1 = root_;
     int wordLen = 0;
     bool endFlag = false;
 
     for (int p3 = startIndex; p3 < word.length(); ++p3) {
-        int unicode = SBCConvert::charConvert(word[p3]);
+        uint32_t unicode = fold_->fold(static_cast<uint32_t>(word[p3]));
         auto subNode = p1->getSubNode(unicode);
         if (subNode == nullptr) {
             // 如果是停顿词，直接往下继续查找
@@ -115,7 +236,7 @@ int Trie::getSensitiveLength(std::wstring word, int startIndex) {
         } else {
             ++wordLen;
             // 直到找到尾巴的位置，才认为完整包含敏感词
-            if (subNode->getSubNode(SBCConvert::charConvert(kEndFlag))) {
+            if (subNode->getSubNode(kEndCode)) {
                 endFlag = true;
                 break;
             } else {
@@ -131,6 +252,68 @@ int Trie::getSensitiveLength(std::wstring word, int startIndex) {
     return wordLen;
 }
 
+bool Trie::search(std::string_view text) {
+    std::shared_ptr<const FrozenTrie> frozen = freeze();
+    return cache_ != nullptr ? cache_->search(*frozen, text) : frozen->search(text);
+}
+
+std::set<Utf8SensitiveWord> Trie::getSensitive(std::string_view text) {
+    std::shared_ptr<const FrozenTrie> frozen = freeze();
+    return cache_ != nullptr ? cache_->getSensitive(*frozen, text) : frozen->getSensitive(text);
+}
+
+std::string Trie::replaceSensitive(std::string_view text) {
+    std::shared_ptr<const FrozenTrie> frozen = freeze();
+    return cache_ != nullptr ? cache_->replaceSensitive(*frozen, text) : frozen->replaceSensitive(text);
+}
+
+void Trie::setBatchThreads(size_t threads) {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    if (threads != batch_threads_) {
+        batch_threads_ = threads;
+        pool_ = nullptr;
+    }
+}
+
+std::shared_ptr<ThreadPool> Trie::batchPool() {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    if (pool_ == nullptr) {
+        pool_ = std::make_shared<ThreadPool>(batch_threads_);
+    }
+    return pool_;
+}
+
+// 每段至少这么多条消息，太少时调度的开销比过滤本身还大
+const size_t kBatchGrain = 64;
+
+std::vector<std::wstring> Trie::replaceSensitiveBatch(const std::wstring *messages, size_t count) {
+    std::shared_ptr<const FrozenTrie> frozen = freeze();
+    std::shared_ptr<ThreadPool> pool = batchPool();
+
+    std::vector<std::wstring> result(count);
+    // 每个工作线程一个临时缓冲区，只被该线程使用
+    std::vector<std::wstring> scratch(pool->size());
+    pool->parallelFor(count, kBatchGrain, [&](size_t begin, size_t end, size_t worker) {
+        for (size_t i = begin; i < end; ++i) {
+            result[i] = frozen->replaceSensitive(messages[i], scratch[worker]);
+        }
+    });
+    return result;
+}
+
+std::vector<std::string> Trie::replaceSensitiveBatch(const std::string_view *messages, size_t count) {
+    std::shared_ptr<const FrozenTrie> frozen = freeze();
+    std::shared_ptr<ThreadPool> pool = batchPool();
+
+    std::vector<std::string> result(count);
+    pool->parallelFor(count, kBatchGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            result[i] = frozen->replaceSensitive(messages[i]);
+        }
+    });
+    return result;
+}
+
 #if 0
 /** @fn
   * @brief linux下一个中文占用三个字节,windows占两个字节
@@ -176,6 +359,10 @@ std::string chinese_or_english_append(const std::string &str) {
 #endif
 
 std::wstring Trie::replaceSensitive(const std::wstring &word) {
+    if (frozen_ != nullptr) {
+        return cache_ != nullptr ? cache_->replaceSensitive(*frozen_, word) : frozen_->replaceSensitive(word);
+    }
+
     std::set<SensitiveWord> words = getSensitive(word);
     std::wstring ret = word;
     for (auto &item : words) {
@@ -186,46 +373,213 @@ std::wstring Trie::replaceSensitive(const std::wstring &word) {
     return ret;
 }
 
-void Trie::loadFromFile(const std::string &file_name) {
+namespace {
+
+// 解析 "敏感词<TAB>分类<TAB>权重"，后两列可以省略，数字格式错误时返回false，tag为默认值
+bool parseWordLine(const std::string &line, std::string &word, WordTag &tag) {
+    tag = WordTag();
+    size_t tab = line.find('\t');
+    word = line.substr(0, tab);
+    if (tab == std::string::npos) {
+        return true;
+    }
+
+    // 整个字段都是数字才算成功
+    auto parse = [](const std::string &field, int base, uint32_t &value) {
+        const char *begin = field.c_str();
+        char *end = nullptr;
+        errno = 0;
+        unsigned long long n = strtoull(begin, &end, base);
+        if (field.empty() || field[0] == '-' || *end != '\0' || errno != 0 || n > UINT32_MAX) {
+            return false;
+        }
+        value = static_cast<uint32_t>(n);
+        return true;
+    };
+    size_t tab2 = line.find('\t', tab + 1);
+    std::string categories = line.substr(tab + 1, tab2 == std::string::npos ? std::string::npos : tab2 - tab - 1);
+    WordTag parsed;
+    if (!parse(categories, 0, parsed.categories) || parsed.categories == 0) {
+        return false;
+    }
+    if (tab2 != std::string::npos && !parse(line.substr(tab2 + 1), 10, parsed.severity)) {
+        return false;
+    }
+    tag = parsed;
+    return true;
+}
+
+} // namespace
+
+bool Trie::loadFromFile(const std::string &file_name, std::string *error) {
     std::ifstream ifs(file_name, std::ios_base::in);
+    if (!ifs.is_open()) {
+        if (error != nullptr) {
+            *error = "open " + file_name + " failed";
+        }
+        return false;
+    }
     std::string str;
+    std::string word;
+    WordTag tag;
     int count = 0;
+    bool bulk = canBulkLoad();
+    TrieArena::WordList words;
     while (getline(ifs, str)) {
-        std::wstring utf8_str = SBCConvert::s2ws(str);
-        insert(utf8_str);
+        // 标签格式错误时仍然加载敏感词，使用默认的分类和权重
+        if (!parseWordLine(str, word, tag)) {
+            std::cout << file_name << ":" << count + 1 << ": bad category or severity, use default" << std::endl;
+        }
+        std::wstring utf8_str = SBCConvert::s2ws(word);
+        if (bulk) {
+            words.add(utf8_str, *fold_, tag);
+        } else {
+            insert(utf8_str, tag);
+        }
         count++;
     }
+    if (bulk) {
+        bulkLoad(words);
+    }
+    build();
     std::cout << "load " << count << " words" << std::endl;
+    return true;
 }
 
-void Trie::loadStopWordFromFile(const std::string &file_name) {
+bool Trie::loadStopWordFromFile(const std::string &file_name, std::string *error) {
     std::ifstream ifs(file_name, std::ios_base::in);
+    if (!ifs.is_open()) {
+        if (error != nullptr) {
+            *error = "open " + file_name + " failed";
+        }
+        return false;
+    }
     std::string str;
     int count = 0;
     while (getline(ifs, str)) {
         std::wstring utf8_str = SBCConvert::s2ws(str);
         if (utf8_str.length() == 1) {
-            stop_words_.insert(utf8_str[0]);
+            stop_words_.insert(fold_->fold(static_cast<uint32_t>(utf8_str[0])));
             count++;
         } else if (utf8_str.empty()) {
             stop_words_.insert(L' ');
             count++;
         }
     }
+    // 停顿词编译在匹配器里，需要重新生成
+    if (frozen_ != nullptr) {
+        build();
+    }
     std::cout << "load " << count << " stop words" << std::endl;
+    return true;
 }
 
 void Trie::loadStopWordFromMemory(std::unordered_set<wchar_t> &words) {
     for (auto &str : words) {
-        int unicode = SBCConvert::charConvert(str);
+        uint32_t unicode = fold_->fold(static_cast<uint32_t>(str));
         stop_words_.emplace(unicode);
     }
+    if (frozen_ != nullptr) {
+        build();
+    }
 }
 
 void Trie::loadFromMemory(std::unordered_set<std::wstring> &words) {
+    loadFromMemory(std::vector<std::wstring>(words.begin(), words.end()));
+}
+
+void Trie::loadFromMemory(const std::vector<std::wstring> &words) {
+    if (!canBulkLoad()) {
+        for (auto &item : words) {
+            insert(item);
+        }
+        build();
+        return;
+    }
+    TrieArena::WordList list;
     for (auto &item : words) {
-        insert(item);
+        list.add(item, *fold_);
     }
+    bulkLoad(list);
+    build();
+}
+
+void Trie::loadFromMemory(const std::vector<std::pair<std::wstring, WordTag>> &words) {
+    if (!canBulkLoad()) {
+        for (auto &item : words) {
+            insert(item.first, item.second);
+        }
+        build();
+        return;
+    }
+    TrieArena::WordList list;
+    for (auto &item : words) {
+        list.add(item.first, *fold_, item.second);
+    }
+    bulkLoad(list);
+    build();
+}
+
+bool Trie::loadFoldMappingFiles(const std::vector<std::string> &files, std::string *error) {
+    auto fold = std::make_shared<FoldTable>();
+    for (const std::string &file : files) {
+        if (!fold->addMappingFile(file, error)) {
+            return false;
+        }
+    }
+    if (!setFoldTable(fold)) {
+        if (error != nullptr) {
+            *error = "fold mappings must be loaded before words and stop words";
+        }
+        return false;
+    }
+    return true;
+}
+
+bool Trie::setFoldTable(std::shared_ptr<const FoldTable> fold) {
+    // 已经加载的敏感词和停顿词是按原来的规则转换的，无法再还原
+    if (word_count_ > 0 || !stop_words_.empty() || dict_ != nullptr) {
+        return false;
+    }
+    fold_ = std::move(fold);
+    frozen_ = nullptr;
+    return true;
+}
+
+bool Trie::loadFromBinaryFile(const std::string &file_name, bool verify) {
+    std::string error;
+    std::shared_ptr<const DictFile> dict = DictFile::open(file_name, verify, &error, fold_.get());
+    if (dict == nullptr) {
+        std::cout << "load " << error << std::endl;
+        return false;
+    }
+
+    delete root_;
+    root_ = new TrieNode();
+    arena_ = nullptr;
+    word_count_ = static_cast<int>(dict->header().wordCount);
+    tags_.assign(dict->wordTags(), dict->wordTags() + word_count_);
+    const uint64_t *bits = dict->stopWords();
+    for (size_t i = 0; i < DictFile::kStopWordsWords; ++i) {
+        for (uint64_t w = bits[i]; w != 0; w &= w - 1) {
+            stop_words_.insert(static_cast<uint32_t>(i * 64 + __builtin_ctzll(w)));
+        }
+    }
+    const uint32_t *astral_stops = dict->astralStopWords();
+    stop_words_.insert(astral_stops, astral_stops + dict->header().astralStopCount);
+    dict_ = dict;
+    build();
+    std::cout << "load " << word_count_ << " words from " << file_name << std::endl;
+    return true;
+}
+
+bool Trie::saveToBinaryFile(const std::string &file_name) {
+    std::string error;
+    if (!DictFile::save(*freeze(), static_cast<uint32_t>(word_count_), file_name, &error)) {
+        std::cout << error << std::endl;
+        return false;
+    }
+    return true;
 }
 
 #ifdef UNIT_TEST
@@ -261,7 +615,7 @@ void func(Trie &t) {
 
         // PS：对于中文敏感词，因为一般汉字占3个字节（也有4个字节），所以这里“*”是正常的3倍。
         // 项目里需要是判断是包含，而不是替换。
-        // 所以，如果有这种需求，建议改成wstring和wchat_t来实现
+        // 所以，如果有这种需求，建议改成wstring和wchat_t来实现，或者用maskSensitive直接在utf8上按字符替换
         for (int j = i.startIndex; j < (i.startIndex + i.len); ++j) {
             dest[j] = '*';
         }
@@ -4,12 +4,29 @@
   * @date 2021/6/10
   */
 
+#ifndef INC_01_TRIE_TREE_TRIE_H_
+#define INC_01_TRIE_TREE_TRIE_H_
+
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
+#include "fold_table.h"
+#include "frozen_trie.h"
+#include "fuzzy_matcher.h"
+#include "layered_matcher.h"
+#include "layout_profile.h"
+#include "match_stream.h"
+#include "pinyin_index.h"
+#include "result_cache.h"
 #include "sbc_convert.h"
+#include "thread_pool.h"
+#include "trie_arena.h"
 
 /** @class trie
   * @brief trie树算法实现的敏感词过滤
@@ -21,24 +38,25 @@ public:
     ~TrieNode();
 
     // 添加子节点
-    void addSubNode(uint16_t c, TrieNode *subNode) { subNodes_[c] = subNode; }
+    void addSubNode(uint32_t c, TrieNode *subNode) { subNodes_[c] = subNode; }
 
-    // 获取子节点
-    TrieNode *getSubNode(uint16_t c) { return subNodes_[c]; }
+    // 获取子节点，不存在返回nullptr（不会插入空节点）
+    TrieNode *getSubNode(uint32_t c) const {
+        auto it = subNodes_.find(c);
+        return it == subNodes_.end() ? nullptr : it->second;
+    }
 
-private:
-    std::unordered_map<uint16_t /*unicode*/, TrieNode *> subNodes_;
-};
+    // 以该节点结尾的敏感词编号，不是结尾返回-1
+    int wordId() const { return word_id_; }
 
-struct SensitiveWord {
-    std::wstring word;
-    int startIndex;
-    int len;
+    void setWordId(int id) { word_id_ = id; }
 
-    friend bool operator<(struct SensitiveWord const &a,
-                          struct SensitiveWord const &b) {
-        return a.startIndex < b.startIndex;
-    }
+    // 所有子节点，用于编译双数组
+    const std::unordered_map<uint32_t, TrieNode *> &subNodes() const { return subNodes_; }
+
+private:
+    std::unordered_map<uint32_t /*unicode*/, TrieNode *> subNodes_;
+    int word_id_ = -1;
 };
 
 /** @class Trie
@@ -63,25 +81,43 @@ public:
     Trie &operator=(const Trie &that) = delete;
 
     /** @fn loadFromFile
-      * @brief 从文件加载敏感词列表，文件utf8格式，一个敏感词单独一行
+      * @brief 从文件加载敏感词列表，文件utf8格式，一个敏感词单独一行，
+      * 可以用TAB分隔跟上分类和权重："敏感词<TAB>分类<TAB>权重"，见WordTag。
+      * 还没有敏感词时批量构建（见TrieArena），词多时在批量接口的线程池中并行，否则逐个insert追加
       * @param [in]file_name: file full path
-      * @return void
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 文件无法打开时返回false，敏感词不变
       */
-    void loadFromFile(const std::string &file_name);
+    bool loadFromFile(const std::string &file_name, std::string *error = nullptr);
 
     /** @fn loadFromMemory
-      * @brief 从内存加载敏感词列表
+      * @brief 从内存加载敏感词列表，同loadFromFile
       * @param [in]words: 列表，utf8
       * @return void
       */
     void loadFromMemory(std::unordered_set<std::wstring> &words);
 
+    /** @fn loadFromMemory
+      * @brief 同上，敏感词按数组中的顺序编号，可以有重复
+      * @param [in]words: 列表
+      * @return void
+      */
+    void loadFromMemory(const std::vector<std::wstring> &words);
+
+    /** @fn loadFromMemory
+      * @brief 同上，每个敏感词带有分类和严重程度，重复的敏感词保留第一次的
+      * @param [in]words: 列表
+      * @return void
+      */
+    void loadFromMemory(const std::vector<std::pair<std::wstring, WordTag>> &words);
+
     /** @fn loadStopWord
       * @brief 加载停顿词从指定的文件
       * @param [in]file_name:  file full path
-      * @return void
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 文件无法打开时返回false，停顿词不变
       */
-    void loadStopWordFromFile(const std::string &file_name);
+    bool loadStopWordFromFile(const std::string &file_name, std::string *error = nullptr);
 
     /** @fn loadStopWordFromMemory
       * @brief 从内存加载停顿词
@@ -90,12 +126,142 @@ public:
       */
     void loadStopWordFromMemory(std::unordered_set<wchar_t> &words);
 
+    /** @fn loadFoldMappingFiles
+      * @brief 在默认的字符转换规则（全角转半角、大写转小写）之后按顺序叠加映射文件，如繁转简、形近字母、带圈数字，
+      * 合成一张转换表，insert和匹配都使用这张表。必须在加载敏感词和停顿词之前调用
+      * @param [in]files: 映射文件，格式见FoldTable
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 文件无法读取、格式错误或者已经加载了敏感词时返回false，转换规则不变
+      */
+    bool loadFoldMappingFiles(const std::vector<std::string> &files, std::string *error = nullptr);
+
+    /** @fn setFoldTable
+      * @brief 使用已经构建好的转换表，多个Trie可以共享。必须在加载敏感词和停顿词之前调用
+      * @param [in]fold: 转换表
+      * @return 已经加载了敏感词或停顿词时返回false
+      */
+    bool setFoldTable(std::shared_ptr<const FoldTable> fold);
+
+    const std::shared_ptr<const FoldTable> &foldTable() const { return fold_; }
+
+    /** @fn loadFromBinaryFile
+      * @brief 从dirtyfilter-compile（或saveToBinaryFile）生成的二进制词库加载，文件只读mmap，
+      * 不需要解析和构建，多个进程加载同一个文件时共享物理内存。会替换当前的敏感词，
+      * 文件中的停顿词加入当前的停顿词。之后再insert时先从双数组还原出树，保留原有的敏感词、编号和标签
+      * @param [in]file_name: file full path
+      * @param [in]verify: 是否计算校验和
+      * @return 文件不存在、格式或版本不对、校验失败时返回false，原有内容不变
+      */
+    bool loadFromBinaryFile(const std::string &file_name, bool verify = true);
+
+    /** @fn saveToBinaryFile
+      * @brief 把当前的敏感词和停顿词编译为二进制词库，未build时会先build
+      * @param [in]file_name: file full path
+      * @return 是否成功
+      */
+    bool saveToBinaryFile(const std::string &file_name);
+
     /** @fn insert
       * @brief Inserts a word into the trie
       * @param [in]word: utf8 word
+      * @param [in]tag: 分类和严重程度，已经存在的敏感词不会改变
+      * @return void
+      */
+    void insert(const std::wstring &word, const WordTag &tag = WordTag());
+
+    /** @fn build
+      * @brief 把insert构建的树编译为双数组，之后的getSensitive/replaceSensitive/search都走双数组。
+      * loadFromFile和loadFromMemory加载完成后会自动调用，单独insert后需要手动调用，
+      * 否则仍然使用树来匹配。
+      * @return void
+      */
+    void build();
+
+    /** @fn freeze
+      * @brief 生成只读的匹配器，之后再insert或加载停顿词不会影响已经生成的匹配器。
+      * 返回的对象所有接口都是const，可以被多个线程同时使用。
+      * @return 只读匹配器
+      */
+    std::shared_ptr<const FrozenTrie> freeze();
+
+    /** @fn openStream
+      * @brief 创建流式匹配器，文本可以分块输入，使用当前的只读匹配器（freeze()），之后修改词库不影响已经创建的流
+      * @return 流式匹配器
+      */
+    std::unique_ptr<MatchStream> openStream() { return std::unique_ptr<MatchStream>(new MatchStream(freeze())); }
+
+    /** @fn openFuzzy
+      * @brief 创建模糊匹配器，命中编辑距离不超过max_distance的变体，使用当前的只读匹配器（freeze()），见FuzzyMatcher
+      * @param [in]max_distance: 最大编辑距离，1或2
+      * @param [in]min_word_length: 至少这么多个字符的敏感词才允许编辑
+      * @return 模糊匹配器
+      */
+    std::unique_ptr<FuzzyMatcher> openFuzzy(int max_distance, int min_word_length = 2) {
+        return std::unique_ptr<FuzzyMatcher>(new FuzzyMatcher(freeze(), max_distance, min_word_length));
+    }
+
+    /** @fn openPinyin
+      * @brief 为当前的只读匹配器（freeze()）建立拼音索引，匹配拼音、汉字拼音混写和同音字，见PinyinIndex
+      * @param [in]table: 字表，如pinyin.txt
+      * @param [in]min_syllables: 至少这么多个字的敏感词才加入索引
+      * @return 拼音索引
+      */
+    std::unique_ptr<PinyinIndex> openPinyin(std::shared_ptr<const PinyinTable> table, int min_syllables = 2) {
+        return std::unique_ptr<PinyinIndex>(new PinyinIndex(freeze(), std::move(table), min_syllables));
+    }
+
+    /** @fn openLayered
+      * @brief 以当前的只读匹配器（freeze()）为基础词库，创建租户的叠加层，见LayeredMatcher
+      * @param [in]additions: 租户增加的敏感词
+      * @param [in]suppressions: 租户屏蔽的基础词库中的敏感词
+      * @param [in]tags: 增加的敏感词的分类和严重程度，和additions一一对应
+      * @return 叠加匹配器
+      */
+    std::unique_ptr<LayeredMatcher> openLayered(const std::vector<std::wstring> &additions,
+                                                const std::vector<std::wstring> &suppressions = {},
+                                                const std::vector<WordTag> &tags = {}) {
+        return std::unique_ptr<LayeredMatcher>(new LayeredMatcher(freeze(), additions, suppressions, tags));
+    }
+
+    /** @fn openProfile
+      * @brief 为当前的只读匹配器（freeze()）创建状态访问统计，用样本流量record之后交给setLayoutProfile，见LayoutProfile
+      * @return 状态访问统计
+      */
+    std::shared_ptr<LayoutProfile> openProfile() { return std::make_shared<LayoutProfile>(freeze()); }
+
+    /** @fn setLayoutProfile
+      * @brief 之后build时按访问次数布局双数组，热路径上的状态集中在一起，匹配结果不变。
+      * 统计和词库按字符路径对应，之后再insert也可以继续使用；loadFromBinaryFile加载的词库已经布局好，不受影响
+      * @param [in]profile: 状态访问统计，nullptr时恢复广度优先布局
+      * @return void
+      */
+    void setLayoutProfile(std::shared_ptr<const LayoutProfile> profile);
+
+    /** @fn metrics
+      * @brief 当前匹配器的运行时统计，需要编译时打开DIRTYFILTER_METRICS，见Metrics。词库或停顿词变化后从0开始
+      * @return 统计结果，可以用toPrometheus()输出
+      */
+    MetricsSnapshot metrics() { return freeze()->metrics(); }
+
+    /** @fn setResultCache
+      * @brief 设置结果缓存，之后build过的search/getSensitive/replaceSensitive先查缓存，见ResultCache。
+      * 缓存按匹配器版本区分结果，词库变化后不需要清空；多个Trie可以共用一个缓存
+      * @param [in]cache: 缓存，nullptr时不使用缓存
       * @return void
       */
-    void insert(const std::wstring &word);
+    void setResultCache(std::shared_ptr<ResultCache> cache) { cache_ = std::move(cache); }
+
+    const std::shared_ptr<ResultCache> &resultCache() const { return cache_; }
+
+    /** @fn setMatchMode
+      * @brief 设置匹配算法，两种算法结果一致。AC自动机需要build之后才生效，否则仍然使用kTrie；
+      *        停顿词同时出现在敏感词里时也按kTrie匹配，见FrozenTrie::stopWordsInWords
+      * @param [in]mode: 匹配算法
+      * @return void
+      */
+    void setMatchMode(MatchMode mode);
+
+    MatchMode matchMode() const { return match_mode_; }
 
     /** @fn search
       * @brief Returns if the word is in the trie
@@ -125,15 +291,144 @@ public:
       */
     std::wstring replaceSensitive(const std::wstring &word);
 
+    /** @fn search
+      * @brief utf8版本，直接在utf8上边解码边匹配，不需要s2ws/ws2s。未build时会先build
+      * @param [in]text: utf8字符串
+      * @return bool result
+      */
+    bool search(std::string_view text);
+
+    /** @fn getSensitive
+      * @brief utf8版本，结果同时包含字节偏移和字符偏移。未build时会先build
+      * @param [in]text: utf8字符串
+      * @return 命中敏感词信息
+      */
+    std::set<Utf8SensitiveWord> getSensitive(std::string_view text);
+
+    /** @fn replaceSensitive
+      * @brief utf8版本，每个字符替换为一个*（中文不会变成3个*）。未build时会先build
+      * @param [in]text: utf8字符串
+      * @return 替换后的utf8文本
+      */
+    std::string replaceSensitive(std::string_view text);
+
+    /** @fn maskSensitive
+      * @brief 直接在调用者的utf8缓冲区上替换敏感词，不申请内存，见FrozenTrie::maskSensitive。未build时会先build
+      * @param [in,out]data: utf8文本
+      * @param [in]size: 字节数
+      * @param [in]mode: 每个字符替换为一个mask（文本变短），或者每个字节替换为一个mask（长度不变）
+      * @param [in]mask: 替换成的字符，必须是ASCII
+      * @return 替换后的字节数
+      */
+    size_t maskSensitive(char *data, size_t size, MaskMode mode = MaskMode::kPerCodepoint, char mask = '*') {
+        return freeze()->maskSensitive(data, size, mode, mask);
+    }
+
+    void maskSensitive(std::string &text, MaskMode mode = MaskMode::kPerCodepoint, char mask = '*') {
+        freeze()->maskSensitive(text, mode, mask);
+    }
+
+    /** @fn replaceSensitiveBatch
+      * @brief 批量替换，消息分段后在内部的工作窃取线程池中并行处理，结果和输入顺序一致。未build时会先build
+      * @param [in]messages: 消息数组
+      * @param [in]count: 消息数
+      * @return 替换后的文本，和messages一一对应
+      */
+    std::vector<std::wstring> replaceSensitiveBatch(const std::wstring *messages, size_t count);
+
+    std::vector<std::wstring> replaceSensitiveBatch(const std::vector<std::wstring> &messages) {
+        return replaceSensitiveBatch(messages.data(), messages.size());
+    }
+
+    /** @fn replaceSensitiveBatch
+      * @brief utf8版本
+      * @param [in]messages: 消息数组
+      * @param [in]count: 消息数
+      * @return 替换后的utf8文本，和messages一一对应
+      */
+    std::vector<std::string> replaceSensitiveBatch(const std::string_view *messages, size_t count);
+
+    std::vector<std::string> replaceSensitiveBatch(const std::vector<std::string_view> &messages) {
+        return replaceSensitiveBatch(messages.data(), messages.size());
+    }
+
+    /** @fn setBatchThreads
+      * @brief 设置批量接口使用的线程数，默认为CPU核数，第一次调用批量接口时创建线程
+      * @param [in]threads: 线程数，0为CPU核数
+      * @return void
+      */
+    void setBatchThreads(size_t threads);
+
+    /** @fn score
+      * @brief 累加指定分类的命中的权重，达到阈值后立即停止扫描，见FrozenTrie::score。未build时会先build
+      * @param [in]word: 原始字符串
+      * @param [in]categories: 只统计这些分类（位掩码），kAllCategories为所有分类
+      * @param [in]threshold: 阈值，为0时扫描完整个文本
+      * @return 得分
+      */
+    SensitiveScore score(const std::wstring &word, uint32_t categories, uint64_t threshold) {
+        return freeze()->score(word, categories, threshold);
+    }
+
+    SensitiveScore score(std::string_view text, uint32_t categories, uint64_t threshold) {
+        return freeze()->score(text, categories, threshold);
+    }
+
+    /** @fn forEachSensitive
+      * @brief 按顺序回调每个命中的敏感词（位置、长度、敏感词编号），扫描过程不申请堆内存。未build时会先build
+      * @param [in]word: 原始字符串
+      * @param [in]visitor: 命中回调，返回false时停止
+      * @return void
+      */
+    void forEachSensitive(const std::wstring &word, MatchVisitor &visitor) { freeze()->forEachSensitive(word, visitor); }
+
+    /** @fn forEachSensitive
+      * @brief utf8版本，MatchSpan的offset/length为字节
+      */
+    void forEachSensitive(std::string_view text, MatchVisitor &visitor) { freeze()->forEachSensitive(text, visitor); }
+
+    /** @fn forEachSensitive
+      * @brief 回调为函数对象 bool(const MatchSpan &)，返回false时停止
+      */
+    template<typename Text, typename Func,
+            typename = std::enable_if_t<!std::is_base_of<MatchVisitor, std::decay_t<Func>>::value>>
+    void forEachSensitive(const Text &text, Func &&func) { freeze()->forEachSensitive(text, func); }
+
 private:
-    int getSensitiveLength(std::wstring text, int startIndex);
+    int getSensitiveLength(const std::wstring &text, int startIndex);
+
+    // 是否可以批量构建：还没有任何敏感词
+    bool canBulkLoad() const { return word_count_ == 0 && arena_ == nullptr; }
+
+    // 批量构建，代替树
+    void bulkLoad(const TrieArena::WordList &words);
+
+    // 从二进制词库的双数组还原出树，之后可以继续insert
+    void restoreTree();
+
+    std::shared_ptr<ThreadPool> batchPool();
 
     TrieNode *root_;
-    std::unordered_set<uint16_t /*unicode*/ > stop_words_;
+    int word_count_ = 0; // 已经分配的敏感词编号
+    std::vector<WordTag> tags_; // 敏感词编号 -> 标签
+    MatchMode match_mode_ = MatchMode::kTrie;
+    std::shared_ptr<const FrozenTrie> frozen_; // 和树保持一致的只读匹配器，树变化后置空
+    std::shared_ptr<const DictFile> dict_;     // loadFromBinaryFile加载的词库，不为空时代替树
+    std::unique_ptr<TrieArena> arena_;         // 批量构建的词库，不为空时代替树，再insert时还原为树
+    std::shared_ptr<const FoldTable> fold_ = FoldTable::defaultTable(); // 字符转换表
+    std::shared_ptr<ResultCache> cache_;       // 结果缓存，为空时不缓存
+    std::shared_ptr<const LayoutProfile> layout_; // 双数组布局使用的访问统计，为空时广度优先
+
+    std::mutex pool_mutex_;
+    size_t batch_threads_ = 0;
+    std::shared_ptr<ThreadPool> pool_; // 批量接口使用，延迟创建
+    std::unordered_set<uint32_t /*unicode*/ > stop_words_;
 };
 
 //#define UNIT_TEST
 
 #ifdef UNIT_TEST
 int testTrie();
-#endif
\ No newline at end of file
+#endif
+
+#endif //INC_01_TRIE_TREE_TRIE_H_
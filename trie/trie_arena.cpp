@@ -0,0 +1,250 @@
+/** @file trie_arena.cpp
+  * @brief 连续存储的trie树
+  * @author teng.qing
+  * @date 2021/7/31
+  */
+
+#include "trie_arena.h"
+#include "thread_pool.h"
+#include "trie.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+const uint32_t TrieArena::kRoot;
+
+namespace {
+
+// 首字符相同的一组敏感词，和由它们构建的子树
+struct Group {
+    size_t begin;                        // 在order中的范围
+    size_t end;
+    std::vector<TrieArena::Node> nodes;  // 子树，nodes[0]为首字符对应的节点
+    size_t base;                         // nodes[1..]拼接到最终数组中的位置
+};
+
+// 有线程池时并行执行func(0) ~ func(count-1)
+void forEach(ThreadPool *pool, size_t count, const std::function<void(size_t)> &func) {
+    if (pool == nullptr) {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+    pool->parallelFor(count, 1, [&func](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            func(i);
+        }
+    });
+}
+
+} // namespace
+
+void TrieArena::WordList::add(const std::wstring &word, const FoldTable &fold, const WordTag &tag) {
+    for (wchar_t code : word) {
+        chars_.push_back(fold.fold(static_cast<uint32_t>(code)));
+    }
+    ends_.push_back(chars_.size());
+    tags_.push_back(tag);
+}
+
+void TrieArena::WordList::clear() {
+    chars_.clear();
+    ends_.clear();
+    tags_.clear();
+}
+
+TrieArena::TrieArena() : nodes_(1, Node{0, -1, 0, 0}) {}
+
+void TrieArena::build(const WordList &words, ThreadPool *pool, std::vector<WordTag> *tags) {
+    size_t count = words.size();
+
+    // 按 (首字符, 编号) 排序，首字符相同的敏感词分为一组；空的敏感词只保留第一个，以根节点结尾
+    std::vector<uint64_t> keys;
+    keys.reserve(count);
+    size_t empty = count;
+    for (size_t i = 0; i < count; ++i) {
+        if (words.length(i) == 0) {
+            empty = std::min(empty, i);
+        } else {
+            keys.push_back(static_cast<uint64_t>(words.word(i)[0]) << 32 | i);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<uint32_t> order(keys.size());
+    std::vector<Group> groups;
+    for (size_t k = 0; k < keys.size(); ++k) {
+        order[k] = static_cast<uint32_t>(keys[k]);
+        if (k == 0 || (keys[k] >> 32) != (keys[k - 1] >> 32)) {
+            groups.push_back(Group{k, k + 1, {}, 0});
+        } else {
+            groups.back().end = k + 1;
+        }
+    }
+    keys = std::vector<uint64_t>();
+
+    // 每组内按字符串排序并去重，相同的敏感词保留编号最小的（第一次出现的）
+    std::vector<int32_t> ids(count, -1);
+    forEach(pool, groups.size(), [&](size_t g) {
+        Group &group = groups[g];
+        auto first = order.begin() + static_cast<std::ptrdiff_t>(group.begin);
+        auto last = order.begin() + static_cast<std::ptrdiff_t>(group.end);
+        std::sort(first, last, [&words](uint32_t a, uint32_t b) {
+            const uint32_t *wa = words.word(a);
+            const uint32_t *wb = words.word(b);
+            size_t la = words.length(a);
+            size_t lb = words.length(b);
+            for (size_t k = 1; k < std::min(la, lb); ++k) {
+                if (wa[k] != wb[k]) {
+                    return wa[k] < wb[k];
+                }
+            }
+            return la != lb ? la < lb : a < b;
+        });
+        last = std::unique(first, last, [&words](uint32_t a, uint32_t b) {
+            return words.length(a) == words.length(b) &&
+                   std::equal(words.word(a), words.word(a) + words.length(a), words.word(b));
+        });
+        group.end = static_cast<size_t>(last - order.begin());
+        for (auto it = first; it != last; ++it) {
+            ids[*it] = 0;
+        }
+    });
+    if (empty < count) {
+        ids[empty] = 0;
+    }
+
+    // 保留下来的敏感词按出现的顺序编号，和逐个insert一致
+    int32_t next_id = 0;
+    if (tags != nullptr) {
+        tags->clear();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (ids[i] == 0) {
+            ids[i] = next_id++;
+            if (tags != nullptr) {
+                tags->push_back(words.tag(i));
+            }
+        }
+    }
+    word_count_ = static_cast<size_t>(next_id);
+
+    // 并行构建每组的子树。组内已经有序，一个节点的所有敏感词是连续的一段，
+    // 按下一个字符切分就是它的子节点，子节点一次性分配，在数组中连续
+    forEach(pool, groups.size(), [&](size_t g) {
+        struct Range {
+            size_t begin;
+            size_t end;
+            size_t depth;  // 这一段敏感词的公共前缀长度
+            uint32_t node;
+        };
+        Group &group = groups[g];
+        std::vector<Node> &nodes = group.nodes;
+        nodes.push_back(Node{words.word(order[group.begin])[0], -1, 0, 0});
+        std::vector<Range> stack{Range{group.begin, group.end, 1, 0}};
+        while (!stack.empty()) {
+            Range range = stack.back();
+            stack.pop_back();
+
+            // 和公共前缀相同的敏感词排在最前面，去重后最多一个
+            size_t i = range.begin;
+            if (words.length(order[i]) == range.depth) {
+                nodes[range.node].wordId = ids[order[i]];
+                ++i;
+            }
+            auto first_child = static_cast<uint32_t>(nodes.size());
+            while (i < range.end) {
+                uint32_t c = words.word(order[i])[range.depth];
+                size_t j = i + 1;
+                while (j < range.end && words.word(order[j])[range.depth] == c) {
+                    ++j;
+                }
+                stack.push_back(Range{i, j, range.depth + 1, static_cast<uint32_t>(nodes.size())});
+                nodes.push_back(Node{c, -1, 0, 0});
+                i = j;
+            }
+            if (nodes.size() > first_child) {
+                nodes[range.node].firstChild = first_child;
+                nodes[range.node].childCount = static_cast<uint32_t>(nodes.size() - first_child);
+            }
+        }
+    });
+
+    // 拼接：根节点，所有首字符节点，然后依次是每组的其余节点
+    size_t total = 1 + groups.size();
+    for (Group &group : groups) {
+        group.base = total;
+        total += group.nodes.size() - 1;
+    }
+    nodes_ = std::vector<Node>(total);
+    nodes_[kRoot] = Node{0, empty < count ? ids[empty] : -1, 1, static_cast<uint32_t>(groups.size())};
+    forEach(pool, groups.size(), [&](size_t g) {
+        Group &group = groups[g];
+        auto relocate = [&group](Node node) {
+            if (node.childCount > 0) {
+                node.firstChild = static_cast<uint32_t>(group.base + node.firstChild - 1);
+            }
+            return node;
+        };
+        nodes_[1 + g] = relocate(group.nodes[0]);
+        for (size_t j = 1; j < group.nodes.size(); ++j) {
+            nodes_[group.base + j - 1] = relocate(group.nodes[j]);
+        }
+        group.nodes = std::vector<Node>();
+    });
+}
+
+void TrieArena::assign(const TrieNode *root, uint32_t end_code) {
+    nodes_.assign(1, Node{0, -1, 0, 0});
+    word_count_ = 0;
+
+    std::vector<std::pair<const TrieNode *, uint32_t>> stack{{root, kRoot}};
+    std::vector<std::pair<uint32_t, const TrieNode *>> children;
+    while (!stack.empty()) {
+        const TrieNode *node = stack.back().first;
+        uint32_t index = stack.back().second;
+        stack.pop_back();
+
+        children.clear();
+        for (auto &item : node->subNodes()) {
+            if (item.first == end_code) {
+                nodes_[index].wordId = node->wordId();
+                ++word_count_;
+                continue;
+            }
+            children.emplace_back(item.first, item.second);
+        }
+        if (children.empty()) {
+            continue;
+        }
+
+        std::sort(children.begin(), children.end());
+        nodes_[index].firstChild = static_cast<uint32_t>(nodes_.size());
+        nodes_[index].childCount = static_cast<uint32_t>(children.size());
+        for (auto &child : children) {
+            stack.emplace_back(child.second, static_cast<uint32_t>(nodes_.size()));
+            nodes_.push_back(Node{child.first, -1, 0, 0});
+        }
+    }
+}
+
+void TrieArena::toTree(TrieNode *root, uint32_t end_code) const {
+    std::vector<std::pair<uint32_t, TrieNode *>> stack{{kRoot, root}};
+    while (!stack.empty()) {
+        const Node &node = nodes_[stack.back().first];
+        TrieNode *tree = stack.back().second;
+        stack.pop_back();
+
+        if (node.wordId >= 0) {
+            tree->addSubNode(end_code, new TrieNode());
+            tree->setWordId(node.wordId);
+        }
+        for (uint32_t i = node.firstChild; i < node.firstChild + node.childCount; ++i) {
+            auto *sub = new TrieNode();
+            tree->addSubNode(nodes_[i].code, sub);
+            stack.emplace_back(i, sub);
+        }
+    }
+}
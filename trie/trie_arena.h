@@ -0,0 +1,127 @@
+/** @file trie_arena.h
+  * @brief 连续存储的trie树：批量构建词库，以及编译双数组和AC自动机时使用
+  * @author teng.qing
+  * @date 2021/7/31
+  */
+
+#ifndef INC_01_TRIE_TREE_TRIE_ARENA_H_
+#define INC_01_TRIE_TREE_TRIE_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fold_table.h"
+#include "word_tag.h"
+
+class TrieNode;
+
+class ThreadPool;
+
+/** @class TrieArena
+  * @brief 所有节点放在一个数组里的只读trie树，每个节点的子节点连续存放，按字符升序
+  *
+  * 和insert逐个new出来的TrieNode相比，没有每个节点一个unordered_map的开销，析构只需要释放一个数组。
+  * 有两种构建方式：
+  * 1. build：批量构建，敏感词先排序去重，再按首字符分组，每组的子树在线程池中并行构建，最后拼接到一个数组中
+  * 2. assign：从insert构建的TrieNode树转换
+  *
+  * 两种方式得到的树相同，敏感词编号都是第一次出现的顺序（和逐个insert一致），
+  * 双数组、AC自动机都从这里编译，遍历数组比遍历unordered_map快。
+  */
+class TrieArena {
+public:
+    struct Node {
+        uint32_t code;       // 父节点到该节点的字符（已经过FoldTable转换），根节点为0
+        int32_t wordId;      // 以该节点结尾的敏感词编号，不是结尾为-1
+        uint32_t firstChild; // 第一个子节点的下标
+        uint32_t childCount; // 子节点数
+    };
+
+    static const uint32_t kRoot = 0;
+
+    /** @class WordList
+      * @brief 批量构建的输入，所有敏感词的字符连续存放，按add的顺序编号
+      */
+    class WordList {
+    public:
+        /** @fn add
+          * @brief 添加一个敏感词，可以为空或者重复，重复的敏感词保留第一次的编号
+          * @param [in]word: 敏感词
+          * @param [in]fold: 字符转换表，和匹配时使用同一张表
+          * @param [in]tag: 分类和严重程度
+          * @return void
+          */
+        void add(const std::wstring &word, const FoldTable &fold, const WordTag &tag = WordTag());
+
+        // 敏感词数（含重复）
+        size_t size() const { return ends_.size(); }
+
+        // 第i个敏感词的字符
+        const uint32_t *word(size_t i) const { return chars_.data() + begin(i); }
+
+        size_t length(size_t i) const { return ends_[i] - begin(i); }
+
+        const WordTag &tag(size_t i) const { return tags_[i]; }
+
+        void clear();
+
+    private:
+        size_t begin(size_t i) const { return i == 0 ? 0 : ends_[i - 1]; }
+
+    private:
+        std::vector<uint32_t> chars_;
+        std::vector<size_t> ends_;
+        std::vector<WordTag> tags_;
+    };
+
+    // 只有根节点的空树
+    TrieArena();
+
+    TrieArena(const TrieArena &that) = delete;
+
+    TrieArena &operator=(const TrieArena &that) = delete;
+
+    /** @fn build
+      * @brief 批量构建，会清空之前的内容
+      * @param [in]words: 敏感词
+      * @param [in]pool: 并行构建使用的线程池，为nullptr时在当前线程构建
+      * @param [out]tags: 敏感词编号 -> 标签，重复的敏感词取第一次的标签，可以为nullptr
+      * @return void
+      */
+    void build(const WordList &words, ThreadPool *pool = nullptr, std::vector<WordTag> *tags = nullptr);
+
+    /** @fn assign
+      * @brief 从insert构建的TrieNode树转换，会清空之前的内容
+      * @param [in]root: 树根节点
+      * @param [in]end_code: 结束标识对应的子节点key
+      * @return void
+      */
+    void assign(const TrieNode *root, uint32_t end_code);
+
+    /** @fn toTree
+      * @brief 还原为TrieNode树，用于批量加载之后继续insert
+      * @param [in]root: 空的树根节点
+      * @param [in]end_code: 结束标识对应的子节点key
+      * @return void
+      */
+    void toTree(TrieNode *root, uint32_t end_code) const;
+
+    const Node &node(uint32_t i) const { return nodes_[i]; }
+
+    // 节点数（含根节点）
+    size_t size() const { return nodes_.size(); }
+
+    // 不同的敏感词数，即编号数
+    size_t wordCount() const { return word_count_; }
+
+    // 占用的内存，单位字节
+    size_t memoryUsage() const { return nodes_.capacity() * sizeof(Node); }
+
+private:
+    std::vector<Node> nodes_;
+    size_t word_count_ = 0;
+};
+
+#endif //INC_01_TRIE_TREE_TRIE_ARENA_H_
@@ -0,0 +1,1030 @@
+/** @file trie_bench.cpp
+  * @brief 基准测试：词库规模从word.txt到100万个合成敏感词，统计构建耗时（逐个insert和批量构建）、内存峰值、吞吐(MB/s)和延迟分位数，
+  *        编辑距离1~2的模糊匹配（bench=fuzzy）和精确匹配的对比，
+  *        1000个租户共享基础词库、各自带叠加层时的内存和扫描耗时（bench=tenant_memory/tenant_scan），
+  *        消息按Zipf分布重复出现时有无结果缓存（ResultCache）的吞吐和命中率（bench=cache），
+  *        按样本流量布局双数组（LayoutProfile）前后的缓存未命中和吞吐（bench=layout），
+  *        以及编译期词库（StaticMatcher，由构建时的word.txt生成）和运行时构建的启动耗时、吞吐（bench=static）。
+  *
+  * 结果输出到stdout，每行一个json对象（--format=csv时为csv，字段变化时先输出一行表头），日志输出到stderr，方便脚本比较前后两次的结果。
+  *
+  * trie_bench [--quick] [--max-words=N] [--messages=N] [--densities=0,0.01,0.05,0.2] [--format=json|csv]
+  *            [--word-file=word.txt] [--stop-file=stopwd.txt]
+  *
+  * @author teng.qing
+  * @date 2021/7/24
+  */
+
+#include "corpus_gen.h"
+#include "static_word_dict.h"
+#include "text_codec.h"
+#include "trie.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef DIRTYFILTER_BUILD_TYPE
+#define DIRTYFILTER_BUILD_TYPE ""
+#endif
+
+// 统计C++堆内存的当前值和峰值（按malloc_usable_size），不受进程中已有的空闲内存影响
+static std::atomic<size_t> g_heap_bytes{0};
+static std::atomic<size_t> g_heap_peak{0};
+
+void *operator new(std::size_t size) {
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    size_t bytes = g_heap_bytes.fetch_add(malloc_usable_size(p), std::memory_order_relaxed) + malloc_usable_size(p);
+    size_t peak = g_heap_peak.load(std::memory_order_relaxed);
+    while (bytes > peak && !g_heap_peak.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    if (p != nullptr) {
+        g_heap_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+        std::free(p);
+    }
+}
+
+void operator delete(void *p, std::size_t) noexcept { operator delete(p); }
+
+namespace {
+
+struct BenchOptions {
+    bool quick = false;
+    size_t maxWords = 1000000;
+    size_t messages = 20000;
+    std::vector<double> densities = {0, 0.01, 0.05, 0.2}; // 0: 不含敏感词的正常消息
+    bool csv = false;
+    std::string wordFile = "word.txt";
+    std::string stopFile = "stopwd.txt";
+};
+
+// 上一行csv的表头，字段变化时（如build和scan之间）先输出新的表头
+std::string g_csv_header;
+
+// json字符串，转义引号、反斜杠和控制字符
+std::string jsonString(const std::string &value) {
+    std::string ret = "\"";
+    for (char ch : value) {
+        if (ch == '"' || ch == '\\') {
+            ret += '\\';
+            ret += ch;
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned char>(ch));
+            ret += buf;
+        } else {
+            ret += ch;
+        }
+    }
+    return ret + "\"";
+}
+
+// csv字段（RFC 4180），含逗号、引号或换行时加引号，引号写两次
+std::string csvField(const std::string &value) {
+    if (value.find_first_of(",\"\r\n") == std::string::npos) {
+        return value;
+    }
+    std::string ret = "\"";
+    for (char ch : value) {
+        ret += ch;
+        if (ch == '"') {
+            ret += '"';
+        }
+    }
+    return ret + "\"";
+}
+
+/** @class Record
+  * @brief 一行结果，字段按添加顺序输出
+  */
+class Record {
+public:
+    Record &add(const std::string &key, const std::string &value) {
+        fields_.push_back(Field{key, value, true});
+        return *this;
+    }
+
+    Record &add(const std::string &key, double value) {
+        std::ostringstream os;
+        os << std::setprecision(6) << std::fixed << value;
+        fields_.push_back(Field{key, os.str(), false});
+        return *this;
+    }
+
+    Record &add(const std::string &key, size_t value) {
+        fields_.push_back(Field{key, std::to_string(value), false});
+        return *this;
+    }
+
+    void print(bool csv) const {
+        std::string line;
+        if (csv) {
+            std::string header;
+            for (auto &field : fields_) {
+                header += (header.empty() ? "" : ",") + csvField(field.key);
+                line += (line.empty() ? "" : ",") + csvField(field.value);
+            }
+            if (header != g_csv_header) {
+                std::cout << header << std::endl;
+                g_csv_header = header;
+            }
+        } else {
+            for (auto &field : fields_) {
+                line += (line.empty() ? "{" : ",") + jsonString(field.key) + ":" +
+                        (field.quoted ? jsonString(field.value) : field.value);
+            }
+            line += "}";
+        }
+        std::cout << line << std::endl;
+    }
+
+private:
+    struct Field {
+        std::string key;
+        std::string value;
+        bool quoted; // 字符串，json中加引号
+    };
+
+    std::vector<Field> fields_;
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point t1) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+}
+
+// 当前常驻内存，单位KB
+size_t rssKb() {
+    size_t pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp != nullptr) {
+        if (fscanf(fp, "%zu %zu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(fp);
+    }
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) / 1024;
+}
+
+// 峰值常驻内存（/proc/self/status的VmHWM），单位KB
+size_t peakRssKb() {
+    size_t peak = 0;
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp != nullptr) {
+        char line[256];
+        while (fgets(line, sizeof(line), fp) != nullptr) {
+            if (sscanf(line, "VmHWM: %zu kB", &peak) == 1) {
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    return peak;
+}
+
+// 把峰值重置为当前的常驻内存（Linux 4.0+），失败时峰值包含之前的阶段
+void resetPeakRss() {
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (fp != nullptr) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+}
+
+double percentile(std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto i = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return sorted[i];
+}
+
+std::vector<std::wstring> readLines(const std::string &file_name) {
+    std::vector<std::wstring> lines;
+    std::ifstream ifs(file_name);
+    std::string str;
+    while (getline(ifs, str)) {
+        lines.push_back(SBCConvert::s2ws(str));
+    }
+    return lines;
+}
+
+bool parseArgs(int argc, char *argv[], BenchOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.find('=') != std::string::npos ? arg.substr(arg.find('=') + 1) : "";
+        if (arg == "--quick") {
+            options.quick = true;
+            options.maxWords = 10000;
+            options.messages = 2000;
+        } else if (arg.rfind("--max-words=", 0) == 0) {
+            options.maxWords = std::stoul(value);
+        } else if (arg.rfind("--messages=", 0) == 0) {
+            options.messages = std::stoul(value);
+        } else if (arg.rfind("--densities=", 0) == 0) {
+            options.densities.clear();
+            std::istringstream is(value);
+            std::string item;
+            while (getline(is, item, ',')) {
+                options.densities.push_back(std::stod(item));
+            }
+        } else if (arg == "--format=csv") {
+            options.csv = true;
+        } else if (arg == "--format=json") {
+            options.csv = false;
+        } else if (arg.rfind("--word-file=", 0) == 0) {
+            options.wordFile = value;
+        } else if (arg.rfind("--stop-file=", 0) == 0) {
+            options.stopFile = value;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** @struct Api
+  * @brief 被测接口，返回命中数
+  */
+struct Api {
+    const char *name;
+    const char *encoding;
+    size_t (*run)(const FrozenTrie &frozen, const std::wstring &wide, const std::string &utf8);
+};
+
+const Api kApis[] = {
+        {"search",           "wide", [](const FrozenTrie &f, const std::wstring &w, const std::string &) {
+            return static_cast<size_t>(f.search(w));
+        }},
+        {"getSensitive",     "wide", [](const FrozenTrie &f, const std::wstring &w, const std::string &) {
+            return f.getSensitive(w).size();
+        }},
+        {"replaceSensitive", "wide", [](const FrozenTrie &f, const std::wstring &w, const std::string &) {
+            return f.replaceSensitive(w).size();
+        }},
+        {"search",           "utf8", [](const FrozenTrie &f, const std::wstring &, const std::string &u) {
+            return static_cast<size_t>(f.search(std::string_view(u)));
+        }},
+        {"getSensitive",     "utf8", [](const FrozenTrie &f, const std::wstring &, const std::string &u) {
+            return f.getSensitive(std::string_view(u)).size();
+        }},
+        {"replaceSensitive", "utf8", [](const FrozenTrie &f, const std::wstring &, const std::string &u) {
+            return f.replaceSensitive(std::string_view(u)).size();
+        }},
+};
+
+// 模糊匹配每个命中密度最多测这么多条消息
+const size_t kFuzzyMessages = 2000;
+
+const char *modeName(MatchMode mode) { return mode == MatchMode::kTrie ? "trie" : "aho_corasick"; }
+
+// 构建一次词库并释放：insert为逐个insert再build，bulk为loadFromMemory批量构建（见TrieArena）
+void benchBuild(const BenchOptions &options, const std::string &dict_name, const std::vector<std::wstring> &words,
+                const std::vector<wchar_t> &stop_words, bool bulk) {
+    resetPeakRss();
+    size_t rss_before = rssKb();
+    size_t heap_before = g_heap_bytes.load();
+    g_heap_peak = heap_before;
+
+    auto t1 = std::chrono::steady_clock::now();
+    std::unique_ptr<Trie> trie(new Trie());
+    std::unordered_set<wchar_t> stop_set(stop_words.begin(), stop_words.end());
+    trie->loadStopWordFromMemory(stop_set);
+    double insert_ms = 0;
+    if (bulk) {
+        trie->loadFromMemory(words);
+    } else {
+        for (const auto &word : words) {
+            trie->insert(word);
+        }
+        insert_ms = elapsedMs(t1);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    std::shared_ptr<const FrozenTrie> frozen = trie->freeze();
+    double build_ms = elapsedMs(t2);
+    double total_ms = elapsedMs(t1);
+    size_t rss = rssKb();
+    size_t peak = peakRssKb();
+    size_t heap = g_heap_bytes.load();
+    size_t heap_peak = g_heap_peak.load();
+
+    // 释放树（或者连续数组），FrozenTrie由frozen持有，不计入
+    t1 = std::chrono::steady_clock::now();
+    trie = nullptr;
+    double free_ms = elapsedMs(t1);
+
+    Record record;
+    record.add("bench", "build")
+            .add("dict", dict_name)
+            .add("words", words.size())
+            .add("path", bulk ? "bulk" : "insert");
+    if (!bulk) {
+        record.add("insert_ms", insert_ms).add("build_ms", build_ms);
+    }
+    record.add("total_ms", total_ms)
+            .add("free_ms", free_ms)
+            .add("states", frozen->dat().stateCount())
+            .add("array_size", frozen->dat().size())
+            .add("frozen_bytes", frozen->memoryUsage())
+            .add("rss_kb", rss)
+            .add("rss_delta_kb", static_cast<double>(rss) - static_cast<double>(rss_before))
+            .add("peak_rss_delta_kb", static_cast<double>(peak) - static_cast<double>(rss_before))
+            .add("heap_kb", (heap - heap_before) / 1024)
+            .add("peak_heap_kb", (heap_peak - heap_before) / 1024)
+            .print(options.csv);
+}
+
+// 在子进程中执行，每次构建的内存峰值互不影响
+template<typename Func>
+void runIsolated(Func &&func) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        func();
+        std::cout.flush();
+        _exit(0);
+    }
+    if (pid < 0) {
+        func();
+        return;
+    }
+    waitpid(pid, nullptr, 0);
+}
+
+// 词库的前count个词，分别用两种方式构建
+void benchBuilds(const BenchOptions &options, const std::string &dict_name, const std::vector<std::wstring> &all,
+                 size_t count, const std::vector<wchar_t> &stop_words) {
+    for (bool bulk : {false, true}) {
+        runIsolated([&]() {
+            std::vector<std::wstring> words(all.begin(), all.begin() + static_cast<std::ptrdiff_t>(count));
+            benchBuild(options, dict_name, words, stop_words, bulk);
+        });
+    }
+}
+
+// 预热一遍后逐条计时，run(i)扫描第i条消息并返回命中数，结果加在record后面输出
+template<typename Run>
+void timeScan(const BenchOptions &options, size_t count, size_t bytes, Run &&run, Record record) {
+    size_t hits = 0;
+    for (size_t i = 0; i < count; ++i) {
+        hits += run(i);
+    }
+
+    std::vector<double> latencies(count);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        auto t = std::chrono::steady_clock::now();
+        hits += run(i);
+        latencies[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t).count();
+    }
+    double total_ms = elapsedMs(start);
+    std::sort(latencies.begin(), latencies.end());
+
+    record.add("messages", count)
+            .add("mb_per_s", static_cast<double>(bytes) / 1048576.0 / (total_ms / 1000))
+            .add("p50_us", percentile(latencies, 0.5))
+            .add("p90_us", percentile(latencies, 0.9))
+            .add("p99_us", percentile(latencies, 0.99))
+            .add("p999_us", percentile(latencies, 0.999))
+            .add("max_us", latencies.empty() ? 0 : latencies.back())
+            .add("checksum", hits)
+            .print(options.csv);
+}
+
+void benchDict(const BenchOptions &options, const std::string &dict_name, const std::vector<std::wstring> &words,
+               const std::vector<wchar_t> &stop_words) {
+    Trie trie;
+    std::unordered_set<wchar_t> stop_set(stop_words.begin(), stop_words.end());
+    trie.loadStopWordFromMemory(stop_set);
+    trie.loadFromMemory(words);
+    std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+
+    // 每个命中密度一份语料，同一个词库的所有接口使用同一份语料
+    for (double density : options.densities) {
+        CorpusOptions corpus_options;
+        corpus_options.messages = options.messages;
+        corpus_options.hitDensity = density;
+        std::vector<std::wstring> corpus = CorpusGenerator().messages(words, stop_words, corpus_options);
+        std::vector<std::string> utf8_corpus;
+        size_t bytes = 0;
+        for (const auto &msg : corpus) {
+            utf8_corpus.push_back(SBCConvert::ws2s(msg));
+            bytes += utf8_corpus.back().size();
+        }
+
+        for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+            trie.setMatchMode(mode);
+            frozen = trie.freeze();
+            for (const Api &api : kApis) {
+                timeScan(options, corpus.size(), bytes, [&](size_t i) {
+                    return api.run(*frozen, corpus[i], utf8_corpus[i]);
+                }, Record()
+                        .add("bench", "scan")
+                        .add("dict", dict_name)
+                        .add("words", words.size())
+                        .add("density", density)
+                        .add("mode", modeName(mode))
+                        .add("api", api.name)
+                        .add("encoding", api.encoding));
+            }
+        }
+
+        // 模糊匹配，和上面精确匹配的getSensitive比较。大词库下慢1~2个数量级，只取前kFuzzyMessages条
+        size_t fuzzy_messages = std::min(corpus.size(), kFuzzyMessages);
+        size_t fuzzy_bytes = 0;
+        for (size_t i = 0; i < fuzzy_messages; ++i) {
+            fuzzy_bytes += utf8_corpus[i].size();
+        }
+        for (int distance = 1; distance <= FuzzyMatcher::kMaxDistance; ++distance) {
+            FuzzyMatcher fuzzy(frozen, distance);
+            timeScan(options, fuzzy_messages, fuzzy_bytes, [&](size_t i) {
+                return fuzzy.getSensitive(corpus[i]).size();
+            }, Record()
+                    .add("bench", "fuzzy")
+                    .add("dict", dict_name)
+                    .add("words", words.size())
+                    .add("density", density)
+                    .add("distance", static_cast<size_t>(distance))
+                    .add("api", "getSensitive")
+                    .add("encoding", "wide")
+                    .add("index_bytes", fuzzy.memoryUsage()));
+        }
+    }
+}
+
+// 多租户：租户数、每个租户增加和屏蔽的敏感词数
+const size_t kTenants = 1000;
+const size_t kTenantWords = 300;
+const size_t kTenantSuppressions = 30;
+
+// 所有租户共享一个基础词库，各自的叠加层（LayeredMatcher）和每个租户单独构建完整词库的内存、扫描对比
+void benchTenants(const BenchOptions &options, const std::string &dict_name, const std::vector<std::wstring> &words,
+                  const std::vector<wchar_t> &stop_words) {
+    std::unordered_set<wchar_t> stop_set(stop_words.begin(), stop_words.end());
+    Trie trie;
+    trie.loadStopWordFromMemory(stop_set);
+    trie.loadFromMemory(words);
+    std::shared_ptr<const FrozenTrie> base = trie.freeze();
+
+    std::vector<std::vector<std::wstring>> additions(kTenants), suppressions(kTenants);
+    for (size_t i = 0; i < kTenants; ++i) {
+        additions[i] = CorpusGenerator(i + 1).words(kTenantWords);
+        for (size_t j = 0; j < kTenantSuppressions; ++j) {
+            suppressions[i].push_back(words[(i * kTenantSuppressions + j) * 7919 % words.size()]);
+        }
+    }
+
+    size_t heap_before = g_heap_bytes.load();
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<LayeredMatcher>> tenants;
+    size_t overlay_bytes = 0;
+    for (size_t i = 0; i < kTenants; ++i) {
+        tenants.emplace_back(new LayeredMatcher(base, additions[i], suppressions[i]));
+        overlay_bytes += tenants.back()->memoryUsage();
+    }
+    double layered_ms = elapsedMs(t1);
+    size_t layered_heap = g_heap_bytes.load() - heap_before;
+
+    // 完整词库只构建第一个租户的，按租户数估算
+    std::vector<std::wstring> merged;
+    for (const auto &word : words) {
+        if (std::find(suppressions[0].begin(), suppressions[0].end(), word) == suppressions[0].end()) {
+            merged.push_back(word);
+        }
+    }
+    merged.insert(merged.end(), additions[0].begin(), additions[0].end());
+    heap_before = g_heap_bytes.load();
+    t1 = std::chrono::steady_clock::now();
+    std::unique_ptr<Trie> merged_trie(new Trie());
+    merged_trie->loadStopWordFromMemory(stop_set);
+    merged_trie->loadFromMemory(merged);
+    std::shared_ptr<const FrozenTrie> merged_frozen = merged_trie->freeze();
+    double merged_ms = elapsedMs(t1);
+    merged_trie = nullptr;
+    size_t merged_heap = g_heap_bytes.load() - heap_before;
+
+    Record()
+            .add("bench", "tenant_memory")
+            .add("dict", dict_name)
+            .add("words", words.size())
+            .add("tenants", kTenants)
+            .add("tenant_words", kTenantWords)
+            .add("tenant_suppressions", kTenantSuppressions)
+            .add("base_bytes", base->memoryUsage())
+            .add("layered_heap_kb", layered_heap / 1024)
+            .add("layered_bytes", overlay_bytes)
+            .add("layered_build_ms", layered_ms)
+            .add("merged_heap_kb_est", merged_heap * kTenants / 1024)
+            .add("merged_bytes_est", merged_frozen->memoryUsage() * kTenants)
+            .add("merged_build_ms_est", merged_ms * static_cast<double>(kTenants))
+            .print(options.csv);
+
+    // 消息中插入基础词库和租户增加的敏感词，第i条消息由第i%kTenants个租户扫描
+    std::vector<std::wstring> dict(words);
+    dict.insert(dict.end(), additions[0].begin(), additions[0].end());
+    CorpusOptions corpus_options;
+    corpus_options.messages = options.messages;
+    std::vector<std::wstring> corpus = CorpusGenerator().messages(dict, stop_words, corpus_options);
+    size_t bytes = 0;
+    for (const auto &msg : corpus) {
+        bytes += SBCConvert::ws2s(msg).size();
+    }
+    auto record = [&](const char *matcher) {
+        return Record()
+                .add("bench", "tenant_scan")
+                .add("dict", dict_name)
+                .add("words", words.size())
+                .add("tenants", kTenants)
+                .add("tenant_words", kTenantWords)
+                .add("density", corpus_options.hitDensity)
+                .add("matcher", matcher)
+                .add("api", "getSensitive")
+                .add("encoding", "wide");
+    };
+    timeScan(options, corpus.size(), bytes, [&](size_t i) {
+        return base->getSensitive(corpus[i]).size();
+    }, record("base"));
+    timeScan(options, corpus.size(), bytes, [&](size_t i) {
+        return merged_frozen->getSensitive(corpus[i]).size();
+    }, record("merged"));
+    // 同一个租户扫描所有消息，和上面比较可以看出轮流切换租户时缓存未命中的影响
+    timeScan(options, corpus.size(), bytes, [&](size_t i) {
+        return tenants[0]->getSensitive(corpus[i]).size();
+    }, record("layered_one_tenant"));
+    timeScan(options, corpus.size(), bytes, [&](size_t i) {
+        return tenants[i % kTenants]->getSensitive(corpus[i]).size();
+    }, record("layered"));
+}
+
+/** @class PerfCounters
+  * @brief 当前线程的硬件计数器（perf_event_open，只统计用户态），和perf stat的事件相同。
+  * 虚拟机、容器或perf_event_paranoid过高时打不开，available()为false
+  */
+class PerfCounters {
+public:
+    PerfCounters() {
+        const std::pair<const char *, std::pair<uint32_t, uint64_t>> events[] = {
+                {"perf_instructions",     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS}},
+                {"perf_cache_misses",     {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}},
+                {"perf_l1d_read_misses",  {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}},
+                {"perf_dtlb_read_misses", {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}},
+        };
+        for (auto &event : events) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = event.second.first;
+            attr.config = event.second.second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fd >= 0) {
+                names_.push_back(event.first);
+                fds_.push_back(fd);
+            }
+        }
+    }
+
+    ~PerfCounters() {
+        for (int fd : fds_) {
+            close(fd);
+        }
+    }
+
+    bool available() const { return !fds_.empty(); }
+
+    void start() {
+        for (int fd : fds_) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    // 停止计数，结果加到record后面
+    void stop(Record &record) {
+        for (size_t i = 0; i < fds_.size(); ++i) {
+            ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t value = 0;
+            if (read(fds_[i], &value, sizeof(value)) != sizeof(value)) {
+                value = 0;
+            }
+            record.add(names_[i], static_cast<size_t>(value));
+        }
+        if (fds_.empty()) {
+            record.add("perf", "unavailable");
+        }
+    }
+
+private:
+    std::vector<const char *> names_;
+    std::vector<int> fds_;
+};
+
+/** @class CacheSim
+  * @brief 组相联LRU缓存的模拟，按64字节的缓存行计数。硬件计数器不可用时用它比较不同布局的未命中次数
+  */
+class CacheSim {
+public:
+    CacheSim(size_t bytes, size_t ways) : ways_(ways), sets_(bytes / 64 / ways), tags_(sets_ * ways, kEmpty) {}
+
+    // 访问一个缓存行，未命中返回false
+    bool access(uint64_t line) {
+        uint64_t *set = &tags_[(line % sets_) * ways_];
+        size_t i = 0;
+        while (i < ways_ && set[i] != line) {
+            ++i;
+        }
+        bool hit = i < ways_;
+        // 移到最前面（最近使用），未命中时淘汰最后一个
+        for (size_t j = hit ? i : ways_ - 1; j > 0; --j) {
+            set[j] = set[j - 1];
+        }
+        set[0] = line;
+        return hit;
+    }
+
+private:
+    static const uint64_t kEmpty = ~uint64_t(0);
+
+    size_t ways_;
+    size_t sets_;
+    std::vector<uint64_t> tags_;
+};
+
+const uint64_t CacheSim::kEmpty;
+
+/** @struct LayoutStats
+  * @brief 一种布局下扫描语料时双数组的访问情况
+  */
+struct LayoutStats {
+    size_t hotLines = 0;   // 访问过的状态占用的缓存行数
+    size_t hotPages = 0;   // 访问过的状态占用的4KB页数
+    size_t l1Misses = 0;   // 模拟的32KB 8路L1未命中次数
+    size_t l2Misses = 0;   // 模拟的1MB 16路L2未命中次数
+    size_t accesses = 0;   // 字符表和双数组的访问次数
+};
+
+// 按FrozenTrie kTrie的方式扫描语料，把字符表和双数组的每次读取交给模拟的两级缓存
+LayoutStats simulateLayout(const FrozenTrie &frozen, const std::vector<std::string> &corpus) {
+    LayoutStats stats;
+    LayoutProfile profile(std::shared_ptr<const FrozenTrie>(&frozen, [](const FrozenTrie *) {}));
+    for (const auto &text : corpus) {
+        profile.record(std::string_view(text));
+    }
+    std::unordered_set<size_t> lines, pages;
+    for (size_t state = 0; state < frozen.dat().size(); ++state) {
+        if (profile.visits(static_cast<int>(state)) > 0) {
+            lines.insert(state * sizeof(DoubleArray::Unit) / 64);
+            pages.insert(state * sizeof(DoubleArray::Unit) / 4096);
+        }
+    }
+    stats.hotLines = lines.size();
+    stats.hotPages = pages.size();
+
+    // 字符表和双数组的地址不重叠
+    const uint64_t kAlphabetLines = uint64_t(1) << 40;
+    CacheSim l1(32 * 1024, 8), l2(1024 * 1024, 16);
+    auto touch = [&](uint64_t line) {
+        ++stats.accesses;
+        if (!l1.access(line)) {
+            ++stats.l1Misses;
+            if (!l2.access(line)) {
+                ++stats.l2Misses;
+            }
+        }
+    };
+    const DoubleArray &dat = frozen.dat();
+    const DoubleArray::Unit *units = dat.units();
+    for (const auto &text : corpus) {
+        Utf8Text utf8(text, frozen.foldTable());
+        size_t offset = 0;
+        int index = 0;
+        uint32_t c;
+        while ((offset = utf8.skip(offset, frozen.prefilter(), index)) < utf8.size()) {
+            size_t pos = offset;
+            int state = DoubleArray::kRoot;
+            while (utf8.decode(pos, c)) {
+                uint32_t unicode = utf8.fold(c);
+                uint16_t code = dat.code(unicode);
+                touch(kAlphabetLines + (unicode < Alphabet::kBmpSize ? unicode * sizeof(uint16_t) / 64 : 0));
+                size_t t = static_cast<size_t>(units[state].base >> 1) + code;
+                touch(t * sizeof(DoubleArray::Unit) / 64);
+                int next = dat.transition(state, code);
+                if (next < 0) {
+                    if (state != DoubleArray::kRoot && frozen.isStopWord(unicode)) {
+                        continue;
+                    }
+                    break;
+                }
+                if (dat.isTerminal(next)) {
+                    break;
+                }
+                state = next;
+            }
+            utf8.decode(offset, c);
+            ++index;
+        }
+    }
+    return stats;
+}
+
+// 布局对比：样本流量和测试语料用不同的随机种子生成，敏感词的出现频率服从同一个Zipf分布
+const double kLayoutWordZipf = 1.0;
+
+// 广度优先布局和按样本流量布局（LayoutProfile）的访问局部性、硬件计数器和吞吐
+void benchLayout(const BenchOptions &options, const std::string &dict_name, const std::vector<std::wstring> &words,
+                 const std::vector<wchar_t> &stop_words) {
+    std::unordered_set<wchar_t> stop_set(stop_words.begin(), stop_words.end());
+    CorpusOptions corpus_options;
+    corpus_options.messages = options.messages;
+    corpus_options.wordZipf = kLayoutWordZipf;
+    std::vector<std::string> sample, corpus;
+    for (const auto &msg : CorpusGenerator(1).messages(words, stop_words, corpus_options)) {
+        sample.push_back(SBCConvert::ws2s(msg));
+    }
+    size_t bytes = 0;
+    for (const auto &msg : CorpusGenerator().messages(words, stop_words, corpus_options)) {
+        corpus.push_back(SBCConvert::ws2s(msg));
+        bytes += corpus.back().size();
+    }
+
+    Trie trie;
+    trie.loadStopWordFromMemory(stop_set);
+    trie.loadFromMemory(words);
+    std::shared_ptr<LayoutProfile> profile = trie.openProfile();
+    for (const auto &text : sample) {
+        profile->record(std::string_view(text));
+    }
+
+    PerfCounters perf;
+    for (const char *layout : {"bfs", "profiled"}) {
+        trie.setLayoutProfile(std::string(layout) == "bfs" ? nullptr : profile);
+        // 模拟只按kTrie的路径，两种匹配算法使用同样的双数组布局
+        trie.setMatchMode(MatchMode::kTrie);
+        LayoutStats stats = simulateLayout(*trie.freeze(), corpus);
+        for (MatchMode mode : {MatchMode::kTrie, MatchMode::kAhoCorasick}) {
+            trie.setMatchMode(mode);
+            std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+            auto scan = [&](size_t i) {
+                size_t hits = 0;
+                frozen->forEachSensitive(std::string_view(corpus[i]), [&](const MatchSpan &) {
+                    ++hits;
+                    return true;
+                });
+                return hits;
+            };
+            Record record;
+            record.add("bench", "layout")
+                    .add("dict", dict_name)
+                    .add("words", words.size())
+                    .add("word_zipf", kLayoutWordZipf)
+                    .add("mode", modeName(mode))
+                    .add("layout", layout)
+                    .add("api", "forEachSensitive")
+                    .add("encoding", "utf8")
+                    .add("states", frozen->dat().stateCount())
+                    .add("hot_states", profile->hotStates())
+                    .add("hot_lines", stats.hotLines)
+                    .add("hot_pages", stats.hotPages)
+                    .add("sim_accesses", stats.accesses)
+                    .add("sim_l1_misses", stats.l1Misses)
+                    .add("sim_l2_misses", stats.l2Misses);
+            // 预热一遍后计数
+            for (size_t i = 0; i < corpus.size(); ++i) {
+                scan(i);
+            }
+            perf.start();
+            for (size_t i = 0; i < corpus.size(); ++i) {
+                scan(i);
+            }
+            perf.stop(record);
+            timeScan(options, corpus.size(), bytes, scan, record);
+        }
+    }
+}
+
+// 结果缓存：消息按Zipf分布重复出现（刷屏），请求数是不同消息数的这么多倍
+const size_t kCacheRepeat = 5;
+const double kZipfExponents[] = {0.6, 0.9, 1.1, 1.4};
+const size_t kCacheCapacities[] = {1u << 20, 16u << 20, 256u << 20};
+
+// 有无ResultCache时replaceSensitive(utf8)的吞吐，hit_rate为新建的缓存跑一遍请求序列的命中率（不含预热）
+void benchCache(const BenchOptions &options, const std::string &dict_name, const std::vector<std::wstring> &words,
+                const std::vector<wchar_t> &stop_words) {
+    Trie trie;
+    std::unordered_set<wchar_t> stop_set(stop_words.begin(), stop_words.end());
+    trie.loadStopWordFromMemory(stop_set);
+    trie.loadFromMemory(words);
+    std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+
+    CorpusOptions corpus_options;
+    corpus_options.messages = options.messages;
+    std::vector<std::string> corpus;
+    for (const auto &msg : CorpusGenerator().messages(words, stop_words, corpus_options)) {
+        corpus.push_back(SBCConvert::ws2s(msg));
+    }
+
+    for (double exponent : kZipfExponents) {
+        std::vector<size_t> requests = CorpusGenerator().zipf(corpus.size() * kCacheRepeat, corpus.size(), exponent);
+        size_t bytes = 0;
+        for (size_t i : requests) {
+            bytes += corpus[i].size();
+        }
+        auto record = [&](const char *cache) {
+            return Record()
+                    .add("bench", "cache")
+                    .add("dict", dict_name)
+                    .add("words", words.size())
+                    .add("density", corpus_options.hitDensity)
+                    .add("distinct", corpus.size())
+                    .add("zipf", exponent)
+                    .add("cache", cache)
+                    .add("api", "replaceSensitive")
+                    .add("encoding", "utf8");
+        };
+        timeScan(options, requests.size(), bytes, [&](size_t i) {
+            return frozen->replaceSensitive(std::string_view(corpus[requests[i]])).size();
+        }, record("none").add("capacity_bytes", static_cast<size_t>(0)).add("hit_rate", 0.0));
+
+        for (size_t capacity : kCacheCapacities) {
+            CacheOptions cache_options;
+            cache_options.capacityBytes = capacity;
+            ResultCache cold(cache_options);
+            for (size_t i : requests) {
+                cold.replaceSensitive(*frozen, std::string_view(corpus[i]));
+            }
+            CacheStats stats = cold.stats();
+
+            ResultCache cache(cache_options);
+            timeScan(options, requests.size(), bytes, [&](size_t i) {
+                return cache.replaceSensitive(*frozen, std::string_view(corpus[requests[i]])).size();
+            }, record("clock")
+                    .add("capacity_bytes", capacity)
+                    .add("hit_rate", stats.hitRate())
+                    .add("evictions", static_cast<size_t>(stats.evictions))
+                    .add("cache_bytes", stats.bytes));
+        }
+    }
+}
+
+// 编译期词库和运行时构建：词表为生成头文件中的敏感词，启动耗时为从内存中的词表构建到freeze完成
+void benchStatic(const BenchOptions &options, const std::vector<wchar_t> &stop_words) {
+    typedef StaticMatcher<StaticWordDict> Matcher;
+    std::vector<std::wstring> words;
+    for (size_t i = 0; i < Matcher::wordCount(); ++i) {
+        words.push_back(SBCConvert::s2ws(std::string(Matcher::word(static_cast<int>(i)))));
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    Trie trie;
+    std::unordered_set<wchar_t> stop_set(stop_words.begin(), stop_words.end());
+    trie.loadStopWordFromMemory(stop_set);
+    trie.loadFromMemory(words);
+    std::shared_ptr<const FrozenTrie> frozen = trie.freeze();
+    double startup_ms = elapsedMs(t1);
+
+    CorpusOptions corpus_options;
+    corpus_options.messages = options.messages;
+    std::vector<std::string> corpus;
+    size_t bytes = 0;
+    for (const auto &msg : CorpusGenerator().messages(words, stop_words, corpus_options)) {
+        corpus.push_back(SBCConvert::ws2s(msg));
+        bytes += corpus.back().size();
+    }
+    auto record = [&](const char *matcher, double ms) {
+        return Record()
+                .add("bench", "static")
+                .add("dict", "static_word_dict")
+                .add("words", words.size())
+                .add("matcher", matcher)
+                .add("startup_ms", ms)
+                .add("api", "forEachSensitive")
+                .add("encoding", "utf8");
+    };
+    timeScan(options, corpus.size(), bytes, [&](size_t i) {
+        size_t hits = 0;
+        frozen->forEachSensitive(std::string_view(corpus[i]), [&](const MatchSpan &) {
+            ++hits;
+            return true;
+        });
+        return hits;
+    }, record("frozen", startup_ms));
+    timeScan(options, corpus.size(), bytes, [&](size_t i) {
+        return Matcher::countSensitive(corpus[i]);
+    }, record("static", 0.0));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    BenchOptions options;
+    if (!parseArgs(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0]
+                  << " [--quick] [--max-words=N] [--messages=N] [--densities=0,0.01,0.05,0.2] [--format=json|csv]"
+                     " [--word-file=word.txt] [--stop-file=stopwd.txt]" << std::endl;
+        return 2;
+    }
+    if (std::string(DIRTYFILTER_BUILD_TYPE) != "Release") {
+        std::cerr << "warning: build type is '" << DIRTYFILTER_BUILD_TYPE
+                  << "', use -DCMAKE_BUILD_TYPE=Release for meaningful numbers" << std::endl;
+    }
+
+    std::vector<wchar_t> stop_words;
+    // 和Trie::loadStopWordFromFile一样，只取单个字符的行，空行为空格
+    for (const auto &line : readLines(options.stopFile)) {
+        if (line.size() <= 1) {
+            stop_words.push_back(line.empty() ? L' ' : line[0]);
+        }
+    }
+
+    Record()
+            .add("bench", "env")
+            .add("build_type", DIRTYFILTER_BUILD_TYPE)
+            .add("messages", options.messages)
+            .add("stop_words", stop_words.size())
+            .print(options.csv);
+
+    std::vector<std::wstring> bundled = readLines(options.wordFile);
+    CorpusGenerator generator;
+    std::vector<std::wstring> synthetic = generator.words(options.maxWords);
+
+    // 先测构建，每次构建在单独的子进程中
+    if (!bundled.empty()) {
+        benchBuilds(options, options.wordFile, bundled, bundled.size(), stop_words);
+    }
+    for (size_t size = 10000; size <= options.maxWords; size *= 10) {
+        benchBuilds(options, "synthetic", synthetic, size, stop_words);
+    }
+
+    if (!bundled.empty()) {
+        std::cerr << "dict " << options.wordFile << std::endl;
+        benchDict(options, options.wordFile, bundled, stop_words);
+    }
+
+    // 合成词库，每次扩大10倍
+    for (size_t size = 10000; size <= options.maxWords; size *= 10) {
+        std::cerr << "dict synthetic " << size << std::endl;
+        std::vector<std::wstring> words(synthetic.begin(), synthetic.begin() + static_cast<std::ptrdiff_t>(size));
+        benchDict(options, "synthetic", words, stop_words);
+    }
+
+    // 多租户，每个词库在单独的子进程中
+    if (!bundled.empty()) {
+        runIsolated([&]() { benchTenants(options, options.wordFile, bundled, stop_words); });
+    }
+    for (size_t size = 10000; size <= options.maxWords; size *= 100) {
+        std::cerr << "tenants synthetic " << size << std::endl;
+        runIsolated([&]() {
+            std::vector<std::wstring> words(synthetic.begin(), synthetic.begin() + static_cast<std::ptrdiff_t>(size));
+            benchTenants(options, "synthetic", words, stop_words);
+        });
+    }
+
+    // 双数组布局，词库越大差别越明显
+    if (!bundled.empty()) {
+        benchLayout(options, options.wordFile, bundled, stop_words);
+    }
+    for (size_t size = 10000; size <= options.maxWords; size *= 10) {
+        std::cerr << "layout synthetic " << size << std::endl;
+        std::vector<std::wstring> words(synthetic.begin(), synthetic.begin() + static_cast<std::ptrdiff_t>(size));
+        benchLayout(options, "synthetic", words, stop_words);
+    }
+
+    // 结果缓存，使用word.txt，没有时使用1万个合成敏感词
+    if (!bundled.empty()) {
+        benchCache(options, options.wordFile, bundled, stop_words);
+    } else {
+        std::vector<std::wstring> words(synthetic.begin(), synthetic.begin() + std::min<std::ptrdiff_t>(
+                10000, static_cast<std::ptrdiff_t>(synthetic.size())));
+        benchCache(options, "synthetic", words, stop_words);
+    }
+
+    benchStatic(options, stop_words);
+    return 0;
+}
@@ -0,0 +1,134 @@
+/** @file trie_holder.cpp
+  * @brief 敏感词库热更新
+  * @author teng.qing
+  * @date 2021/7/12
+  */
+
+#include "trie_holder.h"
+#include "trie.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <thread>
+
+namespace {
+
+// reload发布后最多等待读者释放旧快照这么久，扫描一条消息只需要微秒级
+const std::chrono::milliseconds kDrainTimeout(100);
+
+// 等待期间检查的间隔
+const std::chrono::microseconds kDrainInterval(200);
+
+} // namespace
+
+TrieHolder::TrieHolder(MatchMode mode) : mode_(mode) {}
+
+TrieHolder::~TrieHolder() {
+    std::shared_future<bool> pending;
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        pending = last_async_;
+    }
+    if (pending.valid()) {
+        pending.wait();
+    }
+}
+
+bool TrieHolder::reload(const std::string &word_file, const std::string &stop_word_file, std::string *error) {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    auto t1 = std::chrono::steady_clock::now();
+
+    Trie trie;
+    trie.setMatchMode(mode_);
+    trie.setFoldTable(fold_);
+    // 先加载停顿词，loadFromFile里build一次即可。文件不存在时不能发布空词库，否则所有文本都不再过滤
+    if (!stop_word_file.empty() && !trie.loadStopWordFromFile(stop_word_file, error)) {
+        return false;
+    }
+    if (!trie.loadFromFile(word_file, error)) {
+        return false;
+    }
+    std::shared_ptr<const FrozenTrie> snapshot = trie.freeze();
+
+    auto t2 = std::chrono::steady_clock::now();
+    last_build_ms_ = std::chrono::duration<double, std::milli>(t2 - t1).count();
+
+    publish(std::move(snapshot));
+    drainRetired(kDrainTimeout);
+    return true;
+}
+
+void TrieHolder::setFoldTable(std::shared_ptr<const FoldTable> fold) {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    fold_ = std::move(fold);
+}
+
+std::shared_future<bool> TrieHolder::reloadAsync(const std::string &word_file, const std::string &stop_word_file) {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    std::shared_future<bool> prev = last_async_;
+    last_async_ = std::async(std::launch::async, [this, prev, word_file, stop_word_file]() {
+        // 保证先发起的先发布
+        if (prev.valid()) {
+            prev.wait();
+        }
+        return reload(word_file, stop_word_file);
+    }).share();
+    return last_async_;
+}
+
+void TrieHolder::publish(std::shared_ptr<const FrozenTrie> snapshot) {
+    std::shared_ptr<const FrozenTrie> old;
+    {
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+        const FrozenTrie *next = snapshot.get();
+        old = std::atomic_exchange(&current_, std::move(snapshot));
+        version_++;
+        // 重复发布同一个匹配器时它还在current_中，不能再算一次，也不能析构
+        if (old == nullptr || old.get() == next) {
+            return;
+        }
+        if (Metrics::enabled()) {
+            retired_metrics_.merge(old->metrics());
+        }
+    }
+    // 旧快照交给写线程析构：如果读者持有最后一个引用，析构（释放双数组、AC自动机等）会发生在读者的扫描路径上
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        retired_.push_back(std::move(old));
+    }
+    drainRetired(std::chrono::milliseconds(0));
+}
+
+void TrieHolder::drainRetired(std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        std::vector<std::shared_ptr<const FrozenTrie>> unused;
+        bool empty;
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+            // current_已经不指向它们，use_count为1时只剩retired_持有，不会再有新的读者
+            auto it = std::partition(retired_.begin(), retired_.end(),
+                                     [](const std::shared_ptr<const FrozenTrie> &item) { return item.use_count() > 1; });
+            std::move(it, retired_.end(), std::back_inserter(unused));
+            retired_.erase(it, retired_.end());
+            empty = retired_.empty();
+        }
+        // 在锁外析构
+        unused.clear();
+        if (empty || std::chrono::steady_clock::now() >= deadline) {
+            return;
+        }
+        std::this_thread::sleep_for(kDrainInterval);
+    }
+}
+
+MetricsSnapshot TrieHolder::metrics() const {
+    std::lock_guard<std::mutex> lock(metrics_mutex_);
+    MetricsSnapshot ret = retired_metrics_;
+    std::shared_ptr<const FrozenTrie> current = get();
+    if (current != nullptr) {
+        ret.merge(current->metrics());
+    }
+    return ret;
+}
@@ -0,0 +1,121 @@
+/** @file trie_holder.h
+  * @brief 敏感词库热更新，后台加载新词库后原子替换（类似RCU）
+  * @author teng.qing
+  * @date 2021/7/12
+  */
+
+#ifndef INC_01_TRIE_TREE_TRIE_HOLDER_H_
+#define INC_01_TRIE_TREE_TRIE_HOLDER_H_
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frozen_trie.h"
+
+/** @class TrieHolder
+  * @brief 持有当前生效的只读匹配器
+  *
+  * 读：get()原子地拿到当前快照的shared_ptr，扫描期间一直持有，即使中途发生替换，
+  * 旧快照也要等所有持有者释放后才会析构。
+  * 写：reload()在调用线程（reloadAsync在后台线程）里构建新的Trie并freeze，
+  * 构建期间不影响读，构建完成后用一次原子指针交换发布。文件无法读取时不发布，继续使用当前快照。
+  * 被替换的快照由写线程析构：reload发布后等待读者释放旧快照，读者不会在扫描路径上执行析构。
+  *
+  * 用法：
+  * @code
+  * TrieHolder holder;
+  * holder.reload("word.txt", "stopwd.txt");
+  * // 工作线程
+  * auto snapshot = holder.get();
+  * snapshot->replaceSensitive(text);
+  * // 词库更新
+  * holder.reloadAsync("word.txt", "stopwd.txt");
+  * @endcode
+  */
+class TrieHolder {
+public:
+    explicit TrieHolder(MatchMode mode = MatchMode::kTrie);
+
+    ~TrieHolder();
+
+    TrieHolder(const TrieHolder &that) = delete;
+
+    TrieHolder &operator=(const TrieHolder &that) = delete;
+
+    /** @fn get
+      * @brief 获取当前生效的匹配器，没有加载过时返回nullptr
+      * @return 只读匹配器
+      */
+    std::shared_ptr<const FrozenTrie> get() const { return std::atomic_load(&current_); }
+
+    /** @fn setFoldTable
+      * @brief 设置字符转换表（见FoldTable），之后的reload使用，已经发布的匹配器不变
+      * @param [in]fold: 转换表
+      * @return void
+      */
+    void setFoldTable(std::shared_ptr<const FoldTable> fold);
+
+    /** @fn reload
+      * @brief 从文件重新加载敏感词和停顿词，加载完成后替换当前匹配器
+      * @param [in]word_file: 敏感词文件
+      * @param [in]stop_word_file: 停顿词文件，为空则不加载
+      * @param [out]error: 失败原因，可以为nullptr
+      * @return 文件无法读取时返回false，当前匹配器和version()不变
+      */
+    bool reload(const std::string &word_file, const std::string &stop_word_file, std::string *error = nullptr);
+
+    /** @fn reloadAsync
+      * @brief 在后台线程执行reload，多次调用会按顺序执行
+      * @param [in]word_file: 敏感词文件
+      * @param [in]stop_word_file: 停顿词文件，为空则不加载
+      * @return 加载完成时就绪，值同reload
+      */
+    std::shared_future<bool> reloadAsync(const std::string &word_file, const std::string &stop_word_file);
+
+    /** @fn publish
+      * @brief 发布一个已经构建好的匹配器，被替换的快照没有读者持有时在调用线程析构，否则留到之后的reload
+      * @param [in]snapshot: 新的匹配器
+      * @return void
+      */
+    void publish(std::shared_ptr<const FrozenTrie> snapshot);
+
+    // 发布的次数，每次替换加1
+    uint64_t version() const { return version_.load(); }
+
+    // 最近一次reload的构建耗时，单位毫秒
+    double lastBuildMs() const { return last_build_ms_.load(); }
+
+    /** @fn metrics
+      * @brief 所有版本合计的运行时统计（见Metrics）：被替换的版本在替换时的统计加上当前版本，
+      * 替换之后仍在旧版本上进行的扫描不计入
+      * @return 统计结果
+      */
+    MetricsSnapshot metrics() const;
+
+private:
+    // 析构没有读者持有的旧快照，timeout内每隔一段时间再检查，仍被持有的（如MatchStream）留在retired_中
+    void drainRetired(std::chrono::milliseconds timeout);
+
+    MatchMode mode_;
+    std::shared_ptr<const FoldTable> fold_ = FoldTable::defaultTable(); // reload_mutex_保护
+    std::shared_ptr<const FrozenTrie> current_;
+    std::atomic<uint64_t> version_{0};
+    std::atomic<double> last_build_ms_{0};
+
+    mutable std::mutex metrics_mutex_;    // 保护retired_metrics_，和发布互斥
+    MetricsSnapshot retired_metrics_;     // 已经替换掉的版本的统计
+
+    std::mutex retired_mutex_;            // 保护retired_
+    std::vector<std::shared_ptr<const FrozenTrie>> retired_; // 被替换、可能仍有读者持有的快照
+
+    std::mutex reload_mutex_;             // 串行化reload
+    std::mutex async_mutex_;
+    std::shared_future<bool> last_async_; // 析构时等待后台任务完成
+};
+
+#endif //INC_01_TRIE_TREE_TRIE_HOLDER_H_
@@ -0,0 +1,34 @@
+/** @file word_tag.h
+  * @brief 敏感词的分类和严重程度
+  * @author teng.qing
+  * @date 2021/8/4
+  */
+
+#ifndef INC_01_TRIE_TREE_WORD_TAG_H_
+#define INC_01_TRIE_TREE_WORD_TAG_H_
+
+#include <cstdint>
+
+// 没有指定分类的敏感词属于这一类
+const uint32_t kDefaultCategory = 1;
+// 匹配所有分类
+const uint32_t kAllCategories = 0xFFFFFFFFu;
+
+/** @struct WordTag
+  * @brief 敏感词的分类（位掩码，最多32类）和严重程度（打分时的权重），见FrozenTrie::score
+  *
+  * 词库文件每行为"敏感词<TAB>分类<TAB>权重"，分类为十进制或0x开头的十六进制位掩码，权重为非负整数，
+  * 后两列可以省略，省略时为kDefaultCategory和1。会原样写入二进制词库，不能有指针等成员。
+  */
+struct WordTag {
+    uint32_t categories = kDefaultCategory;
+    uint32_t severity = 1;
+
+    friend bool operator==(const WordTag &a, const WordTag &b) {
+        return a.categories == b.categories && a.severity == b.severity;
+    }
+
+    friend bool operator!=(const WordTag &a, const WordTag &b) { return !(a == b); }
+};
+
+#endif //INC_01_TRIE_TREE_WORD_TAG_H_